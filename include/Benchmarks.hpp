@@ -0,0 +1,88 @@
+/***************************************************************************
+									Benchmarks.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Benchmarks run from the command line
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Benchmarks run from the command line
+  * \file Benchmarks.hpp
+*/
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <SDL/SDL.h>
+
+#include "glm/glm.hpp"
+#include "Mesh.hpp"
+#include "NormalGenerator.hpp"
+#include "ObjParser.hpp"
+
+/*!
+ * \brief Benchmarks that need no window, run with ./3DObs --benchmark-<name>
+ */
+class Benchmarks
+{
+	public:
+		//! Runs the benchmark asked on the command line
+		/*!
+		 * \param argc Number of arguments
+		 * \param argv Arguments
+		 * \return The exit code of the benchmark, -1 if no benchmark was asked
+		 */
+		static int run(int argc, char** argv);
+
+	private:
+		//! Compares the fused statistics of the meshes with the former passes, from 1M to 50M vertices
+		/*!
+		 * \return 0
+		 */
+		static int statistics();
+		//! Measures the build of the hierarchy of a model and the cost of its ray queries
+		/*!
+		 * \param filename Path of the model
+		 * \return 0, 1 if the model cannot be loaded
+		 */
+		static int bvh(const char* filename);
+		//! Compares the generation of the smooth normals with the one of assimp on a tiled height field
+		/*!
+		 * \param nb_triangles Number of triangles of the height field, about
+		 * \return 0, 1 if the height field cannot be written or imported
+		 */
+		static int normals(unsigned int nb_triangles);
+		//! Compares the parser of the OBJ files with the import of assimp on the same file
+		/*!
+		 * \param filename Path of the OBJ file
+		 * \return 0, 1 if the file cannot be read
+		 */
+		static int obj(const char* filename);
+};
@@ -0,0 +1,149 @@
+/***************************************************************************
+									BufferStreamer.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Uploads big buffers chunk after chunk
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Uploads big buffers chunk after chunk
+  * \file BufferStreamer.hpp
+*/
+
+#pragma once
+
+#ifdef _WIN32
+	#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+#include <vector>
+#include <cstring>
+
+/*!
+ * \brief Fills the vertex and index buffers of a mesh chunk after chunk, within a byte budget per frame
+ *
+ * The chunks go through a ring of staging slots, each one guarded by a fence, and are copied on the GPU into the
+ * destination buffers. Without sync objects or buffer copies the chunks are uploaded with glBufferSubData.
+ * The vertices are sent before the index chunks that reference them, so the indices already resident can be drawn.
+ */
+class BufferStreamer
+{
+	public:
+		//! Constructor
+		/*!
+		 * \param chunk_size Size in bytes of a chunk
+		 */
+		BufferStreamer(unsigned int chunk_size);
+		//! Destructor
+		~BufferStreamer();
+
+		//! Adds a vertex buffer to fill
+		/*!
+		 * \param buffer Destination buffer, already allocated
+		 * \param data Source data, kept alive by the caller until the upload is complete
+		 * \param size Size of the data in bytes
+		 * \param vertex_size Size of a vertex in bytes
+		 */
+		void add_vertex_buffer(GLuint buffer, const void* data, size_t size, unsigned int vertex_size);
+		//! Adds a vertex buffer to fill, from data given to the streamer
+		/*!
+		 * \param buffer Destination buffer, already allocated
+		 * \param data Source data, swapped with an empty vector
+		 * \param vertex_size Size of a vertex in bytes
+		 */
+		void add_vertex_buffer(GLuint buffer, std::vector<unsigned char>& data, unsigned int vertex_size);
+		//! Sets the index buffer to fill
+		/*!
+		 * \param buffer Destination buffer, already allocated
+		 * \param data Source data, swapped with an empty vector
+		 * \param index_size Size of an index in bytes
+		 * \param indices The indices, used to know which vertices each chunk needs
+		 * \param nb_indices Number of indices
+		 */
+		void set_index_buffer(GLuint buffer, std::vector<unsigned char>& data, unsigned int index_size, const unsigned int* indices, unsigned int nb_indices);
+
+		//! Uploads the next chunks
+		/*!
+		 * \param budget Maximum number of bytes to upload
+		 * \return Number of bytes uploaded
+		 */
+		size_t stream(size_t budget);
+		//! Tells if every buffer is filled
+		/*!
+		 * \return True if the upload is complete
+		 */
+		bool is_complete() const;
+		//! Gets the number of indices that can be drawn
+		/*!
+		 * \return Number of resident indices whose vertices are resident too
+		 */
+		unsigned int get_resident_indices() const;
+		//! Gets the progress of the upload
+		/*!
+		 * \return Uploaded bytes over the total size, between 0 and 1
+		 */
+		float get_progress() const;
+
+	private:
+		//! Copy of a source array into a buffer
+		struct Upload
+		{
+			GLuint buffer;
+			const unsigned char* data;
+			size_t size;
+			size_t uploaded;
+			unsigned int element_size;
+			std::vector<unsigned char> owned;
+		};
+
+		//! Gets the number of vertices resident in every vertex buffer
+		/*!
+		 * \return The number of resident vertices
+		 */
+		unsigned int get_resident_vertices() const;
+		//! Uploads the next chunk of a buffer
+		/*!
+		 * \param upload The buffer to fill
+		 * \param size Maximum size of the chunk
+		 * \return Number of bytes uploaded, 0 if the staging slot is still in use by the GPU
+		 */
+		size_t upload_chunk(Upload& upload, size_t size);
+
+		unsigned int m_chunk_size;
+		std::vector<Upload*> m_vertex_uploads;
+		Upload* m_index_upload;
+		unsigned int m_index_chunk_size;
+		//~ Highest vertex referenced by the indices up to the end of each index chunk
+		std::vector<unsigned int> m_chunk_max_vertex;
+		size_t m_total_size;
+		size_t m_total_uploaded;
+
+		//~ Staging ring
+		bool m_use_staging;
+		GLuint m_staging_buffer;
+		std::vector<GLsync> m_fences;
+		unsigned int m_slot;
+};
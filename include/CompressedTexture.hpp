@@ -0,0 +1,169 @@
+/***************************************************************************
+									CompressedTexture.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Block-compressed textures : encoder and memory-mapped DDS files
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Block-compressed textures : encoder and memory-mapped DDS files
+  * \file CompressedTexture.hpp
+*/
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include <SDL/SDL.h>
+
+#include "TextureDecoder.hpp"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Block compression formats, 4x4 texels per block
+ */
+enum CompressionFormat
+{
+	COMPRESSION_BC1,	//!< 8 bytes per block : RGB colors, for the opaque color textures
+	COMPRESSION_BC3,	//!< 16 bytes per block : RGB colors and interpolated alpha, for the color textures with transparency
+	COMPRESSION_BC5		//!< 16 bytes per block : two interpolated channels, for the x and y of the normal maps
+};
+
+/*!
+ * \brief Block-compressed texture and its mip chain, memory-mapped from a DDS file
+ *
+ * The levels are given to the driver straight from the mapping, without any processing on the CPU. The files are
+ * written by encode(), run with ./3DObs --compress-texture <image> [bc1|bc3|bc5], next to their image with the .dds extension.
+ */
+class CompressedTexture
+{
+	public:
+		//! Constructor, maps the file
+		/*!
+		 * \param path Path of the DDS file
+		 */
+		CompressedTexture(const std::string& path) throw (int);
+		//! Destructor, unmaps the file
+		~CompressedTexture();
+
+		//! Compresses the image asked on the command line
+		/*!
+		 * \param argc Number of arguments
+		 * \param argv Arguments
+		 * \return The exit code of the compression, -1 if no compression was asked
+		 */
+		static int run(int argc, char** argv);
+		//! Compresses an image and its mip chain into a DDS file, on the shared thread pool
+		/*!
+		 * \param image The image and its mipmaps
+		 * \param format The compression format
+		 * \param path Path of the DDS file
+		 * \return True if the file was written
+		 */
+		static bool encode(const TextureImage& image, CompressionFormat format, const std::string& path);
+		//! Gets the path of the compressed file of an image
+		/*!
+		 * \param image_path Path of the image
+		 * \return The path with the .dds extension
+		 */
+		static std::string get_path(const std::string& image_path);
+		//! Gets the compressed files of images, when every image has one
+		/*!
+		 * \param image_paths Paths of the images, empty for no image
+		 * \return The paths of the compressed files, empty for no image ; no path at all if a file is missing or the first image is
+		 */
+		static std::vector<std::string> find(const std::vector<std::string>& image_paths);
+		//! Tells if the driver can sample a format
+		/*!
+		 * \param format The compression format
+		 * \return True if the format is supported
+		 */
+		static bool is_supported(CompressionFormat format);
+		//! Uploads textures into the bound texture
+		/*!
+		 * \param target GL_TEXTURE_2D for one texture ; GL_TEXTURE_2D_ARRAY for one layer per texture of an array allocated beforehand,
+		 * such as a page of the TextureArrayManager
+		 * \param layers The textures, all with the size, the levels and the format of the first one
+		 * \param first_layer Layer of the array receiving the first texture
+		 */
+		static void upload(GLenum target, const std::vector<const CompressedTexture*>& layers, unsigned int first_layer = 0);
+
+		//! Gets the width
+		/*!
+		 * \return Width of the first level
+		 */
+		int get_width() const;
+		//! Gets the height
+		/*!
+		 * \return Height of the first level
+		 */
+		int get_height() const;
+		//! Gets the number of levels
+		/*!
+		 * \return Number of levels of the mip chain
+		 */
+		unsigned int get_number_of_levels() const;
+		//! Gets the format
+		/*!
+		 * \return The compression format
+		 */
+		CompressionFormat get_format() const;
+		//! Gets the GL format
+		/*!
+		 * \return The internal format of the compressed texture
+		 */
+		GLenum get_internal_format() const;
+		//! Gets the size of the levels
+		/*!
+		 * \return Size in bytes of every level
+		 */
+		size_t get_size() const;
+
+	private:
+		//! Gets the size of a level
+		/*!
+		 * \param level The level
+		 * \return Size in bytes of the blocks of the level
+		 */
+		size_t get_level_size(unsigned int level) const;
+		//! Unmaps the file
+		void unmap();
+
+		void* m_mapping;
+		size_t m_mapping_size;
+		const unsigned char* m_data;
+		int m_width;
+		int m_height;
+		unsigned int m_levels;
+		CompressionFormat m_format;
+};
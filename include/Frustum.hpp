@@ -0,0 +1,103 @@
+/***************************************************************************
+									Frustum.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Planes bounding what a camera sees, for culling
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Planes bounding what a camera sees, for culling
+  * \file Frustum.hpp
+*/
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+/*!
+ * \brief Six planes bounding what a camera sees, for culling
+ *
+ * The planes are stored as (normal, distance), the normals pointing inside and normalized, in the space the matrix
+ * they are extracted from takes its points from. The tests are conservative : a volume reported outside is never seen.
+ */
+class Frustum
+{
+	public:
+		//! Constructor
+		/*!
+		 * Extracts the planes from the rows of the matrix (Gribb & Hartmann)
+		 * \param clip Matrix bringing points to clip space, the projection times the view for the world space
+		 */
+		Frustum(const glm::mat4& clip);
+		//! Constructor
+		/*!
+		 * Builds one frustum enclosing two others, such as the ones of the eyes of a stereo rig. Each plane is the one of
+		 * either frustum that needs the smallest shift to leave the corners of both inside, shifted by that amount.
+		 * \param first Matrix of the first frustum
+		 * \param second Matrix of the second frustum
+		 */
+		Frustum(const glm::mat4& first, const glm::mat4& second);
+
+		//! Tells if a sphere may be in the frustum
+		/*!
+		 * \param centre Centre of the sphere
+		 * \param radius Radius of the sphere
+		 * \return False if the sphere is entirely outside one of the planes
+		 */
+		bool intersects_sphere(const glm::vec3& centre, float radius) const;
+		//! Tells if an axis-aligned box may be in the frustum
+		/*!
+		 * \param min Lower corner of the box
+		 * \param max Upper corner of the box
+		 * \return False if the box is entirely outside one of the planes
+		 */
+		bool intersects_box(const glm::vec3& min, const glm::vec3& max) const;
+		//! Gets a plane
+		/*!
+		 * \param p Index of the plane : left, right, bottom, top, near, far
+		 * \return The normal pointing inside in xyz, the distance in w
+		 */
+		const glm::vec4& get_plane(unsigned int p) const;
+
+	private:
+		//! Extracts and normalizes the planes of a matrix
+		/*!
+		 * \param clip Matrix bringing points to clip space
+		 * \param planes Receives the 6 planes
+		 */
+		static void extract_planes(const glm::mat4& clip, glm::vec4* planes);
+		//! Computes the corners of the frustum of a matrix
+		/*!
+		 * \param clip Matrix bringing points to clip space
+		 * \param corners Receives the 8 corners
+		 */
+		static void compute_corners(const glm::mat4& clip, glm::vec3* corners);
+
+		glm::vec4 m_planes[6];
+};
@@ -0,0 +1,392 @@
+/***************************************************************************
+									Mesh.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Geometry of a model, on the CPU side
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Geometry of a model, on the CPU side
+  * \file Mesh.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include <SDL/SDL.h>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/mesh.h>
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "NormalGenerator.hpp"
+#include "ObjParser.hpp"
+#include "TriangleBVH.hpp"
+
+/*!
+ * \brief Bounding box and spread of a set of vertices
+ */
+struct MeshStatistics
+{
+	glm::vec3 min;				/*!< Lower corner of the bounding box */
+	glm::vec3 max;				/*!< Upper corner of the bounding box */
+	glm::vec3 barycentre;		/*!< Barycentre of the vertices */
+	float average_distance;		/*!< Average distance to the barycentre */
+	float standard_deviation;	/*!< Standard deviation of the distances to the barycentre */
+	float radius;				/*!< Largest distance to the barycentre, radius of the bounding sphere centred on it */
+};
+
+/*!
+ * \brief Range of the index buffer drawn with one material
+ */
+struct Submesh
+{
+	unsigned int first_index;		/*!< First index of the range */
+	unsigned int number_of_indices;	/*!< Number of indices of the range */
+	unsigned int material;			/*!< Index of the material */
+};
+
+/*!
+ * \brief Level of detail : its ranges, one per submesh, and its geometric error
+ */
+struct MeshLod
+{
+	unsigned int first_submesh;			/*!< First range of the level among the submeshes */
+	unsigned int number_of_submeshes;	/*!< Number of ranges of the level */
+	float error;						/*!< Largest distance between the level and the model, in model units */
+	unsigned int first_meshlet;			/*!< First cluster of the level among the meshlets */
+	unsigned int number_of_meshlets;	/*!< Number of clusters of the level */
+};
+
+/*!
+ * \brief Cluster of neighbouring triangles, culled as a whole
+ *
+ * The triangles whose normals lie in the cone all face away from the points v for which
+ * dot(centre - v, cone_axis) >= cone_cutoff * length(centre - v) + radius.
+ */
+struct Meshlet
+{
+	unsigned int first_index;		/*!< First index of the cluster */
+	unsigned int number_of_indices;	/*!< Number of indices of the cluster */
+	glm::vec3 centre;				/*!< Centre of the bounding sphere */
+	float radius;					/*!< Radius of the bounding sphere */
+	glm::vec3 cone_axis;			/*!< Average direction of the normals */
+	float cone_cutoff;				/*!< Sine of the half angle of the normal cone, 1 when the cone is too wide to cull */
+};
+
+/*!
+ * \brief Material of a submesh
+ */
+struct MeshMaterial
+{
+	glm::vec3 diffuse_color;		/*!< Diffuse color */
+	std::string diffuse_texture;	/*!< Path of the diffuse texture, relative to the working directory, empty if none */
+};
+
+/*!
+ * \brief What is kept of the arrays of a mesh once its buffers are on the GPU
+ */
+enum CpuRetention
+{
+	RETENTION_NONE,			//!< Every array is dropped, they are read again from the cache when the buffers are rebuilt
+	RETENTION_POSITIONS,	//!< Only the positions and the indices are kept, for the queries made on the CPU
+	RETENTION_ALL			//!< Every array is kept
+};
+
+/*!
+ * \brief Welded, indexed geometry of a model and its statistics
+ *
+ * The post-processed arrays are saved in a binary cache written next to the model. When the cache is up to date
+ * the arrays are memory-mapped from it instead of being imported again.
+ * Once uploaded, the arrays can be released and mapped again from the cache when they are needed. The statistics,
+ * the ranges, the clusters and the hierarchy do not depend on them.
+ */
+class Mesh
+{
+	public:
+		//! Constructor
+		/*!
+		 *	Loads the mesh from its cache when it is up to date, imports it with assimp and writes the cache otherwise
+		 *	\param filename Path of the model to load
+		 *	\param geometry_only True to get only the arrays and the statistics : the hierarchy is not built, and without
+		 *	a cache the imported arrays are neither optimized nor simplified, and no cache is written
+		 */
+		Mesh(const char* filename, bool geometry_only = false) throw (int);
+		//! Destructor
+		~Mesh();
+
+		//! Tells if a file is a mesh cache
+		/*!
+		 * \param filename Name of the file
+		 * \return True if the name ends with the extension of the mesh caches
+		 */
+		static bool is_cache_file(const std::string& filename);
+		//! Measures the bounding box, the barycentre and the spread of vertices
+		/*!
+		 *	Two vectorized sweeps on the shared thread pool : bounding box and barycentre, then the distances to the barycentre
+		 *	and the largest of them.
+		 *	The sums are made in float within blocks and in double across them, the deviations are merged with Chan's formula
+		 *	\param vertices The vertices
+		 *	\param nb_vertices Number of vertices
+		 *	\return The statistics of the vertices
+		 */
+		static MeshStatistics measure(const glm::vec3* vertices, unsigned int nb_vertices);
+		//! Measures the resident memory of the process
+		/*!
+		 *	\return The resident set size in bytes, 0 where it cannot be read
+		 */
+		static size_t get_resident_memory();
+
+		//! Releases the arrays which are not retained
+		/*!
+		 *	Nothing is released while the cache of the model is missing, the arrays could not be restored
+		 *	\param retention What is kept of the arrays
+		 */
+		void release_arrays(CpuRetention retention);
+		//! Maps again the arrays released by release_arrays()
+		/*!
+		 *	\return True if every array is available, false if the cache no longer matches the model
+		 */
+		bool reload_arrays();
+		//! Tells if every array is available
+		/*!
+		 * \return False once the arrays have been released, until they are reloaded
+		 */
+		bool has_arrays() const;
+
+		//! Gets the positions
+		/*!
+		 * \return The positions of the vertices, NULL once released
+		 */
+		const glm::vec3* get_vertices() const;
+		//! Gets the normals
+		/*!
+		 * \return The normals of the vertices, NULL once released
+		 */
+		const glm::vec3* get_normals() const;
+		//! Gets the texture coordinates
+		/*!
+		 * \return The texture coordinates of the vertices, NULL once released
+		 */
+		const glm::vec2* get_uvs() const;
+		//! Gets the indices of the triangles
+		/*!
+		 * \return Three indices per triangle, NULL once released
+		 */
+		const unsigned int* get_indices() const;
+		//! Gets the ranges of the index buffer
+		/*!
+		 * \return One range per assimp mesh and per level of detail, level after level, in the order of the index buffer
+		 */
+		const std::vector<Submesh>& get_submeshes() const;
+		//! Gets the levels of detail
+		/*!
+		 * \return The levels, from the full resolution to the coarsest one
+		 */
+		const std::vector<MeshLod>& get_lods() const;
+		//! Gets the clusters of triangles
+		/*!
+		 * \return The clusters of every level of detail, level after level, in the order of the index buffer
+		 */
+		const std::vector<Meshlet>& get_meshlets() const;
+		//! Gets the hierarchy of the triangles of the full resolution, for ray queries
+		/*!
+		 * \return The hierarchy, built at each load
+		 */
+		const TriangleBVH& get_bvh() const;
+		//! Gets the materials
+		/*!
+		 * \return The materials of the scene, at least one
+		 */
+		const std::vector<MeshMaterial>& get_materials() const;
+		//! Gets the number of vertices
+		/*!
+		 * \return The number of unique vertices
+		 */
+		unsigned int get_number_of_vertices() const;
+		//! Gets the number of indices
+		/*!
+		 * \return Three times the number of triangles, every level of detail included
+		 */
+		unsigned int get_number_of_indices() const;
+		//! Gets the ratio between unique vertices and referenced vertices
+		/*!
+		 * \return 1.0 if no vertex could be welded, lower values mean more sharing
+		 */
+		float get_unique_vertex_ratio() const;
+		//! Gets the lower corner of the bounding box
+		/*!
+		 * \return The lower corner of the bounding box
+		 */
+		glm::vec3 get_min() const;
+		//! Gets the upper corner of the bounding box
+		/*!
+		 * \return The upper corner of the bounding box
+		 */
+		glm::vec3 get_max() const;
+		//! Gets the barycentre of the vertices
+		/*!
+		 * \return The barycentre of the vertices
+		 */
+		glm::vec3 get_barycentre() const;
+		//! Gets the average distance between the vertices and the barycentre
+		/*!
+		 * \return The average distance to the barycentre
+		 */
+		float get_average_distance() const;
+		//! Gets the standard deviation of the distances to the barycentre
+		/*!
+		 * \return The standard deviation
+		 */
+		float get_standard_deviation() const;
+		//! Gets the radius of the bounding sphere centred on the barycentre
+		/*!
+		 * \return The largest distance between a vertex and the barycentre
+		 */
+		float get_radius() const;
+		//! Gets the efficiency of the triangle order of the model file
+		/*!
+		 * \return ACMR and ATVR of the imported order
+		 */
+		VertexCacheStatistics get_original_cache_statistics() const;
+		//! Gets the efficiency of the optimized triangle order
+		/*!
+		 * \return ACMR and ATVR of the order in use
+		 */
+		VertexCacheStatistics get_optimized_cache_statistics() const;
+		//! Tells if the mesh was read from its cache
+		/*!
+		 * \return True if the mesh is mapped from its cache, false if it was imported
+		 */
+		bool is_from_cache() const;
+
+	private:
+		//! Imports the model with assimp, or with the parser of the OBJ files
+		/*!
+		 * \param filename Path of the model
+		 */
+		void import(const char* filename) throw (int);
+		//! Imports an OBJ file with the parser of the OBJ files, faster than assimp
+		/*!
+		 * \param filename Path of the model
+		 */
+		void import_obj(const char* filename) throw (int);
+		//! Reads the diffuse color and texture of the materials of a scene
+		/*!
+		 * \param scene The imported scene
+		 * \param filename Path of the model, the textures are relative to its directory
+		 */
+		void import_materials(const aiScene* scene, const char* filename);
+		//! Reorders the triangles of each submesh for the vertex cache then the overdraw, and the vertices for the fetch
+		void optimize();
+		//! Appends coarser copies of the submeshes to the indices, each level keeping about half of the triangles of the previous one
+		void build_lods();
+		//! Splits the ranges of every level of detail into clusters of neighbouring triangles and bounds them
+		void build_meshlets();
+		//! Computes the bounding box, the barycentre and the distances to the barycentre
+		void compute_statistics();
+		//! Points the accessors to the owned arrays
+		void use_owned_arrays();
+		//! Reads the cache if it matches the model
+		/*!
+		 * \param cache_path Path of the cache
+		 * \param filename Path of the model
+		 * \return True if the cache was up to date and is now mapped
+		 */
+		bool read_cache(const std::string& cache_path, const char* filename);
+		//! Maps the cache and checks that it matches the model
+		/*!
+		 * \param cache_path Path of the cache
+		 * \param filename Path of the model
+		 * \return True if the cache is up to date, it is left unmapped otherwise
+		 */
+		bool map_cache(const std::string& cache_path, const char* filename);
+		//! Points the accessors to the arrays of the mapped cache
+		void use_cached_arrays();
+		//! Writes the cache of the model
+		/*!
+		 * \param cache_path Path of the cache
+		 * \param filename Path of the model
+		 * \return True if the cache was written
+		 */
+		bool write_cache(const std::string& cache_path, const char* filename) const;
+		//! Unmaps the cache
+		void unmap_cache();
+
+		//~ Owned arrays, filled by the import
+		std::vector<glm::vec3> m_owned_vertices;
+		std::vector<glm::vec3> m_owned_normals;
+		std::vector<glm::vec2> m_owned_uvs;
+		std::vector<unsigned int> m_owned_indices;
+
+		//~ Arrays in use, either owned or mapped from the cache
+		const glm::vec3* m_vertices;
+		const glm::vec3* m_normals;
+		const glm::vec2* m_uvs;
+		const unsigned int* m_indices;
+		unsigned int m_number_of_vertices;
+		unsigned int m_number_of_indices;
+
+		//~ Draw ranges, their levels of detail and their materials
+		std::vector<Submesh> m_submeshes;
+		std::vector<MeshLod> m_lods;
+		std::vector<Meshlet> m_meshlets;
+		
+		//~ Ray queries
+		TriangleBVH m_bvh;
+		std::vector<MeshMaterial> m_materials;
+
+		//~ Mapping of the cache
+		std::string m_filename;
+		bool m_has_cache;
+		void* m_mapping;
+		size_t m_mapping_size;
+
+		//~ Statistics
+		float m_unique_vertex_ratio;
+		glm::vec3 m_min;
+		glm::vec3 m_max;
+		glm::vec3 m_barycentre;
+		float m_average_distance;
+		float m_standard_deviation;
+		float m_radius;
+		VertexCacheStatistics m_original_cache_statistics;
+		VertexCacheStatistics m_optimized_cache_statistics;
+};
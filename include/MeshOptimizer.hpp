@@ -0,0 +1,112 @@
+/***************************************************************************
+									MeshOptimizer.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Reorders the triangles and the vertices of a mesh for the GPU
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Reorders the triangles and the vertices of a mesh for the GPU
+  * \file MeshOptimizer.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+
+/*!
+ * \brief Efficiency of a triangle order for the post-transform cache
+ */
+struct VertexCacheStatistics
+{
+	float acmr;	/*!< Average cache miss ratio : transformed vertices per triangle, 0.5 at best, 3 at worst */
+	float atvr;	/*!< Average transformed vertex ratio : transformed vertices per referenced vertex, 1 at best */
+};
+
+/*!
+ * \brief Reorders the triangles and the vertices of a mesh for the GPU
+ *
+ * The triangles are first ordered for the post-transform cache (Forsyth's linear-speed algorithm), then the clusters of
+ * that order are sorted so that the outer ones are drawn first, to reduce the overdraw (Sander et al.). At last the
+ * vertices are renumbered in the order of their first use, so that they are fetched sequentially.
+ */
+class MeshOptimizer
+{
+	public:
+		//! Orders triangles for the post-transform cache
+		/*!
+		 * \param indices The triangles, reordered in place
+		 * \param nb_indices Number of indices
+		 * \param nb_vertices Number of vertices referenced by the indices
+		 */
+		static void optimize_vertex_cache(unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices);
+		//! Sorts the clusters of a cache-optimized order from the outside to the inside
+		/*!
+		 * The new order is kept only if its cache efficiency stays within the threshold of the original one
+		 * \param indices The triangles, ordered for the cache, reordered in place
+		 * \param nb_indices Number of indices
+		 * \param vertices Positions of the vertices
+		 * \param nb_vertices Number of vertices
+		 * \param threshold Highest ratio allowed between the new and the original ACMR
+		 */
+		static void optimize_overdraw(unsigned int* indices, unsigned int nb_indices, const glm::vec3* vertices, unsigned int nb_vertices, float threshold);
+		//! Numbers the vertices in the order of their first use
+		/*!
+		 * \param indices The triangles, renumbered in place
+		 * \param nb_indices Number of indices
+		 * \param nb_vertices Number of vertices
+		 * \return For each new vertex, the old one ; the unused vertices come last
+		 */
+		static std::vector<unsigned int> optimize_vertex_fetch(unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices);
+		//! Applies a remapping to a vertex array
+		/*!
+		 * \param values The array, reordered in place
+		 * \param remap For each new vertex, the old one
+		 */
+		template <typename T>
+		static void remap_vertices(std::vector<T>& values, const std::vector<unsigned int>& remap)
+		{
+			std::vector<T> reordered(values.size());
+			for(unsigned int i = 0; i < remap.size(); ++i)
+			{
+				reordered[i] = values[remap[i]];
+			}
+			values.swap(reordered);
+		}
+		//! Simulates a FIFO post-transform cache
+		/*!
+		 * \param indices The triangles
+		 * \param nb_indices Number of indices
+		 * \param nb_vertices Number of vertices
+		 * \param cache_size Number of entries of the cache
+		 * \return The ACMR and the ATVR of the order
+		 */
+		static VertexCacheStatistics analyze_vertex_cache(const unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices, unsigned int cache_size = 16);
+};
@@ -0,0 +1,67 @@
+/***************************************************************************
+									MeshSimplifier.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Reduces the number of triangles of a mesh for its levels of detail
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Reduces the number of triangles of a mesh for its levels of detail
+  * \file MeshSimplifier.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+#include "glm/glm.hpp"
+
+/*!
+ * \brief Reduces the number of triangles of a mesh for its levels of detail
+ *
+ * Edges are collapsed by increasing quadric error (Garland & Heckbert), one vertex onto the other end of the edge, so
+ * the simplified triangles index the vertices of the original mesh and share its vertex buffers. The vertices on a
+ * border or a seam of the attributes are kept, as well as the collapses that would flip a triangle.
+ */
+class MeshSimplifier
+{
+	public:
+		//! Simplifies a set of triangles
+		/*!
+		 * \param destination Receives the simplified triangles, at most nb_indices indices
+		 * \param indices The triangles
+		 * \param nb_indices Number of indices
+		 * \param vertices Positions of the vertices
+		 * \param nb_vertices Number of vertices
+		 * \param target_nb_indices Number of indices to reach, the result is larger when no collapse is left
+		 * \param error Receives the geometric error of the result, in the unit of the positions
+		 * \return Number of indices written to destination
+		 */
+		static unsigned int simplify(unsigned int* destination, const unsigned int* indices, unsigned int nb_indices, const glm::vec3* vertices, unsigned int nb_vertices, unsigned int target_nb_indices, float& error);
+};
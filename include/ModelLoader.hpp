@@ -0,0 +1,159 @@
+/***************************************************************************
+									ModelLoader.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Loads the models on a worker thread
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Loads the models on a worker thread
+  * \file ModelLoader.hpp
+*/
+
+#pragma once
+
+#include <string>
+#include <queue>
+#include <iostream>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+#include "Mesh.hpp"
+#include "Object.hpp"
+#include "PointCloud.hpp"
+
+//! Stage of the loading of a model
+enum LoadingStage
+{
+	LOADING_IDLE,		/*!< Nothing to load */
+	LOADING_PENDING,	/*!< A request waits for the worker */
+	LOADING_GEOMETRY,	/*!< The mesh is imported or read from its cache, or the point cloud read and sorted in its octree */
+	LOADING_TEXTURE,	/*!< The textures are decoded */
+	LOADING_DONE		/*!< The data waits for the render thread */
+};
+
+/*!
+ * \brief CPU side data of a loaded model, ready to be sent to the GPU
+ */
+struct LoadedModel
+{
+	std::string model_path;		/*!< Path of the model */
+	std::string texture_path;	/*!< Path of the texture */
+	Mesh* mesh;					/*!< Geometry, NULL if the import failed or the model is a point cloud */
+	PointCloud* cloud;			/*!< Point cloud and its octree, NULL unless the model is one */
+	DecodedTextures textures;	/*!< Decoded textures and their mipmaps, without pixels if they are cached or the decoding failed */
+	Uint32 texture_time;		/*!< Time spent decoding the textures and building their mipmaps, in ms */
+	unsigned int request;		/*!< Number of the request */
+};
+
+/*!
+ * \brief Loads the models on a worker thread
+ *
+ * The import, the statistics and the decoding of the texture run on the worker. The loaded models are pushed in a
+ * completion queue that the render thread polls once per frame, the GL objects being created on the render thread only.
+ * Only the latest request matters : a request still pending is replaced, and outdated results are discarded.
+ */
+class ModelLoader
+{
+	public:
+		//! Constructor, starts the worker thread
+		ModelLoader();
+		//! Destructor, stops the worker thread and frees the models that were not taken
+		~ModelLoader();
+
+		//! Asks for a model to be loaded
+		/*!
+		 * \param model_path Path of the model
+		 * \param texture_path Path of the texture
+		 */
+		void request(const std::string& model_path, const std::string& texture_path);
+		//! Takes the latest loaded model
+		/*!
+		 *	Never blocks. The caller owns the returned model and frees it with release()
+		 *	\return The loaded model, NULL if none is ready
+		 */
+		LoadedModel* poll();
+		//! Frees the pixels and the structure of a loaded model, and its point cloud unless it was taken
+		/*!
+		 * \param model The model to free
+		 */
+		static void release(LoadedModel* model);
+
+		//! Tells if a model is being loaded
+		/*!
+		 * \return True if a request is not completed yet
+		 */
+		bool is_loading();
+		//! Gets the stage of the loading
+		/*!
+		 * \return The current stage
+		 */
+		LoadingStage get_stage();
+		//! Gets the name of the model being loaded
+		/*!
+		 * \return The path of the model
+		 */
+		std::string get_loading_model();
+		//! Gets the time spent on the current request
+		/*!
+		 * \return Milliseconds since the request was posted
+		 */
+		unsigned int get_loading_time();
+
+	private:
+		//! Entry point of the worker thread
+		/*!
+		 * \param data The loader
+		 * \return 0
+		 */
+		static int run_worker(void* data);
+		//! Loop of the worker thread
+		void work();
+		//! Sets the stage of the loading
+		/*!
+		 * \param stage The new stage
+		 */
+		void set_stage(LoadingStage stage);
+
+		SDL_Thread* m_thread;
+		SDL_mutex* m_mutex;
+		SDL_cond* m_condition;
+		bool m_stop;
+
+		//~ Latest request, waiting for the worker
+		bool m_has_request;
+		std::string m_requested_model;
+		std::string m_requested_texture;
+		unsigned int m_request_counter;
+
+		//~ Completion queue
+		std::queue<LoadedModel*> m_completed;
+
+		//~ Progress of the loading
+		LoadingStage m_stage;
+		std::string m_loading_model;
+		unsigned int m_request_time;
+};
@@ -0,0 +1,70 @@
+/***************************************************************************
+									NormalGenerator.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Generates smooth normals for the meshes that have none
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Generates smooth normals for the meshes that have none
+  * \file NormalGenerator.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Generates smooth normals for the meshes that have none, on the shared thread pool
+ *
+ * The positions are welded through a spatial hash : the vertices lying in the same cell of a fine grid share their
+ * normal, so that the seams of the texture coordinates do not show. Each corner of a triangle adds the normal of the
+ * triangle weighted by its angle, which does not depend on the tessellation.
+ *
+ * No step writes where another thread may write : the cells are spread among partitions by their hash, the vertices
+ * then the corners are sorted by partition, and each partition is welded and accumulated by a single task.
+ */
+class NormalGenerator
+{
+	public:
+		//! Generates the normals of a mesh
+		/*!
+		 * \param vertices Positions of the vertices
+		 * \param nb_vertices Number of vertices
+		 * \param indices Three indices per triangle
+		 * \param nb_indices Number of indices
+		 * \param base_vertex Index of the first vertex in the indices, subtracted from them
+		 * \param normals One normal per vertex, written ; (0, 0, 1) for the vertices of degenerate triangles only
+		 */
+		static void generate(const glm::vec3* vertices, unsigned int nb_vertices, const unsigned int* indices, unsigned int nb_indices,
+			unsigned int base_vertex, glm::vec3* normals);
+};
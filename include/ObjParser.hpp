@@ -0,0 +1,159 @@
+/***************************************************************************
+									ObjParser.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Reads Wavefront OBJ files without assimp
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Reads Wavefront OBJ files without assimp
+  * \file ObjParser.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <climits>
+#include <stdint.h>
+#include <algorithm>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Material of an OBJ file, read from its material libraries
+ */
+struct ObjMaterial
+{
+	std::string name;				/*!< Name given by newmtl */
+	glm::vec3 diffuse_color;		/*!< Diffuse color (Kd) */
+	std::string diffuse_texture;	/*!< Path of the diffuse texture (map_Kd), relative to the working directory, empty if none */
+};
+
+/*!
+ * \brief Range of the indices drawn with one material
+ */
+struct ObjRange
+{
+	unsigned int first_index;		/*!< First index of the range */
+	unsigned int number_of_indices;	/*!< Number of indices of the range */
+	unsigned int material;			/*!< Index of the material */
+};
+
+/*!
+ * \brief Indexed triangles of an OBJ file
+ */
+struct ObjModel
+{
+	std::vector<glm::vec3> vertices;	/*!< Positions of the vertices */
+	std::vector<glm::vec3> normals;		/*!< Normals of the vertices, null if the faces have none */
+	std::vector<glm::vec2> uvs;			/*!< Texture coordinates of the vertices, flipped vertically like aiProcess_FlipUVs */
+	std::vector<unsigned int> indices;	/*!< Three indices per triangle, grouped by material */
+	std::vector<ObjRange> ranges;		/*!< One range per material in use, in the order of the materials */
+	std::vector<ObjMaterial> materials;	/*!< Materials of the libraries, then a white one for the faces without a known material */
+	bool has_normals;					/*!< True if every corner of every face has a normal */
+};
+
+/*!
+ * \brief Reads Wavefront OBJ files without assimp, on the shared thread pool
+ *
+ * The file is memory-mapped and split into chunks that end with a line, parsed in parallel : the digits are located
+ * 16 at a time with SSE2 and converted 8 at a time. The chunks are then merged with prefix sums over their counts.
+ * When every face indexes its positions, texture coordinates and normals alike and no position is shared by two
+ * materials, as in the exports of scans, the vertices are the positions and need no welding ; otherwise the (position,
+ * texture coordinates, normal, material) corners are welded, since the material is an attribute of the vertices.
+ *
+ * Faces are triangulated as fans, the lines and points are skipped, like by aiProcess_Triangulate.
+ */
+class ObjParser
+{
+	public:
+		//! Tells if a file is an OBJ file
+		/*!
+		 * \param filename Name of the file
+		 * \return True if the name ends with .obj, whatever its case
+		 */
+		static bool is_obj_file(const std::string& filename);
+		//! Reads an OBJ file and its material libraries
+		/*!
+		 * \param filename Path of the file
+		 * \param model The triangles read
+		 * \throw 0 if the file cannot be read or one of its faces indexes a missing element
+		 */
+		static void parse(const char* filename, ObjModel& model) throw (int);
+
+	private:
+		//! Parses a range of chunks, run by the thread pool
+		/*!
+		 * \param begin First chunk of the range
+		 * \param end Chunk after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void parse_chunks(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Turns the indices of a range of chunks into vertices, run by the thread pool
+		/*!
+		 * \param begin First chunk of the range
+		 * \param end Chunk after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void resolve_chunks(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Copies the elements of a range of chunks into the model, run by the thread pool
+		/*!
+		 * \param begin First chunk of the range
+		 * \param end Chunk after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void gather_chunks(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Copies the triangles of a range of spans to the place of their material in the indices, run by the thread pool
+		/*!
+		 * \param begin First span of the range
+		 * \param end Span after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void copy_spans(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Reads the materials of a library
+		/*!
+		 * \param path Path of the library
+		 * \param directory Directory of the model, the textures are relative to it
+		 * \param materials The materials, the new ones are appended
+		 */
+		static void read_materials(const std::string& path, const std::string& directory, std::vector<ObjMaterial>& materials);
+};
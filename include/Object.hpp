@@ -39,7 +39,9 @@
 #endif
 #include <GL/glew.h>
 #include <vector>
+#include <string>
 #include <iostream>
+#include <cstring>
 #include <SDL/SDL.h>
 
 #include <assimp/cimport.h>
@@ -47,13 +49,54 @@
 #include <assimp/postprocess.h>
 #include <assimp/mesh.h>
 
-#include "stb_image/stb_image.h"
+#include "Mesh.hpp"
+#include "TextureDecoder.hpp"
+#include "TextureCache.hpp"
+#include "CompressedTexture.hpp"
+#include "BufferStreamer.hpp"
+#include "Camera.hpp"
+#include "Frustum.hpp"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/half_float.hpp"
+
+/*!
+ * \brief Layout of the vertex buffers of an object
+ */
+enum VertexLayout
+{
+	LAYOUT_SEPARATE,	//!< One buffer per attribute, shared by every pass
+	LAYOUT_INTERLEAVED,	//!< One interleaved buffer, shared by every pass
+	LAYOUT_SPLIT		//!< One interleaved buffer for the shading passes and a position-only buffer for the depth-only passes
+};
+
+/*!
+ * \brief Format of the vertex attributes once uploaded
+ */
+enum VertexFormat
+{
+	FORMAT_FLOAT,		//!< 32 bytes per vertex : float positions, normals and uvs
+	FORMAT_QUANTIZED	//!< 16 bytes per vertex : 16 bits positions normalized in the bounding box, octahedral 2x16 bits normals, half float uvs
+};
+
+/*!
+ * \brief Textures of an object, decoded before the creation of its GL objects
+ */
+struct DecodedTextures
+{
+	std::string key;							/*!< Key of the texture array in the texture cache */
+	TextureImage diffuse;						/*!< Chosen texture, without pixels if it is cached or could not be decoded */
+	std::vector<TextureImage> material_images;	/*!< Textures of the materials, with the size and the levels of the chosen one */
+	std::vector<CompressedTexture*> compressed;	/*!< Compressed files used instead of the images : the chosen texture, then one per material, NULL without texture */
+};
 
 /*!
  * \brief Object that can be instanced in the scene
+ *
+ * The submeshes of the model share the vertex and index buffers, each one keeps its range of indices and its material.
+ * The ranges are drawn with one call, the material of a vertex selects a layer of the texture array and a tint in the material table.
+ * The texture array is shared with the objects whose textures have the same size.
  */ 
 class Object
 {
@@ -62,30 +105,175 @@ class Object
 		/*!
 		 *	\param filename Path of the obj model to load
 		 *	\param texture_path Path of the texture to load
+		 *	\param layout Layout of the vertex buffers
+		 *	\param format Format of the vertex attributes
+		 *	\param retention What is kept of the arrays of the mesh once uploaded
 		 */
-		Object(const char* filename, const char* texture_path) throw (int);
+		Object(const char* filename, const char* texture_path, VertexLayout layout = LAYOUT_SPLIT, VertexFormat format = FORMAT_FLOAT, CpuRetention retention = RETENTION_NONE) throw (int);
+		//! Constructor with an already loaded mesh
+		/*!
+		 *	Only the GL objects are created, the mesh and the texture may have been prepared by another thread
+		 *	\param mesh The geometry, owned by the object afterwards
+		 *	\param texture_path Path of the texture
+		 *	\param textures Textures as given by decode_textures(), without pixels to take them from the cache or the disk
+		 *	\param layout Layout of the vertex buffers
+		 *	\param format Format of the vertex attributes
+		 *	\param retention What is kept of the arrays of the mesh once uploaded
+		 */
+		Object(Mesh* mesh, const char* texture_path, const DecodedTextures& textures, VertexLayout layout = LAYOUT_SPLIT, VertexFormat format = FORMAT_FLOAT, CpuRetention retention = RETENTION_NONE);
+
+		//! Number of materials of the material table
+		static const unsigned int MAX_MATERIALS = 32;
 		//! Destuctor
 		~Object();
 		
-		//! Creates all the required buffers for the objects (vertices, normals, uvs) and the associated VAO
+		//! Creates all the required buffers for the objects (vertices, normals, uvs, indices) and the associated VAOs
+		/*!
+		 * Buffers bigger than a threshold are only allocated, stream_buffers() fills them over the next frames.
+		 * The arrays of the mesh must be available, they are released afterwards according to the retention policy
+		 */
 		void create_buffers();
-		//! Loads the textures thanks to stb_image
+		//! Uploads the next chunks of the buffers of a streamed mesh
+		/*!
+		 * \param budget Maximum number of bytes to upload
+		 * \return True once every buffer is resident
+		 */
+		bool stream_buffers(size_t budget);
+		//! Deletes the buffers and the VAOs of the object
+		void delete_buffers();
+		//! Takes the textures from the texture cache, or loads them thanks to stb_image
 		void load_textures();
+		//! Uploads the layers with their mipmaps : the chosen texture, then the textures of the materials
+		/*!
+		 * The layers are taken from a page of the texture array manager and added to the texture cache
+		 * \param textures The decoded textures, the chosen one white when only the materials have one, or the compressed files
+		 */
+		void upload_textures(const DecodedTextures& textures);
+		//! Takes the texture array from the texture cache
+		/*!
+		 * \param key Key of the array
+		 * \return True if the array was cached
+		 */
+		bool acquire_textures(const std::string& key);
+		//! Gets the files of the texture array of a mesh
+		/*!
+		 * \param texture_path Path of the chosen texture
+		 * \param mesh The mesh, only the models made of several materials use their own textures
+		 * \return The chosen texture, then one path per material
+		 */
+		static std::vector<std::string> get_texture_paths(const std::string& texture_path, const Mesh& mesh);
+		//! Decodes the textures of a mesh and builds their mipmaps, on the shared thread pool
+		/*!
+		 * Nothing is decoded when the texture cache already holds the array, the compressed files are mapped instead of the images
+		 * when each of them has one
+		 * \param texture_path Path of the chosen texture
+		 * \param mesh The mesh
+		 * \param textures The key of the array and, unless it is cached, the decoded textures
+		 */
+		static void decode_textures(const std::string& texture_path, const Mesh& mesh, DecodedTextures& textures);
+		//! Maps the compressed files of the layers of a texture array
+		/*!
+		 * \param paths Paths of the compressed files, empty for no texture
+		 * \param compressed The mapped files, left empty if a file cannot be used or they differ in size, levels or format
+		 */
+		static void map_compressed_textures(const std::vector<std::string>& paths, std::vector<CompressedTexture*>& compressed);
+		//! Frees the pixels of decoded textures
+		/*!
+		 * \param textures The textures
+		 */
+		static void free_textures(DecodedTextures& textures);
+		//! Draws the submeshes with the bound VAO
+		/*!
+		 * One glMultiDrawElements for every range of the level, cut at the resident indices while the mesh is streamed
+		 * \param level Level of detail, clamped to the coarsest one ; the full resolution is drawn while the mesh is streamed
+		 */
+		void draw(unsigned int level = 0) const;
+		//! Culls the clusters of a level against two cameras and compacts the visible ones into a draw list
+		/*!
+		 * A cluster is kept when it is in one of the frusta and not entirely back-facing for that camera, so that the
+		 * list can be drawn by both eyes. The back faces must be culled when the list is drawn.
+		 * \param level Level of detail, clamped to the coarsest one ; the full resolution is culled while the mesh is streamed
+		 * \param first The first camera
+		 * \param second The second camera
+		 */
+		void cull(unsigned int level, const Camera& first, const Camera& second);
+		//! Draws the clusters kept by the last culling with the bound VAO
+		void draw_visible() const;
+		//! Gets the fraction of the clusters removed by the last culling
+		/*!
+		 * \return 0 when every cluster is drawn, 1 when none is
+		 */
+		float get_culled_fraction() const;
+		//! Draws every instance of the object with the bound VAO
+		/*!
+		 * One glDrawElementsInstanced per range of the level, cut at the resident indices while the mesh is streamed
+		 * \param level Level of detail, clamped to the coarsest one ; the full resolution is drawn while the mesh is streamed
+		 */
+		void draw_instanced(unsigned int level = 0) const;
+		//! Places copies of the object, sharing its buffers and its textures
+		/*!
+		 * The matrices are uploaded to a buffer read by the VAOs as an instanced attribute at the locations 4 to 7. The bounding
+		 * volumes then enclose every instance.
+		 * \param instances One matrix per instance, applied after the model matrix ; none to draw the object alone
+		 */
+		void set_instances(const std::vector<glm::mat4>& instances);
+		//! Gets the number of instances
+		/*!
+		 * \return The number of matrices of the instance buffer, 0 when the object is drawn alone
+		 */
+		unsigned int get_number_of_instances() const;
+		//! Chooses the coarsest level of detail whose error stays under a number of pixels
+		/*!
+		 * \param viewpoint Position from which the object is seen
+		 * \param projection_scale Pixels covered by one unit at a distance of one unit
+		 * \param max_error Largest error allowed, in pixels
+		 * \return The level of detail
+		 */
+		unsigned int select_lod(const glm::vec3& viewpoint, float projection_scale, float max_error) const;
+		//! Finds the nearest triangle of the full resolution hit by each ray
+		/*!
+		 * \param rays The rays, in world space, traversed in packets of 4
+		 * \param hits Receives one hit per ray, the distances are in lengths of the directions
+		 * \param nb_rays Number of rays
+		 */
+		void intersect(const Ray* rays, RayHit* hits, unsigned int nb_rays) const;
+		//! Tells if the object may be seen through a frustum
+		/*!
+		 * \param frustum The frustum, in world space
+		 * \return False if the bounding box or the bounding sphere is outside the frustum
+		 */
+		bool is_visible(const Frustum& frustum) const;
+		//! Gets the number of levels of detail
+		/*!
+		 * \return 1 when the mesh is drawn at full resolution only
+		 */
+		unsigned int get_number_of_lods() const;
+		//! Gets the number of draw ranges of a level of detail
+		/*!
+		 * \param level Level of detail, clamped to the coarsest one
+		 * \return The number of ranges, one per submesh
+		 */
+		unsigned int get_number_of_ranges(unsigned int level) const;
 
-		//! Compute and return the barycentre of the object
+		//! Return the barycentre of the object, computed at load
 		glm::vec3 computeBarycentre();
 
-		//! Compute and return the standard deviation
+		//! Return the standard deviation of the distances to the barycentre, computed at load
 		float computeStandardDeviation();
 
-		//! Compute and return the average dist to the barycentre
+		//! Return the average dist to the barycentre, computed at load
 		float computeAvgDistToBarycentre();
 		
 		//! Gets the identifier of the diffuse texture
 		/*!
-		 * \return The identifier of the diffuse texture
+		 * \return The identifier of the texture array, shared with other objects, 0 if the object has no texture
 		 */ 
 		GLuint get_diffuse_texture() const;
+		//! Gets the material table
+		/*!
+		 * \return Per material, the tint in rgb and the layer of the texture array in w
+		 */ 
+		const std::vector<glm::vec4>& get_material_table() const;
 		//! Gets the path of the diffuse texture
 		/*!
 		 * \return The path of the diffuse texture
@@ -93,35 +281,184 @@ class Object
 		const char* get_texture_path() const;
 		//! Gets the number of vertices in the model
 		/*!
-		 * \return The number of vertices in the model
+		 * \return The number of unique vertices in the model
 		 */ 
 		unsigned int get_size() const;
+		//! Gets the number of indices to draw
+		/*!
+		 * \return The number of indices in the index buffer
+		 */ 
+		unsigned int get_number_of_indices() const;
+		//! Gets the number of indices that can be drawn
+		/*!
+		 * \return The number of indices already uploaded, with their vertices, while the mesh is streamed
+		 */ 
+		unsigned int get_number_of_resident_indices() const;
+		//! Tells if the buffers are completely uploaded
+		/*!
+		 * \return False while the mesh is streamed
+		 */ 
+		bool is_resident() const;
+		//! Gets the progress of the upload of a streamed mesh
+		/*!
+		 * \return The uploaded fraction of the buffers
+		 */ 
+		float get_upload_progress() const;
+		//! Gets the type of the indices
+		/*!
+		 * \return GL_UNSIGNED_SHORT or GL_UNSIGNED_INT depending on the number of vertices
+		 */ 
+		GLenum get_index_type() const;
+		//! Gets the ratio between unique vertices and referenced vertices
+		/*!
+		 * \return 1.0 if no vertex could be welded, lower values mean more sharing
+		 */ 
+		float get_unique_vertex_ratio() const;
 		//! Gets the identifier of the VAO
 		/*!
-		 * \return The identifier of the VAO
+		 * \return The identifier of the VAO used by the shading passes
 		 */ 
 		GLuint get_vao() const;
+		//! Gets the identifier of the VAO used by the depth-only passes
+		/*!
+		 * \return The identifier of the position-only VAO, or the shading one if the layout does not split the streams
+		 */ 
+		GLuint get_depth_vao() const;
+		//! Gets the layout of the vertex buffers
+		/*!
+		 * \return The layout of the vertex buffers
+		 */ 
+		VertexLayout get_vertex_layout() const;
 		//! Gets the Model matrix
 		/*!
 		 * \return Model matrix
 		 */ 
 		glm::mat4 get_model_matrix() const;
+		//! Gets the lower corner of the bounding box in world space
+		/*!
+		 * \return Lower corner of the box enclosing the transformed bounding box of the mesh
+		 */
+		glm::vec3 get_world_min() const;
+		//! Gets the upper corner of the bounding box in world space
+		/*!
+		 * \return Upper corner of the box enclosing the transformed bounding box of the mesh
+		 */
+		glm::vec3 get_world_max() const;
+		//! Gets the centre of the bounding sphere in world space
+		/*!
+		 * \return The transformed barycentre of the mesh
+		 */
+		glm::vec3 get_world_centre() const;
+		//! Gets the radius of the bounding sphere in world space
+		/*!
+		 * \return The radius of the mesh times the largest scale of the model matrix
+		 */
+		float get_world_radius() const;
+		//! Gets the matrix transforming the uploaded positions
+		/*!
+		 * \return Model matrix with the dequantization of the positions folded in (the model matrix itself for FORMAT_FLOAT)
+		 */ 
+		glm::mat4 get_position_matrix() const;
+		//! Gets the format of the vertex attributes
+		/*!
+		 * \return The format of the vertex attributes
+		 */ 
+		VertexFormat get_vertex_format() const;
+		//! Gets what is kept of the arrays of the mesh once uploaded
+		/*!
+		 * \return The retention policy, RETENTION_NONE by default
+		 */ 
+		CpuRetention get_cpu_retention() const;
 		
-		//! Sets the model matrix of the object
+		//! Sets the model matrix of the object and moves its bounding volumes
 		void set_model_matrix(const glm::mat4 input_matrix);
+		//! Sets the layout of the vertex buffers and recreates them
+		/*!
+		 * \param layout The new layout
+		 * \return False if the arrays of the mesh could not be read again, the buffers are kept as they were
+		 */
+		bool set_vertex_layout(const VertexLayout layout);
+		//! Sets the format of the vertex attributes and recreates the buffers
+		/*!
+		 * \param format The new format
+		 * \return False if the arrays of the mesh could not be read again, the buffers are kept as they were
+		 */
+		bool set_vertex_format(const VertexFormat format);
+		//! Sets what is kept of the arrays of the mesh once uploaded, and applies it if the buffers are resident
+		/*!
+		 * The released arrays are mapped again from the mesh cache when the buffers are recreated or when more of them
+		 * are to be kept
+		 * \param retention The retention policy
+		 * \return False if the arrays to keep could not be read again, the policy is left unchanged
+		 */
+		bool set_cpu_retention(const CpuRetention retention);
 		
 	private:
-		std::vector<glm::vec3> m_vertices;
-		std::vector<glm::vec3> m_normals;
-		std::vector<glm::vec2> m_uvs;
+		//! Chooses the index type, initializes the model matrix and creates the buffers
+		void initialize();
+		//! Transforms the bounding box and the bounding sphere of the mesh with the model matrix
+		void update_bounds();
+		//! Binds the instance buffer to the locations 4 to 7 of the VAOs, advancing once per instance, or disables them without instances
+		void attach_instances();
+		//! Quantizes the attributes for FORMAT_QUANTIZED and prints the resulting error bounds
+		/*!
+		 * \param positions 4 normalized unsigned shorts per vertex (the last one pads the vertex)
+		 * \param normals 2 normalized shorts per vertex, octahedral encoding
+		 * \param uvs 2 half floats per vertex
+		 */
+		void quantize(std::vector<GLushort>& positions, std::vector<GLshort>& normals, std::vector<glm::detail::hdata>& uvs);
+		//! Fills the bound vertex buffer, or hands the data to the streamer
+		/*!
+		 * \param buffer The buffer bound to GL_ARRAY_BUFFER
+		 * \param data Vertex data
+		 * \param size Size of the data in bytes
+		 * \param vertex_size Size of a vertex in bytes
+		 * \param persistent True if the data outlives the upload, false to let the streamer copy it
+		 */
+		void fill_vertex_buffer(GLuint buffer, const unsigned char* data, size_t size, unsigned int vertex_size, bool persistent);
+		//! Releases the arrays of the mesh according to the retention policy, once the buffers are resident
+		void release_arrays();
+		
+		Mesh* m_mesh;
+		
+		GLenum m_index_type;
 		
 		glm::mat4 m_model_matrix;
+		glm::mat4 m_dequantization_matrix;
+		//~ Bounding volumes in world space, updated with the model matrix
+		glm::vec3 m_world_min;
+		glm::vec3 m_world_max;
+		glm::vec3 m_world_centre;
+		float m_world_radius;
+		
+		VertexLayout m_layout;
+		VertexFormat m_format;
+		CpuRetention m_retention;
 		
 		GLuint m_object_vao;
+		GLuint m_object_depth_vao;
 		GLuint m_object_vertices_vbo;
 		GLuint m_object_normals_vbo;
 		GLuint m_object_uvs_vbo;
+		GLuint m_object_interleaved_vbo;
+		GLuint m_object_materials_vbo;
+		GLuint m_object_indices_ibo;
+		GLuint m_object_instances_vbo;
+		BufferStreamer* m_streamer;
+		
+		//~ Draw ranges of the submeshes, level after level
+		std::vector<GLsizei> m_draw_counts;
+		std::vector<const GLvoid*> m_draw_offsets;
+		std::vector<MeshLod> m_lods;
+		//~ Model matrices of the instances, empty when the object is drawn alone
+		std::vector<glm::mat4> m_instances;
+		//~ Draw list of the clusters kept by the culling
+		std::vector<GLsizei> m_visible_counts;
+		std::vector<const GLvoid*> m_visible_offsets;
+		float m_culled_fraction;
+		std::vector<glm::vec4> m_material_table;
 		
-		const char* m_texture_path;
+		std::string m_texture_path;
+		std::string m_texture_key;
 		GLuint m_diffuse_texture;
 };
@@ -0,0 +1,144 @@
+/***************************************************************************
+									OctreeBuilder.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Partitions a model into an octree of chunks with levels of detail, for the out-of-core rendering
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Partitions a model into an octree of chunks with levels of detail, for the out-of-core rendering
+  * \file OctreeBuilder.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <algorithm>
+#include <SDL/SDL.h>
+
+#include "glm/glm.hpp"
+#include "Mesh.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+/*!
+ * \brief Header of an octree file, followed by the chunks and the table of the nodes
+ */
+struct OctreeFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t number_of_nodes;
+	uint64_t nodes_offset;			/*!< Offset of the table of the nodes, the root first */
+	uint64_t file_size;
+	uint32_t max_vertices;			/*!< Largest number of vertices of a chunk */
+	uint32_t max_indices;			/*!< Largest number of indices of a chunk */
+	float min[3];					/*!< Lower corner of the bounding box of the model */
+	float max[3];					/*!< Upper corner of the bounding box of the model */
+	float barycentre[3];			/*!< Barycentre of the vertices */
+	float average_distance;			/*!< Average distance of the vertices to the barycentre */
+	float diffuse_color[3];			/*!< Color of the first material */
+	uint32_t padding;
+};
+
+/*!
+ * \brief Node of an octree file
+ *
+ * A leaf holds the triangles of the model whose centre lies in its cell. An inner node holds a simplified copy of the
+ * triangles of its children, so that a node is drawn either alone or replaced by all its children.
+ */
+struct OctreeFileNode
+{
+	float min[3];					/*!< Lower corner of the bounding box of the triangles */
+	float max[3];					/*!< Upper corner of the bounding box of the triangles */
+	float error;					/*!< Largest distance to the model, in model units, 0 for a leaf, never lower than the errors of the children */
+	uint32_t first_child;			/*!< Index of the first child, the children follow each other */
+	uint32_t number_of_children;	/*!< Number of children, 0 for a leaf */
+	uint32_t number_of_vertices;	/*!< Number of vertices of the chunk */
+	uint32_t number_of_indices;		/*!< Number of indices of the chunk */
+	uint32_t padding;
+	uint64_t data_offset;			/*!< Offset of the chunk : the vertices, then the 32 bits indices, 16 bytes aligned */
+};
+
+/*!
+ * \brief Vertex of a chunk, laid out as the interleaved vertex buffers of the objects
+ */
+struct OctreeVertex
+{
+	float position[3];
+	float normal[3];
+	float uv[2];
+};
+
+/*!
+ * \brief Partitions a model into an octree of chunks with levels of detail, for the out-of-core rendering
+ *
+ * The triangles are sorted along a Morton curve of their centres, whose prefixes are the cells of the octree : a cell
+ * is split until it holds no more than OCTREE_CHUNK_TRIANGLES triangles. The nodes are then built depth first, each
+ * inner node simplifying the union of its children, and written as soon as they are done ; only the chunks of the
+ * children of the nodes on the current path are in memory. The partition holds 8 bytes per triangle besides the
+ * chunks. The arrays of the model are memory-mapped from its mesh cache, written by a first load in the viewer ;
+ * without it the model is imported in memory, at about 40 bytes per vertex and 12 per triangle.
+ * The files are written by ./3DObs --build-octree <model>, next to their model with the .octree extension.
+ */
+class OctreeBuilder
+{
+	public:
+		//! Builds the octree asked on the command line, if any
+		/*!
+		 * \param argc Number of arguments
+		 * \param argv Arguments
+		 * \return The exit code of the build, -1 if no build was asked
+		 */
+		static int run(int argc, char** argv);
+		//! Builds the octree of a mesh
+		/*!
+		 * \param mesh The mesh, only its full resolution is used
+		 * \param path Path of the octree file
+		 * \param chunk_triangles Largest number of triangles of a leaf
+		 * \return True if the file was written
+		 */
+		static bool build(const Mesh& mesh, const std::string& path, unsigned int chunk_triangles);
+		//! Tells if a file is an octree file
+		/*!
+		 * \param filename Name of the file
+		 * \return True if the name ends with the extension of the octree files
+		 */
+		static bool is_octree_file(const std::string& filename);
+		//! Checks the header of an octree file
+		/*!
+		 * \param header The header
+		 * \param file_size Size of the file
+		 * \return True if the file has the current version and its table of the nodes lies within it
+		 */
+		static bool check_header(const OctreeFileHeader& header, uint64_t file_size);
+};
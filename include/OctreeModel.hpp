@@ -0,0 +1,272 @@
+/***************************************************************************
+									OctreeModel.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Model drawn out of core from an octree file, its chunks paged in and out of a pool of GPU buffers
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Model drawn out of core from an octree file, its chunks paged in and out of a pool of GPU buffers
+  * \file OctreeModel.hpp
+*/
+
+#pragma once
+
+#ifdef _WIN32
+	#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cfloat>
+#include <algorithm>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+#include "glm/glm.hpp"
+#include "OctreeBuilder.hpp"
+#include "TextureDecoder.hpp"
+#include "TextureArrayManager.hpp"
+#include "Camera.hpp"
+#include "Frustum.hpp"
+
+/*!
+ * \brief Chunk read by the loader thread, waiting for its upload
+ */
+struct OctreePage
+{
+	unsigned int node;					/*!< Node of the chunk */
+	std::vector<unsigned char> data;	/*!< Vertices then indices of the chunk, as in the file */
+};
+
+/*!
+ * \brief Model drawn out of core from an octree file, its chunks paged in and out of a pool of GPU buffers
+ *
+ * Only the table of the nodes stays in memory. Each frame the octree is walked from the root with the frusta of both
+ * eyes : a visible node is replaced by its children while its error on screen, seen from the nearest eye, is above the
+ * threshold and all its visible children are resident ; the missing ones are asked to the loader thread, the largest
+ * errors first. The loader copies their chunks out of the memory-mapped file, as long as the chunks waiting for their
+ * upload stay within the CPU budget, and the render thread uploads them within a byte budget per frame.
+ * The GPU pool is allocated once : as many slots of the size of the largest chunk as the GPU budget holds. A new
+ * chunk takes a free slot or the one least recently used, never one of the nodes walked in the current frame.
+ */
+class OctreeModel
+{
+	public:
+		//! Default size of the GPU pool, in bytes
+		static const size_t DEFAULT_GPU_BUDGET = 256 << 20;
+		//! Default size of the chunks read and not uploaded yet, in bytes
+		static const size_t DEFAULT_CPU_BUDGET = 64 << 20;
+
+		//! Constructor, maps the file, allocates the pool and starts the loader thread
+		/*!
+		 * \param filename Path of the octree file
+		 * \param texture_path Path of the texture
+		 * \param gpu_budget Size of the GPU pool in bytes
+		 * \param cpu_budget Size of the chunks read and not uploaded yet, in bytes
+		 */
+		OctreeModel(const char* filename, const char* texture_path, size_t gpu_budget = DEFAULT_GPU_BUDGET, size_t cpu_budget = DEFAULT_CPU_BUDGET) throw (int);
+		//! Destructor, stops the loader thread and frees the pool
+		~OctreeModel();
+
+		//! Uploads the chunks read since the last frame, chooses the nodes to draw and asks for the missing ones
+		/*!
+		 * \param first First camera of the rig
+		 * \param second Second camera of the rig
+		 * \param projection_scale Half the height of the screen in pixels times the focal length of the projection
+		 * \param max_error Largest error of a node on screen, in pixels
+		 * \param upload_budget Bytes uploaded per frame, at least one chunk
+		 */
+		void update(const Camera& first, const Camera& second, float projection_scale, float max_error, size_t upload_budget);
+		//! Draws the chosen nodes, with their own VAO
+		void draw() const;
+
+		//! Sets the model matrix
+		/*!
+		 * \param model_matrix The model matrix, of uniform scale
+		 */
+		void set_model_matrix(const glm::mat4& model_matrix);
+		//! Gets the model matrix
+		/*!
+		 * \return The model matrix
+		 */
+		glm::mat4 get_model_matrix() const;
+		//! Gets the barycentre of the vertices of the model
+		/*!
+		 * \return The barycentre, in model space
+		 */
+		glm::vec3 get_barycentre() const;
+		//! Gets the average distance between the vertices and the barycentre
+		/*!
+		 * \return The average distance, in model units
+		 */
+		float get_average_distance() const;
+		//! Gets the texture array holding the texture
+		/*!
+		 * \return The texture array
+		 */
+		GLuint get_diffuse_texture() const;
+		//! Gets the material table
+		/*!
+		 * \return One entry : the tint and the layer of the texture
+		 */
+		const std::vector<glm::vec4>& get_material_table() const;
+		//! Gets the number of nodes
+		/*!
+		 * \return The number of nodes of the octree
+		 */
+		unsigned int get_number_of_nodes() const;
+		//! Gets the number of slots of the GPU pool
+		/*!
+		 * \return The number of chunks the pool holds
+		 */
+		unsigned int get_number_of_slots() const;
+		//! Gets the number of resident nodes
+		/*!
+		 * \return The number of occupied slots
+		 */
+		unsigned int get_number_of_resident_nodes() const;
+		//! Gets the number of nodes drawn
+		/*!
+		 * \return The number of nodes chosen by the last update
+		 */
+		unsigned int get_number_of_drawn_nodes() const;
+		//! Gets the number of triangles drawn
+		/*!
+		 * \return The number of triangles of the nodes chosen by the last update
+		 */
+		unsigned int get_number_of_drawn_triangles() const;
+		//! Gets the number of nodes asked to the loader
+		/*!
+		 * \return The number of missing nodes found by the last update
+		 */
+		unsigned int get_number_of_requests() const;
+
+	private:
+		//! Entry point of the loader thread
+		/*!
+		 * \param data The model
+		 * \return 0
+		 */
+		static int run_loader(void* data);
+		//! Loop of the loader thread
+		void load();
+		//! Copies a chunk out of the file
+		/*!
+		 * \param node The node
+		 * \param data Receives the vertices then the indices
+		 */
+		void read_chunk(unsigned int node, std::vector<unsigned char>& data);
+		//! Gets the size of a chunk
+		/*!
+		 * \param node The node
+		 * \return The size of its vertices and its indices, in bytes
+		 */
+		size_t get_chunk_size(unsigned int node) const;
+		//! Chooses the nodes of a subtree to draw
+		/*!
+		 * \param node Root of the subtree, resident
+		 * \param eyes Frustum enclosing the ones of both eyes, in model space
+		 * \param viewpoints Positions of the eyes, in model space
+		 * \param projection_scale Half the height of the screen in pixels times the focal length of the projection
+		 * \param max_error Largest error of a node on screen, in pixels
+		 * \param requests Receives the missing nodes and their priorities
+		 */
+		void select(unsigned int node, const Frustum& eyes, const glm::vec3 viewpoints[2], float projection_scale, float max_error, std::vector<std::pair<float, unsigned int> >& requests);
+		//! Computes the error of a node on screen
+		/*!
+		 * \param node The node
+		 * \param viewpoints Positions of the eyes, in model space
+		 * \param projection_scale Half the height of the screen in pixels times the focal length of the projection
+		 * \return The error in pixels seen from the nearest eye, FLT_MAX if an eye is in the bounding box of the node
+		 */
+		float get_projected_error(unsigned int node, const glm::vec3 viewpoints[2], float projection_scale) const;
+		//! Finds a slot for a new chunk, evicting the least recently used node if the pool is full
+		/*!
+		 * \return The slot, -1 if every slot holds a node walked in the current frame
+		 */
+		int acquire_slot();
+		//! Uploads a chunk into a slot of the pool
+		/*!
+		 * \param page The chunk
+		 * \param slot The slot
+		 */
+		void upload(const OctreePage& page, unsigned int slot);
+		//! Loads the texture into a layer of a texture array
+		/*!
+		 * \param texture_path Path of the texture, a white layer tinted with the color of the model if it cannot be decoded
+		 */
+		void load_texture(const char* texture_path);
+
+		//~ File and table of the nodes
+		std::string m_filename;
+		OctreeFileHeader m_header;
+		std::vector<OctreeFileNode> m_nodes;
+#ifdef _WIN32
+		FILE* m_file;
+#else
+		void* m_mapping;
+		size_t m_mapping_size;
+#endif
+
+		//~ Pool of slots, each one of the size of the largest chunk
+		GLuint m_vao;
+		GLuint m_vertices_vbo;
+		GLuint m_indices_ibo;
+		unsigned int m_number_of_slots;
+		std::vector<int> m_slot_nodes;
+		std::vector<unsigned int> m_slot_last_use;
+		std::vector<int> m_node_slots;
+		unsigned int m_frame;
+
+		//~ Nodes chosen by the last update
+		std::vector<GLsizei> m_draw_counts;
+		std::vector<const GLvoid*> m_draw_offsets;
+		std::vector<GLint> m_draw_base_vertices;
+		unsigned int m_drawn_triangles;
+		unsigned int m_number_of_requests;
+
+		//~ Loader thread and what it shares with the render thread
+		SDL_Thread* m_thread;
+		SDL_mutex* m_mutex;
+		SDL_cond* m_condition;
+		bool m_stop;
+		std::vector<unsigned int> m_requests;
+		std::vector<unsigned char> m_loading;
+		std::vector<OctreePage*> m_pages;
+		size_t m_staged_size;
+		size_t m_cpu_budget;
+		//~ Chunks read but not uploaded yet, on the render thread
+		std::vector<OctreePage*> m_waiting_pages;
+
+		//~ Placement and appearance
+		glm::mat4 m_model_matrix;
+		std::vector<glm::vec4> m_material_table;
+		TextureArrayRange m_texture_range;
+};
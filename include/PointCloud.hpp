@@ -0,0 +1,299 @@
+/***************************************************************************
+									PointCloud.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Point cloud drawn as splats, through a nested octree of subsamples
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Point cloud drawn as splats, through a nested octree of subsamples
+  * \file PointCloud.hpp
+*/
+
+#pragma once
+
+#ifdef _WIN32
+	#define GLEW_STATIC
+#endif
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <cfloat>
+#include <queue>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+#include "Camera.hpp"
+#include "Frustum.hpp"
+
+/*!
+ * \brief Point of a cloud, as stored in the vertex buffer
+ */
+struct PointVertex
+{
+	float position[3];		/*!< Position, relative to the first point of the file */
+	GLshort normal[2];		/*!< Octahedral-encoded normal, normalized shorts */
+	GLubyte color[4];		/*!< Color in rgb ; a is 255 if the normal is known, 0 for a splat facing the viewer */
+};
+
+/*!
+ * \brief Node of the nested octree
+ *
+ * A node holds at most one point per cell of a grid laid over its cube, the points it rejects go down to its children.
+ * Its points and those of its children thus make a denser sample : the nodes are drawn along with their ancestors.
+ */
+struct PointNode
+{
+	glm::vec3 min;						/*!< Corner of the cube of the node */
+	float size;							/*!< Side of the cube */
+	unsigned int first_point;			/*!< First point of the node in the points of the cloud */
+	unsigned int number_of_points;		/*!< Number of points of the node */
+	unsigned int first_child;			/*!< First child, the children follow each other */
+	unsigned int number_of_children;	/*!< Number of children, the empty octants have none */
+	unsigned int depth;					/*!< Depth of the node, 0 for the root */
+};
+
+/*!
+ * \brief Point cloud drawn as splats, through a nested octree of subsamples
+ *
+ * The cloud is read and its octree built on the loader thread, the GL objects are created on the render thread. The
+ * nodes are chosen once per frame for both eyes, the largest on screen first, until the point budget is spent ; the
+ * missing ones are uploaded into a pool of slots of fixed size, the least recently used being reused.
+ *
+ * The splats are written in the geometry buffer like the triangles of the objects, so that the SSAO and the lighting
+ * apply to them.
+ */
+class PointCloud
+{
+	public:
+		//! Size of the pool of slots, in bytes
+		static const size_t DEFAULT_GPU_BUDGET = 512 << 20;
+
+		//! Constructor, reads the cloud and builds its octree
+		/*!
+		 * \param filename Path of a PLY file without faces, or of an XYZ file
+		 * \throw 0 if the file cannot be read or holds no point
+		 */
+		PointCloud(const char* filename) throw (int);
+		//! Destructor
+		~PointCloud();
+
+		//! Tells if a file is a point cloud
+		/*!
+		 * \param filename Name of the file
+		 * \return True for the XYZ files and the PLY files whose header declares vertices but no face
+		 */
+		static bool is_point_cloud_file(const std::string& filename);
+
+		//! Creates the pool of slots and the VAO, on the render thread
+		/*!
+		 * \param gpu_budget Size of the pool, in bytes
+		 */
+		void create_buffers(size_t gpu_budget = DEFAULT_GPU_BUDGET);
+		//! Chooses the nodes drawn by both eyes and uploads the missing ones
+		/*!
+		 * \param first First camera of the rig
+		 * \param second Second camera of the rig
+		 * \param projection_scale Pixels per unit at distance 1
+		 * \param point_budget Highest number of points drawn
+		 * \param upload_budget Highest number of bytes uploaded
+		 */
+		void update(const Camera& first, const Camera& second, float projection_scale, unsigned int point_budget, size_t upload_budget);
+		//! Draws the chosen nodes as points, with the splat program bound
+		/*!
+		 * \param spacing_location Location of the uniform receiving the spacing of the points, in world units
+		 */
+		void draw(GLint spacing_location) const;
+
+		//~ Setters
+		//! Sets the model matrix
+		/*!
+		 * \param model_matrix The new model matrix
+		 */
+		void set_model_matrix(const glm::mat4& model_matrix);
+
+		//~ Getters
+		//! Gets the model matrix
+		/*!
+		 * \return The model matrix
+		 */
+		glm::mat4 get_model_matrix() const;
+		//! Gets the barycentre of the points
+		/*!
+		 * \return The barycentre, in model space
+		 */
+		glm::vec3 get_barycentre() const;
+		//! Gets the average distance of the points to their barycentre
+		/*!
+		 * \return The average distance
+		 */
+		float get_average_distance() const;
+		//! Gets the number of points
+		/*!
+		 * \return The number of points of the cloud
+		 */
+		unsigned int get_number_of_points() const;
+		//! Gets the number of nodes
+		/*!
+		 * \return The number of nodes of the octree
+		 */
+		unsigned int get_number_of_nodes() const;
+		//! Gets the number of slots
+		/*!
+		 * \return The number of nodes the pool can hold
+		 */
+		unsigned int get_number_of_slots() const;
+		//! Gets the number of resident nodes
+		/*!
+		 * \return The number of nodes in the pool
+		 */
+		unsigned int get_number_of_resident_nodes() const;
+		//! Gets the number of drawn nodes
+		/*!
+		 * \return The number of nodes chosen by the last update
+		 */
+		unsigned int get_number_of_drawn_nodes() const;
+		//! Gets the number of drawn points
+		/*!
+		 * \return The number of points chosen by the last update
+		 */
+		unsigned int get_number_of_drawn_points() const;
+
+	private:
+		//! Reads a PLY file
+		/*!
+		 * \param filename Path of the file
+		 * \throw 0 if the file is not a readable point cloud
+		 */
+		void read_ply(const char* filename) throw (int);
+		//! Reads an XYZ file : x y z, followed by an intensity, a color, a normal, or a color and a normal
+		/*!
+		 * \param filename Path of the file
+		 * \throw 0 if the file cannot be read
+		 */
+		void read_xyz(const char* filename) throw (int);
+		//! Parses the lines of a text in parallel, the points of the chunks following each other
+		/*!
+		 * \param begin First character of the text
+		 * \param end Character after the last one of the text
+		 * \param data The parsing job, with the layout of the lines
+		 * \param points The points read
+		 */
+		static void parse_text(const char* begin, const char* end, void* data, std::vector<PointVertex>& points);
+		//! Parses the lines of a range of chunks, run by the thread pool
+		/*!
+		 * \param begin First chunk of the range
+		 * \param end Chunk after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void parse_lines(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Copies the points of a range of chunks to their place, run by the thread pool
+		/*!
+		 * \param begin First chunk of the range
+		 * \param end Chunk after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The parsing job
+		 */
+		static void gather_lines(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Converts a range of vertices of a binary PLY file, run by the thread pool
+		/*!
+		 * \param begin First group of POINT_RECORDS_PER_TASK vertices of the range
+		 * \param end Group after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The conversion job
+		 */
+		static void convert_records(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Builds the octree, the points being reordered node after node
+		void build_octree();
+		//! Builds the subtrees of a range of children of the root, run by the thread pool
+		/*!
+		 * \param begin First child of the range
+		 * \param end Child after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The building job
+		 */
+		static void build_subtrees(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Tells if a node is seen by the eyes
+		/*!
+		 * \param node The node
+		 * \param eyes Frustum enclosing both eyes, in model space
+		 * \return True if the cube of the node intersects the frustum
+		 */
+		bool is_visible(unsigned int node, const Frustum& eyes) const;
+		//! Computes the size on screen of a length at a node
+		/*!
+		 * \param node The node
+		 * \param length The length, in model space
+		 * \param viewpoints Positions of the eyes, in model space
+		 * \param projection_scale Pixels per unit at distance 1
+		 * \return The size in pixels from the nearest eye, FLT_MAX inside the node
+		 */
+		float get_projected_size(unsigned int node, float length, const glm::vec3 viewpoints[2], float projection_scale) const;
+		//! Takes a slot for a node, free or the least recently used one
+		/*!
+		 * \return The slot, -1 if every slot is used by the current frame
+		 */
+		int acquire_slot();
+
+		//~ Points, reordered node after node, and the octree
+		std::vector<PointVertex> m_points;
+		std::vector<PointNode> m_nodes;
+		unsigned int m_max_node_points;
+		glm::vec3 m_barycentre;
+		float m_average_distance;
+
+		//~ Pool of slots, each holding the points of one node
+		GLuint m_vao;
+		GLuint m_vbo;
+		unsigned int m_number_of_slots;
+		std::vector<int> m_slot_nodes;
+		std::vector<unsigned int> m_slot_last_use;
+		std::vector<int> m_node_slots;
+		unsigned int m_frame;
+
+		//~ Nodes chosen by the last update, in the order of their choice
+		std::vector<unsigned int> m_drawn_nodes;
+		std::vector<unsigned int> m_node_drawn_frame;
+		//~ Depth whose spacing the splats of a drawn node take, the deepest one covering it without holes
+		std::vector<unsigned int> m_node_splat_depths;
+		unsigned int m_drawn_points;
+		//~ Draw lists, grouped by splat depth : the depth and the first draw of each group
+		std::vector<GLint> m_draw_firsts;
+		std::vector<GLsizei> m_draw_counts;
+		std::vector<std::pair<unsigned int, unsigned int> > m_draw_groups;
+
+		glm::mat4 m_model_matrix;
+};
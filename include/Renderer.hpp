@@ -42,13 +42,18 @@
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <SDL/SDL.h>
 #include <dirent.h>
 #include <vector>
+#include <algorithm>
 
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 #include "Object.hpp"
+#include "Scene.hpp"
+#include "ModelLoader.hpp"
+#include "OctreeModel.hpp"
 #include "Rig.hpp"
 #include "Framebuffer.hpp"
 #include "imgui/imgui.h"
@@ -81,11 +86,73 @@ class Renderer
 		void find_available_files(const char* directory,std::vector<std::string> &container);
 		//! Loads an object in the renderer
 		/*!
-		 * Loads an object in the renderer
+		 * Asks the loader thread for the model, the current object is rendered until the new one is ready
 		 * \param model The model to load
 		 * \param texture The texture to load
 		 */ 
 		void load_object(const std::string model,const std::string texture);
+		//! Takes the model loaded by the loader thread, if any, and replaces the current object with it
+		void finish_loading();
+		//! Prints the resident memory before the upload of the loaded object and once its buffers are resident
+		void print_resident_memory() const;
+		//! Places a model in front of the rig
+		/*!
+		 * \param barycentre Barycentre of the model, in model space
+		 * \param average_distance Average distance of the vertices to the barycentre
+		 * \return The model matrix, scaling the model to 2/3 of the convergence distance
+		 */
+		glm::mat4 place_model(const glm::vec3& barycentre, float average_distance) const;
+		//! Gets the model matrix of the loaded model, the object, the octree or the point cloud
+		/*!
+		 * \return The model matrix, the identity if no model is loaded
+		 */
+		glm::mat4 get_loaded_model_matrix() const;
+		//! Chooses the level of detail of an object for both eyes
+		/*!
+		 * \param object The object
+		 * \return The coarsest level whose error stays under LOD_MAX_ERROR pixels, 0 when the levels of detail are off
+		 */
+		unsigned int select_lod(const Object* object) const;
+		//! Places a grid of copies of the object
+		/*!
+		 * \param count Number of copies
+		 * \return One translation per copy, row after row going away from the cameras
+		 */
+		std::vector<glm::mat4> make_instance_grid(unsigned int count) const;
+		//! Gives the object the number of instances chosen in the GUI
+		void update_instances();
+		//! Culls the objects of the scene, chooses the levels of detail of the kept ones and culls their clusters
+		/*!
+		 * \param light Frustum of the light, in world space
+		 */
+		void cull_objects(const Frustum& light);
+		//! Draws the objects seen by the eyes in the bound geometry buffer, the view and the projection being set
+		/*!
+		 * \return The number of texture binds
+		 */
+		unsigned int draw_visible_objects() const;
+		//! Draws the objects seen by the light with the shadow program, the matrices of the light being set
+		void draw_shadow_casters() const;
+		//! Draws the splats of the point cloud in the bound geometry buffer, with their own program
+		/*!
+		 * \param camera The camera of the eye
+		 */
+		void draw_point_cloud(const Camera* camera) const;
+		//! Casts a ray from the first camera through a pixel
+		/*!
+		 * \param x Column of the pixel
+		 * \param y Row of the pixel, from the top
+		 * \return The ray, in world space
+		 */
+		Ray view_ray(const float x, const float y) const;
+		//! Moves the convergence towards the depth seen at the centre of the view, when the auto-convergence is on
+		void update_convergence();
+		//! Draws an object with the bound VAO for an eye, only its visible clusters when they are culled
+		/*!
+		 * \param object The object
+		 * \param level Its level of detail
+		 */
+		void draw_object(const Object* object, unsigned int level) const;
 		//! Loads the normal map
 		void load_normal_map();
 		//! Renders the GUI
@@ -109,6 +176,30 @@ class Renderer
 		 */ 
 		void blend_SSAO(const Framebuffer* output_frambuffer, const GLuint color_map, const GLuint occlusion_map);
 		void toggle_ssao(const int enable_disable);
+		//! Measures the cost of the vertex fetch of the loaded object for every vertex layout
+		/*!
+		 * The object is drawn several times in the geometry buffer and in a depth-only pass for each layout, the GPU time is printed
+		 */
+		void benchmark_vertex_layouts();
+		//! Compares drawing copies of the loaded object one by one and with instancing
+		/*!
+		 * 1000 then 10000 copies of the coarsest level are drawn in the geometry buffer, with one set of draws per copy then
+		 * with one instanced draw per range ; the number of draws, the CPU time of the submission and the GPU time are printed
+		 */
+		void benchmark_instancing();
+		//! Finds the point of the object seen through a pixel of the first camera
+		/*!
+		 * \param x Column of the pixel
+		 * \param y Row of the pixel, from the top
+		 * \param point Receives the point hit, in world space
+		 * \return False if the ray through the pixel hits nothing
+		 */
+		bool pick(const int x, const int y, glm::vec3& point) const;
+		//! Sets the convergence distance to the depth of a point
+		/*!
+		 * \param point The point, in world space
+		 */
+		void converge_at(const glm::vec3& point);
 		//! Gets the rig maintaining the two cameras
 		/*!
 		 * \return The rig
@@ -164,7 +255,15 @@ class Renderer
 		GLuint loadProgram(const char* vertexShaderFile, const char* fragmentShaderFile);
 		
 		Rig* m_rig;
+		//~ Objects drawn, and the last loaded model among them
+		Scene* m_scene;
 		Object* m_object;
+		unsigned int m_object_node;
+		//~ Model drawn out of core instead of the object, NULL if none
+		OctreeModel* m_octree;
+		//~ Point cloud drawn instead of the object, NULL if none
+		PointCloud* m_cloud;
+		ModelLoader* m_model_loader;
 		Object* m_quad_left;
 		Object* m_quad_right;
 		int m_view_mode;
@@ -189,9 +288,13 @@ class Renderer
 		
 		GLuint m_geometry_buffer_shader_program;
 		GLuint m_geometry_buffer_shader_model_matrix_location;
+		GLuint m_geometry_buffer_shader_normal_matrix_location;
+		GLuint m_geometry_buffer_shader_octahedral_normals_location;
+		GLuint m_geometry_buffer_shader_instanced_location;
 		GLuint m_geometry_buffer_shader_view_matrix_location;
 		GLuint m_geometry_buffer_shader_projection_matrix_location;
 		GLuint m_geometry_buffer_shader_diffuse_location;
+		GLuint m_geometry_buffer_shader_material_table_location;
 
 		GLuint m_light_accumulation_shader_program;
 		GLuint m_light_accumulation_camera_position_location;
@@ -234,6 +337,15 @@ class Renderer
 		GLuint m_shadow_projection_matrix_location;
 		GLuint m_shadow_model_matrix_location;
 		GLuint m_shadow_view_matrix_location;
+		GLuint m_shadow_instanced_location;
+
+		GLuint m_point_splat_shader_program;
+		GLuint m_point_splat_model_matrix_location;
+		GLuint m_point_splat_view_matrix_location;
+		GLuint m_point_splat_projection_matrix_location;
+		GLuint m_point_splat_eye_position_location;
+		GLuint m_point_splat_spacing_location;
+		GLuint m_point_splat_viewport_height_location;
 
 		float m_lightIntensity;
 		float m_radiusLight;
@@ -279,4 +391,34 @@ class Renderer
 		float m_blur_coef_value;
 		
 		bool m_is_ssao_enabled;
+		
+		//~ Quantized vertex attributes for the loaded models
+		bool m_compressed_vertices;
+		//~ What the loaded models keep of their arrays once uploaded, and the resident memory before the upload of the last one
+		CpuRetention m_cpu_retention;
+		size_t m_resident_memory_before_upload;
+		
+		//~ Levels of detail of the visible objects and of the shadow casters, in the order of the lists of the scene
+		bool m_use_lods;
+		std::vector<unsigned int> m_visible_lods;
+		std::vector<unsigned int> m_caster_lods;
+		
+		//~ Culling of the clusters of triangles of the visible objects against both eyes
+		bool m_cull_clusters;
+		
+		//~ Copies of the object drawn with instancing, 1 for the object alone
+		float m_number_of_instances_value;
+		
+		//~ Size above which the texture arrays no object uses are deleted, in MB
+		float m_texture_cache_budget_value;
+		
+		//~ Points of the point cloud drawn per frame, in millions
+		float m_point_budget_value;
+		
+		//~ Texture binds of the geometry buffer passes in the last frame, and as many as with one texture per object
+		unsigned int m_texture_binds;
+		unsigned int m_texture_binds_per_object;
+		
+		//~ Convergence driven by the depth at the centre of the view
+		bool m_auto_convergence;
 };
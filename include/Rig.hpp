@@ -103,6 +103,12 @@ class Rig
 		void change_dioc(const float delta, const float dc, const float l);
 		//! Resets the dioc to 6.5cm and applies the proper effects to the cameras
 		void reset_dioc(const float dc, const float l);
+		//! Recomputes the projections of the cameras for a new convergence distance
+		/*!
+		 * \param dc The distance between the camera and the virtual plane
+		 * \param l The virtual screen width
+		 */
+		void set_convergence(const float dc, const float l);
 		//! Gets the position of the rig
 		/*!
 		 * \return The position of the rig
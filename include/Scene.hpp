@@ -0,0 +1,160 @@
+/***************************************************************************
+									Scene.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Objects of a scene, their transforms, bounds and render flags
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Objects of a scene, their transforms, bounds and render flags
+  * \file Scene.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <cfloat>
+#include <algorithm>
+
+#include "glm/glm.hpp"
+#include "Object.hpp"
+#include "Frustum.hpp"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Render flags of a node
+ */
+enum SceneFlag
+{
+	SCENE_HIDDEN = 1,		/*!< Neither drawn nor casting shadows */
+	SCENE_NO_SHADOW = 2		/*!< Drawn, but absent from the shadow map */
+};
+
+/*!
+ * \brief Objects of a scene, their transforms, bounds and render flags, one array per attribute
+ *
+ * A node holds an object, or none to group other nodes, and a transform relative to its parent. A parent is always
+ * added before its children, so that the nodes are sorted from the roots to the leaves. Only the world matrices of the
+ * nodes whose transform changed, and of their descendants, are recomputed ; they are processed depth after depth,
+ * each depth in parallel batches. The culling then compacts the visible nodes into two lists, one for the eyes and one
+ * for the light.
+ */
+class Scene
+{
+	public:
+		//! Constructor
+		Scene();
+		//! Destructor, deletes the objects
+		~Scene();
+
+		//! Adds a node
+		/*!
+		 * \param object The object, owned by the scene afterwards, NULL for a group
+		 * \param local_matrix Transform relative to the parent
+		 * \param parent Index of the parent, -1 for a root
+		 * \return The index of the node
+		 */
+		unsigned int add(Object* object, const glm::mat4& local_matrix, int parent = -1);
+		//! Deletes every node and its object
+		void clear();
+		//! Recomputes the world matrices and the bounds of the nodes that moved
+		void update();
+		//! Fills the lists of the nodes seen by the eyes and by the light
+		/*!
+		 * \param eyes Frustum enclosing the ones of both eyes, in world space
+		 * \param light Frustum of the light, in world space
+		 */
+		void cull(const Frustum& eyes, const Frustum& light);
+
+		//! Sets the transform of a node relatively to its parent
+		/*!
+		 * \param node Index of the node
+		 * \param local_matrix The new transform, its descendants move with it at the next update
+		 */
+		void set_local_matrix(unsigned int node, const glm::mat4& local_matrix);
+		//! Sets the render flags of a node
+		/*!
+		 * \param node Index of the node
+		 * \param flags Combination of SceneFlag
+		 */
+		void set_flags(unsigned int node, unsigned int flags);
+		//! Marks a node for the next update, after the bounds of its object changed
+		/*!
+		 * \param node Index of the node
+		 */
+		void invalidate(unsigned int node);
+
+		//! Gets the number of nodes
+		/*!
+		 * \return The number of nodes, groups included
+		 */
+		unsigned int get_number_of_nodes() const;
+		//! Gets the object of a node
+		/*!
+		 * \param node Index of the node
+		 * \return The object, NULL for a group
+		 */
+		Object* get_object(unsigned int node) const;
+		//! Gets the transform of a node in world space
+		/*!
+		 * \param node Index of the node
+		 * \return The world matrix computed by the last update
+		 */
+		const glm::mat4& get_world_matrix(unsigned int node) const;
+		//! Gets the nodes seen by the eyes
+		/*!
+		 * \return The indices of the nodes kept by the last culling, in the order of the nodes
+		 */
+		const std::vector<unsigned int>& get_visible() const;
+		//! Gets the nodes seen by the light
+		/*!
+		 * \return The indices of the nodes casting a shadow, in the order of the nodes
+		 */
+		const std::vector<unsigned int>& get_shadow_casters() const;
+
+	private:
+		//! Computes the world matrices and the bounds of a range of the dirty nodes of a depth
+		static void update_nodes(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+
+		//~ One entry per node
+		std::vector<Object*> m_objects;
+		std::vector<int> m_parents;
+		std::vector<unsigned int> m_depths;
+		std::vector<glm::mat4> m_local_matrices;
+		std::vector<glm::mat4> m_world_matrices;
+		std::vector<glm::vec3> m_world_min;
+		std::vector<glm::vec3> m_world_max;
+		std::vector<unsigned char> m_flags;
+		std::vector<unsigned char> m_dirty;
+
+		//~ Dirty nodes sorted by depth, and the first one of each depth
+		std::vector<unsigned int> m_update_list;
+		std::vector<unsigned int> m_depth_starts;
+
+		//~ Results of the culling
+		std::vector<unsigned int> m_visible;
+		std::vector<unsigned int> m_shadow_casters;
+};
@@ -0,0 +1,128 @@
+/***************************************************************************
+									TextureArrayManager.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Texture arrays shared by the objects whose textures have the same size
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Texture arrays shared by the objects whose textures have the same size
+  * \file TextureArrayManager.hpp
+*/
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <algorithm>
+
+/*!
+ * \brief Consecutive layers of a texture array
+ */
+struct TextureArrayRange
+{
+	GLuint texture;					/*!< Texture array holding the layers, 0 if none */
+	unsigned int first_layer;		/*!< First layer of the range */
+	unsigned int number_of_layers;	/*!< Number of layers of the range */
+};
+
+/*!
+ * \brief Texture arrays shared by the objects whose textures have the same size
+ *
+ * The arrays, or pages, are allocated per format, size and number of levels, with as many layers as fit in the page size.
+ * Each object takes a range of layers of a page and addresses them through its material table : the objects of a page
+ * are drawn without binding another texture. A page is deleted when its last range is released.
+ */
+class TextureArrayManager
+{
+	public:
+		//! Constructor
+		/*!
+		 * \param page_size Size in bytes of a page, unless a single range needs more
+		 */
+		TextureArrayManager(size_t page_size = DEFAULT_PAGE_SIZE);
+		//! Destructor, the pages have to be deleted by clear() while the GL context exists
+		~TextureArrayManager();
+
+		//! Default size of a page, in bytes
+		static const size_t DEFAULT_PAGE_SIZE = 64 << 20;
+
+		//! Gets the manager shared by the application
+		/*!
+		 * \return The shared manager
+		 */
+		static TextureArrayManager& get_shared();
+
+		//! Reserves layers in a page of a given format, creating the page if none has room
+		/*!
+		 * \param internal_format Format of the layers, compressed or not
+		 * \param width Width of the layers
+		 * \param height Height of the layers
+		 * \param levels Number of levels of the layers
+		 * \param layer_size Size in bytes of a layer with its levels
+		 * \param count Number of consecutive layers
+		 * \return The range, its layers are still to be uploaded
+		 */
+		TextureArrayRange allocate(GLenum internal_format, int width, int height, unsigned int levels, size_t layer_size, unsigned int count);
+		//! Frees the layers of a range
+		/*!
+		 * \param range The range
+		 */
+		void release(const TextureArrayRange& range);
+		//! Deletes every page
+		void clear();
+
+		//! Gets the number of pages
+		/*!
+		 * \return The number of texture arrays
+		 */
+		unsigned int get_number_of_pages() const;
+		//! Gets the number of layers in use
+		/*!
+		 * \return The number of reserved layers of every page
+		 */
+		unsigned int get_number_of_layers() const;
+
+	private:
+		//! Texture array and the layers it gives out
+		struct Page
+		{
+			GLuint texture;
+			GLenum internal_format;
+			int width;
+			int height;
+			unsigned int levels;
+			std::vector<bool> used;
+		};
+
+		//! Creates the storage of a page
+		/*!
+		 * \param page The page, with its format, size and number of layers
+		 */
+		static void create_storage(Page& page);
+
+		std::vector<Page> m_pages;
+		size_t m_page_size;
+};
@@ -0,0 +1,170 @@
+/***************************************************************************
+									TextureCache.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Texture arrays shared between the objects, kept after their last use
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Texture arrays shared between the objects, kept after their last use
+  * \file TextureCache.hpp
+*/
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <list>
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+#include "TextureArrayManager.hpp"
+
+/*!
+ * \brief Texture array of the cache and what the objects need to use it
+ */
+struct TextureCacheEntry
+{
+	std::string key;							/*!< Canonical paths and content hashes of the layers */
+	TextureArrayRange range;					/*!< Layers of the texture in a page of the texture array manager */
+	std::vector<unsigned int> material_layers;	/*!< Layer of each material in the page, the first one of the range for the ones without texture */
+	size_t bytes;								/*!< Size of the layers with their mipmaps */
+	unsigned int references;					/*!< Number of objects using the texture */
+};
+
+/*!
+ * \brief Texture arrays shared between the objects, kept after their last use
+ *
+ * The arrays are keyed by the canonical paths of their layers and a hash of the content of the files, so that a
+ * texture chosen again is reused and a file changed on the disk is not. The textures no object uses any more are kept
+ * in least recently used order, the layers of the oldest ones are released once the cache exceeds its budget.
+ * The lookups may come from any thread, the other calls need the GL context.
+ */
+class TextureCache
+{
+	public:
+		//! Constructor
+		/*!
+		 * \param budget Size in bytes above which the unused textures are deleted
+		 */
+		TextureCache(size_t budget = DEFAULT_BUDGET);
+		//! Destructor, the textures have to be released by clear() while the GL context exists
+		~TextureCache();
+
+		//! Default budget, in bytes
+		static const size_t DEFAULT_BUDGET = 256 << 20;
+
+		//! Gets the cache shared by the application
+		/*!
+		 * \return The shared cache
+		 */
+		static TextureCache& get_shared();
+		//! Builds the key of a texture array from the files of its layers
+		/*!
+		 * \param paths Paths of the layers, empty for no file
+		 * \return The canonical path and the hash of the content of each file
+		 */
+		static std::string make_key(const std::vector<std::string>& paths);
+
+		//! Tells if a texture is cached, from any thread
+		/*!
+		 * \param key Key of the texture
+		 * \return True if the texture can be acquired
+		 */
+		bool contains(const std::string& key);
+		//! Gets a cached texture and adds a reference to it
+		/*!
+		 * \param key Key of the texture
+		 * \return The entry, NULL if the texture is not cached
+		 */
+		const TextureCacheEntry* acquire(const std::string& key);
+		//! Adds an uploaded texture, with one reference
+		/*!
+		 * \param key Key of the texture
+		 * \param range Layers of the texture, owned by the cache afterwards
+		 * \param material_layers Layer of each material
+		 * \param bytes Size of the layers with their mipmaps
+		 * \return The entry
+		 */
+		const TextureCacheEntry* insert(const std::string& key, const TextureArrayRange& range, const std::vector<unsigned int>& material_layers, size_t bytes);
+		//! Removes a reference to a texture, which is kept until the budget is exceeded
+		/*!
+		 * \param key Key of the texture, ignored if not cached
+		 */
+		void release(const std::string& key);
+		//! Releases the layers of every texture no object uses
+		void clear();
+
+		//! Sets the budget, deleting the oldest unused textures above it
+		/*!
+		 * \param budget Size in bytes
+		 */
+		void set_budget(size_t budget);
+		//! Gets the budget
+		/*!
+		 * \return Size in bytes above which the unused textures are deleted
+		 */
+		size_t get_budget() const;
+		//! Gets the size of the cached textures
+		/*!
+		 * \return Size in bytes of every texture, used or not
+		 */
+		size_t get_size() const;
+		//! Gets the number of cached textures
+		/*!
+		 * \return The number of textures, used or not
+		 */
+		unsigned int get_number_of_textures() const;
+		//! Gets the number of acquisitions that found their texture
+		/*!
+		 * \return The number of hits since the start
+		 */
+		unsigned int get_hits() const;
+		//! Gets the number of acquisitions that did not find their texture
+		/*!
+		 * \return The number of misses since the start
+		 */
+		unsigned int get_misses() const;
+
+	private:
+		//! Deletes the least recently used unused textures until the cache fits its budget, the mutex being held
+		/*!
+		 * \param budget Size to fit in
+		 */
+		void evict(size_t budget);
+
+		//~ Entries from the most recently used to the least recently used
+		std::list<TextureCacheEntry> m_entries;
+		SDL_mutex* m_mutex;
+		size_t m_budget;
+		size_t m_size;
+		unsigned int m_hits;
+		unsigned int m_misses;
+};
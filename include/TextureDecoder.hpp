@@ -0,0 +1,149 @@
+/***************************************************************************
+									TextureDecoder.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Decodes textures on the worker threads and uploads them with their mipmaps
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Decodes textures on the worker threads and uploads them with their mipmaps
+  * \file TextureDecoder.hpp
+*/
+
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "stb_image/stb_image.h"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Decoded RGBA image and its mip chain
+ *
+ * The levels follow each other in the same block, each one half the size of the previous one, down to 1x1.
+ */
+struct TextureImage
+{
+	unsigned char* pixels;	/*!< RGBA pixels of every level, NULL if the image could not be decoded */
+	int width;				/*!< Width of the first level */
+	int height;				/*!< Height of the first level */
+	unsigned int levels;	/*!< Number of levels, 1 until the mipmaps are built */
+};
+
+/*!
+ * \brief Decodes textures on the worker threads and uploads them with their mipmaps
+ *
+ * The images are always decoded to 4 bytes per pixel : the rows stay aligned for the unpacking and the driver
+ * does not have to expand them. Color textures hold sRGB values, their mipmaps are averaged in linear space.
+ */
+class TextureDecoder
+{
+	public:
+		//! Decodes an image thanks to stb_image
+		/*!
+		 * \param path Path of the image
+		 * \return The RGBA image with its first level only, without pixels if it could not be decoded
+		 */
+		static TextureImage decode(const std::string& path);
+		//! Decodes several images on the shared thread pool
+		/*!
+		 * \param paths Paths of the images, empty for no image
+		 * \return One image per path, in the same order
+		 */
+		static std::vector<TextureImage> decode_all(const std::vector<std::string>& paths);
+		//! Creates an image of a single color
+		/*!
+		 * \param width Width of the image
+		 * \param height Height of the image
+		 * \param color RGBA color of every pixel
+		 * \return The image, with its first level only
+		 */
+		static TextureImage create_filled(int width, int height, const unsigned char color[4]);
+		//! Resizes images to a common size and builds their mip chains, on the shared thread pool
+		/*!
+		 * \param images The images, those without pixels are skipped
+		 * \param width Width of every image, 0 to keep their own
+		 * \param height Height of every image, 0 to keep their own
+		 * \param srgb True if the pixels are sRGB colors, false for linear data such as normals
+		 */
+		static void prepare(std::vector<TextureImage>& images, int width, int height, bool srgb);
+		//! Frees the pixels of an image
+		/*!
+		 * \param image The image
+		 */
+		static void release(TextureImage& image);
+		//! Uploads images into the bound texture, through a pixel buffer
+		/*!
+		 * \param target GL_TEXTURE_2D for one image, whose immutable storage is created ; GL_TEXTURE_2D_ARRAY for one layer per image
+		 * of an array allocated beforehand, such as a page of the TextureArrayManager
+		 * \param layers The images, all with the size and the number of levels of the first one
+		 * \param first_layer Layer of the array receiving the first image
+		 */
+		static void upload(GLenum target, const std::vector<const TextureImage*>& layers, unsigned int first_layer = 0);
+
+		//! Counts the levels of a full mip chain
+		/*!
+		 * \param width Width of the first level
+		 * \param height Height of the first level
+		 * \return The number of levels down to 1x1
+		 */
+		static unsigned int count_levels(int width, int height);
+		//! Gets the position of a level in the pixels of an image
+		/*!
+		 * \param image The image
+		 * \param level The level
+		 * \return Offset of the level in bytes, the size of the image for level == image.levels
+		 */
+		static size_t get_level_offset(const TextureImage& image, unsigned int level);
+
+	private:
+		//! Resizes and builds the mip chains of a range of images, run by the thread pool
+		/*!
+		 * \param begin First image of the range
+		 * \param end Image after the last one of the range
+		 * \param worker Index of the running thread
+		 * \param data The preparation job
+		 */
+		static void prepare_images(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+		//! Resamples the first level of an image with a bilinear filter
+		/*!
+		 * \param image The image, its mip chain is dropped
+		 * \param width New width
+		 * \param height New height
+		 */
+		static void resize(TextureImage& image, int width, int height);
+		//! Builds the mip chain of an image with a box filter
+		/*!
+		 * \param image The image, with its first level only
+		 * \param srgb True if the color channels are averaged in linear space
+		 */
+		static void build_mipmaps(TextureImage& image, bool srgb);
+};
@@ -0,0 +1,128 @@
+/***************************************************************************
+									ThreadPool.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+//!  Pool of worker threads
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Pool of worker threads
+  * \file ThreadPool.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <iostream>
+#include <SDL/SDL.h>
+#include <SDL/SDL_thread.h>
+
+/*!
+ * \brief Function run on a range of a parallel loop
+ * \param begin First item of the range
+ * \param end Item after the last one of the range
+ * \param worker Index of the thread running the range, lower than ThreadPool::get_number_of_workers()
+ * \param data Data given to the loop
+ */
+typedef void (*RangeFunction)(unsigned int begin, unsigned int end, unsigned int worker, void* data);
+
+/*!
+ * \brief Pool of worker threads running parallel loops
+ *
+ * The calling thread takes part in the loops, a pool of n workers runs n + 1 ranges at once. A loop started while
+ * another thread runs one waits for it to end, or runs on its caller alone when it cannot wait, as on the render thread.
+ */
+class ThreadPool
+{
+	public:
+		//! Constructor, starts the threads
+		/*!
+		 * \param nb_threads Number of threads besides the caller, 0 for one less than the number of processors
+		 */
+		ThreadPool(unsigned int nb_threads = 0);
+		//! Destructor, stops the threads
+		~ThreadPool();
+
+		//! Gets the pool shared by the application
+		/*!
+		 *	Created on the first call, which has to come from the main thread
+		 *	\return The shared pool
+		 */
+		static ThreadPool& get_shared();
+
+		//! Runs a function on every range of a loop and waits for its end
+		/*!
+		 * \param count Number of items of the loop
+		 * \param grain Number of items of a range
+		 * \param function Function run on each range
+		 * \param data Data given to the function
+		 * \param wait False to run the loop on the caller alone, as worker 0, when the pool is running another loop
+		 */
+		void parallel_for(unsigned int count, unsigned int grain, RangeFunction function, void* data, bool wait = true);
+		//! Gets the number of threads that may run a range, the caller included
+		/*!
+		 * \return The number of slots for per-thread results
+		 */
+		unsigned int get_number_of_workers() const;
+
+	private:
+		//! Entry point of the threads
+		/*!
+		 * \param data The worker
+		 * \return 0
+		 */
+		static int run_worker(void* data);
+		//! Runs the ranges of the current loop until none is left
+		/*!
+		 * \param worker Index of the running thread
+		 */
+		void run_ranges(unsigned int worker);
+
+		//! Thread of the pool and its index
+		struct Worker
+		{
+			ThreadPool* pool;
+			unsigned int index;
+			SDL_Thread* thread;
+		};
+
+		std::vector<Worker*> m_workers;
+		SDL_mutex* m_mutex;
+		SDL_cond* m_start;
+		SDL_cond* m_done;
+		SDL_cond* m_free;
+		bool m_stop;
+		bool m_busy;
+
+		//~ Current loop
+		unsigned int m_generation;
+		RangeFunction m_function;
+		void* m_data;
+		unsigned int m_count;
+		unsigned int m_grain;
+		unsigned int m_next;
+		unsigned int m_running;
+};
@@ -0,0 +1,132 @@
+/***************************************************************************
+									TriangleBVH.hpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+//!  Bounding volume hierarchy over the triangles of a mesh, for ray queries
+/*!
+  * \author R. Bertozzi & S. Bougeois
+  * \brief Bounding volume hierarchy over the triangles of a mesh, for ray queries
+  * \file TriangleBVH.hpp
+*/
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+#include "glm/glm.hpp"
+#include "ThreadPool.hpp"
+
+/*!
+ * \brief Half-line cast in the scene
+ */
+struct Ray
+{
+	glm::vec3 origin;		/*!< Origin of the ray */
+	glm::vec3 direction;	/*!< Direction of the ray, not necessarily normalized */
+};
+
+/*!
+ * \brief Nearest triangle hit by a ray
+ */
+struct RayHit
+{
+	float distance;			/*!< Distance to the hit, in lengths of the direction of the ray */
+	unsigned int triangle;	/*!< Index of the triangle in the index buffer divided by 3, TriangleBVH::NO_HIT if the ray hits nothing */
+};
+
+/*!
+ * \brief Node of a bounding volume hierarchy, 32 bytes
+ */
+struct BVHNode
+{
+	float min[3];				/*!< Lower corner of the box */
+	unsigned int index;			/*!< First child for an inner node (the second one follows it), first triangle for a leaf */
+	float max[3];				/*!< Upper corner of the box */
+	unsigned short count;		/*!< Number of triangles of a leaf, 0 for an inner node */
+	unsigned short axis;		/*!< Axis of the split of an inner node */
+};
+
+/*!
+ * \brief Bounding volume hierarchy over the triangles of a mesh, for ray queries
+ *
+ * The nodes are split with the surface area heuristic over binned centroids. The top of the tree is split on the calling
+ * thread until there are enough subtrees, which are then built in parallel on the shared thread pool. The rays are
+ * traversed four at a time, with SSE2 when it is available.
+ */
+class TriangleBVH
+{
+	public:
+		//! Value of RayHit::triangle when a ray hits nothing
+		static const unsigned int NO_HIT = 0xFFFFFFFFu;
+
+		//! Constructor, the hierarchy is empty
+		TriangleBVH();
+		//! Builds the hierarchy
+		/*!
+		 * \param vertices Positions of the vertices
+		 * \param indices The triangles
+		 * \param nb_indices Number of indices
+		 */
+		void build(const glm::vec3* vertices, const unsigned int* indices, unsigned int nb_indices);
+		//! Finds the nearest triangle hit by each ray
+		/*!
+		 * \param rays The rays, traversed in packets of 4 : the rays of a packet should be coherent
+		 * \param hits Receives one hit per ray
+		 * \param nb_rays Number of rays
+		 */
+		void intersect(const Ray* rays, RayHit* hits, unsigned int nb_rays) const;
+		//! Finds the nearest triangle hit by a ray
+		/*!
+		 * \param ray The ray
+		 * \return The hit
+		 */
+		RayHit intersect(const Ray& ray) const;
+		//! Gets the number of nodes
+		/*!
+		 * \return The number of nodes, 0 if the hierarchy is empty
+		 */
+		unsigned int get_number_of_nodes() const;
+
+	private:
+		//! Traverses a packet of up to 4 rays
+		/*!
+		 * \param rays The rays
+		 * \param hits Receives one hit per ray
+		 * \param nb_rays Number of rays, 4 at most
+		 */
+		void intersect_packet(const Ray* rays, RayHit* hits, unsigned int nb_rays) const;
+
+		std::vector<BVHNode> m_nodes;
+		//~ Per triangle of the leaves, in the order of the leaves : its first vertex, its two edges from it, and its index
+		std::vector<glm::vec3> m_triangle_edges;
+		std::vector<unsigned int> m_triangle_ids;
+};
@@ -4,8 +4,12 @@
 in vec2 uv;
 in vec3 position;
 in vec3 normal;
+flat in int material;
 
-uniform sampler2D diffuse_texture;
+//~ Layer 0 is the chosen texture, the next ones are the textures of the materials
+uniform sampler2DArray diffuse_texture;
+//~ Per material : tint in rgb, layer of the texture in w
+uniform vec4 material_table[32];
 
 out vec4 out_color;
 out vec4 out_normal;
@@ -13,7 +17,8 @@ out vec4 out_position;
 
 void main(void)
 {
-	vec3 diffuse = texture(diffuse_texture, uv).rgb;
+	vec4 entry = material_table[material];
+	vec3 diffuse = texture(diffuse_texture, vec3(uv, entry.w)).rgb * entry.rgb;
 	out_color = vec4(diffuse, 1.0);
 	out_normal = vec4(normal, 1.0);
 	out_position = vec4(position,1.0);
@@ -4,20 +4,45 @@
 layout (location = 0) in vec3 Position;
 layout (location = 1) in vec3 Normal;
 layout (location = 2) in vec2 UV;
+//~ Index in the material table, 0 when the attribute is disabled
+layout (location = 3) in float Material;
+//~ Placement of the instance, read only when instanced is set
+layout (location = 4) in mat4 Instance;
 
+//~ Transforms the positions, the dequantization of compressed vertices is folded in
 uniform mat4 model_matrix;
+//~ Transforms the normals
+uniform mat4 normal_matrix;
 uniform mat4 view_matrix;
 uniform mat4 projection_matrix;
+//~ The normals are octahedral-encoded in Normal.xy
+uniform bool octahedral_normals;
+//~ The object is drawn once per matrix of the instance buffer
+uniform bool instanced;
 
 out vec2 uv;
 out vec3 normal;
 out vec3 position;
+flat out int material;
+
+vec3 decode_octahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
 
 void main(void)
 {	
+	vec3 object_normal = octahedral_normals ? decode_octahedral(Normal.xy) : Normal;
 	uv = UV;
-	normal = vec3(model_matrix * vec4(Normal, 1.0));
-	position = vec3(model_matrix * vec4(Position, 1.0));
-	gl_Position = projection_matrix * view_matrix * model_matrix * vec4(Position,1.0);
+	material = int(Material + 0.5);
+	mat4 instance = instanced ? Instance : mat4(1.0);
+	normal = mat3(instance) * vec3(normal_matrix * vec4(object_normal, 1.0));
+	position = vec3(instance * model_matrix * vec4(Position, 1.0));
+	gl_Position = projection_matrix * view_matrix * vec4(position, 1.0);
 }
 
@@ -0,0 +1,23 @@
+#version 150
+#extension GL_ARB_explicit_attrib_location : enable
+
+in vec3 color;
+in vec3 normal;
+in vec3 position;
+
+out vec4 out_color;
+out vec4 out_normal;
+out vec4 out_position;
+
+void main(void)
+{
+	//~ Round splats
+	vec2 offset = 2.0 * gl_PointCoord - 1.0;
+	if(dot(offset, offset) > 1.0)
+	{
+		discard;
+	}
+	out_color = vec4(color, 1.0);
+	out_normal = vec4(normal, 1.0);
+	out_position = vec4(position, 1.0);
+}
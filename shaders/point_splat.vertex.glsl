@@ -0,0 +1,42 @@
+#version 150
+#extension GL_ARB_explicit_attrib_location : enable
+
+layout (location = 0) in vec3 Position;
+//~ Octahedral-encoded normal
+layout (location = 1) in vec2 Normal;
+//~ Color in rgb, a is 0 when the point has no normal
+layout (location = 2) in vec4 Color;
+
+uniform mat4 model_matrix;
+uniform mat4 view_matrix;
+uniform mat4 projection_matrix;
+uniform vec3 eye_position;
+//~ Spacing of the points of the drawn node, in world units
+uniform float point_spacing;
+uniform float viewport_height;
+
+out vec3 color;
+out vec3 normal;
+out vec3 position;
+
+vec3 decode_octahedral(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+void main(void)
+{
+	color = Color.rgb;
+	position = vec3(model_matrix * vec4(Position, 1.0));
+	//~ Without a normal the splat faces the eye
+	normal = (Color.a > 0.5) ? normalize(mat3(model_matrix) * decode_octahedral(Normal)) : normalize(eye_position - position);
+	vec4 view_position = view_matrix * vec4(position, 1.0);
+	gl_Position = projection_matrix * view_position;
+	//~ The splats overlap a little, so that no hole is left between the points of the grid
+	gl_PointSize = clamp(1.5 * point_spacing * projection_matrix[1][1] * 0.5 * viewport_height / max(-view_position.z, 1e-4), 1.0, 64.0);
+}
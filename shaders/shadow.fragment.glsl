@@ -3,8 +3,6 @@
 
 out vec4  Color;
 
-in vec3 normal;
-
 void main(void)
 {
 }
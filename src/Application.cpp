@@ -217,6 +217,16 @@ void Application::on_event(SDL_Event* Event)
 				m_has_focus_changed = !m_has_focus_changed;
 			}
 		}
+		//~ The cursor is held at the centre of the view, the point under it becomes the convergence point
+		if(Event->button.button == SDL_BUTTON_LEFT && !m_display_gui)
+		{
+			glm::vec3 point;
+			if(m_renderer->pick(m_display->w/2, m_display->h/2, point))
+			{
+				m_renderer->converge_at(point);
+				std::cout << "Picked (" << point.x << ", " << point.y << ", " << point.z << "), convergence at " << m_renderer->get_dc() << std::endl;
+			}
+		}
 	}
 	if(Event->type == SDL_KEYDOWN)
 	{
@@ -312,6 +322,10 @@ void Application::on_event(SDL_Event* Event)
 			break;
 			case SDLK_d : m_renderer->toggle_ssao(false);
 			break;
+			case SDLK_b : m_renderer->benchmark_vertex_layouts();
+			break;
+			case SDLK_i : m_renderer->benchmark_instancing();
+			break;
 			default : ;
 			break;
 		}
@@ -0,0 +1,384 @@
+/***************************************************************************
+									Benchmarks.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file Benchmarks.cpp
+ * \brief Benchmarks run from the command line
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/Benchmarks.hpp"
+
+int Benchmarks::run(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		return -1;
+	}
+	std::string name = argv[1];
+	if(name == "--benchmark-statistics")
+	{
+		return statistics();
+	}
+	if(name == "--benchmark-bvh")
+	{
+		if(argc < 3)
+		{
+			std::cerr << "Usage : " << argv[0] << " --benchmark-bvh <model>" << std::endl;
+			return 1;
+		}
+		return bvh(argv[2]);
+	}
+	if(name == "--benchmark-normals")
+	{
+		return normals((argc >= 3) ? strtoul(argv[2], NULL, 10) : 10000000);
+	}
+	if(name == "--benchmark-obj")
+	{
+		if(argc < 3)
+		{
+			std::cerr << "Usage : " << argv[0] << " --benchmark-obj <model.obj>" << std::endl;
+			return 1;
+		}
+		return obj(argv[2]);
+	}
+	return -1;
+}
+
+//~ Statistics as they were computed before, one pass for the barycentre, then for the average distance, then for the deviation
+static MeshStatistics measure_with_passes(const std::vector<glm::vec3>& vertices)
+{
+	MeshStatistics statistics;
+	glm::vec3 sum = glm::vec3(0.0, 0.0, 0.0);
+	statistics.min = statistics.max = vertices[0];
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+	{
+		sum += vertices.at(i);
+		statistics.min = glm::min(statistics.min, vertices.at(i));
+		statistics.max = glm::max(statistics.max, vertices.at(i));
+	}
+	statistics.barycentre = sum / (float)vertices.size();
+
+	float sumDist = 0;
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+	{
+		sumDist += glm::distance(vertices.at(i), statistics.barycentre);
+	}
+	statistics.average_distance = sumDist / vertices.size();
+
+	float sumValMoinsMoy = 0;
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+	{
+		sumValMoinsMoy += pow(glm::distance(vertices.at(i), statistics.barycentre) - statistics.average_distance, 2);
+	}
+	statistics.standard_deviation = sqrt(sumValMoinsMoy / vertices.size());
+	return statistics;
+}
+
+//~ Exact statistics in double, the reference of the comparison
+static MeshStatistics measure_in_double(const std::vector<glm::vec3>& vertices)
+{
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+	{
+		for(unsigned int c = 0; c < 3; ++c) sum[c] += vertices[i][c];
+	}
+	double centre[3] = { sum[0] / vertices.size(), sum[1] / vertices.size(), sum[2] / vertices.size() };
+	double distances = 0.0, squares = 0.0;
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+	{
+		double d = 0.0;
+		for(unsigned int c = 0; c < 3; ++c) d += (vertices[i][c] - centre[c]) * (vertices[i][c] - centre[c]);
+		d = sqrt(d);
+		distances += d;
+		squares += d * d;
+	}
+	MeshStatistics statistics;
+	statistics.barycentre = glm::vec3(centre[0], centre[1], centre[2]);
+	statistics.average_distance = distances / vertices.size();
+	statistics.standard_deviation = sqrt(squares / vertices.size() - (distances / vertices.size()) * (distances / vertices.size()));
+	return statistics;
+}
+
+int Benchmarks::statistics()
+{
+	SDL_Init(SDL_INIT_TIMER);
+	const unsigned int sizes[] = { 1000000, 5000000, 10000000, 25000000, 50000000 };
+	std::cout << "Mesh statistics : " << ThreadPool::get_shared().get_number_of_workers() << " threads" << std::endl;
+	std::cout << "vertices\tpasses (ms)\tfused (ms)\tspeedup\tavg dist error (passes / fused)\tstd dev error (passes / fused)" << std::endl;
+	srand(42);
+	for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+	{
+		//~ A model far from the origin, the case where float sums drift the most
+		std::vector<glm::vec3> vertices(sizes[s]);
+		for(unsigned int i = 0; i < vertices.size(); ++i)
+		{
+			vertices[i] = glm::vec3(100.0f + rand() / (float)RAND_MAX, 50.0f + rand() / (float)RAND_MAX, -20.0f + 2.0f * rand() / (float)RAND_MAX);
+		}
+		MeshStatistics reference = measure_in_double(vertices);
+
+		Uint32 start = SDL_GetTicks();
+		MeshStatistics passes = measure_with_passes(vertices);
+		Uint32 passes_time = SDL_GetTicks() - start;
+
+		//~ Best of 3 runs, the first one also wakes the threads up
+		Uint32 fused_time = 0xFFFFFFFF;
+		MeshStatistics fused;
+		for(unsigned int run = 0; run < 3; ++run)
+		{
+			start = SDL_GetTicks();
+			fused = Mesh::measure(&vertices[0], vertices.size());
+			fused_time = std::min(fused_time, SDL_GetTicks() - start);
+		}
+
+		std::cout << sizes[s] << "\t" << passes_time << "\t" << fused_time << "\t" << (float)passes_time / std::max(fused_time, (Uint32)1) << "x\t"
+			<< fabs(passes.average_distance - reference.average_distance) << " / " << fabs(fused.average_distance - reference.average_distance) << "\t"
+			<< fabs(passes.standard_deviation - reference.standard_deviation) << " / " << fabs(fused.standard_deviation - reference.standard_deviation) << std::endl;
+	}
+	SDL_Quit();
+	return 0;
+}
+
+int Benchmarks::bvh(const char* filename)
+{
+	SDL_Init(SDL_INIT_TIMER);
+	std::cout << "BVH : " << ThreadPool::get_shared().get_number_of_workers() << " threads for the build" << std::endl;
+	Mesh* mesh = NULL;
+	try
+	{
+		mesh = new Mesh(filename);
+	}
+	catch(int)
+	{
+		std::cerr << "Unable to load " << filename << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+	//~ Rays from a sphere around the model towards its barycentre, four coherent rays per packet, like the auto-convergence
+	const float radius = 2.0f * glm::distance(mesh->get_min(), mesh->get_max());
+	const unsigned int nb_packets = 100000;
+	std::vector<Ray> rays(4 * nb_packets);
+	srand(0);
+	for(unsigned int p = 0; p < nb_packets; ++p)
+	{
+		glm::vec3 direction;
+		do
+		{
+			direction = glm::vec3(rand(), rand(), rand()) / (float)RAND_MAX * 2.0f - 1.0f;
+		}
+		while(glm::length(direction) > 1.0f || glm::length(direction) < 0.1f);
+		direction = glm::normalize(direction);
+		for(unsigned int r = 0; r < 4; ++r)
+		{
+			const glm::vec3 jitter = glm::vec3(r & 1, r >> 1, 0.0f) * 0.001f * radius;
+			rays[4 * p + r].origin = mesh->get_barycentre() + direction * radius + jitter;
+			rays[4 * p + r].direction = -direction;
+		}
+	}
+	std::vector<RayHit> hits(rays.size());
+	Uint32 start = SDL_GetTicks();
+	mesh->get_bvh().intersect(&rays[0], &hits[0], rays.size());
+	Uint32 elapsed = std::max(SDL_GetTicks() - start, (Uint32)1);
+	unsigned int nb_hits = 0;
+	for(unsigned int r = 0; r < hits.size(); ++r)
+	{
+		nb_hits += (hits[r].triangle != TriangleBVH::NO_HIT) ? 1 : 0;
+	}
+	std::cout << rays.size() << " rays on one thread in " << elapsed << " ms : " << 1000.0f * elapsed / nb_packets << " us per packet of 4, "
+		<< (100 * nb_hits) / hits.size() << "% of hits" << std::endl;
+	delete mesh;
+	SDL_Quit();
+	return 0;
+}
+
+int Benchmarks::normals(unsigned int nb_triangles)
+{
+	SDL_Init(SDL_INIT_TIMER);
+	//~ Height field cut into tiles that do not share their border vertices, like the seams of the texture coordinates
+	const unsigned int tile = 64;
+	unsigned int side = tile;
+	while(2 * side * side < nb_triangles) side += tile;
+	const unsigned int nb_tiles = side / tile;
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+	vertices.reserve(nb_tiles * nb_tiles * (tile + 1) * (tile + 1));
+	indices.reserve(6 * side * side);
+	for(unsigned int ty = 0; ty < nb_tiles; ++ty)
+	{
+		for(unsigned int tx = 0; tx < nb_tiles; ++tx)
+		{
+			const unsigned int first = vertices.size();
+			for(unsigned int y = 0; y <= tile; ++y)
+			{
+				for(unsigned int x = 0; x <= tile; ++x)
+				{
+					const float u = (float)(tx * tile + x) / side, v = (float)(ty * tile + y) / side;
+					vertices.push_back(glm::vec3(u, 0.05f * sinf(20.0f * u) * cosf(17.0f * v), v));
+				}
+			}
+			for(unsigned int y = 0; y < tile; ++y)
+			{
+				for(unsigned int x = 0; x < tile; ++x)
+				{
+					const unsigned int corner = first + y * (tile + 1) + x;
+					const unsigned int quad[6] = { corner, corner + tile + 1, corner + 1, corner + 1, corner + tile + 1, corner + tile + 2 };
+					indices.insert(indices.end(), quad, quad + 6);
+				}
+			}
+		}
+	}
+	std::cout << "Smooth normals : " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices, "
+		<< ThreadPool::get_shared().get_number_of_workers() << " threads" << std::endl;
+
+	//~ Best of 3 runs, the first one also wakes the threads up
+	std::vector<glm::vec3> normals(vertices.size());
+	Uint32 generator_time = 0xFFFFFFFF;
+	for(unsigned int run = 0; run < 3; ++run)
+	{
+		Uint32 start = SDL_GetTicks();
+		NormalGenerator::generate(&vertices[0], vertices.size(), &indices[0], indices.size(), 0, &normals[0]);
+		generator_time = std::min(generator_time, SDL_GetTicks() - start);
+	}
+
+	//~ assimp post-processes only the scenes it imported : the height field goes through a binary PLY without normals
+	const char* path = "benchmark_normals.ply";
+	FILE* file = fopen(path, "wb");
+	if(!file)
+	{
+		std::cerr << "Unable to write " << path << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+	fprintf(file, "ply\nformat binary_little_endian 1.0\nelement vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+		"element face %u\nproperty list uchar int vertex_indices\nend_header\n", (unsigned int)vertices.size(), (unsigned int)indices.size() / 3);
+	fwrite(&vertices[0], sizeof(glm::vec3), vertices.size(), file);
+	std::vector<unsigned char> faces(13 * (indices.size() / 3));
+	for(unsigned int t = 0; t < indices.size() / 3; ++t)
+	{
+		faces[13 * t] = 3;
+		memcpy(&faces[13 * t + 1], &indices[3 * t], 3 * sizeof(unsigned int));
+	}
+	fwrite(&faces[0], 1, faces.size(), file);
+	fclose(file);
+
+	const aiScene* scene = aiImportFile(path, 0);
+	remove(path);
+	if(!scene || scene->mNumMeshes == 0)
+	{
+		std::cerr << "Unable to import " << path << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+	Uint32 start = SDL_GetTicks();
+	scene = aiApplyPostProcessing(scene, aiProcess_GenSmoothNormals);
+	const Uint32 assimp_time = SDL_GetTicks() - start;
+	std::cout << "generator (ms)\tassimp (ms)\tspeedup" << std::endl;
+	std::cout << generator_time << "\t" << assimp_time << "\t" << (float)assimp_time / std::max(generator_time, (Uint32)1) << "x" << std::endl;
+
+	//~ The faces keep their order : the normals are compared corner by corner, assimp does not weight them by the angles
+	const aiMesh* mesh = scene ? scene->mMeshes[0] : NULL;
+	if(mesh && mesh->HasNormals() && mesh->mNumFaces == indices.size() / 3)
+	{
+		double sum = 0.0;
+		float largest = 0.0f;
+		for(unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		{
+			for(unsigned int k = 0; k < 3 && k < mesh->mFaces[f].mNumIndices; ++k)
+			{
+				const aiVector3D& other = mesh->mNormals[mesh->mFaces[f].mIndices[k]];
+				const float cosine = glm::dot(normals[indices[3 * f + k]], glm::normalize(glm::vec3(other.x, other.y, other.z)));
+				const float angle = acosf(std::max(-1.0f, std::min(1.0f, cosine))) * 180.0f / (float)M_PI;
+				sum += angle;
+				largest = std::max(largest, angle);
+			}
+		}
+		std::cout << "Angle to the normals of assimp : " << sum / (3.0 * mesh->mNumFaces) << " degrees on average, " << largest << " at most" << std::endl;
+	}
+	if(scene)
+	{
+		aiReleaseImport(scene);
+	}
+	SDL_Quit();
+	return 0;
+}
+
+int Benchmarks::obj(const char* filename)
+{
+	SDL_Init(SDL_INIT_TIMER);
+	std::cout << "OBJ : " << ThreadPool::get_shared().get_number_of_workers() << " threads for the parser" << std::endl;
+	//~ Best of 3 runs, the later ones read the file from the page cache like assimp does
+	ObjModel model;
+	Uint32 parser_time = 0xFFFFFFFF;
+	for(unsigned int run = 0; run < 3; ++run)
+	{
+		ObjModel parsed;
+		Uint32 start = SDL_GetTicks();
+		try
+		{
+			ObjParser::parse(filename, parsed);
+		}
+		catch(int)
+		{
+			std::cerr << "Unable to parse " << filename << std::endl;
+			SDL_Quit();
+			return 1;
+		}
+		parser_time = std::min(parser_time, SDL_GetTicks() - start);
+		model = parsed;
+	}
+
+	//~ Same post-processing as the import of the meshes, without their welding
+	Uint32 start = SDL_GetTicks();
+	const aiScene* scene = aiImportFile(filename, aiProcess_Triangulate | aiProcess_FlipUVs);
+	const Uint32 assimp_time = SDL_GetTicks() - start;
+	unsigned int nb_assimp_triangles = 0, nb_assimp_vertices = 0, nb_assimp_meshes = 0;
+	if(scene)
+	{
+		nb_assimp_meshes = scene->mNumMeshes;
+		for(unsigned int m = 0; m < scene->mNumMeshes; ++m)
+		{
+			nb_assimp_vertices += scene->mMeshes[m]->mNumVertices;
+			for(unsigned int f = 0; f < scene->mMeshes[m]->mNumFaces; ++f)
+			{
+				nb_assimp_triangles += (scene->mMeshes[m]->mFaces[f].mNumIndices == 3) ? 1 : 0;
+			}
+		}
+		aiReleaseImport(scene);
+	}
+	else
+	{
+		std::cerr << "assimp : " << aiGetErrorString() << std::endl;
+	}
+
+	std::cout << "\ttriangles\tvertices\tranges\ttime (ms)" << std::endl;
+	std::cout << "parser\t" << model.indices.size() / 3 << "\t" << model.vertices.size() << "\t" << model.ranges.size() << "\t" << parser_time << std::endl;
+	std::cout << "assimp\t" << nb_assimp_triangles << "\t" << nb_assimp_vertices << "\t" << nb_assimp_meshes << "\t" << assimp_time << std::endl;
+	std::cout << "Speedup : " << (float)assimp_time / std::max(parser_time, (Uint32)1) << "x" << std::endl;
+	SDL_Quit();
+	return 0;
+}
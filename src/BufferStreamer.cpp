@@ -0,0 +1,243 @@
+/***************************************************************************
+									BufferStreamer.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file BufferStreamer.cpp
+ * \brief Uploads big buffers chunk after chunk
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/BufferStreamer.hpp"
+
+#include <algorithm>
+
+//~ Number of staging slots, a slot is reused once the GPU is done with its copy
+static const unsigned int STAGING_SLOTS = 3;
+
+BufferStreamer::BufferStreamer(unsigned int chunk_size):
+	m_chunk_size(chunk_size),
+	m_index_upload(NULL),
+	m_index_chunk_size(0),
+	m_total_size(0),
+	m_total_uploaded(0),
+	m_staging_buffer(0),
+	m_fences(STAGING_SLOTS, (GLsync)0),
+	m_slot(0)
+{
+	m_use_staging = GLEW_ARB_sync && GLEW_ARB_copy_buffer && GLEW_ARB_map_buffer_range;
+	if(m_use_staging)
+	{
+		glGenBuffers(1, &m_staging_buffer);
+		glBindBuffer(GL_COPY_READ_BUFFER, m_staging_buffer);
+		glBufferData(GL_COPY_READ_BUFFER, STAGING_SLOTS * m_chunk_size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+}
+
+BufferStreamer::~BufferStreamer()
+{
+	for(unsigned int i = 0; i < STAGING_SLOTS; ++i)
+	{
+		if(m_fences[i] != 0)
+		{
+			glDeleteSync(m_fences[i]);
+		}
+	}
+	glDeleteBuffers(1, &m_staging_buffer);
+	for(unsigned int i = 0; i < m_vertex_uploads.size(); ++i)
+	{
+		delete m_vertex_uploads[i];
+	}
+	delete m_index_upload;
+}
+
+void BufferStreamer::add_vertex_buffer(GLuint buffer, const void* data, size_t size, unsigned int vertex_size)
+{
+	Upload* upload = new Upload();
+	upload->buffer = buffer;
+	upload->data = (const unsigned char*)data;
+	upload->size = size;
+	upload->uploaded = 0;
+	upload->element_size = vertex_size;
+	m_vertex_uploads.push_back(upload);
+	m_total_size += size;
+}
+
+void BufferStreamer::add_vertex_buffer(GLuint buffer, std::vector<unsigned char>& data, unsigned int vertex_size)
+{
+	add_vertex_buffer(buffer, NULL, data.size(), vertex_size);
+	Upload* upload = m_vertex_uploads.back();
+	upload->owned.swap(data);
+	upload->data = upload->owned.empty() ? NULL : &upload->owned[0];
+}
+
+void BufferStreamer::set_index_buffer(GLuint buffer, std::vector<unsigned char>& data, unsigned int index_size, const unsigned int* indices, unsigned int nb_indices)
+{
+	m_index_upload = new Upload();
+	m_index_upload->buffer = buffer;
+	m_index_upload->size = data.size();
+	m_index_upload->uploaded = 0;
+	m_index_upload->element_size = index_size;
+	m_index_upload->owned.swap(data);
+	m_index_upload->data = m_index_upload->owned.empty() ? NULL : &m_index_upload->owned[0];
+	m_total_size += m_index_upload->size;
+
+	//~ Index chunks hold whole triangles
+	const unsigned int chunk_indices = std::max(3u, (m_chunk_size / index_size) / 3 * 3);
+	m_index_chunk_size = chunk_indices * index_size;
+	unsigned int max_vertex = 0;
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		max_vertex = std::max(max_vertex, indices[i]);
+		if((i + 1) % chunk_indices == 0 || i + 1 == nb_indices)
+		{
+			m_chunk_max_vertex.push_back(max_vertex);
+		}
+	}
+}
+
+size_t BufferStreamer::stream(size_t budget)
+{
+	size_t uploaded = 0;
+	while(uploaded < budget && !is_complete())
+	{
+		const size_t size = std::min((size_t)m_chunk_size, budget - uploaded);
+		size_t chunk = 0;
+		//~ The next index chunk goes first once the vertices it references are resident
+		if(m_index_upload != NULL && m_index_upload->uploaded < m_index_upload->size)
+		{
+			const unsigned int next_chunk = m_index_upload->uploaded / m_index_chunk_size;
+			if(m_chunk_max_vertex[next_chunk] < get_resident_vertices())
+			{
+				//~ Index chunks are never cut by the budget so that they stay aligned on triangles
+				chunk = upload_chunk(*m_index_upload, m_index_chunk_size);
+				if(chunk == 0) break;
+				uploaded += chunk;
+				continue;
+			}
+		}
+		//~ Otherwise the vertex buffer that is the most behind
+		Upload* behind = NULL;
+		for(unsigned int i = 0; i < m_vertex_uploads.size(); ++i)
+		{
+			Upload* upload = m_vertex_uploads[i];
+			if(upload->uploaded < upload->size && (behind == NULL || upload->uploaded / upload->element_size < behind->uploaded / behind->element_size))
+			{
+				behind = upload;
+			}
+		}
+		if(behind == NULL) break;
+		chunk = upload_chunk(*behind, size);
+		if(chunk == 0) break;
+		uploaded += chunk;
+	}
+	return uploaded;
+}
+
+size_t BufferStreamer::upload_chunk(Upload& upload, size_t size)
+{
+	size = std::min(size, upload.size - upload.uploaded);
+	const unsigned char* source = upload.data + upload.uploaded;
+	if(m_use_staging)
+	{
+		//~ The slot is reused only when the GPU has consumed its previous copy, the frame never waits for it
+		if(m_fences[m_slot] != 0)
+		{
+			GLenum status = glClientWaitSync(m_fences[m_slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+			if(status == GL_TIMEOUT_EXPIRED)
+			{
+				return 0;
+			}
+			glDeleteSync(m_fences[m_slot]);
+			m_fences[m_slot] = 0;
+		}
+		const GLintptr offset = m_slot * m_chunk_size;
+		glBindBuffer(GL_COPY_READ_BUFFER, m_staging_buffer);
+		void* staging = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if(staging == NULL)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			return 0;
+		}
+		memcpy(staging, source, size);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, upload.buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, upload.uploaded, size);
+		m_fences[m_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_slot = (m_slot + 1) % STAGING_SLOTS;
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	else
+	{
+		//~ GL_COPY_WRITE_BUFFER does not touch the bindings recorded by the VAOs
+		glBindBuffer(GL_COPY_WRITE_BUFFER, upload.buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, upload.uploaded, size, source);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	upload.uploaded += size;
+	m_total_uploaded += size;
+	//~ The source is not needed anymore once uploaded
+	if(upload.uploaded == upload.size)
+	{
+		std::vector<unsigned char>().swap(upload.owned);
+	}
+	return size;
+}
+
+bool BufferStreamer::is_complete() const
+{
+	return m_total_uploaded == m_total_size;
+}
+
+unsigned int BufferStreamer::get_resident_vertices() const
+{
+	unsigned int resident = 0xFFFFFFFFu;
+	for(unsigned int i = 0; i < m_vertex_uploads.size(); ++i)
+	{
+		resident = std::min(resident, (unsigned int)(m_vertex_uploads[i]->uploaded / m_vertex_uploads[i]->element_size));
+	}
+	return resident;
+}
+
+unsigned int BufferStreamer::get_resident_indices() const
+{
+	if(m_index_upload == NULL)
+	{
+		return 0;
+	}
+	return m_index_upload->uploaded / m_index_upload->element_size;
+}
+
+float BufferStreamer::get_progress() const
+{
+	if(m_total_size == 0)
+	{
+		return 1.0f;
+	}
+	return (float)m_total_uploaded / (float)m_total_size;
+}
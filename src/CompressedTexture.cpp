@@ -0,0 +1,605 @@
+/***************************************************************************
+									CompressedTexture.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file CompressedTexture.cpp
+ * \brief Block-compressed textures : encoder and memory-mapped DDS files
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/CompressedTexture.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+//~ Layout of the DDS files, without the DX10 extension
+struct DdsPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t four_cc;
+	uint32_t rgb_bit_count;
+	uint32_t masks[4];
+};
+
+struct DdsHeader
+{
+	char magic[4];
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t linear_size;
+	uint32_t depth;
+	uint32_t mip_map_count;
+	uint32_t reserved[11];
+	DdsPixelFormat pixel_format;
+	uint32_t caps[4];
+	uint32_t reserved_end;
+};
+
+//~ Flags of the header and of the pixel format
+static const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+static const uint32_t DDPF_FOURCC = 0x4;
+static const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+//~ Four characters code of a format, as read from a little endian file
+static uint32_t make_four_cc(const char* code)
+{
+	return (uint32_t)(unsigned char)code[0] | ((uint32_t)(unsigned char)code[1] << 8) | ((uint32_t)(unsigned char)code[2] << 16) | ((uint32_t)(unsigned char)code[3] << 24);
+}
+
+//~ Bytes per block of 4x4 texels
+static size_t get_block_size(CompressionFormat format)
+{
+	return (format == COMPRESSION_BC1) ? 8 : 16;
+}
+
+CompressedTexture::CompressedTexture(const std::string& path) throw (int):
+	m_mapping(NULL),
+	m_mapping_size(0),
+	m_data(NULL),
+	m_width(0),
+	m_height(0),
+	m_levels(0),
+	m_format(COMPRESSION_BC1)
+{
+#ifdef _WIN32
+	//~ No mmap : the file is read at once
+	FILE* file = fopen(path.c_str(), "rb");
+	if(file == NULL)
+	{
+		throw(0);
+	}
+	fseek(file, 0, SEEK_END);
+	m_mapping_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	m_mapping = new char[m_mapping_size];
+	bool read = fread(m_mapping, 1, m_mapping_size, file) == m_mapping_size;
+	fclose(file);
+	if(!read)
+	{
+		unmap();
+		throw(0);
+	}
+#else
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if(descriptor < 0)
+	{
+		throw(0);
+	}
+	struct stat file_stat;
+	if(fstat(descriptor, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(DdsHeader))
+	{
+		close(descriptor);
+		throw(0);
+	}
+	m_mapping_size = file_stat.st_size;
+	m_mapping = mmap(NULL, m_mapping_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(m_mapping == MAP_FAILED)
+	{
+		m_mapping = NULL;
+		throw(0);
+	}
+#endif
+
+	//~ Only the 2D block-compressed textures written by encode() or by the usual tools are read
+	const DdsHeader* header = (const DdsHeader*)m_mapping;
+	bool valid = m_mapping_size >= sizeof(DdsHeader) && memcmp(header->magic, "DDS ", 4) == 0
+		&& header->size == sizeof(DdsHeader) - 4 && (header->pixel_format.flags & DDPF_FOURCC) != 0
+		&& header->width > 0 && header->height > 0;
+	const uint32_t four_cc = header->pixel_format.four_cc;
+	if(valid && four_cc == make_four_cc("DXT1"))
+	{
+		m_format = COMPRESSION_BC1;
+	}
+	else if(valid && four_cc == make_four_cc("DXT5"))
+	{
+		m_format = COMPRESSION_BC3;
+	}
+	else if(valid && (four_cc == make_four_cc("ATI2") || four_cc == make_four_cc("BC5U")))
+	{
+		m_format = COMPRESSION_BC5;
+	}
+	else
+	{
+		valid = false;
+	}
+	if(valid)
+	{
+		m_width = header->width;
+		m_height = header->height;
+		m_levels = std::max(1u, std::min((unsigned int)header->mip_map_count, TextureDecoder::count_levels(m_width, m_height)));
+		m_data = (const unsigned char*)m_mapping + sizeof(DdsHeader);
+		valid = sizeof(DdsHeader) + get_size() <= m_mapping_size;
+	}
+	if(!valid)
+	{
+		std::cerr << path << " is not a BC1, BC3 or BC5 DDS file" << std::endl;
+		unmap();
+		throw(0);
+	}
+}
+
+CompressedTexture::~CompressedTexture()
+{
+	unmap();
+}
+
+void CompressedTexture::unmap()
+{
+	if(m_mapping == NULL)
+	{
+		return;
+	}
+#ifdef _WIN32
+	delete[] (char*)m_mapping;
+#else
+	munmap(m_mapping, m_mapping_size);
+#endif
+	m_mapping = NULL;
+	m_mapping_size = 0;
+	m_data = NULL;
+}
+
+std::string CompressedTexture::get_path(const std::string& image_path)
+{
+	const size_t dot = image_path.find_last_of('.');
+	const size_t slash = image_path.find_last_of('/');
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+	{
+		return image_path + ".dds";
+	}
+	return image_path.substr(0, dot) + ".dds";
+}
+
+std::vector<std::string> CompressedTexture::find(const std::vector<std::string>& image_paths)
+{
+	std::vector<std::string> paths;
+	if(image_paths.empty() || image_paths[0].empty())
+	{
+		return paths;
+	}
+	for(unsigned int i = 0; i < image_paths.size(); ++i)
+	{
+		struct stat file_stat;
+		paths.push_back(image_paths[i].empty() ? "" : get_path(image_paths[i]));
+		if(!paths.back().empty() && stat(paths.back().c_str(), &file_stat) != 0)
+		{
+			paths.clear();
+			break;
+		}
+	}
+	return paths;
+}
+
+bool CompressedTexture::is_supported(CompressionFormat format)
+{
+	//~ RGTC is core since GL 3.0
+	return format == COMPRESSION_BC5 || GLEW_EXT_texture_compression_s3tc;
+}
+
+GLenum CompressedTexture::get_internal_format() const
+{
+	switch(m_format)
+	{
+		case COMPRESSION_BC1:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case COMPRESSION_BC3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default:
+			return GL_COMPRESSED_RG_RGTC2;
+	}
+}
+
+void CompressedTexture::upload(GLenum target, const std::vector<const CompressedTexture*>& layers, unsigned int first_layer)
+{
+	const CompressedTexture& first = *layers[0];
+	const GLenum internal_format = first.get_internal_format();
+	if(target == GL_TEXTURE_2D)
+	{
+		size_t offset = 0;
+		for(unsigned int level = 0; level < first.m_levels; ++level)
+		{
+			glCompressedTexImage2D(target, level, internal_format, std::max(1, first.m_width >> level), std::max(1, first.m_height >> level), 0,
+				first.get_level_size(level), first.m_data + offset);
+			offset += first.get_level_size(level);
+		}
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, first.m_levels - 1);
+		return;
+	}
+	//~ Each layer is copied from its mapping into the storage of the array
+	for(unsigned int layer = 0; layer < layers.size(); ++layer)
+	{
+		size_t offset = 0;
+		for(unsigned int level = 0; level < first.m_levels; ++level)
+		{
+			glCompressedTexSubImage3D(target, level, 0, 0, first_layer + layer, std::max(1, first.m_width >> level), std::max(1, first.m_height >> level), 1, internal_format,
+				first.get_level_size(level), layers[layer]->m_data + offset);
+			offset += first.get_level_size(level);
+		}
+	}
+}
+
+//~ Expands a 5 or 6 bits channel to 8 bits
+static int expand_565(unsigned int value, unsigned int bits)
+{
+	return (bits == 5) ? (int)((value << 3) | (value >> 2)) : (int)((value << 2) | (value >> 4));
+}
+
+//~ Packs a color in 16 bits
+static unsigned int pack_565(const float color[3])
+{
+	const unsigned int r = (unsigned int)(std::max(0.0f, std::min(255.0f, color[0])) * 31.0f / 255.0f + 0.5f);
+	const unsigned int g = (unsigned int)(std::max(0.0f, std::min(255.0f, color[1])) * 63.0f / 255.0f + 0.5f);
+	const unsigned int b = (unsigned int)(std::max(0.0f, std::min(255.0f, color[2])) * 31.0f / 255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+//~ Color block : the endpoints are the extremes of the texels along their principal axis, each texel takes the nearest of the 4 colors
+static void encode_color_block(const unsigned char texels[16][4], unsigned char* block)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for(unsigned int t = 0; t < 16; ++t)
+	{
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			mean[c] += texels[t][c] / 16.0f;
+		}
+	}
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for(unsigned int t = 0; t < 16; ++t)
+	{
+		const float r = texels[t][0] - mean[0], g = texels[t][1] - mean[1], b = texels[t][2] - mean[2];
+		covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+		covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+	}
+	//~ Principal axis by power iterations
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for(unsigned int i = 0; i < 8; ++i)
+	{
+		const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+		const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+		const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+		const float length = std::max(std::max(fabs(x), fabs(y)), fabs(z));
+		if(length <= 0.0f)
+		{
+			break;
+		}
+		axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+	}
+	float low = 0.0f, high = 0.0f;
+	const float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	for(unsigned int t = 0; t < 16; ++t)
+	{
+		const float projection = ((texels[t][0] - mean[0]) * axis[0] + (texels[t][1] - mean[1]) * axis[1] + (texels[t][2] - mean[2]) * axis[2]) / norm;
+		low = std::min(low, projection);
+		high = std::max(high, projection);
+	}
+	float end0[3], end1[3];
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		end0[c] = mean[c] + axis[c] * high;
+		end1[c] = mean[c] + axis[c] * low;
+	}
+	unsigned int color0 = pack_565(end0), color1 = pack_565(end1);
+	//~ The first color is the greatest for the 4 colors mode
+	if(color0 < color1)
+	{
+		std::swap(color0, color1);
+	}
+
+	int palette[4][3];
+	palette[0][0] = expand_565(color0 >> 11, 5); palette[0][1] = expand_565((color0 >> 5) & 63, 6); palette[0][2] = expand_565(color0 & 31, 5);
+	palette[1][0] = expand_565(color1 >> 11, 5); palette[1][1] = expand_565((color1 >> 5) & 63, 6); palette[1][2] = expand_565(color1 & 31, 5);
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+	uint32_t indices = 0;
+	if(color0 != color1)
+	{
+		for(unsigned int t = 0; t < 16; ++t)
+		{
+			unsigned int best = 0;
+			int best_distance = 1 << 30;
+			for(unsigned int p = 0; p < 4; ++p)
+			{
+				const int r = texels[t][0] - palette[p][0], g = texels[t][1] - palette[p][1], b = texels[t][2] - palette[p][2];
+				const int distance = r * r + g * g + b * b;
+				if(distance < best_distance)
+				{
+					best_distance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (2 * t);
+		}
+	}
+	block[0] = color0 & 255; block[1] = color0 >> 8;
+	block[2] = color1 & 255; block[3] = color1 >> 8;
+	for(unsigned int i = 0; i < 4; ++i)
+	{
+		block[4 + i] = (indices >> (8 * i)) & 255;
+	}
+}
+
+//~ Interpolated channel block : the endpoints are the extremes of the channel, each texel takes the nearest of the 8 values
+static void encode_channel_block(const unsigned char texels[16][4], unsigned int channel, unsigned char* block)
+{
+	int high = 0, low = 255;
+	for(unsigned int t = 0; t < 16; ++t)
+	{
+		high = std::max(high, (int)texels[t][channel]);
+		low = std::min(low, (int)texels[t][channel]);
+	}
+	int palette[8] = { high, low };
+	for(unsigned int p = 1; p < 7; ++p)
+	{
+		palette[p + 1] = ((7 - p) * high + p * low) / 7;
+	}
+	uint64_t indices = 0;
+	if(high != low)
+	{
+		for(unsigned int t = 0; t < 16; ++t)
+		{
+			unsigned int best = 0;
+			for(unsigned int p = 1; p < 8; ++p)
+			{
+				if(abs(texels[t][channel] - palette[p]) < abs(texels[t][channel] - palette[best]))
+				{
+					best = p;
+				}
+			}
+			indices |= (uint64_t)best << (3 * t);
+		}
+	}
+	block[0] = high;
+	block[1] = low;
+	for(unsigned int i = 0; i < 6; ++i)
+	{
+		block[2 + i] = (indices >> (8 * i)) & 255;
+	}
+}
+
+//~ Level compressed by the threads, one task per row of blocks
+struct EncodeJob
+{
+	const unsigned char* pixels;
+	int width;
+	int height;
+	CompressionFormat format;
+	unsigned char* blocks;
+};
+
+static void encode_rows(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	const EncodeJob& job = *(const EncodeJob*)data;
+	const unsigned int blocks_per_row = (job.width + 3) / 4;
+	const size_t block_size = get_block_size(job.format);
+	unsigned char texels[16][4];
+	for(unsigned int row = begin; row < end; ++row)
+	{
+		for(unsigned int column = 0; column < blocks_per_row; ++column)
+		{
+			//~ The texels past the borders of the small levels repeat the last row or column
+			for(unsigned int t = 0; t < 16; ++t)
+			{
+				const int x = std::min((int)(column * 4 + t % 4), job.width - 1), y = std::min((int)(row * 4 + t / 4), job.height - 1);
+				memcpy(texels[t], job.pixels + ((size_t)y * job.width + x) * 4, 4);
+			}
+			unsigned char* block = job.blocks + ((size_t)row * blocks_per_row + column) * block_size;
+			switch(job.format)
+			{
+				case COMPRESSION_BC1:
+					encode_color_block(texels, block);
+					break;
+				case COMPRESSION_BC3:
+					encode_channel_block(texels, 3, block);
+					encode_color_block(texels, block + 8);
+					break;
+				case COMPRESSION_BC5:
+					encode_channel_block(texels, 0, block);
+					encode_channel_block(texels, 1, block + 8);
+					break;
+			}
+		}
+	}
+}
+
+bool CompressedTexture::encode(const TextureImage& image, CompressionFormat format, const std::string& path)
+{
+	const char* four_ccs[] = { "DXT1", "DXT5", "ATI2" };
+	DdsHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "DDS ", 4);
+	header.size = sizeof(DdsHeader) - 4;
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = image.height;
+	header.width = image.width;
+	header.linear_size = ((image.width + 3) / 4) * ((image.height + 3) / 4) * get_block_size(format);
+	header.mip_map_count = image.levels;
+	header.pixel_format.size = sizeof(DdsPixelFormat);
+	header.pixel_format.flags = DDPF_FOURCC;
+	header.pixel_format.four_cc = make_four_cc(four_ccs[format]);
+	header.caps[0] = DDSCAPS_TEXTURE | (image.levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if(file == NULL)
+	{
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	std::vector<unsigned char> blocks;
+	for(unsigned int level = 0; level < image.levels && written; ++level)
+	{
+		EncodeJob job;
+		job.pixels = image.pixels + TextureDecoder::get_level_offset(image, level);
+		job.width = std::max(1, image.width >> level);
+		job.height = std::max(1, image.height >> level);
+		job.format = format;
+		const unsigned int rows = (job.height + 3) / 4;
+		blocks.resize((size_t)rows * ((job.width + 3) / 4) * get_block_size(format));
+		job.blocks = &blocks[0];
+		ThreadPool::get_shared().parallel_for(rows, 4, encode_rows, &job);
+		written = fwrite(&blocks[0], 1, blocks.size(), file) == blocks.size();
+	}
+	fclose(file);
+	return written;
+}
+
+int CompressedTexture::run(int argc, char** argv)
+{
+	if(argc < 2 || std::string(argv[1]) != "--compress-texture")
+	{
+		return -1;
+	}
+	if(argc < 3)
+	{
+		std::cerr << "Usage : " << argv[0] << " --compress-texture <image> [bc1|bc3|bc5]" << std::endl;
+		return 1;
+	}
+	Uint32 start = SDL_GetTicks();
+	TextureImage image = TextureDecoder::decode(argv[2]);
+	if(image.pixels == NULL)
+	{
+		return 1;
+	}
+	//~ Without a format, BC3 for the images with transparency and BC1 for the others
+	CompressionFormat format = COMPRESSION_BC1;
+	const std::string name = (argc > 3) ? argv[3] : "";
+	if(name == "bc3")
+	{
+		format = COMPRESSION_BC3;
+	}
+	else if(name == "bc5")
+	{
+		format = COMPRESSION_BC5;
+	}
+	else if(name.empty())
+	{
+		for(size_t p = 0; p < (size_t)image.width * image.height; ++p)
+		{
+			if(image.pixels[p * 4 + 3] < 255)
+			{
+				format = COMPRESSION_BC3;
+				break;
+			}
+		}
+	}
+	else if(name != "bc1")
+	{
+		std::cerr << "Unknown format " << name << ", expected bc1, bc3 or bc5" << std::endl;
+		TextureDecoder::release(image);
+		return 1;
+	}
+
+	//~ The colors are averaged in linear space for the mipmaps, the normals as they are
+	std::vector<TextureImage> images(1, image);
+	TextureDecoder::prepare(images, 0, 0, format != COMPRESSION_BC5);
+	image = images[0];
+	const std::string path = get_path(argv[2]);
+	const bool written = encode(image, format, path);
+	if(written)
+	{
+		const size_t size = ((image.width + 3) / 4) * ((image.height + 3) / 4) * get_block_size(format);
+		std::cout << path << " : " << image.width << "x" << image.height << ", " << image.levels << " levels, " << size << " bytes for the first level instead of "
+			<< (size_t)image.width * image.height * 4 << ", compressed in " << SDL_GetTicks() - start << " ms" << std::endl;
+	}
+	else
+	{
+		std::cerr << "Unable to write " << path << std::endl;
+	}
+	TextureDecoder::release(image);
+	return written ? 0 : 1;
+}
+
+//~ Getters
+int CompressedTexture::get_width() const
+{
+	return m_width;
+}
+
+int CompressedTexture::get_height() const
+{
+	return m_height;
+}
+
+unsigned int CompressedTexture::get_number_of_levels() const
+{
+	return m_levels;
+}
+
+CompressionFormat CompressedTexture::get_format() const
+{
+	return m_format;
+}
+
+size_t CompressedTexture::get_level_size(unsigned int level) const
+{
+	return (size_t)std::max(1, (std::max(1, m_width >> level) + 3) / 4) * std::max(1, (std::max(1, m_height >> level) + 3) / 4) * get_block_size(m_format);
+}
+
+size_t CompressedTexture::get_size() const
+{
+	size_t size = 0;
+	for(unsigned int level = 0; level < m_levels; ++level)
+	{
+		size += get_level_size(level);
+	}
+	return size;
+}
@@ -0,0 +1,125 @@
+/***************************************************************************
+									Frustum.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+/*!
+ * \file Frustum.cpp
+ * \brief Planes bounding what a camera sees, for culling
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/Frustum.hpp"
+
+Frustum::Frustum(const glm::mat4& clip)
+{
+	extract_planes(clip, m_planes);
+}
+
+Frustum::Frustum(const glm::mat4& first, const glm::mat4& second)
+{
+	glm::vec4 candidates[2][6];
+	extract_planes(first, candidates[0]);
+	extract_planes(second, candidates[1]);
+	glm::vec3 corners[16];
+	compute_corners(first, corners);
+	compute_corners(second, corners + 8);
+
+	for(unsigned int p = 0; p < 6; ++p)
+	{
+		//~ The most negative distance of a corner is the shift that brings every corner inside the plane
+		float shifts[2] = { 0.0f, 0.0f };
+		for(unsigned int f = 0; f < 2; ++f)
+		{
+			for(unsigned int c = 0; c < 16; ++c)
+			{
+				shifts[f] = std::max(shifts[f], -glm::dot(candidates[f][p], glm::vec4(corners[c], 1.0f)));
+			}
+		}
+		const unsigned int chosen = (shifts[1] < shifts[0]) ? 1 : 0;
+		m_planes[p] = candidates[chosen][p];
+		m_planes[p].w += shifts[chosen];
+	}
+}
+
+bool Frustum::intersects_sphere(const glm::vec3& centre, float radius) const
+{
+	for(unsigned int p = 0; p < 6; ++p)
+	{
+		if(glm::dot(m_planes[p], glm::vec4(centre, 1.0f)) < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Frustum::intersects_box(const glm::vec3& min, const glm::vec3& max) const
+{
+	for(unsigned int p = 0; p < 6; ++p)
+	{
+		//~ The corner of the box the farthest along the normal is the last one to leave the plane
+		const glm::vec3 farthest(	m_planes[p].x >= 0.0f ? max.x : min.x,
+									m_planes[p].y >= 0.0f ? max.y : min.y,
+									m_planes[p].z >= 0.0f ? max.z : min.z);
+		if(glm::dot(m_planes[p], glm::vec4(farthest, 1.0f)) < 0.0f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+const glm::vec4& Frustum::get_plane(unsigned int p) const
+{
+	return m_planes[p];
+}
+
+void Frustum::extract_planes(const glm::mat4& clip, glm::vec4* planes)
+{
+	const glm::vec4 w_row(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+	for(unsigned int axis = 0; axis < 3; ++axis)
+	{
+		const glm::vec4 row(clip[0][axis], clip[1][axis], clip[2][axis], clip[3][axis]);
+		planes[2 * axis] = w_row + row;
+		planes[2 * axis + 1] = w_row - row;
+	}
+	for(unsigned int p = 0; p < 6; ++p)
+	{
+		planes[p] /= glm::length(glm::vec3(planes[p]));
+	}
+}
+
+void Frustum::compute_corners(const glm::mat4& clip, glm::vec3* corners)
+{
+	const glm::mat4 clip_to_space = glm::inverse(clip);
+	for(unsigned int c = 0; c < 8; ++c)
+	{
+		const glm::vec4 corner = clip_to_space * glm::vec4((c & 1) ? 1.0f : -1.0f, (c & 2) ? 1.0f : -1.0f, (c & 4) ? 1.0f : -1.0f, 1.0f);
+		corners[c] = glm::vec3(corner) / corner.w;
+	}
+}
@@ -0,0 +1,1460 @@
+/***************************************************************************
+									Mesh.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+/*!
+ * \file Mesh.cpp
+ * \brief Geometry of a model, on the CPU side
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/Mesh.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+//~ Post-processing asked to assimp, part of the key of the cache
+static const unsigned int MESH_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs;
+//~ Bumped whenever the content of the cache changes
+static const uint32_t MESH_CACHE_VERSION = 8;
+static const char MESH_CACHE_MAGIC[8] = { '3', 'D', 'O', 'B', 'S', 'M', 'S', 'H' };
+static const char* MESH_CACHE_EXTENSION = ".meshcache";
+
+/*!
+ * \brief Header of a mesh cache, followed by the path of the model and the arrays
+ */
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t import_flags;
+	int64_t source_mtime;
+	uint64_t source_size;
+	uint64_t file_size;
+	uint32_t path_length;
+	uint32_t number_of_vertices;
+	uint32_t number_of_indices;
+	float unique_vertex_ratio;
+	float min[3];
+	float max[3];
+	float barycentre[3];
+	float average_distance;
+	float standard_deviation;
+	float radius;
+	float original_acmr;
+	float original_atvr;
+	float optimized_acmr;
+	float optimized_atvr;
+	//~ Offsets of the arrays from the beginning of the file, 16 bytes aligned
+	uint64_t vertices_offset;
+	uint64_t normals_offset;
+	uint64_t uvs_offset;
+	uint64_t indices_offset;
+	//~ Draw ranges and materials, the texture paths are stored one after the other
+	uint32_t number_of_submeshes;
+	uint32_t number_of_materials;
+	uint64_t submeshes_offset;
+	uint64_t materials_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	//~ Levels of detail, their ranges follow the ones of the full resolution in the submeshes
+	uint32_t number_of_lods;
+	uint64_t lods_offset;
+	//~ Clusters of triangles of every level
+	uint32_t number_of_meshlets;
+	uint64_t meshlets_offset;
+};
+
+/*!
+ * \brief Material of a mesh cache
+ */
+struct CachedMaterial
+{
+	float diffuse_color[3];
+	uint32_t texture_offset;
+	uint32_t texture_length;
+};
+
+static uint64_t align_offset(uint64_t offset)
+{
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+//~ Tells if a range lies within a block, without overflowing on the values of a corrupted cache
+static bool fits_in(uint64_t offset, uint64_t count, uint64_t element_size, uint64_t block_size)
+{
+	return offset <= block_size && count * element_size <= block_size - offset;
+}
+
+Mesh::Mesh(const char* filename, bool geometry_only) throw (int):
+	m_vertices(NULL),
+	m_normals(NULL),
+	m_uvs(NULL),
+	m_indices(NULL),
+	m_number_of_vertices(0),
+	m_number_of_indices(0),
+	m_filename(filename),
+	m_has_cache(false),
+	m_mapping(NULL),
+	m_mapping_size(0),
+	m_unique_vertex_ratio(1.0f),
+	m_average_distance(0.0f),
+	m_standard_deviation(0.0f),
+	m_radius(0.0f)
+{
+	m_original_cache_statistics.acmr = m_original_cache_statistics.atvr = 0.0f;
+	m_optimized_cache_statistics = m_original_cache_statistics;
+	Uint32 start = SDL_GetTicks();
+	std::string cache_path = std::string(filename) + MESH_CACHE_EXTENSION;
+
+	m_has_cache = read_cache(cache_path, filename);
+	if(m_has_cache)
+	{
+		std::cout << filename << " : warm load from the mesh cache in " << SDL_GetTicks() - start << " ms" << std::endl;
+	}
+	else if(geometry_only)
+	{
+		//~ A cache without the levels of detail and the clusters would be taken as complete, the viewer writes it
+		import(filename);
+		compute_statistics();
+		std::cout << filename << " : imported in memory without a mesh cache in " << SDL_GetTicks() - start << " ms" << std::endl;
+	}
+	else
+	{
+		import(filename);
+		optimize();
+		build_lods();
+		build_meshlets();
+		compute_statistics();
+		m_has_cache = write_cache(cache_path, filename);
+		std::cout << filename << " : cold load with assimp in " << SDL_GetTicks() - start << " ms" << std::endl;
+	}
+	if(geometry_only)
+	{
+		std::vector<Meshlet>().swap(m_meshlets);
+		return;
+	}
+	//~ The hierarchy is quick to build in parallel, it is not cached
+	start = SDL_GetTicks();
+	unsigned int nb_full_indices = m_number_of_indices;
+	if(!m_lods.empty() && m_lods[0].number_of_submeshes > 0)
+	{
+		const Submesh& last = m_submeshes[m_lods[0].first_submesh + m_lods[0].number_of_submeshes - 1];
+		nb_full_indices = last.first_index + last.number_of_indices;
+	}
+	m_bvh.build(m_vertices, m_indices, nb_full_indices);
+	std::cout << "BVH of " << m_bvh.get_number_of_nodes() << " nodes built in " << SDL_GetTicks() - start << " ms" << std::endl;
+	std::cout << m_lods.size() << " levels of detail :";
+	for(unsigned int l = 0; l < m_lods.size(); ++l)
+	{
+		unsigned int nb_indices = 0;
+		for(unsigned int s = m_lods[l].first_submesh; s < m_lods[l].first_submesh + m_lods[l].number_of_submeshes; ++s)
+		{
+			nb_indices += m_submeshes[s].number_of_indices;
+		}
+		std::cout << " " << nb_indices / 3;
+	}
+	std::cout << " triangles in " << m_meshlets.size() << " clusters" << std::endl;
+	std::cout << "ACMR " << m_original_cache_statistics.acmr << " -> " << m_optimized_cache_statistics.acmr
+		<< ", ATVR " << m_original_cache_statistics.atvr << " -> " << m_optimized_cache_statistics.atvr << std::endl;
+}
+
+Mesh::~Mesh()
+{
+	unmap_cache();
+}
+
+bool Mesh::is_cache_file(const std::string& filename)
+{
+	const std::string extension = MESH_CACHE_EXTENSION;
+	return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+size_t Mesh::get_resident_memory()
+{
+#ifdef _WIN32
+	return 0;
+#else
+	//~ Second field of statm : number of resident pages, only on Linux
+	FILE* file = fopen("/proc/self/statm", "r");
+	if(file == NULL)
+	{
+		return 0;
+	}
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	const bool read = fscanf(file, "%lu %lu", &size, &resident) == 2;
+	fclose(file);
+	return read ? (size_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+//~ Hashes the raw bits of a vertex (position, normal, uv)
+static unsigned int hash_vertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv)
+{
+	float key[8] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, uv.x, uv.y };
+	unsigned int words[8];
+	memcpy(words, key, sizeof(words));
+
+	unsigned int hash = 2166136261u;
+	for(unsigned int i = 0; i < 8; ++i)
+	{
+		hash = (hash ^ words[i]) * 16777619u;
+	}
+	//~ Final avalanche so that the low bits can be used as a bucket index
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+//~ Conversion of the meshes of a scene, one task per mesh : each one is welded within the region of the arrays given
+//~ by the prefix sums of the numbers of vertices and faces, then the regions are packed
+struct ImportJob
+{
+	const aiScene* scene;
+	//~ Region of each mesh, then what the welding left in it
+	std::vector<unsigned int> first_vertices;
+	std::vector<unsigned int> first_indices;
+	std::vector<unsigned int> nb_vertices;
+	std::vector<unsigned int> nb_indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<unsigned int> indices;
+	//~ Place of each mesh in the packed arrays
+	std::vector<unsigned int> packed_vertices;
+	std::vector<unsigned int> packed_indices;
+	glm::vec3* packed_vertex_array;
+	glm::vec3* packed_normal_array;
+	glm::vec2* packed_uv_array;
+	unsigned int* packed_index_array;
+};
+
+static void weld_meshes(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ImportJob* job = static_cast<ImportJob*>(data);
+	std::vector<unsigned int> table, remap;
+	for(unsigned int m = begin; m < end; ++m)
+	{
+		const aiMesh* mesh = job->scene->mMeshes[m];
+		const unsigned int nb_mesh_vertices = mesh->mNumVertices;
+		job->nb_vertices[m] = job->nb_indices[m] = 0;
+		if(nb_mesh_vertices == 0)
+		{
+			continue;
+		}
+		glm::vec3* vertices = &job->vertices[0] + job->first_vertices[m];
+		glm::vec3* normals = &job->normals[0] + job->first_vertices[m];
+		glm::vec2* uvs = &job->uvs[0] + job->first_vertices[m];
+
+		//~ Each attribute is copied by its own loop, so that its presence is checked once per mesh
+		if(mesh->HasPositions())
+		{
+			for(unsigned int v = 0; v < nb_mesh_vertices; ++v)
+			{
+				vertices[v] = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+			}
+		}
+		if(mesh->HasNormals())
+		{
+			for(unsigned int v = 0; v < nb_mesh_vertices; ++v)
+			{
+				normals[v] = glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+			}
+		}
+		if(mesh->HasTextureCoords(0))
+		{
+			const aiVector3D* coordinates = mesh->mTextureCoords[0];
+			for(unsigned int v = 0; v < nb_mesh_vertices; ++v)
+			{
+				uvs[v] = glm::vec2(coordinates[v].x, coordinates[v].y);
+			}
+		}
+
+		//~ Welding in place : a new vertex moves down to the first free slot, never past its own one
+		unsigned int table_size = 1;
+		while(table_size < nb_mesh_vertices * 2) table_size <<= 1;
+		const unsigned int empty = 0xFFFFFFFFu;
+		table.assign(table_size, empty);
+		remap.resize(nb_mesh_vertices);
+		unsigned int count = 0;
+		for(unsigned int v = 0; v < nb_mesh_vertices; ++v)
+		{
+			//~ Looking for an identical vertex, bitwise
+			unsigned int bucket = hash_vertex(vertices[v], normals[v], uvs[v]) & (table_size - 1);
+			while(table[bucket] != empty)
+			{
+				const unsigned int candidate = table[bucket];
+				if(memcmp(&vertices[candidate], &vertices[v], sizeof(glm::vec3)) == 0 &&
+				   memcmp(&normals[candidate], &normals[v], sizeof(glm::vec3)) == 0 &&
+				   memcmp(&uvs[candidate], &uvs[v], sizeof(glm::vec2)) == 0)
+				{
+					break;
+				}
+				bucket = (bucket + 1) & (table_size - 1);
+			}
+			if(table[bucket] == empty)
+			{
+				vertices[count] = vertices[v];
+				normals[count] = normals[v];
+				uvs[count] = uvs[v];
+				table[bucket] = count++;
+			}
+			remap[v] = table[bucket];
+		}
+		job->nb_vertices[m] = count;
+
+		//~ Faces (points and lines left by the triangulation are skipped)
+		unsigned int* indices = &job->indices[0] + job->first_indices[m];
+		unsigned int nb_mesh_indices = 0;
+		for(unsigned int f = 0; f < mesh->mNumFaces; ++f)
+		{
+			const aiFace& face = mesh->mFaces[f];
+			if(face.mNumIndices != 3) continue;
+			indices[nb_mesh_indices++] = remap[face.mIndices[0]];
+			indices[nb_mesh_indices++] = remap[face.mIndices[1]];
+			indices[nb_mesh_indices++] = remap[face.mIndices[2]];
+		}
+		job->nb_indices[m] = nb_mesh_indices;
+	}
+}
+
+static void pack_meshes(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ImportJob* job = static_cast<ImportJob*>(data);
+	for(unsigned int m = begin; m < end; ++m)
+	{
+		const unsigned int first_vertex = job->first_vertices[m], nb_vertices = job->nb_vertices[m];
+		std::copy(job->vertices.begin() + first_vertex, job->vertices.begin() + first_vertex + nb_vertices, job->packed_vertex_array + job->packed_vertices[m]);
+		std::copy(job->normals.begin() + first_vertex, job->normals.begin() + first_vertex + nb_vertices, job->packed_normal_array + job->packed_vertices[m]);
+		std::copy(job->uvs.begin() + first_vertex, job->uvs.begin() + first_vertex + nb_vertices, job->packed_uv_array + job->packed_vertices[m]);
+		//~ The indices of the welding start at 0 for each mesh
+		if(job->nb_indices[m] == 0)
+		{
+			continue;
+		}
+		const unsigned int* indices = &job->indices[0] + job->first_indices[m];
+		unsigned int* packed = job->packed_index_array + job->packed_indices[m];
+		for(unsigned int i = 0; i < job->nb_indices[m]; ++i)
+		{
+			packed[i] = indices[i] + job->packed_vertices[m];
+		}
+	}
+}
+
+void Mesh::import(const char* filename) throw (int)
+{
+	if(ObjParser::is_obj_file(filename))
+	{
+		try
+		{
+			import_obj(filename);
+			return;
+		}
+		catch(int)
+		{
+			//~ assimp may still read it, or report why it cannot
+			std::cerr << filename << " : the OBJ parser failed, falling back to assimp" << std::endl;
+			m_owned_vertices.clear();
+			m_owned_normals.clear();
+			m_owned_uvs.clear();
+			m_owned_indices.clear();
+			m_submeshes.clear();
+			m_materials.clear();
+		}
+	}
+
+	//~ Creating the scene of the model
+	const aiScene* scene = aiImportFile(filename, MESH_IMPORT_FLAGS);
+	if(!scene)
+	{
+		throw(0);
+	}
+
+	import_materials(scene, filename);
+
+	//~ Region of each mesh in the arrays, from the prefix sums of its vertices and faces
+	Uint32 start = SDL_GetTicks();
+	const unsigned int nb_meshes = scene->mNumMeshes;
+	ImportJob job;
+	job.scene = scene;
+	job.first_vertices.resize(nb_meshes + 1, 0);
+	job.first_indices.resize(nb_meshes + 1, 0);
+	for(unsigned int m = 0; m < nb_meshes; ++m)
+	{
+		job.first_vertices[m + 1] = job.first_vertices[m] + scene->mMeshes[m]->mNumVertices;
+		job.first_indices[m + 1] = job.first_indices[m] + 3 * scene->mMeshes[m]->mNumFaces;
+	}
+	job.nb_vertices.resize(nb_meshes);
+	job.nb_indices.resize(nb_meshes);
+	job.vertices.resize(job.first_vertices[nb_meshes]);
+	job.normals.resize(job.first_vertices[nb_meshes]);
+	job.uvs.resize(job.first_vertices[nb_meshes]);
+	job.indices.resize(job.first_indices[nb_meshes]);
+	ThreadPool& pool = ThreadPool::get_shared();
+	pool.parallel_for(nb_meshes, 1, weld_meshes, &job);
+
+	//~ The regions are packed, each mesh keeps its own range of indices
+	job.packed_vertices.resize(nb_meshes + 1, 0);
+	job.packed_indices.resize(nb_meshes + 1, 0);
+	for(unsigned int m = 0; m < nb_meshes; ++m)
+	{
+		job.packed_vertices[m + 1] = job.packed_vertices[m] + job.nb_vertices[m];
+		job.packed_indices[m + 1] = job.packed_indices[m] + job.nb_indices[m];
+	}
+	m_owned_vertices.resize(job.packed_vertices[nb_meshes]);
+	m_owned_normals.resize(job.packed_vertices[nb_meshes]);
+	m_owned_uvs.resize(job.packed_vertices[nb_meshes]);
+	m_owned_indices.resize(job.packed_indices[nb_meshes]);
+	job.packed_vertex_array = m_owned_vertices.empty() ? NULL : &m_owned_vertices[0];
+	job.packed_normal_array = m_owned_normals.empty() ? NULL : &m_owned_normals[0];
+	job.packed_uv_array = m_owned_uvs.empty() ? NULL : &m_owned_uvs[0];
+	job.packed_index_array = m_owned_indices.empty() ? NULL : &m_owned_indices[0];
+	pool.parallel_for(nb_meshes, 1, pack_meshes, &job);
+	std::cout << nb_meshes << " meshes converted in " << SDL_GetTicks() - start << " ms" << std::endl;
+
+	for(unsigned int m = 0; m < nb_meshes; ++m)
+	{
+		Submesh submesh;
+		submesh.first_index = job.packed_indices[m];
+		submesh.number_of_indices = job.nb_indices[m];
+		submesh.material = std::min(scene->mMeshes[m]->mMaterialIndex, (unsigned int)m_materials.size() - 1);
+		if(submesh.number_of_indices == 0)
+		{
+			continue;
+		}
+		m_submeshes.push_back(submesh);
+		//~ Scans often come without normals, they would not be lighted
+		if(!scene->mMeshes[m]->HasNormals())
+		{
+			start = SDL_GetTicks();
+			const unsigned int first_vertex = job.packed_vertices[m];
+			NormalGenerator::generate(&m_owned_vertices[first_vertex], job.nb_vertices[m], &m_owned_indices[submesh.first_index],
+				submesh.number_of_indices, first_vertex, &m_owned_normals[first_vertex]);
+			std::cout << "Smooth normals of " << submesh.number_of_indices / 3 << " triangles generated in " << SDL_GetTicks() - start << " ms" << std::endl;
+		}
+	}
+	m_unique_vertex_ratio = (m_owned_indices.size() > 0) ? (float)m_owned_vertices.size() / (float)m_owned_indices.size() : 1.0f;
+
+	//~ Freeing the memory
+	aiReleaseImport(scene);
+	use_owned_arrays();
+}
+
+void Mesh::import_obj(const char* filename) throw (int)
+{
+	Uint32 start = SDL_GetTicks();
+	ObjModel model;
+	ObjParser::parse(filename, model);
+	std::cout << filename << " : " << model.indices.size() / 3 << " triangles parsed in " << SDL_GetTicks() - start << " ms" << std::endl;
+
+	for(unsigned int m = 0; m < model.materials.size(); ++m)
+	{
+		MeshMaterial material;
+		material.diffuse_color = model.materials[m].diffuse_color;
+		material.diffuse_texture = model.materials[m].diffuse_texture;
+		m_materials.push_back(material);
+	}
+	for(unsigned int r = 0; r < model.ranges.size(); ++r)
+	{
+		Submesh submesh;
+		submesh.first_index = model.ranges[r].first_index;
+		submesh.number_of_indices = model.ranges[r].number_of_indices;
+		submesh.material = model.ranges[r].material;
+		m_submeshes.push_back(submesh);
+	}
+	m_owned_vertices.swap(model.vertices);
+	m_owned_normals.swap(model.normals);
+	m_owned_uvs.swap(model.uvs);
+	m_owned_indices.swap(model.indices);
+
+	//~ Scans often come without normals, they would not be lighted
+	if(!model.has_normals && !m_owned_indices.empty())
+	{
+		start = SDL_GetTicks();
+		NormalGenerator::generate(&m_owned_vertices[0], m_owned_vertices.size(), &m_owned_indices[0], m_owned_indices.size(), 0, &m_owned_normals[0]);
+		std::cout << "Smooth normals of " << m_owned_indices.size() / 3 << " triangles generated in " << SDL_GetTicks() - start << " ms" << std::endl;
+	}
+	m_unique_vertex_ratio = (m_owned_indices.size() > 0) ? (float)m_owned_vertices.size() / (float)m_owned_indices.size() : 1.0f;
+	use_owned_arrays();
+}
+
+void Mesh::import_materials(const aiScene* scene, const char* filename)
+{
+	std::string directory = filename;
+	directory = (directory.find_last_of('/') != std::string::npos) ? directory.substr(0, directory.find_last_of('/') + 1) : "";
+	for(unsigned int index_material = 0; index_material < scene->mNumMaterials; ++index_material)
+	{
+		const aiMaterial* material = scene->mMaterials[index_material];
+		MeshMaterial imported;
+		imported.diffuse_color = glm::vec3(1.0f);
+		aiColor4D color;
+		if(aiGetMaterialColor(material, AI_MATKEY_COLOR_DIFFUSE, &color) == aiReturn_SUCCESS)
+		{
+			imported.diffuse_color = glm::vec3(color.r, color.g, color.b);
+		}
+		aiString path;
+		if(material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == aiReturn_SUCCESS && path.length > 0)
+		{
+			imported.diffuse_texture = directory + path.data;
+		}
+		m_materials.push_back(imported);
+	}
+	//~ Every submesh has a material
+	if(m_materials.empty())
+	{
+		MeshMaterial white;
+		white.diffuse_color = glm::vec3(1.0f);
+		m_materials.push_back(white);
+	}
+}
+
+void Mesh::optimize()
+{
+	const unsigned int nb_vertices = m_owned_vertices.size();
+	const unsigned int nb_indices = m_owned_indices.size();
+	if(nb_indices == 0)
+	{
+		return;
+	}
+	m_original_cache_statistics = MeshOptimizer::analyze_vertex_cache(&m_owned_indices[0], nb_indices, nb_vertices);
+
+	//~ The triangles stay within their submesh
+	for(unsigned int i = 0; i < m_submeshes.size(); ++i)
+	{
+		unsigned int* indices = &m_owned_indices[m_submeshes[i].first_index];
+		MeshOptimizer::optimize_vertex_cache(indices, m_submeshes[i].number_of_indices, nb_vertices);
+		MeshOptimizer::optimize_overdraw(indices, m_submeshes[i].number_of_indices, &m_owned_vertices[0], nb_vertices, 1.05f);
+	}
+
+	//~ The vertices follow the new order of the triangles
+	std::vector<unsigned int> remap = MeshOptimizer::optimize_vertex_fetch(&m_owned_indices[0], nb_indices, nb_vertices);
+	MeshOptimizer::remap_vertices(m_owned_vertices, remap);
+	MeshOptimizer::remap_vertices(m_owned_normals, remap);
+	MeshOptimizer::remap_vertices(m_owned_uvs, remap);
+	use_owned_arrays();
+
+	m_optimized_cache_statistics = MeshOptimizer::analyze_vertex_cache(&m_owned_indices[0], nb_indices, nb_vertices);
+}
+
+//~ Most levels of detail, the full resolution included
+static const unsigned int MESH_MAX_LODS = 5;
+//~ Smallest number of triangles worth a level, and largest ratio of triangles kept from the previous level
+static const unsigned int MESH_LOD_MIN_TRIANGLES = 64;
+static const float MESH_LOD_MIN_REDUCTION = 0.8f;
+
+//~ Simplification of every submesh for every coarser level, one task per pair
+struct LodJob
+{
+	const glm::vec3* vertices;
+	unsigned int nb_vertices;
+	const unsigned int* indices;
+	const std::vector<Submesh>* submeshes;
+	std::vector< std::vector<unsigned int> > results;
+	std::vector<float> errors;
+};
+
+static void simplify_submeshes(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	LodJob* job = static_cast<LodJob*>(data);
+	const unsigned int nb_submeshes = job->submeshes->size();
+	for(unsigned int task = begin; task < end; ++task)
+	{
+		//~ Every level starts from the full resolution, so that its error is measured against the model
+		const unsigned int level = task / nb_submeshes + 1;
+		const Submesh& submesh = (*job->submeshes)[task % nb_submeshes];
+		const unsigned int* indices = job->indices + submesh.first_index;
+		std::vector<unsigned int>& result = job->results[task];
+		result.resize(submesh.number_of_indices);
+		const unsigned int target = (submesh.number_of_indices / 3 >> level) * 3;
+		if(submesh.number_of_indices / 3 < MESH_LOD_MIN_TRIANGLES)
+		{
+			std::copy(indices, indices + submesh.number_of_indices, result.begin());
+			job->errors[task] = 0.0f;
+			continue;
+		}
+		result.resize(MeshSimplifier::simplify(&result[0], indices, submesh.number_of_indices, job->vertices, job->nb_vertices, target, job->errors[task]));
+		if(!result.empty())
+		{
+			MeshOptimizer::optimize_vertex_cache(&result[0], result.size(), job->nb_vertices);
+		}
+	}
+}
+
+void Mesh::build_lods()
+{
+	const std::vector<Submesh> submeshes = m_submeshes;
+	const unsigned int nb_submeshes = submeshes.size();
+	MeshLod full = { 0, nb_submeshes, 0.0f, 0, 0 };
+	m_lods.push_back(full);
+	const unsigned int nb_triangles = m_owned_indices.size() / 3;
+	if(nb_submeshes == 0 || nb_triangles >> 1 < MESH_LOD_MIN_TRIANGLES)
+	{
+		return;
+	}
+
+	LodJob job;
+	job.vertices = &m_owned_vertices[0];
+	job.nb_vertices = m_owned_vertices.size();
+	job.indices = &m_owned_indices[0];
+	job.submeshes = &submeshes;
+	job.results.resize((MESH_MAX_LODS - 1) * nb_submeshes);
+	job.errors.resize(job.results.size());
+	ThreadPool::get_shared().parallel_for(job.results.size(), 1, simplify_submeshes, &job);
+
+	//~ The levels are appended while they remove enough triangles, the last ones stop when the simplification stalls
+	unsigned int previous_triangles = nb_triangles;
+	for(unsigned int level = 1; level < MESH_MAX_LODS; ++level)
+	{
+		unsigned int level_indices = 0;
+		float error = 0.0f;
+		for(unsigned int s = 0; s < nb_submeshes; ++s)
+		{
+			level_indices += job.results[(level - 1) * nb_submeshes + s].size();
+			error = std::max(error, job.errors[(level - 1) * nb_submeshes + s]);
+		}
+		if(level_indices / 3 < MESH_LOD_MIN_TRIANGLES || level_indices / 3 > MESH_LOD_MIN_REDUCTION * previous_triangles)
+		{
+			break;
+		}
+		MeshLod lod = { (unsigned int)m_submeshes.size(), 0, error, 0, 0 };
+		for(unsigned int s = 0; s < nb_submeshes; ++s)
+		{
+			const std::vector<unsigned int>& result = job.results[(level - 1) * nb_submeshes + s];
+			if(result.empty())
+			{
+				continue;
+			}
+			Submesh range = { (unsigned int)m_owned_indices.size(), (unsigned int)result.size(), submeshes[s].material };
+			m_owned_indices.insert(m_owned_indices.end(), result.begin(), result.end());
+			m_submeshes.push_back(range);
+			++lod.number_of_submeshes;
+		}
+		m_lods.push_back(lod);
+		previous_triangles = level_indices / 3;
+	}
+	use_owned_arrays();
+}
+
+//~ Size of the clusters : they are closed at the largest size, or past the smallest one when the normals start to spread
+static const unsigned int MESHLET_MIN_TRIANGLES = 64;
+static const unsigned int MESHLET_MAX_TRIANGLES = 128;
+static const unsigned int MESHLET_MAX_VERTICES = 96;
+static const float MESHLET_MIN_NORMAL_COSINE = 0.5f;
+
+//~ Bounding sphere and normal cone of a cluster
+static void bound_meshlet(Meshlet& meshlet, const unsigned int* indices, const glm::vec3* vertices)
+{
+	glm::vec3 low = vertices[indices[0]], high = low;
+	for(unsigned int i = 1; i < meshlet.number_of_indices; ++i)
+	{
+		low = glm::min(low, vertices[indices[i]]);
+		high = glm::max(high, vertices[indices[i]]);
+	}
+	meshlet.centre = 0.5f * (low + high);
+	meshlet.radius = 0.0f;
+	for(unsigned int i = 0; i < meshlet.number_of_indices; ++i)
+	{
+		meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.centre, vertices[indices[i]]));
+	}
+
+	//~ Widest angle between the average normal and the normals of the triangles
+	glm::vec3 sum(0.0f);
+	std::vector<glm::vec3> normals;
+	for(unsigned int i = 0; i < meshlet.number_of_indices; i += 3)
+	{
+		const glm::vec3 normal = glm::cross(vertices[indices[i + 1]] - vertices[indices[i]], vertices[indices[i + 2]] - vertices[indices[i]]);
+		const float length = glm::length(normal);
+		if(length > 0.0f)
+		{
+			normals.push_back(normal / length);
+			sum += normals.back();
+		}
+	}
+	meshlet.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	meshlet.cone_cutoff = 1.0f;
+	if(glm::length(sum) == 0.0f)
+	{
+		return;
+	}
+	meshlet.cone_axis = glm::normalize(sum);
+	float min_cosine = 1.0f;
+	for(unsigned int n = 0; n < normals.size(); ++n)
+	{
+		min_cosine = std::min(min_cosine, glm::dot(meshlet.cone_axis, normals[n]));
+	}
+	//~ A cone of half angle a can be culled when the view direction is within 90 - a degrees of the axis
+	if(min_cosine > 0.0f)
+	{
+		meshlet.cone_cutoff = sqrt(1.0f - min_cosine * min_cosine);
+	}
+}
+
+void Mesh::build_meshlets()
+{
+	std::vector<unsigned int> stamps(m_number_of_vertices, 0xFFFFFFFFu);
+	for(unsigned int l = 0; l < m_lods.size(); ++l)
+	{
+		m_lods[l].first_meshlet = m_meshlets.size();
+		for(unsigned int s = m_lods[l].first_submesh; s < m_lods[l].first_submesh + m_lods[l].number_of_submeshes; ++s)
+		{
+			//~ The triangles are ordered for the vertex cache, so the neighbouring ones are already close in the range
+			const unsigned int end = m_submeshes[s].first_index + m_submeshes[s].number_of_indices;
+			Meshlet meshlet;
+			meshlet.first_index = m_submeshes[s].first_index;
+			meshlet.number_of_indices = 0;
+			unsigned int nb_vertices = 0;
+			glm::vec3 normal_sum(0.0f);
+			for(unsigned int t = m_submeshes[s].first_index; t < end; t += 3)
+			{
+				const unsigned int* triangle = m_indices + t;
+				glm::vec3 normal = glm::cross(m_vertices[triangle[1]] - m_vertices[triangle[0]], m_vertices[triangle[2]] - m_vertices[triangle[0]]);
+				normal = (glm::length(normal) > 0.0f) ? glm::normalize(normal) : normal;
+				unsigned int new_vertices = 0;
+				for(unsigned int c = 0; c < 3; ++c)
+				{
+					new_vertices += (stamps[triangle[c]] != m_meshlets.size()) ? 1 : 0;
+				}
+				const unsigned int nb_triangles = meshlet.number_of_indices / 3;
+				const bool full = nb_triangles == MESHLET_MAX_TRIANGLES || nb_vertices + new_vertices > MESHLET_MAX_VERTICES;
+				const bool spread = nb_triangles >= MESHLET_MIN_TRIANGLES && glm::length(normal_sum) > 0.0f && glm::dot(glm::normalize(normal_sum), normal) < MESHLET_MIN_NORMAL_COSINE;
+				if(full || spread)
+				{
+					bound_meshlet(meshlet, m_indices + meshlet.first_index, m_vertices);
+					m_meshlets.push_back(meshlet);
+					meshlet.first_index = t;
+					meshlet.number_of_indices = 0;
+					nb_vertices = 0;
+					normal_sum = glm::vec3(0.0f);
+				}
+				for(unsigned int c = 0; c < 3; ++c)
+				{
+					if(stamps[triangle[c]] != m_meshlets.size())
+					{
+						stamps[triangle[c]] = m_meshlets.size();
+						++nb_vertices;
+					}
+				}
+				meshlet.number_of_indices += 3;
+				normal_sum += normal;
+			}
+			if(meshlet.number_of_indices > 0)
+			{
+				bound_meshlet(meshlet, m_indices + meshlet.first_index, m_vertices);
+				m_meshlets.push_back(meshlet);
+			}
+		}
+		m_lods[l].number_of_meshlets = m_meshlets.size() - m_lods[l].first_meshlet;
+	}
+}
+
+//~ Vertices reduced with float accumulators before being merged in double ones
+static const unsigned int STATISTICS_BLOCK = 4096;
+
+//~ Bounding box and sum of the vertices seen by a thread, padded so that two threads never share a cache line
+struct BoundsPartial
+{
+	double sum[3];
+	float min[3];
+	float max[3];
+	char padding[64];
+};
+
+//~ Count, mean, sum of the squared deviations and largest of the distances seen by a thread
+struct DistancePartial
+{
+	double count;
+	double mean;
+	double m2;
+	float max;
+	char padding[64];
+};
+
+//~ Data shared by the ranges of a reduction
+struct StatisticsJob
+{
+	const glm::vec3* vertices;
+	unsigned int nb_vertices;
+	float barycentre[3];
+	std::vector<BoundsPartial> bounds;
+	std::vector<DistancePartial> distances;
+};
+
+//~ Merges the mean and the squared deviations of two sets of samples (Chan et al.)
+static void merge_distances(DistancePartial& into, double count, double mean, double m2)
+{
+	if(count == 0.0)
+	{
+		return;
+	}
+	const double total = into.count + count;
+	const double delta = mean - into.mean;
+	into.mean += delta * count / total;
+	into.m2 += m2 + delta * delta * into.count * count / total;
+	into.count = total;
+}
+
+#ifdef __SSE2__
+//~ Loads 4 packed vertices (x y z x | y z x y | z x y z) and transposes them into 3 registers x, y and z
+static inline void load_vertices(const float* v, __m128& x, __m128& y, __m128& z)
+{
+	const __m128 a = _mm_loadu_ps(v);
+	const __m128 b = _mm_loadu_ps(v + 4);
+	const __m128 c = _mm_loadu_ps(v + 8);
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,0,2,0)), _MM_SHUFFLE(3,1,3,0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,0,0)), _MM_SHUFFLE(2,0,2,0));
+}
+#endif
+
+//~ First sweep : bounding box and sum of the vertices, one block after the other
+static void reduce_bounds(unsigned int begin, unsigned int end, unsigned int worker, void* data)
+{
+	StatisticsJob* job = static_cast<StatisticsJob*>(data);
+	BoundsPartial& partial = job->bounds[worker];
+	for(unsigned int block = begin; block < end; ++block)
+	{
+		const unsigned int first = block * STATISTICS_BLOCK;
+		const unsigned int last = std::min(first + STATISTICS_BLOCK, job->nb_vertices);
+		unsigned int i = first;
+		float sum[3] = { 0.0f, 0.0f, 0.0f };
+#ifdef __SSE2__
+		__m128 sum_x = _mm_setzero_ps(), sum_y = _mm_setzero_ps(), sum_z = _mm_setzero_ps();
+		__m128 min_x = _mm_set1_ps(partial.min[0]), min_y = _mm_set1_ps(partial.min[1]), min_z = _mm_set1_ps(partial.min[2]);
+		__m128 max_x = _mm_set1_ps(partial.max[0]), max_y = _mm_set1_ps(partial.max[1]), max_z = _mm_set1_ps(partial.max[2]);
+		for(; i + 4 <= last; i += 4)
+		{
+			__m128 x, y, z;
+			load_vertices(&job->vertices[i].x, x, y, z);
+			sum_x = _mm_add_ps(sum_x, x); sum_y = _mm_add_ps(sum_y, y); sum_z = _mm_add_ps(sum_z, z);
+			min_x = _mm_min_ps(min_x, x); min_y = _mm_min_ps(min_y, y); min_z = _mm_min_ps(min_z, z);
+			max_x = _mm_max_ps(max_x, x); max_y = _mm_max_ps(max_y, y); max_z = _mm_max_ps(max_z, z);
+		}
+		float lanes[9][4];
+		_mm_storeu_ps(lanes[0], sum_x); _mm_storeu_ps(lanes[1], sum_y); _mm_storeu_ps(lanes[2], sum_z);
+		_mm_storeu_ps(lanes[3], min_x); _mm_storeu_ps(lanes[4], min_y); _mm_storeu_ps(lanes[5], min_z);
+		_mm_storeu_ps(lanes[6], max_x); _mm_storeu_ps(lanes[7], max_y); _mm_storeu_ps(lanes[8], max_z);
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			sum[c] = (lanes[c][0] + lanes[c][1]) + (lanes[c][2] + lanes[c][3]);
+			for(unsigned int l = 0; l < 4; ++l)
+			{
+				partial.min[c] = std::min(partial.min[c], lanes[3 + c][l]);
+				partial.max[c] = std::max(partial.max[c], lanes[6 + c][l]);
+			}
+		}
+#endif
+		for(; i < last; ++i)
+		{
+			for(unsigned int c = 0; c < 3; ++c)
+			{
+				const float value = job->vertices[i][c];
+				sum[c] += value;
+				partial.min[c] = std::min(partial.min[c], value);
+				partial.max[c] = std::max(partial.max[c], value);
+			}
+		}
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			partial.sum[c] += sum[c];
+		}
+	}
+}
+
+//~ Second sweep : mean and squared deviations of the distances to the barycentre, Welford's update per lane within a block
+static void reduce_distances(unsigned int begin, unsigned int end, unsigned int worker, void* data)
+{
+	StatisticsJob* job = static_cast<StatisticsJob*>(data);
+	DistancePartial& partial = job->distances[worker];
+	for(unsigned int block = begin; block < end; ++block)
+	{
+		const unsigned int first = block * STATISTICS_BLOCK;
+		const unsigned int last = std::min(first + STATISTICS_BLOCK, job->nb_vertices);
+		unsigned int i = first;
+#ifdef __SSE2__
+		const __m128 centre_x = _mm_set1_ps(job->barycentre[0]);
+		const __m128 centre_y = _mm_set1_ps(job->barycentre[1]);
+		const __m128 centre_z = _mm_set1_ps(job->barycentre[2]);
+		__m128 mean = _mm_setzero_ps(), m2 = _mm_setzero_ps(), farthest = _mm_setzero_ps();
+		float count = 0.0f;
+		for(; i + 4 <= last; i += 4)
+		{
+			__m128 x, y, z;
+			load_vertices(&job->vertices[i].x, x, y, z);
+			x = _mm_sub_ps(x, centre_x); y = _mm_sub_ps(y, centre_y); z = _mm_sub_ps(z, centre_z);
+			const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			count += 1.0f;
+			const __m128 delta = _mm_sub_ps(distance, mean);
+			mean = _mm_add_ps(mean, _mm_mul_ps(delta, _mm_set1_ps(1.0f / count)));
+			m2 = _mm_add_ps(m2, _mm_mul_ps(delta, _mm_sub_ps(distance, mean)));
+			farthest = _mm_max_ps(farthest, distance);
+		}
+		float lane_mean[4], lane_m2[4], lane_max[4];
+		_mm_storeu_ps(lane_mean, mean);
+		_mm_storeu_ps(lane_m2, m2);
+		_mm_storeu_ps(lane_max, farthest);
+		for(unsigned int l = 0; l < 4; ++l)
+		{
+			merge_distances(partial, count, lane_mean[l], lane_m2[l]);
+			partial.max = std::max(partial.max, lane_max[l]);
+		}
+#endif
+		for(; i < last; ++i)
+		{
+			const float distance = glm::distance(job->vertices[i], glm::vec3(job->barycentre[0], job->barycentre[1], job->barycentre[2]));
+			merge_distances(partial, 1.0, distance, 0.0);
+			partial.max = std::max(partial.max, distance);
+		}
+	}
+}
+
+MeshStatistics Mesh::measure(const glm::vec3* vertices, unsigned int nb_vertices)
+{
+	MeshStatistics statistics;
+	statistics.min = statistics.max = statistics.barycentre = glm::vec3(0.0f);
+	statistics.average_distance = statistics.standard_deviation = statistics.radius = 0.0f;
+	if(nb_vertices == 0)
+	{
+		return statistics;
+	}
+
+	ThreadPool& pool = ThreadPool::get_shared();
+	const unsigned int nb_blocks = (nb_vertices + STATISTICS_BLOCK - 1) / STATISTICS_BLOCK;
+	//~ A few ranges per thread balance the load without much scheduling
+	const unsigned int grain = std::max(1u, nb_blocks / (4 * pool.get_number_of_workers()));
+	StatisticsJob job;
+	job.vertices = vertices;
+	job.nb_vertices = nb_vertices;
+
+	BoundsPartial empty_bounds;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		empty_bounds.sum[c] = 0.0;
+		empty_bounds.min[c] = vertices[0][c];
+		empty_bounds.max[c] = vertices[0][c];
+	}
+	job.bounds.assign(pool.get_number_of_workers(), empty_bounds);
+	pool.parallel_for(nb_blocks, grain, reduce_bounds, &job);
+
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	statistics.min = statistics.max = vertices[0];
+	for(unsigned int w = 0; w < job.bounds.size(); ++w)
+	{
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			sum[c] += job.bounds[w].sum[c];
+			statistics.min[c] = std::min(statistics.min[c], job.bounds[w].min[c]);
+			statistics.max[c] = std::max(statistics.max[c], job.bounds[w].max[c]);
+		}
+	}
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		statistics.barycentre[c] = (float)(sum[c] / nb_vertices);
+		job.barycentre[c] = statistics.barycentre[c];
+	}
+
+	//~ The distances need the barycentre, hence the second sweep
+	DistancePartial empty_distances;
+	empty_distances.count = empty_distances.mean = empty_distances.m2 = 0.0;
+	empty_distances.max = 0.0f;
+	job.distances.assign(pool.get_number_of_workers(), empty_distances);
+	pool.parallel_for(nb_blocks, grain, reduce_distances, &job);
+
+	DistancePartial total = empty_distances;
+	for(unsigned int w = 0; w < job.distances.size(); ++w)
+	{
+		merge_distances(total, job.distances[w].count, job.distances[w].mean, job.distances[w].m2);
+		statistics.radius = std::max(statistics.radius, job.distances[w].max);
+	}
+	statistics.average_distance = (float)total.mean;
+	statistics.standard_deviation = (float)sqrt(total.m2 / total.count);
+	return statistics;
+}
+
+void Mesh::compute_statistics()
+{
+	MeshStatistics statistics = measure(m_vertices, m_number_of_vertices);
+	m_min = statistics.min;
+	m_max = statistics.max;
+	m_barycentre = statistics.barycentre;
+	m_average_distance = statistics.average_distance;
+	m_standard_deviation = statistics.standard_deviation;
+	m_radius = statistics.radius;
+}
+
+void Mesh::use_owned_arrays()
+{
+	m_number_of_vertices = m_owned_vertices.size();
+	m_number_of_indices = m_owned_indices.size();
+	m_vertices = m_number_of_vertices > 0 ? &m_owned_vertices[0] : NULL;
+	m_normals = m_number_of_vertices > 0 ? &m_owned_normals[0] : NULL;
+	m_uvs = m_number_of_vertices > 0 ? &m_owned_uvs[0] : NULL;
+	m_indices = m_number_of_indices > 0 ? &m_owned_indices[0] : NULL;
+}
+
+bool Mesh::map_cache(const std::string& cache_path, const char* filename)
+{
+	//~ Key of the cache : path, modification time and size of the model
+	struct stat source_stat;
+	if(stat(filename, &source_stat) != 0)
+	{
+		return false;
+	}
+
+#ifdef _WIN32
+	//~ No mmap : the cache is read at once
+	FILE* file = fopen(cache_path.c_str(), "rb");
+	if(file == NULL)
+	{
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	m_mapping_size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	m_mapping = new char[m_mapping_size];
+	bool read = fread(m_mapping, 1, m_mapping_size, file) == m_mapping_size;
+	fclose(file);
+	if(!read)
+	{
+		unmap_cache();
+		return false;
+	}
+#else
+	int descriptor = open(cache_path.c_str(), O_RDONLY);
+	if(descriptor < 0)
+	{
+		return false;
+	}
+	struct stat cache_stat;
+	if(fstat(descriptor, &cache_stat) != 0 || cache_stat.st_size < (off_t)sizeof(MeshCacheHeader))
+	{
+		close(descriptor);
+		return false;
+	}
+	m_mapping_size = cache_stat.st_size;
+	m_mapping = mmap(NULL, m_mapping_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(m_mapping == MAP_FAILED)
+	{
+		m_mapping = NULL;
+		return false;
+	}
+#endif
+
+	const char* bytes = (const char*)m_mapping;
+	const MeshCacheHeader* header = (const MeshCacheHeader*)bytes;
+	const size_t path_length = strlen(filename);
+	bool valid = m_mapping_size >= sizeof(MeshCacheHeader)
+		&& memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0
+		&& header->version == MESH_CACHE_VERSION
+		&& header->import_flags == MESH_IMPORT_FLAGS
+		&& header->source_mtime == (int64_t)source_stat.st_mtime
+		&& header->source_size == (uint64_t)source_stat.st_size
+		&& header->file_size == m_mapping_size
+		&& header->path_length == path_length
+		&& sizeof(MeshCacheHeader) + path_length <= m_mapping_size
+		&& memcmp(bytes + sizeof(MeshCacheHeader), filename, path_length) == 0
+		&& fits_in(header->vertices_offset, header->number_of_vertices, sizeof(glm::vec3), m_mapping_size)
+		&& fits_in(header->normals_offset, header->number_of_vertices, sizeof(glm::vec3), m_mapping_size)
+		&& fits_in(header->uvs_offset, header->number_of_vertices, sizeof(glm::vec2), m_mapping_size)
+		&& fits_in(header->indices_offset, header->number_of_indices, sizeof(unsigned int), m_mapping_size)
+		&& fits_in(header->submeshes_offset, header->number_of_submeshes, sizeof(Submesh), m_mapping_size)
+		&& fits_in(header->materials_offset, header->number_of_materials, sizeof(CachedMaterial), m_mapping_size)
+		&& fits_in(header->strings_offset, header->strings_size, 1, m_mapping_size)
+		&& fits_in(header->lods_offset, header->number_of_lods, sizeof(MeshLod), m_mapping_size)
+		&& fits_in(header->meshlets_offset, header->number_of_meshlets, sizeof(Meshlet), m_mapping_size);
+	//~ The ranges lie within the indices, the levels within the ranges and the clusters, the textures within the strings
+	if(valid)
+	{
+		const Submesh* submeshes = (const Submesh*)(bytes + header->submeshes_offset);
+		for(unsigned int s = 0; s < header->number_of_submeshes && valid; ++s)
+		{
+			valid = fits_in(submeshes[s].first_index, submeshes[s].number_of_indices, 1, header->number_of_indices);
+		}
+		const MeshLod* lods = (const MeshLod*)(bytes + header->lods_offset);
+		for(unsigned int l = 0; l < header->number_of_lods && valid; ++l)
+		{
+			valid = fits_in(lods[l].first_submesh, lods[l].number_of_submeshes, 1, header->number_of_submeshes)
+				&& fits_in(lods[l].first_meshlet, lods[l].number_of_meshlets, 1, header->number_of_meshlets);
+		}
+		const Meshlet* meshlets = (const Meshlet*)(bytes + header->meshlets_offset);
+		for(unsigned int m = 0; m < header->number_of_meshlets && valid; ++m)
+		{
+			valid = fits_in(meshlets[m].first_index, meshlets[m].number_of_indices, 1, header->number_of_indices);
+		}
+		const CachedMaterial* materials = (const CachedMaterial*)(bytes + header->materials_offset);
+		for(unsigned int m = 0; m < header->number_of_materials && valid; ++m)
+		{
+			valid = fits_in(materials[m].texture_offset, materials[m].texture_length, 1, header->strings_size);
+		}
+	}
+	if(!valid)
+	{
+		unmap_cache();
+		return false;
+	}
+	return true;
+}
+
+void Mesh::use_cached_arrays()
+{
+	//~ The arrays are used in place
+	const char* bytes = (const char*)m_mapping;
+	const MeshCacheHeader* header = (const MeshCacheHeader*)bytes;
+	m_number_of_vertices = header->number_of_vertices;
+	m_number_of_indices = header->number_of_indices;
+	m_vertices = (const glm::vec3*)(bytes + header->vertices_offset);
+	m_normals = (const glm::vec3*)(bytes + header->normals_offset);
+	m_uvs = (const glm::vec2*)(bytes + header->uvs_offset);
+	m_indices = (const unsigned int*)(bytes + header->indices_offset);
+}
+
+bool Mesh::read_cache(const std::string& cache_path, const char* filename)
+{
+	if(!map_cache(cache_path, filename))
+	{
+		return false;
+	}
+	use_cached_arrays();
+	const char* bytes = (const char*)m_mapping;
+	const MeshCacheHeader* header = (const MeshCacheHeader*)bytes;
+	//~ The ranges and the materials are small, they are copied
+	const Submesh* submeshes = (const Submesh*)(bytes + header->submeshes_offset);
+	m_submeshes.assign(submeshes, submeshes + header->number_of_submeshes);
+	const MeshLod* lods = (const MeshLod*)(bytes + header->lods_offset);
+	m_lods.assign(lods, lods + header->number_of_lods);
+	const Meshlet* meshlets = (const Meshlet*)(bytes + header->meshlets_offset);
+	m_meshlets.assign(meshlets, meshlets + header->number_of_meshlets);
+	const CachedMaterial* materials = (const CachedMaterial*)(bytes + header->materials_offset);
+	for(unsigned int m = 0; m < header->number_of_materials; ++m)
+	{
+		MeshMaterial material;
+		material.diffuse_color = glm::vec3(materials[m].diffuse_color[0], materials[m].diffuse_color[1], materials[m].diffuse_color[2]);
+		material.diffuse_texture.assign(bytes + header->strings_offset + materials[m].texture_offset, materials[m].texture_length);
+		m_materials.push_back(material);
+	}
+
+	m_unique_vertex_ratio = header->unique_vertex_ratio;
+	m_min = glm::vec3(header->min[0], header->min[1], header->min[2]);
+	m_max = glm::vec3(header->max[0], header->max[1], header->max[2]);
+	m_barycentre = glm::vec3(header->barycentre[0], header->barycentre[1], header->barycentre[2]);
+	m_average_distance = header->average_distance;
+	m_standard_deviation = header->standard_deviation;
+	m_radius = header->radius;
+	m_original_cache_statistics.acmr = header->original_acmr;
+	m_original_cache_statistics.atvr = header->original_atvr;
+	m_optimized_cache_statistics.acmr = header->optimized_acmr;
+	m_optimized_cache_statistics.atvr = header->optimized_atvr;
+	return true;
+}
+
+bool Mesh::write_cache(const std::string& cache_path, const char* filename) const
+{
+	struct stat source_stat;
+	if(stat(filename, &source_stat) != 0)
+	{
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.import_flags = MESH_IMPORT_FLAGS;
+	header.source_mtime = source_stat.st_mtime;
+	header.source_size = source_stat.st_size;
+	header.path_length = strlen(filename);
+	header.number_of_vertices = m_number_of_vertices;
+	header.number_of_indices = m_number_of_indices;
+	header.unique_vertex_ratio = m_unique_vertex_ratio;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		header.min[c] = m_min[c];
+		header.max[c] = m_max[c];
+		header.barycentre[c] = m_barycentre[c];
+	}
+	header.average_distance = m_average_distance;
+	header.standard_deviation = m_standard_deviation;
+	header.radius = m_radius;
+	header.original_acmr = m_original_cache_statistics.acmr;
+	header.original_atvr = m_original_cache_statistics.atvr;
+	header.optimized_acmr = m_optimized_cache_statistics.acmr;
+	header.optimized_atvr = m_optimized_cache_statistics.atvr;
+	header.vertices_offset = align_offset(sizeof(MeshCacheHeader) + header.path_length);
+	header.normals_offset = align_offset(header.vertices_offset + m_number_of_vertices * sizeof(glm::vec3));
+	header.uvs_offset = align_offset(header.normals_offset + m_number_of_vertices * sizeof(glm::vec3));
+	header.indices_offset = align_offset(header.uvs_offset + m_number_of_vertices * sizeof(glm::vec2));
+	std::vector<CachedMaterial> materials(m_materials.size());
+	std::string strings;
+	for(unsigned int m = 0; m < m_materials.size(); ++m)
+	{
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			materials[m].diffuse_color[c] = m_materials[m].diffuse_color[c];
+		}
+		materials[m].texture_offset = strings.size();
+		materials[m].texture_length = m_materials[m].diffuse_texture.size();
+		strings += m_materials[m].diffuse_texture;
+	}
+	header.number_of_submeshes = m_submeshes.size();
+	header.number_of_materials = m_materials.size();
+	header.submeshes_offset = align_offset(header.indices_offset + m_number_of_indices * sizeof(unsigned int));
+	header.materials_offset = align_offset(header.submeshes_offset + m_submeshes.size() * sizeof(Submesh));
+	header.strings_offset = align_offset(header.materials_offset + materials.size() * sizeof(CachedMaterial));
+	header.strings_size = strings.size();
+	header.number_of_lods = m_lods.size();
+	header.lods_offset = align_offset(header.strings_offset + header.strings_size);
+	header.number_of_meshlets = m_meshlets.size();
+	header.meshlets_offset = align_offset(header.lods_offset + m_lods.size() * sizeof(MeshLod));
+	header.file_size = header.meshlets_offset + m_meshlets.size() * sizeof(Meshlet);
+
+	//~ Written aside then renamed, so that a partial cache is never read
+	std::string temporary_path = cache_path + ".tmp";
+	FILE* file = fopen(temporary_path.c_str(), "wb");
+	if(file == NULL)
+	{
+		std::cerr << "Unable to write the mesh cache " << cache_path << std::endl;
+		return false;
+	}
+
+	const char padding[16] = { 0 };
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(filename, 1, header.path_length, file) == header.path_length;
+	uint64_t offset = sizeof(header) + header.path_length;
+	const uint64_t offsets[9] = { header.vertices_offset, header.normals_offset, header.uvs_offset, header.indices_offset, header.submeshes_offset, header.materials_offset, header.strings_offset, header.lods_offset, header.meshlets_offset };
+	const void* arrays[9] = { m_vertices, m_normals, m_uvs, m_indices, m_submeshes.empty() ? NULL : &m_submeshes[0], materials.empty() ? NULL : &materials[0], strings.data(), m_lods.empty() ? NULL : &m_lods[0],
+		m_meshlets.empty() ? NULL : &m_meshlets[0] };
+	const uint64_t sizes[9] = { m_number_of_vertices * sizeof(glm::vec3), m_number_of_vertices * sizeof(glm::vec3), m_number_of_vertices * sizeof(glm::vec2), m_number_of_indices * sizeof(unsigned int),
+		m_submeshes.size() * sizeof(Submesh), materials.size() * sizeof(CachedMaterial), strings.size(), m_lods.size() * sizeof(MeshLod), m_meshlets.size() * sizeof(Meshlet) };
+	for(unsigned int a = 0; a < 9 && written; ++a)
+	{
+		written = fwrite(padding, 1, offsets[a] - offset, file) == offsets[a] - offset
+			&& (sizes[a] == 0 || fwrite(arrays[a], 1, sizes[a], file) == sizes[a]);
+		offset = offsets[a] + sizes[a];
+	}
+	written = (fclose(file) == 0) && written;
+
+#ifdef _WIN32
+	remove(cache_path.c_str());
+#endif
+	if(!written || rename(temporary_path.c_str(), cache_path.c_str()) != 0)
+	{
+		remove(temporary_path.c_str());
+		std::cerr << "Unable to write the mesh cache " << cache_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void Mesh::unmap_cache()
+{
+	if(m_mapping == NULL)
+	{
+		return;
+	}
+#ifdef _WIN32
+	delete[] (char*)m_mapping;
+#else
+	munmap(m_mapping, m_mapping_size);
+#endif
+	m_mapping = NULL;
+	m_mapping_size = 0;
+}
+
+void Mesh::release_arrays(CpuRetention retention)
+{
+	if(retention == RETENTION_ALL || !has_arrays())
+	{
+		return;
+	}
+	if(!m_has_cache)
+	{
+		std::cerr << m_filename << " has no mesh cache, its arrays are kept" << std::endl;
+		return;
+	}
+	//~ The kept arrays are copied out of the mapping before it is released
+	if(retention == RETENTION_POSITIONS && m_mapping != NULL)
+	{
+		m_owned_vertices.assign(m_vertices, m_vertices + m_number_of_vertices);
+		m_owned_indices.assign(m_indices, m_indices + m_number_of_indices);
+	}
+	//~ Swapped with empty vectors, clear() would keep the memory
+	std::vector<glm::vec3>().swap(m_owned_normals);
+	std::vector<glm::vec2>().swap(m_owned_uvs);
+	if(retention == RETENTION_NONE)
+	{
+		std::vector<glm::vec3>().swap(m_owned_vertices);
+		std::vector<unsigned int>().swap(m_owned_indices);
+	}
+	unmap_cache();
+	//~ The numbers of vertices and indices stay valid for the draws
+	m_vertices = m_owned_vertices.empty() ? NULL : &m_owned_vertices[0];
+	m_normals = NULL;
+	m_uvs = NULL;
+	m_indices = m_owned_indices.empty() ? NULL : &m_owned_indices[0];
+}
+
+bool Mesh::reload_arrays()
+{
+	if(has_arrays())
+	{
+		return true;
+	}
+	//~ The cache must still hold the arrays the ranges, the clusters and the hierarchy were built from
+	if(map_cache(m_filename + MESH_CACHE_EXTENSION, m_filename.c_str()))
+	{
+		const MeshCacheHeader* header = (const MeshCacheHeader*)m_mapping;
+		if(header->number_of_vertices == m_number_of_vertices && header->number_of_indices == m_number_of_indices)
+		{
+			std::vector<glm::vec3>().swap(m_owned_vertices);
+			std::vector<unsigned int>().swap(m_owned_indices);
+			use_cached_arrays();
+			return true;
+		}
+		unmap_cache();
+	}
+	std::cerr << "The mesh cache of " << m_filename << " no longer matches the model, its arrays cannot be reloaded" << std::endl;
+	return false;
+}
+
+//~ Getters
+VertexCacheStatistics Mesh::get_original_cache_statistics() const
+{
+	return m_original_cache_statistics;
+}
+
+VertexCacheStatistics Mesh::get_optimized_cache_statistics() const
+{
+	return m_optimized_cache_statistics;
+}
+
+const std::vector<Submesh>& Mesh::get_submeshes() const
+{
+	return m_submeshes;
+}
+
+const std::vector<MeshLod>& Mesh::get_lods() const
+{
+	return m_lods;
+}
+
+const std::vector<Meshlet>& Mesh::get_meshlets() const
+{
+	return m_meshlets;
+}
+
+const TriangleBVH& Mesh::get_bvh() const
+{
+	return m_bvh;
+}
+
+const std::vector<MeshMaterial>& Mesh::get_materials() const
+{
+	return m_materials;
+}
+
+const glm::vec3* Mesh::get_vertices() const
+{
+	return m_vertices;
+}
+
+const glm::vec3* Mesh::get_normals() const
+{
+	return m_normals;
+}
+
+const glm::vec2* Mesh::get_uvs() const
+{
+	return m_uvs;
+}
+
+const unsigned int* Mesh::get_indices() const
+{
+	return m_indices;
+}
+
+unsigned int Mesh::get_number_of_vertices() const
+{
+	return m_number_of_vertices;
+}
+
+unsigned int Mesh::get_number_of_indices() const
+{
+	return m_number_of_indices;
+}
+
+float Mesh::get_unique_vertex_ratio() const
+{
+	return m_unique_vertex_ratio;
+}
+
+glm::vec3 Mesh::get_min() const
+{
+	return m_min;
+}
+
+glm::vec3 Mesh::get_max() const
+{
+	return m_max;
+}
+
+glm::vec3 Mesh::get_barycentre() const
+{
+	return m_barycentre;
+}
+
+float Mesh::get_average_distance() const
+{
+	return m_average_distance;
+}
+
+float Mesh::get_standard_deviation() const
+{
+	return m_standard_deviation;
+}
+
+float Mesh::get_radius() const
+{
+	return m_radius;
+}
+
+bool Mesh::is_from_cache() const
+{
+	return m_mapping != NULL;
+}
+
+bool Mesh::has_arrays() const
+{
+	return m_normals != NULL || m_number_of_vertices == 0;
+}
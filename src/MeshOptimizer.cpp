@@ -0,0 +1,352 @@
+/***************************************************************************
+									MeshOptimizer.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file MeshOptimizer.cpp
+ * \brief Reorders the triangles and the vertices of a mesh for the GPU
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/MeshOptimizer.hpp"
+
+//~ Parameters of Forsyth's scoring : size of the simulated LRU cache, and weights of the cache position and of the valence
+static const int FORSYTH_CACHE_SIZE = 32;
+static const float FORSYTH_DECAY_POWER = 1.5f;
+static const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+static const float FORSYTH_VALENCE_SCALE = 2.0f;
+static const float FORSYTH_VALENCE_POWER = 0.5f;
+static const unsigned int FORSYTH_MAX_VALENCE = 64;
+
+//~ Score of a vertex from its position in the cache and the number of triangles still using it
+static float vertex_score(int cache_position, unsigned int valence, const float* cache_scores, const float* valence_scores)
+{
+	if(valence == 0)
+	{
+		return -1.0f;
+	}
+	float score = (cache_position >= 0) ? cache_scores[cache_position] : 0.0f;
+	return score + valence_scores[std::min(valence, FORSYTH_MAX_VALENCE - 1)];
+}
+
+void MeshOptimizer::optimize_vertex_cache(unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices)
+{
+	const unsigned int nb_triangles = nb_indices / 3;
+	if(nb_triangles < 2 || nb_vertices == 0)
+	{
+		return;
+	}
+
+	//~ The vertices of a submesh are contiguous, they are numbered from the lowest one
+	unsigned int first = indices[0], last = indices[0];
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		first = std::min(first, indices[i]);
+		last = std::max(last, indices[i]);
+	}
+	const unsigned int nb_local = last - first + 1;
+
+	float cache_scores[FORSYTH_CACHE_SIZE];
+	for(int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+	{
+		//~ The vertices of the last triangle get a fixed score so that its neighbours do not win by default
+		cache_scores[i] = (i < 3) ? FORSYTH_LAST_TRIANGLE_SCORE : powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_DECAY_POWER);
+	}
+	float valence_scores[FORSYTH_MAX_VALENCE];
+	valence_scores[0] = 0.0f;
+	for(unsigned int i = 1; i < FORSYTH_MAX_VALENCE; ++i)
+	{
+		valence_scores[i] = FORSYTH_VALENCE_SCALE * powf((float)i, -FORSYTH_VALENCE_POWER);
+	}
+
+	//~ Triangles of each vertex, the ones not emitted yet first
+	std::vector<unsigned int> valence(nb_local, 0);
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		++valence[indices[i] - first];
+	}
+	std::vector<unsigned int> offsets(nb_local + 1, 0);
+	for(unsigned int v = 0; v < nb_local; ++v)
+	{
+		offsets[v + 1] = offsets[v] + valence[v];
+	}
+	std::vector<unsigned int> adjacency(nb_indices);
+	std::vector<unsigned int> filled(offsets.begin(), offsets.end() - 1);
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		for(unsigned int k = 0; k < 3; ++k)
+		{
+			adjacency[filled[indices[t * 3 + k] - first]++] = t;
+		}
+	}
+
+	std::vector<int> cache_position(nb_local, -1);
+	std::vector<float> scores(nb_local);
+	for(unsigned int v = 0; v < nb_local; ++v)
+	{
+		scores[v] = vertex_score(-1, valence[v], cache_scores, valence_scores);
+	}
+	std::vector<float> triangle_scores(nb_triangles);
+	std::vector<bool> emitted(nb_triangles, false);
+	int best = 0;
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		triangle_scores[t] = scores[indices[t * 3] - first] + scores[indices[t * 3 + 1] - first] + scores[indices[t * 3 + 2] - first];
+		if(triangle_scores[t] > triangle_scores[best])
+		{
+			best = t;
+		}
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(nb_indices);
+	std::vector<unsigned int> cache, new_cache;
+	unsigned int cursor = 0;
+	for(unsigned int emitted_count = 0; emitted_count < nb_triangles; ++emitted_count)
+	{
+		//~ Dead end : the next triangle in the input order
+		if(best < 0)
+		{
+			while(emitted[cursor]) ++cursor;
+			best = cursor;
+		}
+		emitted[best] = true;
+		new_cache.clear();
+		for(unsigned int k = 0; k < 3; ++k)
+		{
+			const unsigned int v = indices[best * 3 + k] - first;
+			output.push_back(v + first);
+			new_cache.push_back(v);
+			//~ Removing the triangle from the ones of the vertex
+			for(unsigned int a = offsets[v]; a < offsets[v] + valence[v]; ++a)
+			{
+				if(adjacency[a] == (unsigned int)best)
+				{
+					std::swap(adjacency[a], adjacency[offsets[v] + valence[v] - 1]);
+					break;
+				}
+			}
+			--valence[v];
+		}
+		//~ The vertices of the triangle move to the front of the LRU cache
+		for(unsigned int c = 0; c < cache.size(); ++c)
+		{
+			if(cache[c] != new_cache[0] && cache[c] != new_cache[1] && cache[c] != new_cache[2])
+			{
+				new_cache.push_back(cache[c]);
+			}
+		}
+		cache.swap(new_cache);
+
+		//~ Updating the scores of the vertices in the cache, or just evicted, and of their triangles
+		for(unsigned int c = 0; c < cache.size(); ++c)
+		{
+			const unsigned int v = cache[c];
+			cache_position[v] = (c < (unsigned int)FORSYTH_CACHE_SIZE) ? (int)c : -1;
+			scores[v] = vertex_score(cache_position[v], valence[v], cache_scores, valence_scores);
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for(unsigned int c = 0; c < cache.size(); ++c)
+		{
+			const unsigned int v = cache[c];
+			for(unsigned int a = offsets[v]; a < offsets[v] + valence[v]; ++a)
+			{
+				const unsigned int t = adjacency[a];
+				triangle_scores[t] = scores[indices[t * 3] - first] + scores[indices[t * 3 + 1] - first] + scores[indices[t * 3 + 2] - first];
+				if(triangle_scores[t] > best_score)
+				{
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+		}
+		if(cache.size() > (unsigned int)FORSYTH_CACHE_SIZE)
+		{
+			cache.resize(FORSYTH_CACHE_SIZE);
+		}
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//~ Cluster of consecutive triangles and its occlusion potential
+struct TriangleCluster
+{
+	unsigned int first;
+	unsigned int count;
+	float sort_key;
+};
+
+static bool is_drawn_before(const TriangleCluster& a, const TriangleCluster& b)
+{
+	return a.sort_key > b.sort_key;
+}
+
+void MeshOptimizer::optimize_overdraw(unsigned int* indices, unsigned int nb_indices, const glm::vec3* vertices, unsigned int nb_vertices, float threshold)
+{
+	const unsigned int nb_triangles = nb_indices / 3;
+	if(nb_triangles < 2)
+	{
+		return;
+	}
+	const unsigned int cache_size = 16;
+	const VertexCacheStatistics original = analyze_vertex_cache(indices, nb_indices, nb_vertices, cache_size);
+
+	//~ A cluster begins where the cache-optimized order restarts : a triangle whose three vertices miss the cache
+	std::vector<TriangleCluster> clusters;
+	std::vector<unsigned int> timestamps(nb_vertices, 0);
+	unsigned int time = cache_size + 1;
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		unsigned int misses = 0;
+		for(unsigned int k = 0; k < 3; ++k)
+		{
+			const unsigned int v = indices[t * 3 + k];
+			if(time - timestamps[v] > cache_size)
+			{
+				timestamps[v] = time++;
+				++misses;
+			}
+		}
+		if(t == 0 || misses == 3)
+		{
+			TriangleCluster cluster = { t, 0, 0.0f };
+			clusters.push_back(cluster);
+		}
+		++clusters.back().count;
+	}
+	if(clusters.size() < 2)
+	{
+		return;
+	}
+
+	//~ Centroid of the mesh, weighted by the areas
+	glm::vec3 mesh_centroid(0.0f);
+	float mesh_area = 0.0f;
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		const glm::vec3& a = vertices[indices[t * 3]];
+		const glm::vec3& b = vertices[indices[t * 3 + 1]];
+		const glm::vec3& c = vertices[indices[t * 3 + 2]];
+		const float area = glm::length(glm::cross(b - a, c - a));
+		mesh_centroid += (a + b + c) * (area / 3.0f);
+		mesh_area += area;
+	}
+	mesh_centroid = (mesh_area > 0.0f) ? mesh_centroid / mesh_area : vertices[indices[0]];
+
+	//~ The clusters facing away from the centre are likely to occlude the others, they are drawn first
+	for(unsigned int c = 0; c < clusters.size(); ++c)
+	{
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area_sum = 0.0f;
+		for(unsigned int t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t)
+		{
+			const glm::vec3& a = vertices[indices[t * 3]];
+			const glm::vec3& b = vertices[indices[t * 3 + 1]];
+			const glm::vec3& d = vertices[indices[t * 3 + 2]];
+			const glm::vec3 cross = glm::cross(b - a, d - a);
+			const float area = glm::length(cross);
+			centroid += (a + b + d) * (area / 3.0f);
+			normal += cross;
+			area_sum += area;
+		}
+		const float normal_length = glm::length(normal);
+		if(area_sum > 0.0f && normal_length > 0.0f)
+		{
+			clusters[c].sort_key = glm::dot(centroid / area_sum - mesh_centroid, normal / normal_length);
+		}
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), is_drawn_before);
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(nb_indices);
+	for(unsigned int c = 0; c < clusters.size(); ++c)
+	{
+		sorted.insert(sorted.end(), indices + clusters[c].first * 3, indices + (clusters[c].first + clusters[c].count) * 3);
+	}
+	if(analyze_vertex_cache(&sorted[0], nb_indices, nb_vertices, cache_size).acmr <= original.acmr * threshold)
+	{
+		std::copy(sorted.begin(), sorted.end(), indices);
+	}
+}
+
+std::vector<unsigned int> MeshOptimizer::optimize_vertex_fetch(unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices)
+{
+	const unsigned int unused = 0xFFFFFFFFu;
+	std::vector<unsigned int> new_index(nb_vertices, unused);
+	std::vector<unsigned int> remap;
+	remap.reserve(nb_vertices);
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		unsigned int& v = new_index[indices[i]];
+		if(v == unused)
+		{
+			v = remap.size();
+			remap.push_back(indices[i]);
+		}
+		indices[i] = v;
+	}
+	for(unsigned int v = 0; v < nb_vertices; ++v)
+	{
+		if(new_index[v] == unused)
+		{
+			remap.push_back(v);
+		}
+	}
+	return remap;
+}
+
+VertexCacheStatistics MeshOptimizer::analyze_vertex_cache(const unsigned int* indices, unsigned int nb_indices, unsigned int nb_vertices, unsigned int cache_size)
+{
+	VertexCacheStatistics statistics = { 0.0f, 0.0f };
+	if(nb_indices < 3)
+	{
+		return statistics;
+	}
+	//~ A vertex is in the FIFO if fewer than cache_size vertices were transformed since it was
+	std::vector<unsigned int> timestamps(nb_vertices, 0);
+	std::vector<bool> referenced(nb_vertices, false);
+	unsigned int time = cache_size + 1;
+	unsigned int misses = 0, nb_referenced = 0;
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		const unsigned int v = indices[i];
+		if(time - timestamps[v] > cache_size)
+		{
+			timestamps[v] = time++;
+			++misses;
+		}
+		if(!referenced[v])
+		{
+			referenced[v] = true;
+			++nb_referenced;
+		}
+	}
+	statistics.acmr = (float)misses / (nb_indices / 3);
+	statistics.atvr = (float)misses / nb_referenced;
+	return statistics;
+}
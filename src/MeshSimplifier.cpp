@@ -0,0 +1,344 @@
+/***************************************************************************
+									MeshSimplifier.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file MeshSimplifier.cpp
+ * \brief Reduces the number of triangles of a mesh for its levels of detail
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/MeshSimplifier.hpp"
+
+//~ Lowest cosine allowed between the normal of a triangle before and after a collapse
+static const float SIMPLIFIER_MAX_FLIP = 0.25f;
+
+/*!
+ * \brief Sum of the squared distances to a set of planes, weighted by the areas of their triangles
+ */
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static Quadric make_quadric(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+	Quadric q;
+	memset(&q, 0, sizeof(q));
+	glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+	const float length = glm::length(normal);
+	if(length == 0.0f)
+	{
+		return q;
+	}
+	normal /= length;
+	const double area = 0.5 * length;
+	const double d = -glm::dot(normal, p0);
+	q.a00 = area * normal.x * normal.x; q.a01 = area * normal.x * normal.y; q.a02 = area * normal.x * normal.z;
+	q.a11 = area * normal.y * normal.y; q.a12 = area * normal.y * normal.z; q.a22 = area * normal.z * normal.z;
+	q.b0 = area * normal.x * d; q.b1 = area * normal.y * d; q.b2 = area * normal.z * d;
+	q.c = area * d * d;
+	q.weight = area;
+	return q;
+}
+
+static void add_quadric(Quadric& into, const Quadric& q)
+{
+	into.a00 += q.a00; into.a01 += q.a01; into.a02 += q.a02;
+	into.a11 += q.a11; into.a12 += q.a12; into.a22 += q.a22;
+	into.b0 += q.b0; into.b1 += q.b1; into.b2 += q.b2;
+	into.c += q.c;
+	into.weight += q.weight;
+}
+
+//~ Mean squared distance of a point to the planes of a quadric
+static float quadric_error(const Quadric& q, const glm::vec3& p)
+{
+	if(q.weight == 0.0)
+	{
+		return 0.0f;
+	}
+	const double x = p.x, y = p.y, z = p.z;
+	const double error = x * (q.a00 * x + 2.0 * (q.a01 * y + q.a02 * z + q.b0))
+		+ y * (q.a11 * y + 2.0 * (q.a12 * z + q.b1))
+		+ z * (q.a22 * z + 2.0 * q.b2)
+		+ q.c;
+	return (float)std::max(0.0, error / q.weight);
+}
+
+/*!
+ * \brief Collapse of a vertex onto the other end of an edge
+ */
+struct EdgeCollapse
+{
+	unsigned int from;
+	unsigned int to;
+	float cost;
+};
+
+static bool is_cheaper(const EdgeCollapse& a, const EdgeCollapse& b)
+{
+	return a.cost < b.cost;
+}
+
+//~ Orders vertices by position, to find the ones that only differ by their attributes
+struct PositionLess
+{
+	const glm::vec3* vertices;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		const glm::vec3& p = vertices[a];
+		const glm::vec3& q = vertices[b];
+		return p.x < q.x || (p.x == q.x && (p.y < q.y || (p.y == q.y && p.z < q.z)));
+	}
+};
+
+unsigned int MeshSimplifier::simplify(unsigned int* destination, const unsigned int* indices, unsigned int nb_indices, const glm::vec3* vertices, unsigned int nb_vertices, unsigned int target_nb_indices, float& error)
+{
+	error = 0.0f;
+	nb_indices -= nb_indices % 3;
+	if(nb_indices == 0 || nb_vertices == 0)
+	{
+		return 0;
+	}
+
+	//~ Local numbering of the vertices used by the triangles, the arrays below stay small for a small submesh
+	std::vector<unsigned int> globals(indices, indices + nb_indices);
+	std::sort(globals.begin(), globals.end());
+	globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+	const unsigned int nb_locals = globals.size();
+	std::vector<unsigned int> result(nb_indices);
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		result[i] = std::lower_bound(globals.begin(), globals.end(), indices[i]) - globals.begin();
+	}
+	std::vector<glm::vec3> points(nb_locals);
+	for(unsigned int v = 0; v < nb_locals; ++v)
+	{
+		points[v] = vertices[globals[v]];
+	}
+
+	//~ Vertices sharing a position are one vertex for the topology, a seam of the attributes when there are several
+	std::vector<unsigned int> position(nb_locals);
+	std::vector<bool> locked(nb_locals, false);
+	{
+		std::vector<unsigned int> order(nb_locals);
+		for(unsigned int v = 0; v < nb_locals; ++v)
+		{
+			order[v] = v;
+		}
+		PositionLess less;
+		less.vertices = &points[0];
+		std::sort(order.begin(), order.end(), less);
+		for(unsigned int i = 0; i < nb_locals; )
+		{
+			unsigned int j = i + 1;
+			while(j < nb_locals && points[order[j]] == points[order[i]]) ++j;
+			for(unsigned int k = i; k < j; ++k)
+			{
+				position[order[k]] = order[i];
+			}
+			locked[order[i]] = (j - i > 1);
+			i = j;
+		}
+	}
+
+	//~ The ends of the edges used once, or more than twice, are kept so that the borders do not move
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(nb_indices);
+		for(unsigned int t = 0; t < nb_indices; t += 3)
+		{
+			for(unsigned int e = 0; e < 3; ++e)
+			{
+				const uint64_t a = position[result[t + e]];
+				const uint64_t b = position[result[t + (e + 1) % 3]];
+				edges.push_back((a << 32) | b);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for(unsigned int i = 0; i < edges.size(); ++i)
+		{
+			const uint64_t reverse = (edges[i] << 32) | (edges[i] >> 32);
+			const bool repeated = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+			if(repeated || !std::binary_search(edges.begin(), edges.end(), reverse))
+			{
+				locked[edges[i] >> 32] = true;
+				locked[edges[i] & 0xFFFFFFFFu] = true;
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(nb_locals);
+	memset(&quadrics[0], 0, nb_locals * sizeof(Quadric));
+	for(unsigned int t = 0; t < nb_indices; t += 3)
+	{
+		const Quadric q = make_quadric(points[result[t]], points[result[t + 1]], points[result[t + 2]]);
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			add_quadric(quadrics[position[result[t + c]]], q);
+		}
+	}
+
+	//~ Passes of independent collapses, the cheapest first, until the target is reached or nothing can collapse
+	std::vector<unsigned int> offsets, triangles, remap(nb_locals);
+	std::vector<EdgeCollapse> collapses;
+	std::vector<bool> touched;
+	float max_cost = 0.0f;
+	while(result.size() > target_nb_indices)
+	{
+		const unsigned int nb_triangles = result.size() / 3;
+
+		//~ Triangles around each position
+		offsets.assign(nb_locals + 1, 0);
+		for(unsigned int i = 0; i < result.size(); ++i)
+		{
+			++offsets[position[result[i]] + 1];
+		}
+		for(unsigned int v = 0; v < nb_locals; ++v)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(result.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for(unsigned int i = 0; i < result.size(); ++i)
+		{
+			triangles[fill[position[result[i]]]++] = i / 3;
+		}
+
+		collapses.clear();
+		for(unsigned int t = 0; t < result.size(); t += 3)
+		{
+			for(unsigned int e = 0; e < 3; ++e)
+			{
+				const unsigned int a = result[t + e], b = result[t + (e + 1) % 3];
+				if(position[a] == position[b])
+				{
+					continue;
+				}
+				Quadric q = quadrics[position[a]];
+				add_quadric(q, quadrics[position[b]]);
+				if(!locked[position[a]])
+				{
+					EdgeCollapse collapse = { a, b, quadric_error(q, points[b]) };
+					collapses.push_back(collapse);
+				}
+				if(!locked[position[b]])
+				{
+					EdgeCollapse collapse = { b, a, quadric_error(q, points[a]) };
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), is_cheaper);
+
+		//~ A collapse removes two triangles, the neighbourhood of a collapsed vertex is left alone until the next pass
+		const unsigned int needed = (result.size() - target_nb_indices) / 6 + 1;
+		unsigned int accepted = 0;
+		touched.assign(nb_locals, false);
+		for(unsigned int v = 0; v < nb_locals; ++v)
+		{
+			remap[v] = v;
+		}
+		for(unsigned int c = 0; c < collapses.size() && accepted < needed; ++c)
+		{
+			const unsigned int from = position[collapses[c].from];
+			const unsigned int to = position[collapses[c].to];
+			if(touched[from] || touched[to])
+			{
+				continue;
+			}
+			bool flips = false;
+			for(unsigned int k = offsets[from]; k < offsets[from + 1] && !flips; ++k)
+			{
+				const unsigned int* triangle = &result[3 * triangles[k]];
+				glm::vec3 before[3], after[3];
+				bool collapsed = false;
+				for(unsigned int corner = 0; corner < 3; ++corner)
+				{
+					const unsigned int p = position[triangle[corner]];
+					collapsed = collapsed || (p == to);
+					before[corner] = points[p];
+					after[corner] = (p == from) ? points[to] : points[p];
+				}
+				if(collapsed)
+				{
+					continue;
+				}
+				const glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(normal_before, normal_after) <= SIMPLIFIER_MAX_FLIP * glm::length(normal_before) * glm::length(normal_after);
+			}
+			if(flips)
+			{
+				continue;
+			}
+
+			//~ The vertex is not on a seam, it is the only one at its position
+			remap[collapses[c].from] = collapses[c].to;
+			for(unsigned int k = offsets[from]; k < offsets[from + 1]; ++k)
+			{
+				for(unsigned int corner = 0; corner < 3; ++corner)
+				{
+					touched[position[result[3 * triangles[k] + corner]]] = true;
+				}
+			}
+			add_quadric(quadrics[to], quadrics[from]);
+			max_cost = std::max(max_cost, collapses[c].cost);
+			++accepted;
+		}
+		if(accepted == 0)
+		{
+			break;
+		}
+
+		//~ The triangles that lost an edge are removed
+		unsigned int kept = 0;
+		for(unsigned int t = 0; t < nb_triangles; ++t)
+		{
+			const unsigned int a = remap[result[3 * t]], b = remap[result[3 * t + 1]], c = remap[result[3 * t + 2]];
+			if(position[a] == position[b] || position[b] == position[c] || position[c] == position[a])
+			{
+				continue;
+			}
+			result[kept++] = a;
+			result[kept++] = b;
+			result[kept++] = c;
+		}
+		result.resize(kept);
+	}
+
+	for(unsigned int i = 0; i < result.size(); ++i)
+	{
+		destination[i] = globals[result[i]];
+	}
+	error = sqrt(max_cost);
+	return result.size();
+}
@@ -0,0 +1,241 @@
+/***************************************************************************
+									ModelLoader.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file ModelLoader.cpp
+ * \brief Loads the models on a worker thread
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/ModelLoader.hpp"
+
+ModelLoader::ModelLoader():
+	m_thread(NULL),
+	m_stop(false),
+	m_has_request(false),
+	m_request_counter(0),
+	m_stage(LOADING_IDLE),
+	m_request_time(0)
+{
+	m_mutex = SDL_CreateMutex();
+	m_condition = SDL_CreateCond();
+	m_thread = SDL_CreateThread(ModelLoader::run_worker, this);
+	if(m_thread == NULL)
+	{
+		std::cerr << "Unable to create the loading thread : " << SDL_GetError() << std::endl;
+	}
+}
+
+ModelLoader::~ModelLoader()
+{
+	//~ Stopping the worker, it ends once its current model is loaded
+	SDL_LockMutex(m_mutex);
+	m_stop = true;
+	SDL_CondSignal(m_condition);
+	SDL_UnlockMutex(m_mutex);
+	if(m_thread != NULL)
+	{
+		SDL_WaitThread(m_thread, NULL);
+	}
+
+	while(!m_completed.empty())
+	{
+		delete m_completed.front()->mesh;
+		release(m_completed.front());
+		m_completed.pop();
+	}
+
+	SDL_DestroyCond(m_condition);
+	SDL_DestroyMutex(m_mutex);
+}
+
+void ModelLoader::request(const std::string& model_path, const std::string& texture_path)
+{
+	SDL_LockMutex(m_mutex);
+	//~ A request not started yet is simply replaced
+	m_has_request = true;
+	m_requested_model = model_path;
+	m_requested_texture = texture_path;
+	++m_request_counter;
+	m_stage = LOADING_PENDING;
+	m_loading_model = model_path;
+	m_request_time = SDL_GetTicks();
+	SDL_CondSignal(m_condition);
+	SDL_UnlockMutex(m_mutex);
+}
+
+LoadedModel* ModelLoader::poll()
+{
+	LoadedModel* latest = NULL;
+	SDL_LockMutex(m_mutex);
+	while(!m_completed.empty())
+	{
+		LoadedModel* model = m_completed.front();
+		m_completed.pop();
+		//~ Models loaded for an outdated request are dropped
+		if(model->request != m_request_counter)
+		{
+			delete model->mesh;
+			release(model);
+		}
+		else
+		{
+			latest = model;
+		}
+	}
+	if(latest != NULL)
+	{
+		m_stage = LOADING_IDLE;
+	}
+	SDL_UnlockMutex(m_mutex);
+	return latest;
+}
+
+void ModelLoader::release(LoadedModel* model)
+{
+	if(model == NULL)
+	{
+		return;
+	}
+	Object::free_textures(model->textures);
+	delete model->cloud;
+	delete model;
+}
+
+bool ModelLoader::is_loading()
+{
+	SDL_LockMutex(m_mutex);
+	bool loading = (m_stage != LOADING_IDLE);
+	SDL_UnlockMutex(m_mutex);
+	return loading;
+}
+
+LoadingStage ModelLoader::get_stage()
+{
+	SDL_LockMutex(m_mutex);
+	LoadingStage stage = m_stage;
+	SDL_UnlockMutex(m_mutex);
+	return stage;
+}
+
+std::string ModelLoader::get_loading_model()
+{
+	SDL_LockMutex(m_mutex);
+	std::string model = m_loading_model;
+	SDL_UnlockMutex(m_mutex);
+	return model;
+}
+
+unsigned int ModelLoader::get_loading_time()
+{
+	SDL_LockMutex(m_mutex);
+	unsigned int time = SDL_GetTicks() - m_request_time;
+	SDL_UnlockMutex(m_mutex);
+	return time;
+}
+
+int ModelLoader::run_worker(void* data)
+{
+	static_cast<ModelLoader*>(data)->work();
+	return 0;
+}
+
+void ModelLoader::set_stage(LoadingStage stage)
+{
+	SDL_LockMutex(m_mutex);
+	//~ A newer request keeps its own stage until the worker takes it
+	if(!m_has_request)
+	{
+		m_stage = stage;
+	}
+	SDL_UnlockMutex(m_mutex);
+}
+
+void ModelLoader::work()
+{
+	while(true)
+	{
+		//~ Waiting for a request
+		SDL_LockMutex(m_mutex);
+		while(!m_has_request && !m_stop)
+		{
+			SDL_CondWait(m_condition, m_mutex);
+		}
+		if(m_stop)
+		{
+			SDL_UnlockMutex(m_mutex);
+			break;
+		}
+		LoadedModel* model = new LoadedModel();
+		model->model_path = m_requested_model;
+		model->texture_path = m_requested_texture;
+		model->mesh = NULL;
+		model->cloud = NULL;
+		model->textures.diffuse.pixels = NULL;
+		model->texture_time = 0;
+		model->request = m_request_counter;
+		m_has_request = false;
+		m_stage = LOADING_GEOMETRY;
+		SDL_UnlockMutex(m_mutex);
+
+		//~ Import and statistics, or mapping of the cache ; the point clouds have no texture
+		try
+		{
+			if(PointCloud::is_point_cloud_file(model->model_path))
+			{
+				model->cloud = new PointCloud(model->model_path.c_str());
+			}
+			else
+			{
+				model->mesh = new Mesh(model->model_path.c_str());
+			}
+		}
+		catch(int)
+		{
+			model->mesh = NULL;
+			model->cloud = NULL;
+		}
+
+		//~ Decoding the textures and building their mipmaps, unless they are cached
+		if(model->mesh != NULL)
+		{
+			set_stage(LOADING_TEXTURE);
+			Uint32 start = SDL_GetTicks();
+			Object::decode_textures(model->texture_path, *model->mesh, model->textures);
+			model->texture_time = SDL_GetTicks() - start;
+		}
+
+		SDL_LockMutex(m_mutex);
+		m_completed.push(model);
+		if(!m_has_request)
+		{
+			m_stage = LOADING_DONE;
+		}
+		SDL_UnlockMutex(m_mutex);
+	}
+}
@@ -0,0 +1,326 @@
+/***************************************************************************
+									NormalGenerator.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file NormalGenerator.cpp
+ * \brief Generates smooth normals for the meshes that have none
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/NormalGenerator.hpp"
+
+//~ Size of a cell of the welding grid, relatively to the diagonal of the bounding box
+static const float NORMAL_WELD_EPSILON = 1e-5f;
+//~ Items per range of the sorting passes, and per range of the vertex loops
+static const unsigned int NORMAL_RANGE = 65536;
+//~ Partitions per thread : enough for the load to balance, few enough for the histograms to stay small
+static const unsigned int NORMAL_PARTITIONS_PER_WORKER = 8;
+static const unsigned int NORMAL_EMPTY = 0xFFFFFFFFu;
+
+/*!
+ * \brief Items sorted by partition, with a counting sort
+ */
+struct PartitionedItems
+{
+	unsigned int* items;				/*!< Items, partition after partition, in increasing order within a partition */
+	std::vector<unsigned int> starts;	/*!< First item of each partition, then the number of items */
+};
+
+//~ Generation being run, the large arrays are left uninitialized for the threads to fill them
+struct NormalJob
+{
+	const glm::vec3* vertices;
+	unsigned int nb_vertices;
+	const unsigned int* indices;
+	unsigned int nb_indices;
+	unsigned int base_vertex;
+	glm::vec3* normals;
+
+	//~ Bounding box of each thread, then the grid
+	std::vector<glm::vec3> mins;
+	std::vector<glm::vec3> maxs;
+	glm::vec3 origin;
+	float inverse_cell;
+
+	//~ Hash of the cell of each vertex, whose high bits give its partition
+	unsigned int* hashes;
+	unsigned int partition_shift;
+	unsigned int nb_partitions;
+
+	//~ Sort being run : vertices or corners, and the histogram of each range
+	bool sorting_corners;
+	std::vector<unsigned int> counts;
+	PartitionedItems* sorted;
+
+	PartitionedItems vertex_partitions;
+	PartitionedItems corner_partitions;
+	//~ Welded vertex of each vertex, the first one of its cell, and the sum of the normals of each welded vertex
+	unsigned int* groups;
+	glm::vec3* sums;
+};
+
+static void get_cell(const NormalJob& job, unsigned int vertex, int cell[3])
+{
+	const glm::vec3 position = (job.vertices[vertex] - job.origin) * job.inverse_cell;
+	cell[0] = (int)floorf(position.x);
+	cell[1] = (int)floorf(position.y);
+	cell[2] = (int)floorf(position.z);
+}
+
+static unsigned int hash_cell(const int cell[3])
+{
+	unsigned int hash = (unsigned int)cell[0] * 73856093u ^ (unsigned int)cell[1] * 19349663u ^ (unsigned int)cell[2] * 83492791u;
+	//~ Avalanche, both the high bits (partition) and the low bits (bucket) are used
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35u;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+//~ Polynomial arc cosine (Abramowitz and Stegun 4.4.45), within 1e-4 radian : plenty for weights, several times faster than acosf
+static float approximate_acos(float x)
+{
+	const float y = fabsf(x);
+	const float angle = sqrtf(1.0f - y) * (1.5707288f + y * (-0.2121144f + y * (0.0742610f - 0.0187293f * y)));
+	return (x >= 0.0f) ? angle : (float)M_PI - angle;
+}
+
+static unsigned int get_partition(const NormalJob& job, unsigned int item)
+{
+	const unsigned int vertex = job.sorting_corners ? job.indices[item] - job.base_vertex : item;
+	return job.hashes[vertex] >> job.partition_shift;
+}
+
+static void bound_vertices(unsigned int begin, unsigned int end, unsigned int worker, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	glm::vec3& min = job->mins[worker];
+	glm::vec3& max = job->maxs[worker];
+	for(unsigned int v = begin; v < end; ++v)
+	{
+		min = glm::min(min, job->vertices[v]);
+		max = glm::max(max, job->vertices[v]);
+	}
+}
+
+static void hash_vertices(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	for(unsigned int v = begin; v < end; ++v)
+	{
+		int cell[3];
+		get_cell(*job, v, cell);
+		job->hashes[v] = hash_cell(cell);
+	}
+}
+
+static void count_items(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	unsigned int* counts = &job->counts[(begin / NORMAL_RANGE) * job->nb_partitions];
+	for(unsigned int i = begin; i < end; ++i)
+	{
+		++counts[get_partition(*job, i)];
+	}
+}
+
+static void scatter_items(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	unsigned int* offsets = &job->counts[(begin / NORMAL_RANGE) * job->nb_partitions];
+	for(unsigned int i = begin; i < end; ++i)
+	{
+		job->sorted->items[offsets[get_partition(*job, i)]++] = i;
+	}
+}
+
+//~ Counting sort of the vertices or the corners by partition : histogram of each range, prefix sum, then scatter
+static void sort_by_partition(NormalJob& job, bool corners, PartitionedItems& sorted)
+{
+	ThreadPool& pool = ThreadPool::get_shared();
+	const unsigned int nb_items = corners ? job.nb_indices : job.nb_vertices;
+	const unsigned int nb_ranges = (nb_items + NORMAL_RANGE - 1) / NORMAL_RANGE;
+	job.sorting_corners = corners;
+	job.sorted = &sorted;
+	job.counts.assign(nb_ranges * job.nb_partitions, 0);
+	pool.parallel_for(nb_items, NORMAL_RANGE, count_items, &job);
+
+	//~ The ranges of a partition follow each other, so the items stay in increasing order within it
+	sorted.items = new unsigned int[nb_items];
+	sorted.starts.resize(job.nb_partitions + 1);
+	unsigned int offset = 0;
+	for(unsigned int p = 0; p < job.nb_partitions; ++p)
+	{
+		sorted.starts[p] = offset;
+		for(unsigned int r = 0; r < nb_ranges; ++r)
+		{
+			const unsigned int count = job.counts[r * job.nb_partitions + p];
+			job.counts[r * job.nb_partitions + p] = offset;
+			offset += count;
+		}
+	}
+	sorted.starts[job.nb_partitions] = offset;
+	pool.parallel_for(nb_items, NORMAL_RANGE, scatter_items, &job);
+}
+
+static void weld_partitions(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	const PartitionedItems& partitions = job->vertex_partitions;
+	std::vector<unsigned int> table;
+	for(unsigned int p = begin; p < end; ++p)
+	{
+		const unsigned int first = partitions.starts[p], last = partitions.starts[p + 1];
+		unsigned int table_size = 1;
+		while(table_size < (last - first) * 2) table_size <<= 1;
+		table.assign(table_size, NORMAL_EMPTY);
+
+		//~ The vertices come in increasing order, the first one of a cell stands for all of them
+		for(unsigned int i = first; i < last; ++i)
+		{
+			const unsigned int vertex = partitions.items[i];
+			int cell[3];
+			get_cell(*job, vertex, cell);
+			unsigned int bucket = job->hashes[vertex] & (table_size - 1);
+			while(table[bucket] != NORMAL_EMPTY)
+			{
+				int other[3];
+				get_cell(*job, table[bucket], other);
+				if(other[0] == cell[0] && other[1] == cell[1] && other[2] == cell[2])
+				{
+					break;
+				}
+				bucket = (bucket + 1) & (table_size - 1);
+			}
+			if(table[bucket] == NORMAL_EMPTY)
+			{
+				table[bucket] = vertex;
+				job->sums[vertex] = glm::vec3(0.0f);
+			}
+			job->groups[vertex] = table[bucket];
+		}
+	}
+}
+
+static void accumulate_partitions(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	const PartitionedItems& partitions = job->corner_partitions;
+	for(unsigned int i = partitions.starts[begin]; i < partitions.starts[end]; ++i)
+	{
+		//~ The corner, and the two other ones of its triangle in the same winding
+		const unsigned int corner = partitions.items[i];
+		const unsigned int triangle = corner - corner % 3;
+		const unsigned int vertex = job->indices[corner] - job->base_vertex;
+		const glm::vec3& position = job->vertices[vertex];
+		const glm::vec3& next = job->vertices[job->indices[triangle + (corner + 1) % 3] - job->base_vertex];
+		const glm::vec3& previous = job->vertices[job->indices[triangle + (corner + 2) % 3] - job->base_vertex];
+
+		const glm::vec3 edge_next = next - position, edge_previous = previous - position;
+		const glm::vec3 normal = glm::cross(edge_next, edge_previous);
+		const float normal_length = glm::length(normal);
+		const float lengths = glm::length(edge_next) * glm::length(edge_previous);
+		if(normal_length <= 0.0f || lengths <= 0.0f)
+		{
+			continue;
+		}
+		const float angle = approximate_acos(std::max(-1.0f, std::min(1.0f, glm::dot(edge_next, edge_previous) / lengths)));
+		job->sums[job->groups[vertex]] += normal * (angle / normal_length);
+	}
+}
+
+static void normalize_vertices(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	NormalJob* job = (NormalJob*)data;
+	for(unsigned int v = begin; v < end; ++v)
+	{
+		const glm::vec3& sum = job->sums[job->groups[v]];
+		const float length = glm::length(sum);
+		job->normals[v] = (length > 0.0f) ? sum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+}
+
+void NormalGenerator::generate(const glm::vec3* vertices, unsigned int nb_vertices, const unsigned int* indices, unsigned int nb_indices,
+	unsigned int base_vertex, glm::vec3* normals)
+{
+	if(nb_vertices == 0)
+	{
+		return;
+	}
+	ThreadPool& pool = ThreadPool::get_shared();
+	NormalJob job;
+	job.vertices = vertices;
+	job.nb_vertices = nb_vertices;
+	job.indices = indices;
+	job.nb_indices = nb_indices - nb_indices % 3;
+	job.base_vertex = base_vertex;
+	job.normals = normals;
+
+	//~ The cells are a fraction of the diagonal, so that the welding does not depend on the scale of the model
+	job.mins.assign(pool.get_number_of_workers(), glm::vec3(FLT_MAX));
+	job.maxs.assign(pool.get_number_of_workers(), glm::vec3(-FLT_MAX));
+	pool.parallel_for(nb_vertices, NORMAL_RANGE, bound_vertices, &job);
+	glm::vec3 min = job.mins[0], max = job.maxs[0];
+	for(unsigned int w = 1; w < job.mins.size(); ++w)
+	{
+		min = glm::min(min, job.mins[w]);
+		max = glm::max(max, job.maxs[w]);
+	}
+	const float diagonal = glm::distance(min, max);
+	job.origin = min;
+	job.inverse_cell = (diagonal > 0.0f) ? 1.0f / (diagonal * NORMAL_WELD_EPSILON) : 0.0f;
+
+	//~ At least NORMAL_PARTITIONS_PER_WORKER partitions, at most 256
+	unsigned int nb_bits = 3;
+	while((1u << nb_bits) < NORMAL_PARTITIONS_PER_WORKER * pool.get_number_of_workers() && nb_bits < 8) ++nb_bits;
+	job.nb_partitions = 1u << nb_bits;
+	job.partition_shift = 32 - nb_bits;
+
+	job.hashes = new unsigned int[nb_vertices];
+	pool.parallel_for(nb_vertices, NORMAL_RANGE, hash_vertices, &job);
+
+	//~ Welding, then the corners of each welded vertex accumulated by the task of its partition
+	job.groups = new unsigned int[nb_vertices];
+	job.sums = new glm::vec3[nb_vertices];
+	sort_by_partition(job, false, job.vertex_partitions);
+	pool.parallel_for(job.nb_partitions, 1, weld_partitions, &job);
+	sort_by_partition(job, true, job.corner_partitions);
+	pool.parallel_for(job.nb_partitions, 1, accumulate_partitions, &job);
+
+	pool.parallel_for(nb_vertices, NORMAL_RANGE, normalize_vertices, &job);
+
+	delete[] job.hashes;
+	delete[] job.groups;
+	delete[] job.sums;
+	delete[] job.vertex_partitions.items;
+	delete[] job.corner_partitions.items;
+}
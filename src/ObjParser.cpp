@@ -0,0 +1,808 @@
+/***************************************************************************
+									ObjParser.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file ObjParser.cpp
+ * \brief Reads Wavefront OBJ files without assimp
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/ObjParser.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+//~ Size of the chunks parsed in parallel, before they are extended to the end of their last line
+static const size_t OBJ_CHUNK_SIZE = 4 << 20;
+//~ Element missing from a corner, such as the normal of "f 1/2"
+static const int OBJ_MISSING = INT_MIN;
+//~ Negative indices count back from the elements read so far : they are kept relatively to the chunk, offset by
+//~ OBJ_RELATIVE, until the number of elements of the previous chunks is known
+static const int OBJ_RELATIVE = -(1 << 30);
+//~ Material of the faces that name none, or an unknown one
+static const unsigned int OBJ_NO_MATERIAL = 0xFFFFFFFFu;
+
+//~ Exact powers of ten of a double
+static const double OBJ_POWERS_OF_TEN[23] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*!
+ * \brief Part of the file, parsed by one task
+ */
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	//~ Elements defined in the chunk
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	//~ Corners of the triangles ; the texture coordinates and the normals are stored once a corner has them
+	std::vector<int> corner_positions;
+	std::vector<int> corner_uvs;
+	std::vector<int> corner_normals;
+	//~ Materials used from a triangle of the chunk on, and libraries named
+	std::vector<std::pair<unsigned int, std::string> > materials;
+	std::vector<std::string> libraries;
+	//~ Elements defined before the chunk
+	unsigned int first_position;
+	unsigned int first_uv;
+	unsigned int first_normal;
+	//~ Set by the resolution
+	bool valid;
+	bool aligned;
+	bool has_normals;
+};
+
+/*!
+ * \brief Triangles of a chunk drawn with one material
+ */
+struct ObjSpan
+{
+	unsigned int chunk;
+	unsigned int first_triangle;
+	unsigned int number_of_triangles;
+	unsigned int material;
+	unsigned int destination;	/*!< First index written in the model */
+};
+
+/*!
+ * \brief Vertex made of a position, its other elements and its material, for the welding
+ */
+struct ObjVariant
+{
+	int uv;
+	int normal;
+	unsigned int material;
+	unsigned int vertex;
+	unsigned int next;	/*!< Next variant of the same position */
+};
+
+//~ Parsing being run
+struct ObjJob
+{
+	const char* data_end;
+	std::vector<ObjChunk> chunks;
+	std::vector<ObjSpan> spans;
+	ObjModel* model;
+};
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skip_spaces(const char* cursor, const char* end)
+{
+	while(cursor < end && is_space(*cursor)) ++cursor;
+	return cursor;
+}
+
+#ifdef __SSE2__
+//~ Converts 8 ASCII digits, the first one in the lowest byte, with three multiplications
+static uint32_t convert_eight_digits(uint64_t digits)
+{
+	digits -= 0x3030303030303030ull;
+	digits = digits * 10 + (digits >> 8);
+	digits = (((digits & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) + (((digits >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+	return (uint32_t)digits;
+}
+
+//~ Length of the run of digits starting at the cursor, up to 16, from one comparison of 16 bytes
+static unsigned int count_digits(const char* cursor)
+{
+	const __m128i bytes = _mm_loadu_si128((const __m128i*)cursor);
+	const __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+	const unsigned int mask = ~(unsigned int)_mm_movemask_epi8(digits);
+	return __builtin_ctz(mask | 0x10000u);
+}
+#endif
+
+//~ Appends a run of digits to a mantissa ; past 19 digits the mantissa would overflow, the next digits are only counted
+static const char* read_digits(const char* cursor, const char* end, const char* data_end, uint64_t& mantissa, int& nb_kept, int& nb_dropped)
+{
+#ifdef __SSE2__
+	//~ 8 digits at a time while 16 bytes can be loaded from the mapping
+	while(nb_kept + 8 <= 19 && data_end - cursor >= 16)
+	{
+		const unsigned int run = std::min(count_digits(cursor), (unsigned int)(end - cursor));
+		if(run == 0)
+		{
+			return cursor;
+		}
+		const unsigned int length = std::min(run, 8u);
+		uint64_t digits;
+		memcpy(&digits, cursor, sizeof(digits));
+		//~ The shorter runs are padded with leading zeros
+		if(length < 8)
+		{
+			digits = (digits << (8 * (8 - length))) | (0x3030303030303030ull >> (8 * length));
+		}
+		mantissa = mantissa * (uint64_t)OBJ_POWERS_OF_TEN[length] + convert_eight_digits(digits);
+		nb_kept += length;
+		cursor += length;
+		if(length < 8)
+		{
+			return cursor;
+		}
+	}
+#endif
+	for(; cursor < end && is_digit(*cursor); ++cursor)
+	{
+		if(nb_kept < 19)
+		{
+			mantissa = mantissa * 10 + (*cursor - '0');
+			++nb_kept;
+		}
+		else
+		{
+			++nb_dropped;
+		}
+	}
+	return cursor;
+}
+
+//~ Reads a decimal number such as -1.25e-3, 0 if there is none
+static float read_float(const char*& cursor, const char* end, const char* data_end)
+{
+	cursor = skip_spaces(cursor, end);
+	bool negative = false;
+	if(cursor < end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = *cursor == '-';
+		++cursor;
+	}
+	uint64_t mantissa = 0;
+	int nb_kept = 0, nb_dropped = 0;
+	cursor = read_digits(cursor, end, data_end, mantissa, nb_kept, nb_dropped);
+	int exponent = nb_dropped;
+	if(cursor < end && *cursor == '.')
+	{
+		const int nb_integer = nb_kept;
+		int nb_ignored = 0;
+		cursor = read_digits(cursor + 1, end, data_end, mantissa, nb_kept, nb_ignored);
+		exponent -= nb_kept - nb_integer;
+	}
+	if(cursor < end && (*cursor == 'e' || *cursor == 'E'))
+	{
+		++cursor;
+		bool negative_exponent = false;
+		if(cursor < end && (*cursor == '-' || *cursor == '+'))
+		{
+			negative_exponent = *cursor == '-';
+			++cursor;
+		}
+		int value = 0;
+		for(; cursor < end && is_digit(*cursor); ++cursor)
+		{
+			value = std::min(value * 10 + (*cursor - '0'), 1000);
+		}
+		exponent += negative_exponent ? -value : value;
+	}
+
+	//~ Exact when the mantissa and the power of ten are both exact doubles, the usual case
+	double result = (double)mantissa;
+	if(exponent < 0 && exponent >= -22)
+	{
+		result /= OBJ_POWERS_OF_TEN[-exponent];
+	}
+	else if(exponent > 0 && exponent <= 22)
+	{
+		result *= OBJ_POWERS_OF_TEN[exponent];
+	}
+	else if(exponent != 0)
+	{
+		result *= pow(10.0, exponent);
+	}
+	return (float)(negative ? -result : result);
+}
+
+//~ Reads the index of an element of a face, OBJ_MISSING if there is none
+static int read_index(const char*& cursor, const char* end, unsigned int nb_read)
+{
+	bool negative = false;
+	if(cursor < end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = *cursor == '-';
+		++cursor;
+	}
+	int64_t value = 0;
+	const char* first = cursor;
+	for(; cursor < end && is_digit(*cursor); ++cursor)
+	{
+		value = std::min(value * 10 + (*cursor - '0'), (int64_t)INT_MAX);
+	}
+	if(cursor == first || value == 0)
+	{
+		return OBJ_MISSING;
+	}
+	if(!negative)
+	{
+		return (int)(value - 1);
+	}
+	//~ Relatively to the chunk : the first element of the chunk is 0, those of the previous chunks are negative
+	const int64_t relative = (int64_t)nb_read - value;
+	return (relative > OBJ_RELATIVE) ? (int)(relative + OBJ_RELATIVE) : OBJ_MISSING;
+}
+
+//~ Appends an optional element of a corner, the array is started at the first corner that has one
+static void push_optional(std::vector<int>& values, int value, size_t nb_corners)
+{
+	if(value == OBJ_MISSING && values.empty())
+	{
+		return;
+	}
+	values.resize(nb_corners - 1, OBJ_MISSING);
+	values.push_back(value);
+}
+
+static void push_corner(ObjChunk& chunk, const int corner[3])
+{
+	chunk.corner_positions.push_back(corner[0]);
+	push_optional(chunk.corner_uvs, corner[1], chunk.corner_positions.size());
+	push_optional(chunk.corner_normals, corner[2], chunk.corner_positions.size());
+}
+
+//~ Reads a face and triangulates it as a fan
+static void read_face(ObjChunk& chunk, const char* cursor, const char* end)
+{
+	int first[3], previous[3];
+	unsigned int nb_corners = 0;
+	while(true)
+	{
+		cursor = skip_spaces(cursor, end);
+		if(cursor >= end)
+		{
+			return;
+		}
+		int corner[3] = { OBJ_MISSING, OBJ_MISSING, OBJ_MISSING };
+		corner[0] = read_index(cursor, end, chunk.positions.size());
+		if(cursor < end && *cursor == '/')
+		{
+			++cursor;
+			if(cursor < end && *cursor != '/')
+			{
+				corner[1] = read_index(cursor, end, chunk.uvs.size());
+			}
+			if(cursor < end && *cursor == '/')
+			{
+				++cursor;
+				corner[2] = read_index(cursor, end, chunk.normals.size());
+			}
+		}
+		//~ A face without a valid position is dropped
+		if(corner[0] == OBJ_MISSING)
+		{
+			return;
+		}
+		while(cursor < end && !is_space(*cursor)) ++cursor;
+
+		if(nb_corners >= 2)
+		{
+			push_corner(chunk, first);
+			push_corner(chunk, previous);
+			push_corner(chunk, corner);
+		}
+		if(nb_corners == 0)
+		{
+			memcpy(first, corner, sizeof(corner));
+		}
+		memcpy(previous, corner, sizeof(corner));
+		++nb_corners;
+	}
+}
+
+//~ Rest of a line, without its leading and trailing spaces
+static std::string read_name(const char* cursor, const char* end)
+{
+	cursor = skip_spaces(cursor, end);
+	while(end > cursor && is_space(end[-1])) --end;
+	return std::string(cursor, end);
+}
+
+//~ Tells if a line starts with a keyword followed by a space
+static bool has_keyword(const char* cursor, const char* end, const char* keyword)
+{
+	const size_t length = strlen(keyword);
+	return (size_t)(end - cursor) > length && memcmp(cursor, keyword, length) == 0 && is_space(cursor[length]);
+}
+
+bool ObjParser::is_obj_file(const std::string& filename)
+{
+	if(filename.size() < 4)
+	{
+		return false;
+	}
+	std::string extension = filename.substr(filename.size() - 4);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == ".obj";
+}
+
+void ObjParser::parse_chunks(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ObjJob* job = (ObjJob*)data;
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		ObjChunk& chunk = job->chunks[c];
+		const char* cursor = chunk.begin;
+		while(cursor < chunk.end)
+		{
+			const char* line_end = (const char*)memchr(cursor, '\n', chunk.end - cursor);
+			const char* next = line_end ? line_end + 1 : chunk.end;
+			line_end = line_end ? line_end : chunk.end;
+			cursor = skip_spaces(cursor, line_end);
+
+			if(has_keyword(cursor, line_end, "v"))
+			{
+				cursor += 1;
+				glm::vec3 position;
+				position.x = read_float(cursor, line_end, job->data_end);
+				position.y = read_float(cursor, line_end, job->data_end);
+				position.z = read_float(cursor, line_end, job->data_end);
+				chunk.positions.push_back(position);
+			}
+			else if(has_keyword(cursor, line_end, "vt"))
+			{
+				cursor += 2;
+				glm::vec2 uv;
+				uv.x = read_float(cursor, line_end, job->data_end);
+				uv.y = 1.0f - read_float(cursor, line_end, job->data_end);
+				chunk.uvs.push_back(uv);
+			}
+			else if(has_keyword(cursor, line_end, "vn"))
+			{
+				cursor += 2;
+				glm::vec3 normal;
+				normal.x = read_float(cursor, line_end, job->data_end);
+				normal.y = read_float(cursor, line_end, job->data_end);
+				normal.z = read_float(cursor, line_end, job->data_end);
+				chunk.normals.push_back(normal);
+			}
+			else if(has_keyword(cursor, line_end, "f"))
+			{
+				read_face(chunk, cursor + 1, line_end);
+			}
+			else if(has_keyword(cursor, line_end, "usemtl"))
+			{
+				chunk.materials.push_back(std::make_pair((unsigned int)chunk.corner_positions.size() / 3, read_name(cursor + 6, line_end)));
+			}
+			else if(has_keyword(cursor, line_end, "mtllib"))
+			{
+				chunk.libraries.push_back(read_name(cursor + 6, line_end));
+			}
+			cursor = next;
+		}
+	}
+}
+
+//~ Absolute index of an element, -1 if it is missing, -2 if it does not exist
+static int resolve_index(int index, unsigned int first, unsigned int count)
+{
+	if(index == OBJ_MISSING)
+	{
+		return -1;
+	}
+	const int64_t absolute = (index < 0) ? (int64_t)first + (index - OBJ_RELATIVE) : (int64_t)index;
+	return (absolute >= 0 && absolute < (int64_t)count) ? (int)absolute : -2;
+}
+
+void ObjParser::resolve_chunks(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ObjJob* job = (ObjJob*)data;
+	const ObjChunk& last = job->chunks.back();
+	const unsigned int nb_positions = last.first_position + last.positions.size();
+	const unsigned int nb_uvs = last.first_uv + last.uvs.size();
+	const unsigned int nb_normals = last.first_normal + last.normals.size();
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		ObjChunk& chunk = job->chunks[c];
+		const unsigned int nb_corners = chunk.corner_positions.size();
+		if(!chunk.corner_uvs.empty()) chunk.corner_uvs.resize(nb_corners, OBJ_MISSING);
+		if(!chunk.corner_normals.empty()) chunk.corner_normals.resize(nb_corners, OBJ_MISSING);
+		chunk.valid = true;
+		chunk.aligned = true;
+		chunk.has_normals = nb_corners == 0 || !chunk.corner_normals.empty();
+		for(unsigned int i = 0; i < nb_corners; ++i)
+		{
+			const int position = resolve_index(chunk.corner_positions[i], chunk.first_position, nb_positions);
+			chunk.valid = chunk.valid && position >= 0;
+			chunk.corner_positions[i] = position;
+			if(!chunk.corner_uvs.empty())
+			{
+				const int uv = resolve_index(chunk.corner_uvs[i], chunk.first_uv, nb_uvs);
+				chunk.valid = chunk.valid && uv != -2;
+				chunk.aligned = chunk.aligned && (uv == -1 || uv == position);
+				chunk.corner_uvs[i] = uv;
+			}
+			if(!chunk.corner_normals.empty())
+			{
+				const int normal = resolve_index(chunk.corner_normals[i], chunk.first_normal, nb_normals);
+				chunk.valid = chunk.valid && normal != -2;
+				chunk.aligned = chunk.aligned && (normal == -1 || normal == position);
+				chunk.has_normals = chunk.has_normals && normal >= 0;
+				chunk.corner_normals[i] = normal;
+			}
+		}
+	}
+}
+
+void ObjParser::gather_chunks(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ObjJob* job = (ObjJob*)data;
+	ObjModel& model = *job->model;
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		const ObjChunk& chunk = job->chunks[c];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), model.vertices.begin() + chunk.first_position);
+		std::copy(chunk.uvs.begin(), chunk.uvs.end(), model.uvs.begin() + chunk.first_uv);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), model.normals.begin() + chunk.first_normal);
+	}
+}
+
+void ObjParser::copy_spans(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	ObjJob* job = (ObjJob*)data;
+	for(unsigned int s = begin; s < end; ++s)
+	{
+		const ObjSpan& span = job->spans[s];
+		const int* corners = &job->chunks[span.chunk].corner_positions[3 * span.first_triangle];
+		std::copy(corners, corners + 3 * span.number_of_triangles, job->model->indices.begin() + span.destination);
+	}
+}
+
+void ObjParser::read_materials(const std::string& path, const std::string& directory, std::vector<ObjMaterial>& materials)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if(file == NULL)
+	{
+		std::cerr << "Unable to read the material library " << path << std::endl;
+		return;
+	}
+	char line[1024];
+	while(fgets(line, sizeof(line), file))
+	{
+		const char* end = line + strlen(line);
+		while(end > line && (end[-1] == '\n' || is_space(end[-1]))) --end;
+		const char* cursor = skip_spaces(line, end);
+		if(has_keyword(cursor, end, "newmtl"))
+		{
+			ObjMaterial material;
+			material.name = read_name(cursor + 6, end);
+			material.diffuse_color = glm::vec3(1.0f);
+			materials.push_back(material);
+		}
+		else if(materials.empty())
+		{
+			continue;
+		}
+		else if(has_keyword(cursor, end, "Kd"))
+		{
+			cursor += 2;
+			for(unsigned int c = 0; c < 3; ++c)
+			{
+				materials.back().diffuse_color[c] = read_float(cursor, end, end);
+			}
+		}
+		else if(has_keyword(cursor, end, "map_Kd"))
+		{
+			//~ The options come first, the path is the last word
+			const std::string value = read_name(cursor + 6, end);
+			const size_t space = value.find_last_of(" \t");
+			materials.back().diffuse_texture = directory + ((space == std::string::npos) ? value : value.substr(space + 1));
+		}
+	}
+	fclose(file);
+}
+
+void ObjParser::parse(const char* filename, ObjModel& model) throw (int)
+{
+	//~ Mapping of the file
+	size_t size = 0;
+#ifdef _WIN32
+	//~ No mmap : the file is read at once
+	FILE* file = fopen(filename, "rb");
+	if(file == NULL)
+	{
+		throw(0);
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* mapping = new char[size + 1];
+	const bool read = fread(mapping, 1, size, file) == size;
+	fclose(file);
+	if(!read)
+	{
+		delete[] mapping;
+		throw(0);
+	}
+#else
+	int descriptor = open(filename, O_RDONLY);
+	if(descriptor < 0)
+	{
+		throw(0);
+	}
+	struct stat file_stat;
+	if(fstat(descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close(descriptor);
+		throw(0);
+	}
+	size = file_stat.st_size;
+	void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(mapped == MAP_FAILED)
+	{
+		throw(0);
+	}
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	const char* mapping = (const char*)mapped;
+#endif
+
+	//~ Chunks ending with a line
+	ObjJob job;
+	job.data_end = mapping + size;
+	job.model = &model;
+	const char* cursor = mapping;
+	while(cursor < job.data_end)
+	{
+		ObjChunk chunk;
+		chunk.begin = cursor;
+		chunk.end = (size_t)(job.data_end - cursor) > OBJ_CHUNK_SIZE ? cursor + OBJ_CHUNK_SIZE : job.data_end;
+		const char* line_end = (const char*)memchr(chunk.end - 1, '\n', job.data_end - chunk.end + 1);
+		chunk.end = line_end ? line_end + 1 : job.data_end;
+		job.chunks.push_back(chunk);
+		cursor = chunk.end;
+	}
+	ThreadPool& pool = ThreadPool::get_shared();
+	pool.parallel_for(job.chunks.size(), 1, parse_chunks, &job);
+
+	//~ Elements defined before each chunk, then the indices made absolute
+	unsigned int nb_positions = 0, nb_uvs = 0, nb_normals = 0, nb_triangles = 0;
+	for(unsigned int c = 0; c < job.chunks.size(); ++c)
+	{
+		ObjChunk& chunk = job.chunks[c];
+		chunk.first_position = nb_positions;
+		chunk.first_uv = nb_uvs;
+		chunk.first_normal = nb_normals;
+		nb_positions += chunk.positions.size();
+		nb_uvs += chunk.uvs.size();
+		nb_normals += chunk.normals.size();
+		nb_triangles += chunk.corner_positions.size() / 3;
+	}
+	bool valid = !job.chunks.empty();
+	if(valid)
+	{
+		pool.parallel_for(job.chunks.size(), 1, resolve_chunks, &job);
+	}
+	bool aligned = true;
+	model.has_normals = nb_triangles > 0;
+	for(unsigned int c = 0; c < job.chunks.size(); ++c)
+	{
+		valid = valid && job.chunks[c].valid;
+		aligned = aligned && job.chunks[c].aligned;
+		model.has_normals = model.has_normals && job.chunks[c].has_normals;
+	}
+	if(!valid)
+	{
+#ifdef _WIN32
+		delete[] mapping;
+#else
+		munmap(mapped, size);
+#endif
+		std::cerr << filename << " : a face indexes a missing element" << std::endl;
+		throw(0);
+	}
+
+	//~ Elements of the chunks put together
+	model.vertices.resize(nb_positions);
+	model.uvs.resize(std::max(nb_uvs, nb_positions), glm::vec2(0.0f));
+	model.normals.resize(std::max(nb_normals, nb_positions), glm::vec3(0.0f));
+	pool.parallel_for(job.chunks.size(), 1, gather_chunks, &job);
+
+	//~ Materials, by name
+	std::string directory = filename;
+	directory = (directory.find_last_of('/') != std::string::npos) ? directory.substr(0, directory.find_last_of('/') + 1) : "";
+	model.materials.clear();
+	std::vector<std::string> libraries;
+	for(unsigned int c = 0; c < job.chunks.size(); ++c)
+	{
+		for(unsigned int l = 0; l < job.chunks[c].libraries.size(); ++l)
+		{
+			if(std::find(libraries.begin(), libraries.end(), job.chunks[c].libraries[l]) == libraries.end())
+			{
+				libraries.push_back(job.chunks[c].libraries[l]);
+				read_materials(directory + libraries.back(), directory, model.materials);
+			}
+		}
+	}
+	std::map<std::string, unsigned int> material_indices;
+	for(unsigned int m = 0; m < model.materials.size(); ++m)
+	{
+		material_indices.insert(std::make_pair(model.materials[m].name, m));
+	}
+
+	//~ Spans of triangles between the changes of material, and the number of triangles of each material
+	std::vector<unsigned int> material_triangles(model.materials.size() + 1, 0);
+	unsigned int material = OBJ_NO_MATERIAL;
+	for(unsigned int c = 0; c < job.chunks.size(); ++c)
+	{
+		const ObjChunk& chunk = job.chunks[c];
+		const unsigned int nb_chunk_triangles = chunk.corner_positions.size() / 3;
+		unsigned int first = 0;
+		for(unsigned int e = 0; e <= chunk.materials.size(); ++e)
+		{
+			const unsigned int last = (e < chunk.materials.size()) ? chunk.materials[e].first : nb_chunk_triangles;
+			if(last > first)
+			{
+				const unsigned int index = (material == OBJ_NO_MATERIAL) ? model.materials.size() : material;
+				ObjSpan span = { c, first, last - first, index, 0 };
+				job.spans.push_back(span);
+				material_triangles[index] += last - first;
+			}
+			if(e < chunk.materials.size())
+			{
+				std::map<std::string, unsigned int>::const_iterator found = material_indices.find(chunk.materials[e].second);
+				material = (found != material_indices.end()) ? found->second : OBJ_NO_MATERIAL;
+				first = last;
+			}
+		}
+	}
+	//~ The faces without a known material are white, like those of the models without materials
+	if(material_triangles.back() > 0 || model.materials.empty())
+	{
+		ObjMaterial white;
+		white.diffuse_color = glm::vec3(1.0f);
+		model.materials.push_back(white);
+	}
+
+	//~ The material is an attribute of the vertices : a position used by two materials needs a vertex for each of them
+	const unsigned int none = 0xFFFFFFFFu;
+	if(aligned)
+	{
+		std::vector<unsigned int> position_materials(nb_positions, none);
+		for(unsigned int s = 0; aligned && s < job.spans.size(); ++s)
+		{
+			const ObjSpan& span = job.spans[s];
+			const int* corners = &job.chunks[span.chunk].corner_positions[3 * span.first_triangle];
+			for(unsigned int i = 0; aligned && i < 3 * span.number_of_triangles; ++i)
+			{
+				unsigned int& position_material = position_materials[corners[i]];
+				position_material = (position_material == none) ? span.material : position_material;
+				aligned = position_material == span.material;
+			}
+		}
+	}
+
+	//~ Vertices : the positions when every element is indexed alike, the welded corners otherwise
+	if(!aligned)
+	{
+		//~ The variants of each position, chained from it
+		std::vector<unsigned int> first_variant(nb_positions, none);
+		std::vector<ObjVariant> variants;
+		std::vector<glm::vec3> vertices, normals;
+		std::vector<glm::vec2> uvs;
+		for(unsigned int s = 0; s < job.spans.size(); ++s)
+		{
+			const ObjSpan& span = job.spans[s];
+			ObjChunk& chunk = job.chunks[span.chunk];
+			for(unsigned int i = 3 * span.first_triangle; i < 3 * (span.first_triangle + span.number_of_triangles); ++i)
+			{
+				const int position = chunk.corner_positions[i];
+				const int uv = chunk.corner_uvs.empty() ? -1 : chunk.corner_uvs[i];
+				const int normal = chunk.corner_normals.empty() ? -1 : chunk.corner_normals[i];
+				unsigned int variant = first_variant[position];
+				while(variant != none && (variants[variant].uv != uv || variants[variant].normal != normal || variants[variant].material != span.material))
+				{
+					variant = variants[variant].next;
+				}
+				if(variant == none)
+				{
+					ObjVariant created = { uv, normal, span.material, (unsigned int)vertices.size(), first_variant[position] };
+					variant = first_variant[position] = variants.size();
+					variants.push_back(created);
+					vertices.push_back(model.vertices[position]);
+					uvs.push_back((uv >= 0) ? model.uvs[uv] : glm::vec2(0.0f));
+					normals.push_back((normal >= 0) ? model.normals[normal] : glm::vec3(0.0f));
+				}
+				chunk.corner_positions[i] = variants[variant].vertex;
+			}
+		}
+		model.vertices.swap(vertices);
+		model.uvs.swap(uvs);
+		model.normals.swap(normals);
+	}
+	else
+	{
+		model.uvs.resize(nb_positions);
+		model.normals.resize(nb_positions);
+	}
+
+	//~ Triangles grouped by material, each span copied to the place of its material
+	model.ranges.clear();
+	std::vector<unsigned int> material_offsets(material_triangles.size(), 0);
+	unsigned int offset = 0;
+	for(unsigned int m = 0; m < material_triangles.size(); ++m)
+	{
+		material_offsets[m] = offset;
+		if(material_triangles[m] > 0)
+		{
+			ObjRange range = { 3 * offset, 3 * material_triangles[m], std::min(m, (unsigned int)model.materials.size() - 1) };
+			model.ranges.push_back(range);
+		}
+		offset += material_triangles[m];
+	}
+	for(unsigned int s = 0; s < job.spans.size(); ++s)
+	{
+		job.spans[s].destination = 3 * material_offsets[job.spans[s].material];
+		material_offsets[job.spans[s].material] += job.spans[s].number_of_triangles;
+	}
+	model.indices.resize(3 * nb_triangles);
+	pool.parallel_for(job.spans.size(), 1, copy_spans, &job);
+
+#ifdef _WIN32
+	delete[] mapping;
+#else
+	munmap(mapped, size);
+#endif
+}
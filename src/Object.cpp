@@ -33,179 +33,1024 @@
 
 #include "../include/Object.hpp"
 
-Object::Object(const char* filename, const char* texture_path) throw (int)
+//~ Size of the material table of the geometry buffer shader
+const unsigned int Object::MAX_MATERIALS;
+//~ Size of the buffers above which a mesh is streamed over several frames
+static const size_t STREAMING_THRESHOLD = 64 << 20;
+//~ Size of a streamed chunk
+static const unsigned int STREAMING_CHUNK_SIZE = 4 << 20;
+//~ First of the 4 locations of the model matrix of an instance, one column each
+static const GLuint INSTANCE_ATTRIBUTE = 4;
+
+Object::Object(const char* filename, const char* texture_path, VertexLayout layout, VertexFormat format, CpuRetention retention) throw (int):
+	m_mesh(NULL),
+	m_dequantization_matrix(1.0f),
+	m_layout(layout),
+	m_format(format),
+	m_retention(retention),
+	m_object_vao(0),
+	m_object_depth_vao(0),
+	m_object_vertices_vbo(0),
+	m_object_normals_vbo(0),
+	m_object_uvs_vbo(0),
+	m_object_interleaved_vbo(0),
+	m_object_materials_vbo(0),
+	m_object_indices_ibo(0),
+	m_object_instances_vbo(0),
+	m_streamer(NULL),
+	m_culled_fraction(0.0f),
+	m_texture_path(texture_path != NULL ? texture_path : ""),
+	m_texture_key(""),
+	m_diffuse_texture(0)
 {
+	//~ Loading the geometry, from the mesh cache when possible
+	m_mesh = new Mesh(filename);
+	initialize();
+	//~ Load texture
+	load_textures();
+}
+
+Object::Object(Mesh* mesh, const char* texture_path, const DecodedTextures& textures, VertexLayout layout, VertexFormat format, CpuRetention retention):
+	m_mesh(mesh),
+	m_dequantization_matrix(1.0f),
+	m_layout(layout),
+	m_format(format),
+	m_retention(retention),
+	m_object_vao(0),
+	m_object_depth_vao(0),
+	m_object_vertices_vbo(0),
+	m_object_normals_vbo(0),
+	m_object_uvs_vbo(0),
+	m_object_interleaved_vbo(0),
+	m_object_materials_vbo(0),
+	m_object_indices_ibo(0),
+	m_object_instances_vbo(0),
+	m_streamer(NULL),
+	m_culled_fraction(0.0f),
+	m_texture_path(texture_path != NULL ? texture_path : ""),
+	m_texture_key(""),
+	m_diffuse_texture(0)
+{
+	initialize();
+	//~ The textures were decoded beforehand unless they are cached, only the upload remains
+	if(acquire_textures(textures.key))
+	{
+		return;
+	}
+	if(textures.diffuse.pixels != NULL)
+	{
+		upload_textures(textures);
+	}
+	else
+	{
+		load_textures();
+	}
+}
 
-	//~ Creating the scene of the model
-	const aiScene* scene = aiImportFile(filename,aiProcess_Triangulate | aiProcess_FlipUVs );
-	if(!scene)
+Object::~Object()
+{
+	//~ The layers stay in the cache for the next object using them
+	if(m_diffuse_texture != 0)
+	{
+		TextureCache::get_shared().release(m_texture_key);
+	}
+	
+	delete_buffers();
+	glDeleteBuffers(1, &m_object_instances_vbo);
+	delete m_mesh;
+}
+
+void Object::initialize()
+{
+	//~ Choosing the smallest index type able to address every vertex
+	m_index_type = (m_mesh->get_number_of_vertices() <= 65536) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	//~ Initializing model matrix
+	m_model_matrix = glm::mat4(1.0);
+	update_bounds();
+	
+	//~ One draw range per submesh, all submitted at once
+	std::vector<Submesh> submeshes = m_mesh->get_submeshes();
+	if(submeshes.empty() && m_mesh->get_number_of_indices() > 0)
+	{
+		Submesh whole = { 0, m_mesh->get_number_of_indices(), 0 };
+		submeshes.push_back(whole);
+	}
+	const unsigned int index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	for(unsigned int i = 0; i < submeshes.size(); ++i)
+	{
+		m_draw_counts.push_back(submeshes[i].number_of_indices);
+		m_draw_offsets.push_back((const GLvoid*)((size_t)submeshes[i].first_index * index_size));
+	}
+	//~ Each level of detail draws a run of the ranges
+	m_lods = m_mesh->get_lods();
+	if(m_lods.empty())
 	{
-		throw(0);
+		MeshLod full = { 0, (unsigned int)submeshes.size(), 0.0f, 0, 0 };
+		m_lods.push_back(full);
 	}
 	
-	//~ Parsing its meshes
-	for (unsigned int index_mesh = 0; index_mesh < scene->mNumMeshes; ++index_mesh) 
+	//~ Material table : the diffuse color tints the models made of several materials, the others keep the texture as is
+	const std::vector<MeshMaterial>& materials = m_mesh->get_materials();
+	if(materials.size() > MAX_MATERIALS)
+	{
+		std::cerr << materials.size() << " materials, only the first " << MAX_MATERIALS << " are used" << std::endl;
+	}
+	for(unsigned int m = 0; m < materials.size() && m < MAX_MATERIALS; ++m)
+	{
+		glm::vec3 tint = (materials.size() > 1) ? materials[m].diffuse_color : glm::vec3(1.0f);
+		m_material_table.push_back(glm::vec4(tint, 0.0f));
+	}
+	if(m_material_table.empty())
 	{
-		//~ Selecting a mesh
-		const aiMesh* mesh = scene->mMeshes[index_mesh];
-		//~ Parsing its vertices
-		for (unsigned int index_vertice = 0; index_vertice < mesh->mNumVertices; ++index_vertice) 
+		m_material_table.push_back(glm::vec4(1.0f, 1.0f, 1.0f, 0.0f));
+	}
+	//~ Creating buffers
+	create_buffers();
+}
+
+//~ Description of a vertex attribute before its upload
+struct VertexStream
+{
+	GLint components;
+	GLenum type;
+	GLboolean normalized;
+	unsigned int size;
+	const unsigned char* data;
+};
+
+static VertexStream make_stream(GLint components, GLenum type, GLboolean normalized, unsigned int size, const void* data)
+{
+	VertexStream stream;
+	stream.components = components;
+	stream.type = type;
+	stream.normalized = normalized;
+	stream.size = size;
+	stream.data = (const unsigned char*)data;
+	return stream;
+}
+
+void Object::create_buffers()
+{
+	const unsigned int nb_vertices = m_mesh->get_number_of_vertices();
+	const unsigned int nb_indices = m_mesh->get_number_of_indices();
+	// Attributes : position, normal, uv
+	std::vector<GLushort> quantized_positions;
+	std::vector<GLshort> quantized_normals;
+	std::vector<glm::detail::hdata> quantized_uvs;
+	VertexStream streams[4];
+	if(m_format == FORMAT_QUANTIZED)
+	{
+		quantize(quantized_positions, quantized_normals, quantized_uvs);
+		streams[0] = make_stream(3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(GLushort), &quantized_positions[0]);
+		streams[1] = make_stream(2, GL_SHORT, GL_TRUE, 2 * sizeof(GLshort), &quantized_normals[0]);
+		streams[2] = make_stream(2, GL_HALF_FLOAT, GL_FALSE, 2 * sizeof(glm::detail::hdata), &quantized_uvs[0]);
+	}
+	else
+	{
+		m_dequantization_matrix = glm::mat4(1.0f);
+		streams[0] = make_stream(3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), m_mesh->get_vertices());
+		streams[1] = make_stream(3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), m_mesh->get_normals());
+		streams[2] = make_stream(2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), m_mesh->get_uvs());
+	}
+	// Material of each vertex, only for the models made of several materials (the attribute defaults to 0 otherwise)
+	std::vector<GLubyte> material_ids;
+	unsigned int nb_streams = 3;
+	if(m_material_table.size() > 1)
+	{
+		material_ids.assign(nb_vertices, 0);
+		const std::vector<Submesh>& submeshes = m_mesh->get_submeshes();
+		const unsigned int* indices = m_mesh->get_indices();
+		for(unsigned int i = 0; i < submeshes.size(); ++i)
 		{
-			//~ Vertices
-			if (mesh->HasPositions())
-			{
-				const aiVector3D* vp = &(mesh->mVertices[index_vertice]);
-				m_vertices.push_back(glm::vec3(vp->x,vp->y,vp->z));
-			}
-			//~ Normals
-			if (mesh->HasNormals())
+			const GLubyte material = std::min(submeshes[i].material, (unsigned int)m_material_table.size() - 1);
+			for(unsigned int j = submeshes[i].first_index; j < submeshes[i].first_index + submeshes[i].number_of_indices; ++j)
 			{
-				const aiVector3D* vn = &(mesh->mNormals[index_vertice]);
-				m_normals.push_back(glm::vec3(vn->x,vn->y,vn->z));
+				material_ids[indices[j]] = material;
 			}
-			//~ UVs
-			if (mesh->HasTextureCoords(0)) 
+		}
+		streams[3] = make_stream(1, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(GLubyte), &material_ids[0]);
+		nb_streams = 4;
+	}
+	
+	// Big meshes are streamed over several frames instead of being uploaded at once
+	const unsigned int index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	unsigned int vertex_size = 0;
+	for(unsigned int a = 0; a < nb_streams; ++a)
+	{
+		vertex_size += streams[a].size;
+	}
+	const size_t total_size = (size_t)nb_vertices * vertex_size + (size_t)nb_indices * index_size;
+	if(total_size > STREAMING_THRESHOLD)
+	{
+		m_streamer = new BufferStreamer(STREAMING_CHUNK_SIZE);
+	}
+	
+	// Generating Vertex Arrays
+	glGenVertexArrays(1, &m_object_vao);
+	// Indices, shared by every VAO (uploaded with no VAO bound so that none records them yet)
+	glGenBuffers(1, &m_object_indices_ibo);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_object_indices_ibo);
+	if(m_index_type == GL_UNSIGNED_SHORT || m_streamer != NULL)
+	{
+		std::vector<unsigned char> index_data((size_t)nb_indices * index_size);
+		if(m_index_type == GL_UNSIGNED_SHORT)
+		{
+			GLushort* short_indices = (GLushort*)&index_data[0];
+			std::copy(m_mesh->get_indices(), m_mesh->get_indices() + nb_indices, short_indices);
+		}
+		else
+		{
+			memcpy(&index_data[0], m_mesh->get_indices(), index_data.size());
+		}
+		if(m_streamer != NULL)
+		{
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_data.size(), NULL, GL_STATIC_DRAW);
+			m_streamer->set_index_buffer(m_object_indices_ibo, index_data, index_size, m_mesh->get_indices(), nb_indices);
+		}
+		else
+		{
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_data.size(), &index_data[0], GL_STATIC_DRAW);
+		}
+	}
+	else
+	{
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, nb_indices * sizeof(GLuint), m_mesh->get_indices(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	
+	if(m_layout == LAYOUT_SEPARATE)
+	{
+		// Generating buffers : vertices, normals, uvs
+		GLuint* vbos[4] = { &m_object_vertices_vbo, &m_object_normals_vbo, &m_object_uvs_vbo, &m_object_materials_vbo };
+		// Binding vao
+		glBindVertexArray(m_object_vao);
+		for(unsigned int a = 0; a < nb_streams; ++a)
+		{
+			glGenBuffers(1, vbos[a]);
+			glBindBuffer(GL_ARRAY_BUFFER, *vbos[a]);
+			glEnableVertexAttribArray(a);
+			glVertexAttribPointer(a, streams[a].components, streams[a].type, streams[a].normalized, streams[a].size, (void*)0);
+			// The float attributes live in the mesh, the quantized ones and the materials are copied for the streamer
+			fill_vertex_buffer(*vbos[a], streams[a].data, (size_t)nb_vertices * streams[a].size, streams[a].size, a < 3 && m_format == FORMAT_FLOAT);
+		}
+		// Indices
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_object_indices_ibo);
+	}
+	else
+	{
+		// Interleaving the attributes : position, normal, uv (and material), each vertex aligned on 4 bytes
+		const unsigned int stride = (vertex_size + 3) & ~3u;
+		std::vector<unsigned char> interleaved((size_t)nb_vertices * stride);
+		for(unsigned int i = 0; i < nb_vertices; ++i)
+		{
+			unsigned char* vertex = &interleaved[(size_t)i * stride];
+			for(unsigned int a = 0; a < nb_streams; ++a)
 			{
-				const aiVector3D* vt = &(mesh->mTextureCoords[0][index_vertice]);
-				m_uvs.push_back(glm::vec2(vt->x,vt->y));
+				memcpy(vertex, streams[a].data + (size_t)i * streams[a].size, streams[a].size);
+				vertex += streams[a].size;
 			}
 		}
+		glGenBuffers(1, &m_object_interleaved_vbo);
+		// Binding vao
+		glBindVertexArray(m_object_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_object_interleaved_vbo);
+		if(m_streamer != NULL)
+		{
+			glBufferData(GL_ARRAY_BUFFER, interleaved.size(), NULL, GL_STATIC_DRAW);
+			m_streamer->add_vertex_buffer(m_object_interleaved_vbo, interleaved, stride);
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, interleaved.size(), &interleaved[0], GL_STATIC_DRAW);
+		}
+		unsigned int offset = 0;
+		for(unsigned int a = 0; a < nb_streams; ++a)
+		{
+			glEnableVertexAttribArray(a);
+			glVertexAttribPointer(a, streams[a].components, streams[a].type, streams[a].normalized, stride, (void*)(size_t)offset);
+			offset += streams[a].size;
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_object_indices_ibo);
+		
+		if(m_layout == LAYOUT_SPLIT)
+		{
+			// Position-only stream for the depth-only passes
+			glGenVertexArrays(1, &m_object_depth_vao);
+			glGenBuffers(1, &m_object_vertices_vbo);
+			glBindVertexArray(m_object_depth_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, m_object_vertices_vbo);
+			fill_vertex_buffer(m_object_vertices_vbo, streams[0].data, (size_t)nb_vertices * streams[0].size, streams[0].size, m_format == FORMAT_FLOAT);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, streams[0].components, streams[0].type, streams[0].normalized, streams[0].size, (void*)0);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_object_indices_ibo);
+		}
 	}
-	
-	//~ Freeing the memory
-	aiReleaseImport(scene);
-	//~ Initializing model matrix
-	m_model_matrix = glm::mat4(1.0);
-	//~ Creating buffers
-	create_buffers();
-	//~ Load texture
-	m_texture_path = texture_path;
-	load_textures();
+	// The instances outlive the vertex buffers
+	if(!m_instances.empty())
+	{
+		attach_instances();
+	}
+	// Unbinding
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	// Nothing references the arrays any more unless they are streamed
+	release_arrays();
 }
 
-Object::~Object()
+void Object::fill_vertex_buffer(GLuint buffer, const unsigned char* data, size_t size, unsigned int vertex_size, bool persistent)
+{
+	if(m_streamer == NULL)
+	{
+		glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+		return;
+	}
+	// Only the storage is allocated, the streamer fills it over the next frames
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STATIC_DRAW);
+	if(persistent)
+	{
+		m_streamer->add_vertex_buffer(buffer, data, size, vertex_size);
+	}
+	else
+	{
+		std::vector<unsigned char> copy(data, data + size);
+		m_streamer->add_vertex_buffer(buffer, copy, vertex_size);
+	}
+}
+
+bool Object::stream_buffers(size_t budget)
+{
+	if(m_streamer == NULL)
+	{
+		return true;
+	}
+	m_streamer->stream(budget);
+	if(m_streamer->is_complete())
+	{
+		delete m_streamer;
+		m_streamer = NULL;
+		release_arrays();
+		return true;
+	}
+	return false;
+}
+
+void Object::release_arrays()
+{
+	if(m_streamer != NULL || m_retention == RETENTION_ALL || !m_mesh->has_arrays())
+	{
+		return;
+	}
+	m_mesh->release_arrays(m_retention);
+}
+
+//~ Octahedral encoding of a unit vector in [-1,1]^2
+static glm::vec2 encode_octahedral(const glm::vec3& n)
+{
+	float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if(sum == 0.0f) return glm::vec2(0.0f);
+	glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+	if(n.z < 0.0f)
+	{
+		p = glm::vec2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+		              (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+//~ Inverse of encode_octahedral, as done in geometry_buffer.vertex.glsl
+static glm::vec3 decode_octahedral(const glm::vec2& e)
 {
-	if(m_texture_path != NULL)
+	glm::vec3 n = glm::vec3(e.x, e.y, 1.0f - fabs(e.x) - fabs(e.y));
+	if(n.z < 0.0f)
 	{
-		glDeleteTextures(1, &m_diffuse_texture);
+		n.x = (1.0f - fabs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - fabs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
 	}
+	return glm::normalize(n);
+}
+
+void Object::quantize(std::vector<GLushort>& positions, std::vector<GLshort>& normals, std::vector<glm::detail::hdata>& uvs)
+{
+	const unsigned int nb_vertices = m_mesh->get_number_of_vertices();
+	const glm::vec3* vertices = m_mesh->get_vertices();
+	const glm::vec3* object_normals = m_mesh->get_normals();
+	const glm::vec2* object_uvs = m_mesh->get_uvs();
+	positions.resize(nb_vertices * 4);
+	normals.resize(nb_vertices * 2);
+	uvs.resize(nb_vertices * 2);
+	
+	//~ Bounding box of the positions
+	glm::vec3 min_position = m_mesh->get_min();
+	glm::vec3 max_position = m_mesh->get_max();
+	glm::vec3 extent = max_position - min_position;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		if(extent[c] <= 0.0f) extent[c] = 1.0f;
+	}
+	//~ Normalized unsigned shorts are read in [0,1] by the GPU : p = min + q * extent
+	m_dequantization_matrix = glm::scale(glm::translate(glm::mat4(1.0f), min_position), extent);
+	
+	float max_normal_error = 0.0f;
+	float max_uv_error = 0.0f;
+	for(unsigned int i = 0; i < nb_vertices; ++i)
+	{
+		//~ Positions
+		glm::vec3 relative = (vertices[i] - min_position) / extent;
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			positions[i * 4 + c] = (GLushort)(glm::clamp(relative[c], 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+		positions[i * 4 + 3] = 0;
+		
+		//~ Normals
+		glm::vec2 encoded = encode_octahedral(object_normals[i]);
+		for(unsigned int c = 0; c < 2; ++c)
+		{
+			float value = glm::clamp(encoded[c], -1.0f, 1.0f) * 32767.0f;
+			normals[i * 2 + c] = (GLshort)(value >= 0.0f ? value + 0.5f : value - 0.5f);
+		}
+		float length = glm::length(object_normals[i]);
+		if(length > 0.0f)
+		{
+			glm::vec3 decoded = decode_octahedral(glm::vec2(normals[i * 2] / 32767.0f, normals[i * 2 + 1] / 32767.0f));
+			float cosine = glm::clamp(glm::dot(decoded, object_normals[i] / length), -1.0f, 1.0f);
+			max_normal_error = std::max(max_normal_error, (float)acos(cosine));
+		}
+		
+		//~ UVs
+		for(unsigned int c = 0; c < 2; ++c)
+		{
+			uvs[i * 2 + c] = glm::detail::toFloat16(object_uvs[i][c]);
+			max_uv_error = std::max(max_uv_error, (float)fabs(glm::detail::toFloat32(uvs[i * 2 + c]) - object_uvs[i][c]));
+		}
+	}
+	
+	//~ Rounding to the nearest step : half a step of error at most on each axis
+	glm::vec3 position_error = extent / (2.0f * 65535.0f);
+	float max_position_error = glm::length(position_error);
+	float diagonal = glm::length(max_position - min_position);
+	std::cout << "Quantized vertices : " << (size_t)nb_vertices * 16 << " bytes instead of " << (size_t)nb_vertices * 32 << std::endl;
+	std::cout << "\tposition error <= " << max_position_error;
+	if(diagonal > 0.0f) std::cout << " (" << 100.0f * max_position_error / diagonal << "% of the diagonal)";
+	std::cout << ", normal error <= " << glm::degrees(max_normal_error) << " degrees, uv error <= " << max_uv_error << std::endl;
+}
+
+void Object::delete_buffers()
+{
+	delete m_streamer;
+	m_streamer = NULL;
 	
 	glDeleteBuffers(1,&m_object_vertices_vbo);
 	glDeleteBuffers(1,&m_object_normals_vbo);
 	glDeleteBuffers(1,&m_object_uvs_vbo);
+	glDeleteBuffers(1,&m_object_interleaved_vbo);
+	glDeleteBuffers(1,&m_object_materials_vbo);
+	glDeleteBuffers(1,&m_object_indices_ibo);
 	glDeleteVertexArrays(1, &m_object_vao);
+	glDeleteVertexArrays(1, &m_object_depth_vao);
+	
+	m_object_vertices_vbo = 0;
+	m_object_normals_vbo = 0;
+	m_object_uvs_vbo = 0;
+	m_object_interleaved_vbo = 0;
+	m_object_materials_vbo = 0;
+	m_object_indices_ibo = 0;
+	m_object_vao = 0;
+	m_object_depth_vao = 0;
 }
 
-void Object::create_buffers()
+std::vector<std::string> Object::get_texture_paths(const std::string& texture_path, const Mesh& mesh)
 {
-	// Generating Vertex Array
-	glGenVertexArrays(1, &m_object_vao);
-	// Generating buffers
-	glGenBuffers(1, &m_object_vertices_vbo);
-	glGenBuffers(1, &m_object_normals_vbo);
-	glGenBuffers(1, &m_object_uvs_vbo);
-	// Binding vao
-	glBindVertexArray(m_object_vao);
-	// Vertices
-	glBindBuffer(GL_ARRAY_BUFFER, m_object_vertices_vbo);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, m_vertices.size() * sizeof(glm::vec3), &m_vertices[0], GL_STATIC_DRAW);
-    // Normals
-    glBindBuffer(GL_ARRAY_BUFFER, m_object_normals_vbo);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, m_normals.size() * sizeof(glm::vec3), &m_normals[0], GL_STATIC_DRAW);
-    // Uvs
-    glBindBuffer(GL_ARRAY_BUFFER, m_object_uvs_vbo);
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2) , (void*)0);
-    glBufferData(GL_ARRAY_BUFFER, m_uvs.size() * sizeof(glm::vec2), &m_uvs[0], GL_STATIC_DRAW);
-	// Unbinding
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//~ The chosen texture, then one per material for the models made of several materials
+	std::vector<std::string> paths(1, texture_path);
+	const std::vector<MeshMaterial>& materials = mesh.get_materials();
+	if(materials.size() > 1)
+	{
+		for(unsigned int m = 0; m < materials.size() && m < MAX_MATERIALS; ++m)
+		{
+			paths.push_back(materials[m].diffuse_texture);
+		}
+	}
+	return paths;
+}
+
+void Object::decode_textures(const std::string& texture_path, const Mesh& mesh, DecodedTextures& textures)
+{
+	std::vector<std::string> paths = get_texture_paths(texture_path, mesh);
+	textures.diffuse.pixels = NULL;
+	textures.material_images.clear();
+	textures.compressed.clear();
+
+	//~ The compressed files next to the images replace them when every image has one
+	std::vector<std::string> compressed_paths = CompressedTexture::find(paths);
+	textures.key = TextureCache::make_key(compressed_paths.empty() ? paths : compressed_paths);
+	if(TextureCache::get_shared().contains(textures.key))
+	{
+		return;
+	}
+	if(!compressed_paths.empty())
+	{
+		map_compressed_textures(compressed_paths, textures.compressed);
+		if(!textures.compressed.empty())
+		{
+			return;
+		}
+		textures.key = TextureCache::make_key(paths);
+	}
+	std::vector<TextureImage> images = TextureDecoder::decode_all(paths);
+
+	//~ Every layer has the size of the chosen texture, or of the biggest one of the materials over a white layer
+	int width = images[0].width, height = images[0].height;
+	if(images[0].pixels == NULL)
+	{
+		width = height = 0;
+		for(unsigned int l = 1; l < images.size(); ++l)
+		{
+			if(images[l].pixels != NULL && images[l].width * images[l].height > width * height)
+			{
+				width = images[l].width;
+				height = images[l].height;
+			}
+		}
+		if(width > 0)
+		{
+			const unsigned char white[4] = { 255, 255, 255, 255 };
+			images[0] = TextureDecoder::create_filled(width, height, white);
+		}
+	}
+	TextureDecoder::prepare(images, width, height, true);
+
+	textures.diffuse = images[0];
+	textures.material_images.assign(images.begin() + 1, images.end());
+}
+
+void Object::map_compressed_textures(const std::vector<std::string>& paths, std::vector<CompressedTexture*>& compressed)
+{
+	bool usable = true;
+	for(unsigned int l = 0; l < paths.size() && usable; ++l)
+	{
+		CompressedTexture* texture = NULL;
+		if(!paths[l].empty())
+		{
+			try
+			{
+				texture = new CompressedTexture(paths[l]);
+			}
+			catch(int)
+			{
+				usable = false;
+			}
+		}
+		compressed.push_back(texture);
+		//~ The layers of an array share their size, their levels and their format
+		const CompressedTexture* first = compressed[0];
+		usable = usable && (texture == NULL || (CompressedTexture::is_supported(texture->get_format()) && texture->get_format() == first->get_format()
+			&& texture->get_width() == first->get_width() && texture->get_height() == first->get_height()
+			&& texture->get_number_of_levels() == first->get_number_of_levels()));
+	}
+	if(!usable)
+	{
+		for(unsigned int l = 0; l < compressed.size(); ++l)
+		{
+			delete compressed[l];
+		}
+		compressed.clear();
+	}
+}
+
+void Object::free_textures(DecodedTextures& textures)
+{
+	TextureDecoder::release(textures.diffuse);
+	for(unsigned int m = 0; m < textures.material_images.size(); ++m)
+	{
+		TextureDecoder::release(textures.material_images[m]);
+	}
+	for(unsigned int l = 0; l < textures.compressed.size(); ++l)
+	{
+		delete textures.compressed[l];
+	}
+	textures.compressed.clear();
+}
+
+bool Object::acquire_textures(const std::string& key)
+{
+	const TextureCacheEntry* entry = TextureCache::get_shared().acquire(key);
+	if(entry == NULL)
+	{
+		return false;
+	}
+	m_diffuse_texture = entry->range.texture;
+	m_texture_key = key;
+	for(unsigned int m = 0; m < entry->material_layers.size() && m < m_material_table.size(); ++m)
+	{
+		m_material_table[m].w = entry->material_layers[m];
+	}
+	return true;
 }
 
 void Object::load_textures()
 {
-	//~ Declarating values : width, height, components per pixel
-	int w, h, comp;
-	//~ Calling stbi
-	unsigned char* diffuse = stbi_load(m_texture_path, &w, &h, &comp, 3);
-	//~ Processing texture
-	glGenTextures(1, &m_diffuse_texture);
+	DecodedTextures textures;
+	decode_textures(m_texture_path, *m_mesh, textures);
+	if(!acquire_textures(textures.key))
+	{
+		upload_textures(textures);
+	}
+	free_textures(textures);
+}
+
+void Object::upload_textures(const DecodedTextures& textures)
+{
+	const TextureImage& diffuse = textures.diffuse;
+	const bool compressed = !textures.compressed.empty();
+	if(!compressed && diffuse.pixels == NULL)
+	{
+		return;
+	}
+	//~ Layer 0 is the chosen texture, then one layer per material that has its own
+	std::vector<const TextureImage*> layers(1, &diffuse);
+	std::vector<const CompressedTexture*> compressed_layers(1, compressed ? textures.compressed[0] : NULL);
+	std::vector<unsigned int> material_layers(m_material_table.size(), 0);
+	for(unsigned int m = 0; m < m_material_table.size(); ++m)
+	{
+		const bool has_texture = compressed ? (m + 1 < textures.compressed.size() && textures.compressed[m + 1] != NULL)
+			: (m < textures.material_images.size() && textures.material_images[m].pixels != NULL);
+		if(has_texture)
+		{
+			material_layers[m] = layers.size();
+			layers.push_back(compressed ? NULL : &textures.material_images[m]);
+			compressed_layers.push_back(compressed ? textures.compressed[m + 1] : NULL);
+		}
+	}
+	int width = diffuse.width, height = diffuse.height;
+	unsigned int levels = diffuse.levels;
+	GLenum internal_format = GL_RGBA8;
+	size_t layer_size = TextureDecoder::get_level_offset(diffuse, diffuse.levels);
+	if(compressed)
+	{
+		width = compressed_layers[0]->get_width();
+		height = compressed_layers[0]->get_height();
+		levels = compressed_layers[0]->get_number_of_levels();
+		internal_format = compressed_layers[0]->get_internal_format();
+		layer_size = compressed_layers[0]->get_size();
+	}
+
+	//~ The layers go into an array shared with the objects whose textures have the same size, the material table points at them
+	Uint32 start = SDL_GetTicks();
+	const TextureArrayRange range = TextureArrayManager::get_shared().allocate(internal_format, width, height, levels, layer_size, layers.size());
+	for(unsigned int m = 0; m < m_material_table.size(); ++m)
+	{
+		material_layers[m] += range.first_layer;
+		m_material_table[m].w = material_layers[m];
+	}
+	m_diffuse_texture = range.texture;
+	m_texture_key = textures.key;
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, m_diffuse_texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, diffuse);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	
-	stbi_image_free(diffuse);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_diffuse_texture);
+	if(compressed)
+	{
+		//~ The levels go from the mapped files to the driver as they are
+		CompressedTexture::upload(GL_TEXTURE_2D_ARRAY, compressed_layers, range.first_layer);
+	}
+	else
+	{
+		TextureDecoder::upload(GL_TEXTURE_2D_ARRAY, layers, range.first_layer);
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	const size_t bytes = layers.size() * layer_size;
+	TextureCache::get_shared().insert(textures.key, range, material_layers, bytes);
+	std::cout << (compressed ? "Compressed texture" : "Texture") << " layers " << range.first_layer << " to " << range.first_layer + layers.size() - 1
+		<< " of " << width << "x" << height << " and " << levels << " levels (" << bytes / 1024 << " KB) uploaded in " << SDL_GetTicks() - start << " ms" << std::endl;
 }
 
-glm::vec3 Object::computeBarycentre()
+void Object::draw(unsigned int level) const
 {
-    glm::vec3 sum = glm::vec3(0.0, 0.0, 0.0);
-    for (unsigned int i = 0; i < m_vertices.size(); ++i)
-    {
-        sum += m_vertices.at(i);
-    }
+	//~ While the mesh is streamed, only the full resolution is drawn : the coarser levels come last in the index buffer
+	level = (m_streamer == NULL) ? std::min(level, (unsigned int)m_lods.size() - 1) : 0;
+	const unsigned int first = m_lods[level].first_submesh;
+	const unsigned int nb_ranges = m_lods[level].number_of_submeshes;
+	if(nb_ranges == 0)
+	{
+		return;
+	}
+	if(m_streamer == NULL)
+	{
+		glMultiDrawElements(GL_TRIANGLES, &m_draw_counts[first], m_index_type, (const GLvoid**)&m_draw_offsets[first], nb_ranges);
+		return;
+	}
+	//~ The ranges are cut at the last resident index
+	const unsigned int index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	const unsigned int resident = m_streamer->get_resident_indices();
+	std::vector<GLsizei> counts(nb_ranges);
+	for(unsigned int i = 0; i < nb_ranges; ++i)
+	{
+		const unsigned int first_index = (size_t)m_draw_offsets[first + i] / index_size;
+		counts[i] = (resident > first_index) ? std::min((unsigned int)m_draw_counts[first + i], resident - first_index) : 0;
+	}
+	glMultiDrawElements(GL_TRIANGLES, &counts[0], m_index_type, (const GLvoid**)&m_draw_offsets[first], nb_ranges);
+}
 
-    return sum /= m_vertices.size();
+void Object::draw_instanced(unsigned int level) const
+{
+	level = (m_streamer == NULL) ? std::min(level, (unsigned int)m_lods.size() - 1) : 0;
+	const unsigned int first = m_lods[level].first_submesh;
+	const unsigned int index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	const unsigned int resident = (m_streamer != NULL) ? m_streamer->get_resident_indices() : m_mesh->get_number_of_indices();
+	//~ There is no instanced multi-draw before GL 4.3 : one call per range draws every instance
+	for(unsigned int i = first; i < first + m_lods[level].number_of_submeshes; ++i)
+	{
+		const unsigned int first_index = (size_t)m_draw_offsets[i] / index_size;
+		const unsigned int count = (resident > first_index) ? std::min((unsigned int)m_draw_counts[i], resident - first_index) : 0;
+		if(count > 0)
+		{
+			glDrawElementsInstanced(GL_TRIANGLES, count, m_index_type, m_draw_offsets[i], m_instances.size());
+		}
+	}
 }
 
-float Object::computeAvgDistToBarycentre()
+void Object::set_instances(const std::vector<glm::mat4>& instances)
+{
+	m_instances = instances;
+	if(!m_instances.empty())
+	{
+		if(m_object_instances_vbo == 0)
+		{
+			glGenBuffers(1, &m_object_instances_vbo);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, m_object_instances_vbo);
+		glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(glm::mat4), glm::value_ptr(m_instances[0]), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	attach_instances();
+	update_bounds();
+}
+
+unsigned int Object::get_number_of_instances() const
 {
-    glm::vec3 bar = computeBarycentre();
-    float sumDist = 0;
-    float avgDist = 0;
+	return m_instances.size();
+}
+
+void Object::attach_instances()
+{
+	//~ A mat4 attribute takes 4 locations, the matrix advances once per instance ; without instances the locations are left disabled
+	const GLuint vaos[2] = { m_object_vao, m_object_depth_vao };
+	for(unsigned int v = 0; v < 2; ++v)
+	{
+		if(vaos[v] == 0)
+		{
+			continue;
+		}
+		glBindVertexArray(vaos[v]);
+		glBindBuffer(GL_ARRAY_BUFFER, m_object_instances_vbo);
+		for(unsigned int c = 0; c < 4; ++c)
+		{
+			if(m_instances.empty())
+			{
+				glDisableVertexAttribArray(INSTANCE_ATTRIBUTE + c);
+				continue;
+			}
+			glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + c);
+			glVertexAttribPointer(INSTANCE_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(INSTANCE_ATTRIBUTE + c, 1);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Object::cull(unsigned int level, const Camera& first, const Camera& second)
+{
+	m_visible_counts.clear();
+	m_visible_offsets.clear();
+	m_culled_fraction = 0.0f;
+	level = (m_streamer == NULL) ? std::min(level, (unsigned int)m_lods.size() - 1) : 0;
+	const MeshLod& lod = m_lods[level];
+	const unsigned int index_size = (m_index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	const unsigned int resident = (m_streamer != NULL) ? m_streamer->get_resident_indices() : m_mesh->get_number_of_indices();
+	if(lod.number_of_meshlets == 0)
+	{
+		for(unsigned int i = lod.first_submesh; i < lod.first_submesh + lod.number_of_submeshes; ++i)
+		{
+			const unsigned int first_index = (size_t)m_draw_offsets[i] / index_size;
+			m_visible_counts.push_back((resident > first_index) ? std::min((unsigned int)m_draw_counts[i], resident - first_index) : 0);
+			m_visible_offsets.push_back(m_draw_offsets[i]);
+		}
+		return;
+	}
+
+	//~ Frusta and positions of the cameras, in the space of the model
+	const glm::mat4 world_to_model = glm::inverse(m_model_matrix);
+	const Frustum frusta[2] = {	Frustum(first.get_projection_matrix() * first.get_view_matrix() * m_model_matrix),
+								Frustum(second.get_projection_matrix() * second.get_view_matrix() * m_model_matrix) };
+	const glm::vec3 viewpoints[2] = {	glm::vec3(world_to_model * glm::vec4(first.get_position(), 1.0f)),
+										glm::vec3(world_to_model * glm::vec4(second.get_position(), 1.0f)) };
+
+	const std::vector<Meshlet>& meshlets = m_mesh->get_meshlets();
+	unsigned int culled = 0;
+	for(unsigned int m = lod.first_meshlet; m < lod.first_meshlet + lod.number_of_meshlets; ++m)
+	{
+		const Meshlet& meshlet = meshlets[m];
+		bool visible = false;
+		for(unsigned int c = 0; c < 2 && !visible; ++c)
+		{
+			const bool inside = frusta[c].intersects_sphere(meshlet.centre, meshlet.radius);
+			const glm::vec3 direction = meshlet.centre - viewpoints[c];
+			const bool back_facing = glm::dot(direction, meshlet.cone_axis) >= meshlet.cone_cutoff * glm::length(direction) + meshlet.radius;
+			visible = inside && !back_facing;
+		}
+		if(!visible)
+		{
+			++culled;
+			continue;
+		}
+		const unsigned int count = (resident > meshlet.first_index) ? std::min(meshlet.number_of_indices, resident - meshlet.first_index) : 0;
+		if(count == 0)
+		{
+			continue;
+		}
+		//~ Clusters following each other in the index buffer are merged into one range
+		const GLvoid* offset = (const GLvoid*)((size_t)meshlet.first_index * index_size);
+		if(!m_visible_counts.empty() && (const char*)m_visible_offsets.back() + (size_t)m_visible_counts.back() * index_size == (const char*)offset)
+		{
+			m_visible_counts.back() += count;
+		}
+		else
+		{
+			m_visible_counts.push_back(count);
+			m_visible_offsets.push_back(offset);
+		}
+	}
+	m_culled_fraction = (float)culled / (float)lod.number_of_meshlets;
+}
 
-    for (unsigned int i = 0; i < m_vertices.size(); ++i)
-    {
-        sumDist += sqrt((m_vertices.at(i).x - bar.x)*(m_vertices.at(i).x - bar.x) +
-                        (m_vertices.at(i).y - bar.y)*(m_vertices.at(i).y - bar.y) +
-                        (m_vertices.at(i).z - bar.z)*(m_vertices.at(i).z - bar.z));
-    }
-    avgDist = sumDist / m_vertices.size();
-    return avgDist;
+void Object::draw_visible() const
+{
+	if(m_visible_counts.empty())
+	{
+		return;
+	}
+	glMultiDrawElements(GL_TRIANGLES, &m_visible_counts[0], m_index_type, (const GLvoid**)&m_visible_offsets[0], m_visible_counts.size());
+}
+
+float Object::get_culled_fraction() const
+{
+	return m_culled_fraction;
+}
+
+unsigned int Object::select_lod(const glm::vec3& viewpoint, float projection_scale, float max_error) const
+{
+	//~ Scale of the object in the world
+	float scale = 0.0f;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		scale = std::max(scale, glm::length(glm::vec3(m_model_matrix[c])));
+	}
+	//~ The nearest point of the bounding sphere bounds the projected error, the viewpoint inside the sphere keeps the full resolution.
+	//~ The sphere is the one of the object itself : its instances share its level
+	const glm::vec3 centre = glm::vec3(m_model_matrix * glm::vec4(m_mesh->get_barycentre(), 1.0f));
+	const float distance = glm::distance(viewpoint, centre) - m_mesh->get_radius() * scale;
+	if(distance <= 0.0f)
+	{
+		return 0;
+	}
+	unsigned int level = 0;
+	while(level + 1 < m_lods.size() && m_lods[level + 1].error * scale * projection_scale / distance <= max_error)
+	{
+		++level;
+	}
+	return level;
+}
+
+bool Object::is_visible(const Frustum& frustum) const
+{
+	//~ Both volumes are conservative, so is their intersection
+	return frustum.intersects_sphere(m_world_centre, m_world_radius) && frustum.intersects_box(m_world_min, m_world_max);
+}
+
+void Object::update_bounds()
+{
+	//~ Box of the transformed box (Arvo) : each axis of the matrix widens it by its absolute value over the half size
+	const glm::vec3 centre = 0.5f * (m_mesh->get_min() + m_mesh->get_max());
+	const glm::vec3 half_size = 0.5f * (m_mesh->get_max() - m_mesh->get_min());
+	const glm::vec3 world_centre = glm::vec3(m_model_matrix * glm::vec4(centre, 1.0f));
+	glm::vec3 world_half_size(0.0f);
+	float scale = 0.0f;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		const glm::vec3 axis = glm::vec3(m_model_matrix[c]);
+		world_half_size += glm::abs(axis) * half_size[c];
+		scale = std::max(scale, glm::length(axis));
+	}
+	m_world_min = world_centre - world_half_size;
+	m_world_max = world_centre + world_half_size;
+	//~ Sphere around the barycentre, grown by the largest scale of the matrix
+	m_world_centre = glm::vec3(m_model_matrix * glm::vec4(m_mesh->get_barycentre(), 1.0f));
+	m_world_radius = m_mesh->get_radius() * scale;
+	if(m_instances.empty())
+	{
+		return;
+	}
+
+	//~ The instances are bounded together : the box of their boxes, and the sphere around it
+	m_world_min = glm::vec3(FLT_MAX);
+	m_world_max = glm::vec3(-FLT_MAX);
+	for(unsigned int i = 0; i < m_instances.size(); ++i)
+	{
+		const glm::vec3 instance_centre = glm::vec3(m_instances[i] * glm::vec4(world_centre, 1.0f));
+		glm::vec3 instance_half_size(0.0f);
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			instance_half_size += glm::abs(glm::vec3(m_instances[i][c])) * world_half_size[c];
+		}
+		m_world_min = glm::min(m_world_min, instance_centre - instance_half_size);
+		m_world_max = glm::max(m_world_max, instance_centre + instance_half_size);
+	}
+	m_world_centre = 0.5f * (m_world_min + m_world_max);
+	m_world_radius = 0.5f * glm::distance(m_world_min, m_world_max);
+}
+
+void Object::intersect(const Ray* rays, RayHit* hits, unsigned int nb_rays) const
+{
+	//~ The rays are brought in the space of the model, the distances along their directions are kept
+	const glm::mat4 world_to_model = glm::inverse(m_model_matrix);
+	std::vector<Ray> model_rays(nb_rays);
+	for(unsigned int r = 0; r < nb_rays; ++r)
+	{
+		model_rays[r].origin = glm::vec3(world_to_model * glm::vec4(rays[r].origin, 1.0f));
+		model_rays[r].direction = glm::vec3(world_to_model * glm::vec4(rays[r].direction, 0.0f));
+	}
+	m_mesh->get_bvh().intersect(&model_rays[0], hits, nb_rays);
+}
+
+unsigned int Object::get_number_of_lods() const
+{
+	return m_lods.size();
+}
+
+unsigned int Object::get_number_of_ranges(unsigned int level) const
+{
+	return m_lods[std::min(level, (unsigned int)m_lods.size() - 1)].number_of_submeshes;
+}
+
+glm::vec3 Object::computeBarycentre()
+{
+	return m_mesh->get_barycentre();
+}
+
+float Object::computeAvgDistToBarycentre()
+{
+	return m_mesh->get_average_distance();
 }
 
 float Object::computeStandardDeviation()
 {
-    glm::vec3 moyPt;
-    moyPt = computeBarycentre();
-    float sumDist = 0;
-    float moyDist = 0;
-
-    for (unsigned int i = 0; i < m_vertices.size(); ++i)
-    {
-        sumDist += sqrt((m_vertices.at(i).x - moyPt.x)*(m_vertices.at(i).x - moyPt.x) +
-                        (m_vertices.at(i).y - moyPt.y)*(m_vertices.at(i).y - moyPt.y) +
-                        (m_vertices.at(i).z - moyPt.z)*(m_vertices.at(i).z - moyPt.z));
-    }
-    moyDist = sumDist / m_vertices.size();
-
-    float sumValMoinsMoy = 0;
-    float var = 0;
-    for (unsigned int i = 0; i < m_vertices.size(); ++i)
-    {
-        sumValMoinsMoy += pow(sqrt((m_vertices.at(i).x - moyPt.x)*(m_vertices.at(i).x - moyPt.x) +
-                               (m_vertices.at(i).y - moyPt.y)*(m_vertices.at(i).y - moyPt.y) +
-                               (m_vertices.at(i).z - moyPt.z)*(m_vertices.at(i).z - moyPt.z))
-                          - moyDist, 2);
-    }
-    var = sumValMoinsMoy / m_vertices.size();
-
-    return sqrt(var);
+	return m_mesh->get_standard_deviation();
 }
 
 //~ Setters
 void Object::set_model_matrix(const glm::mat4 input_matrix)
 {
 	m_model_matrix = input_matrix;
+	update_bounds();
+}
+
+bool Object::set_vertex_layout(const VertexLayout layout)
+{
+	//~ The buffers are kept if the arrays cannot be read again
+	if(!m_mesh->reload_arrays())
+	{
+		return false;
+	}
+	delete_buffers();
+	m_layout = layout;
+	create_buffers();
+	return true;
+}
+
+bool Object::set_vertex_format(const VertexFormat format)
+{
+	if(!m_mesh->reload_arrays())
+	{
+		return false;
+	}
+	delete_buffers();
+	m_format = format;
+	create_buffers();
+	return true;
+}
+
+bool Object::set_cpu_retention(const CpuRetention retention)
+{
+	//~ The positions dropped by a previous policy are mapped again before the others are released
+	if(retention != RETENTION_NONE && !m_mesh->reload_arrays())
+	{
+		return false;
+	}
+	m_retention = retention;
+	release_arrays();
+	return true;
 }
 
 //~ Getters
@@ -214,9 +1059,69 @@ GLuint Object::get_vao() const
 	return m_object_vao;
 }
 
+GLuint Object::get_depth_vao() const
+{
+	return (m_object_depth_vao != 0) ? m_object_depth_vao : m_object_vao;
+}
+
+VertexLayout Object::get_vertex_layout() const
+{
+	return m_layout;
+}
+
 unsigned int Object::get_size() const
 {
-	return m_vertices.size();
+	return m_mesh->get_number_of_vertices();
+}
+
+unsigned int Object::get_number_of_indices() const
+{
+	return m_mesh->get_number_of_indices();
+}
+
+unsigned int Object::get_number_of_resident_indices() const
+{
+	return (m_streamer != NULL) ? m_streamer->get_resident_indices() : m_mesh->get_number_of_indices();
+}
+
+bool Object::is_resident() const
+{
+	return m_streamer == NULL;
+}
+
+float Object::get_upload_progress() const
+{
+	return (m_streamer != NULL) ? m_streamer->get_progress() : 1.0f;
+}
+
+GLenum Object::get_index_type() const
+{
+	return m_index_type;
+}
+
+float Object::get_unique_vertex_ratio() const
+{
+	return m_mesh->get_unique_vertex_ratio();
+}
+
+glm::vec3 Object::get_world_min() const
+{
+	return m_world_min;
+}
+
+glm::vec3 Object::get_world_max() const
+{
+	return m_world_max;
+}
+
+glm::vec3 Object::get_world_centre() const
+{
+	return m_world_centre;
+}
+
+float Object::get_world_radius() const
+{
+	return m_world_radius;
 }
 
 glm::mat4 Object::get_model_matrix() const
@@ -224,12 +1129,32 @@ glm::mat4 Object::get_model_matrix() const
 	return m_model_matrix;
 }
 
+glm::mat4 Object::get_position_matrix() const
+{
+	return m_model_matrix * m_dequantization_matrix;
+}
+
+VertexFormat Object::get_vertex_format() const
+{
+	return m_format;
+}
+
+CpuRetention Object::get_cpu_retention() const
+{
+	return m_retention;
+}
+
 GLuint Object::get_diffuse_texture() const
 {
 	return m_diffuse_texture;
 }
 
+const std::vector<glm::vec4>& Object::get_material_table() const
+{
+	return m_material_table;
+}
+
 const char* Object::get_texture_path() const
 {
-	return m_texture_path;
+	return m_texture_path.c_str();
 }
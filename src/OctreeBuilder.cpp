@@ -0,0 +1,397 @@
+/***************************************************************************
+									OctreeBuilder.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file OctreeBuilder.cpp
+ * \brief Partitions a model into an octree of chunks with levels of detail, for the out-of-core rendering
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/OctreeBuilder.hpp"
+
+//~ Triangles of a leaf when none is given on the command line
+static const unsigned int OCTREE_CHUNK_TRIANGLES = 32768;
+//~ Levels of the Morton codes, 10 bits per axis : a cell of the deepest level is not split any more
+static const unsigned int OCTREE_MAX_DEPTH = 10;
+//~ Bumped whenever the content of the files changes
+static const uint32_t OCTREE_VERSION = 1;
+static const char OCTREE_MAGIC[8] = { '3', 'D', 'O', 'B', 'S', 'O', 'C', 'T' };
+static const char* OCTREE_EXTENSION = ".octree";
+
+/*!
+ * \brief Cell of the octree during the build : its run of the sorted triangles and its children
+ */
+struct OctreeCell
+{
+	unsigned int begin;
+	unsigned int end;
+	unsigned int depth;
+	unsigned int first_child;
+	unsigned int number_of_children;
+};
+
+/*!
+ * \brief State of a build, shared by the nodes
+ */
+struct OctreeBuild
+{
+	const Mesh* mesh;
+	std::vector<uint64_t> keys;
+	std::vector<OctreeCell> cells;
+	std::vector<OctreeFileNode> nodes;
+	unsigned int chunk_triangles;
+	FILE* file;
+	uint64_t offset;
+	bool written;
+	unsigned int max_vertices;
+	unsigned int max_indices;
+};
+
+//~ Spreads the 10 low bits of a value to every third bit
+static uint32_t spread_bits(uint32_t value)
+{
+	value &= 0x3ff;
+	value = (value | (value << 16)) & 0x030000ff;
+	value = (value | (value << 8)) & 0x0300f00f;
+	value = (value | (value << 4)) & 0x030c30c3;
+	value = (value | (value << 2)) & 0x09249249;
+	return value;
+}
+
+//~ Writes zeros up to the next multiple of 16 bytes
+static void align_file(OctreeBuild& build)
+{
+	const char padding[16] = { 0 };
+	const uint64_t aligned = (build.offset + 15) & ~(uint64_t)15;
+	build.written = build.written && fwrite(padding, 1, aligned - build.offset, build.file) == aligned - build.offset;
+	build.offset = aligned;
+}
+
+//~ Turns triangles indexing the mesh into triangles indexing their own vertices, listed in unique in increasing order
+static void localize(const std::vector<unsigned int>& indices, std::vector<unsigned int>& unique, std::vector<unsigned int>& local)
+{
+	unique = indices;
+	std::sort(unique.begin(), unique.end());
+	unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+	local.resize(indices.size());
+	for(unsigned int i = 0; i < indices.size(); ++i)
+	{
+		local[i] = std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin();
+	}
+}
+
+//~ Simplifies the union of the chunks of the children of a node, the triangles keep indexing the mesh
+static float simplify_chunk(const OctreeBuild& build, std::vector<unsigned int>& indices)
+{
+	std::vector<unsigned int> unique, local;
+	localize(indices, unique, local);
+	std::vector<glm::vec3> positions(unique.size());
+	for(unsigned int v = 0; v < unique.size(); ++v)
+	{
+		positions[v] = build.mesh->get_vertices()[unique[v]];
+	}
+	std::vector<unsigned int> simplified(local.size());
+	float error = 0.0f;
+	const unsigned int nb_indices = MeshSimplifier::simplify(&simplified[0], &local[0], local.size(), &positions[0], positions.size(), build.chunk_triangles * 3, error);
+	indices.resize(nb_indices);
+	for(unsigned int i = 0; i < nb_indices; ++i)
+	{
+		indices[i] = unique[simplified[i]];
+	}
+	return error;
+}
+
+//~ Appends the chunk of a node to the file and fills its entry of the table
+static void write_chunk(OctreeBuild& build, unsigned int node, const std::vector<unsigned int>& indices, float error)
+{
+	std::vector<unsigned int> unique, local;
+	localize(indices, unique, local);
+	if(!local.empty())
+	{
+		MeshOptimizer::optimize_vertex_cache(&local[0], local.size(), unique.size());
+	}
+	std::vector<OctreeVertex> vertices(unique.size());
+	glm::vec3 min(0.0f), max(0.0f);
+	for(unsigned int v = 0; v < unique.size(); ++v)
+	{
+		const glm::vec3& position = build.mesh->get_vertices()[unique[v]];
+		const glm::vec3& normal = build.mesh->get_normals()[unique[v]];
+		const glm::vec2& uv = build.mesh->get_uvs()[unique[v]];
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			vertices[v].position[c] = position[c];
+			vertices[v].normal[c] = normal[c];
+		}
+		vertices[v].uv[0] = uv.x;
+		vertices[v].uv[1] = uv.y;
+		min = (v == 0) ? position : glm::min(min, position);
+		max = (v == 0) ? position : glm::max(max, position);
+	}
+
+	OctreeFileNode& entry = build.nodes[node];
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		entry.min[c] = min[c];
+		entry.max[c] = max[c];
+	}
+	entry.error = error;
+	entry.first_child = build.cells[node].first_child;
+	entry.number_of_children = build.cells[node].number_of_children;
+	entry.number_of_vertices = vertices.size();
+	entry.number_of_indices = local.size();
+	align_file(build);
+	entry.data_offset = build.offset;
+	const size_t vertices_size = vertices.size() * sizeof(OctreeVertex);
+	const size_t indices_size = local.size() * sizeof(unsigned int);
+	build.written = build.written
+		&& (vertices_size == 0 || fwrite(&vertices[0], 1, vertices_size, build.file) == vertices_size)
+		&& (indices_size == 0 || fwrite(&local[0], 1, indices_size, build.file) == indices_size);
+	build.offset += vertices_size + indices_size;
+	build.max_vertices = std::max(build.max_vertices, (unsigned int)vertices.size());
+	build.max_indices = std::max(build.max_indices, (unsigned int)local.size());
+}
+
+//~ Builds the chunks of the subtree of a node, depth first, and gives back the triangles of the node and its error
+static void build_node(OctreeBuild& build, unsigned int node, std::vector<unsigned int>& indices, float& error)
+{
+	const OctreeCell cell = build.cells[node];
+	std::vector<unsigned int> triangles;
+	float node_error = 0.0f;
+	if(cell.number_of_children == 0)
+	{
+		//~ A leaf keeps the triangles of the model whose centre lies in its cell
+		const unsigned int* mesh_indices = build.mesh->get_indices();
+		triangles.reserve((cell.end - cell.begin) * 3);
+		for(unsigned int k = cell.begin; k < cell.end; ++k)
+		{
+			const unsigned int triangle = (unsigned int)(build.keys[k] & 0xFFFFFFFF);
+			triangles.insert(triangles.end(), mesh_indices + triangle * 3, mesh_indices + triangle * 3 + 3);
+		}
+	}
+	else
+	{
+		//~ The chunks of the children are only needed until the one of their parent is built
+		for(unsigned int c = 0; c < cell.number_of_children; ++c)
+		{
+			std::vector<unsigned int> child;
+			float child_error = 0.0f;
+			build_node(build, cell.first_child + c, child, child_error);
+			triangles.insert(triangles.end(), child.begin(), child.end());
+			node_error = std::max(node_error, child_error);
+		}
+		//~ The errors add up from one level to the next, so that a parent never looks better than its children
+		node_error += simplify_chunk(build, triangles);
+	}
+	write_chunk(build, node, triangles, node_error);
+	indices.swap(triangles);
+	error = node_error;
+}
+
+int OctreeBuilder::run(int argc, char** argv)
+{
+	if(argc < 2 || std::string(argv[1]) != "--build-octree")
+	{
+		return -1;
+	}
+	if(argc < 3)
+	{
+		std::cerr << "Usage : " << argv[0] << " --build-octree <model> [triangles per chunk]" << std::endl;
+		return 1;
+	}
+	SDL_Init(SDL_INIT_TIMER);
+	const unsigned int chunk_triangles = (argc > 3) ? std::max(atoi(argv[3]), 256) : OCTREE_CHUNK_TRIANGLES;
+	Mesh* mesh = NULL;
+	try
+	{
+		//~ Only the positions, normals, uvs and indices are read, the hierarchy of the viewer is not built
+		mesh = new Mesh(argv[2], true);
+	}
+	catch(int)
+	{
+		std::cerr << "Unable to load " << argv[2] << std::endl;
+		SDL_Quit();
+		return 1;
+	}
+	const bool built = build(*mesh, std::string(argv[2]) + OCTREE_EXTENSION, chunk_triangles);
+	delete mesh;
+	SDL_Quit();
+	return built ? 0 : 1;
+}
+
+bool OctreeBuilder::build(const Mesh& mesh, const std::string& path, unsigned int chunk_triangles)
+{
+	Uint32 start = SDL_GetTicks();
+	OctreeBuild build;
+	build.mesh = &mesh;
+	build.chunk_triangles = chunk_triangles;
+	build.offset = 0;
+	build.written = true;
+	build.max_vertices = 0;
+	build.max_indices = 0;
+
+	//~ Only the full resolution is partitioned, the levels of detail of the mesh cover the whole model
+	unsigned int nb_indices = mesh.get_number_of_indices();
+	const std::vector<MeshLod>& lods = mesh.get_lods();
+	if(!lods.empty() && lods[0].number_of_submeshes > 0)
+	{
+		const Submesh& last = mesh.get_submeshes()[lods[0].first_submesh + lods[0].number_of_submeshes - 1];
+		nb_indices = last.first_index + last.number_of_indices;
+	}
+	const unsigned int nb_triangles = nb_indices / 3;
+	if(nb_triangles == 0 || mesh.get_vertices() == NULL)
+	{
+		std::cerr << "No triangle to partition" << std::endl;
+		return false;
+	}
+
+	//~ Morton code of the centre of each triangle in the bounding cube, the triangle in the low bits
+	const glm::vec3 min = mesh.get_min();
+	const glm::vec3 extent = mesh.get_max() - min;
+	const float side = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-20f));
+	const float scale = (float)(1 << OCTREE_MAX_DEPTH) / side;
+	const glm::vec3* vertices = mesh.get_vertices();
+	const unsigned int* indices = mesh.get_indices();
+	build.keys.resize(nb_triangles);
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		const glm::vec3 centre = (vertices[indices[t * 3]] + vertices[indices[t * 3 + 1]] + vertices[indices[t * 3 + 2]]) / 3.0f;
+		uint32_t code = 0;
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			const int cell = std::min(std::max((int)((centre[c] - min[c]) * scale), 0), (1 << OCTREE_MAX_DEPTH) - 1);
+			code |= spread_bits(cell) << (2 - c);
+		}
+		build.keys[t] = ((uint64_t)code << 32) | t;
+	}
+	std::sort(build.keys.begin(), build.keys.end());
+
+	//~ Cells split breadth first, so that the children of a cell follow each other
+	OctreeCell root = { 0, nb_triangles, 0, 0, 0 };
+	build.cells.push_back(root);
+	for(unsigned int n = 0; n < build.cells.size(); ++n)
+	{
+		OctreeCell cell = build.cells[n];
+		if(cell.end - cell.begin <= chunk_triangles || cell.depth == OCTREE_MAX_DEPTH)
+		{
+			continue;
+		}
+		//~ The octant of a cell is the next 3 bits of the codes
+		const unsigned int shift = 32 + 3 * (OCTREE_MAX_DEPTH - 1 - cell.depth);
+		cell.first_child = build.cells.size();
+		for(unsigned int begin = cell.begin; begin < cell.end; )
+		{
+			const uint64_t octant = (build.keys[begin] >> shift) & 7;
+			unsigned int end = begin + 1;
+			while(end < cell.end && ((build.keys[end] >> shift) & 7) == octant)
+			{
+				++end;
+			}
+			OctreeCell child = { begin, end, cell.depth + 1, 0, 0 };
+			build.cells.push_back(child);
+			begin = end;
+		}
+		cell.number_of_children = build.cells.size() - cell.first_child;
+		build.cells[n] = cell;
+	}
+	build.nodes.resize(build.cells.size());
+
+	//~ Written aside then renamed, so that a partial file is never read
+	const std::string temporary_path = path + ".tmp";
+	build.file = fopen(temporary_path.c_str(), "wb");
+	if(build.file == NULL)
+	{
+		std::cerr << "Unable to write the octree " << path << std::endl;
+		return false;
+	}
+	OctreeFileHeader header;
+	memset(&header, 0, sizeof(header));
+	build.written = fwrite(&header, sizeof(header), 1, build.file) == 1;
+	build.offset = sizeof(header);
+
+	std::vector<unsigned int> root_triangles;
+	float root_error = 0.0f;
+	build_node(build, 0, root_triangles, root_error);
+
+	//~ The table of the nodes follows the chunks, the header is written last
+	memcpy(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC));
+	header.version = OCTREE_VERSION;
+	header.number_of_nodes = build.nodes.size();
+	align_file(build);
+	header.nodes_offset = build.offset;
+	build.written = build.written && fwrite(&build.nodes[0], sizeof(OctreeFileNode), build.nodes.size(), build.file) == build.nodes.size();
+	header.file_size = build.offset + build.nodes.size() * sizeof(OctreeFileNode);
+	header.max_vertices = build.max_vertices;
+	header.max_indices = build.max_indices;
+	const glm::vec3 color = mesh.get_materials().empty() ? glm::vec3(1.0f) : mesh.get_materials()[0].diffuse_color;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		header.min[c] = mesh.get_min()[c];
+		header.max[c] = mesh.get_max()[c];
+		header.barycentre[c] = mesh.get_barycentre()[c];
+		header.diffuse_color[c] = color[c];
+	}
+	header.average_distance = mesh.get_average_distance();
+	build.written = build.written && fseek(build.file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, build.file) == 1;
+	build.written = (fclose(build.file) == 0) && build.written;
+
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if(!build.written || rename(temporary_path.c_str(), path.c_str()) != 0)
+	{
+		remove(temporary_path.c_str());
+		std::cerr << "Unable to write the octree " << path << std::endl;
+		return false;
+	}
+	unsigned int nb_leaves = 0, depth = 0;
+	for(unsigned int n = 0; n < build.cells.size(); ++n)
+	{
+		nb_leaves += (build.cells[n].number_of_children == 0);
+		depth = std::max(depth, build.cells[n].depth);
+	}
+	std::cout << path << " : " << build.nodes.size() << " nodes, " << nb_leaves << " leaves, depth " << depth << ", root error " << root_error
+		<< ", " << (header.file_size >> 20) << " MB written in " << SDL_GetTicks() - start << " ms" << std::endl;
+	return true;
+}
+
+bool OctreeBuilder::is_octree_file(const std::string& filename)
+{
+	const std::string extension = OCTREE_EXTENSION;
+	return filename.size() >= extension.size() && filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool OctreeBuilder::check_header(const OctreeFileHeader& header, uint64_t file_size)
+{
+	return memcmp(header.magic, OCTREE_MAGIC, sizeof(OCTREE_MAGIC)) == 0
+		&& header.version == OCTREE_VERSION
+		&& header.file_size == file_size
+		&& header.number_of_nodes > 0
+		&& header.nodes_offset + (uint64_t)header.number_of_nodes * sizeof(OctreeFileNode) <= file_size;
+}
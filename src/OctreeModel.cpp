@@ -0,0 +1,570 @@
+/***************************************************************************
+									OctreeModel.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file OctreeModel.cpp
+ * \brief Model drawn out of core from an octree file, its chunks paged in and out of a pool of GPU buffers
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/OctreeModel.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+//~ Missing nodes asked to the loader per frame, the most needed ones
+static const unsigned int OCTREE_MAX_REQUESTS = 64;
+
+OctreeModel::OctreeModel(const char* filename, const char* texture_path, size_t gpu_budget, size_t cpu_budget) throw (int):
+	m_filename(filename),
+#ifdef _WIN32
+	m_file(NULL),
+#else
+	m_mapping(NULL),
+	m_mapping_size(0),
+#endif
+	m_vao(0),
+	m_vertices_vbo(0),
+	m_indices_ibo(0),
+	m_number_of_slots(0),
+	m_frame(0),
+	m_drawn_triangles(0),
+	m_number_of_requests(0),
+	m_thread(NULL),
+	m_mutex(NULL),
+	m_condition(NULL),
+	m_stop(false),
+	m_staged_size(0),
+	m_cpu_budget(cpu_budget),
+	m_model_matrix(1.0f)
+{
+	m_texture_range.texture = 0;
+	m_texture_range.first_layer = 0;
+	m_texture_range.number_of_layers = 0;
+
+	//~ Only the header and the table of the nodes are read, the chunks stay in the file until they are asked for
+	uint64_t file_size = 0;
+#ifdef _WIN32
+	m_file = fopen(filename, "rb");
+	if(m_file == NULL)
+	{
+		throw(0);
+	}
+	_fseeki64(m_file, 0, SEEK_END);
+	file_size = _ftelli64(m_file);
+	_fseeki64(m_file, 0, SEEK_SET);
+	bool valid = fread(&m_header, sizeof(m_header), 1, m_file) == 1 && OctreeBuilder::check_header(m_header, file_size);
+	if(valid)
+	{
+		m_nodes.resize(m_header.number_of_nodes);
+		_fseeki64(m_file, m_header.nodes_offset, SEEK_SET);
+		valid = fread(&m_nodes[0], sizeof(OctreeFileNode), m_nodes.size(), m_file) == m_nodes.size();
+	}
+#else
+	int descriptor = open(filename, O_RDONLY);
+	if(descriptor < 0)
+	{
+		throw(0);
+	}
+	struct stat file_stat;
+	if(fstat(descriptor, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(OctreeFileHeader))
+	{
+		close(descriptor);
+		throw(0);
+	}
+	m_mapping_size = file_stat.st_size;
+	m_mapping = mmap(NULL, m_mapping_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(m_mapping == MAP_FAILED)
+	{
+		m_mapping = NULL;
+		throw(0);
+	}
+	file_size = m_mapping_size;
+	memcpy(&m_header, m_mapping, sizeof(m_header));
+	bool valid = OctreeBuilder::check_header(m_header, file_size);
+	if(valid)
+	{
+		const OctreeFileNode* nodes = (const OctreeFileNode*)((const char*)m_mapping + m_header.nodes_offset);
+		m_nodes.assign(nodes, nodes + m_header.number_of_nodes);
+	}
+#endif
+	//~ Every chunk lies within the file and within the size of a slot, the children come after their parent
+	for(unsigned int n = 0; n < m_nodes.size() && valid; ++n)
+	{
+		const OctreeFileNode& node = m_nodes[n];
+		valid = node.number_of_vertices <= m_header.max_vertices && node.number_of_indices <= m_header.max_indices
+			&& node.data_offset + get_chunk_size(n) <= file_size
+			&& (node.number_of_children == 0 || (node.first_child > n && (uint64_t)node.first_child + node.number_of_children <= m_nodes.size()));
+	}
+	const size_t slot_size = m_header.max_vertices * sizeof(OctreeVertex) + m_header.max_indices * sizeof(GLuint);
+	if(valid && gpu_budget < slot_size)
+	{
+		std::cerr << "The GPU budget of " << (gpu_budget >> 20) << " MB cannot hold a chunk of " << (slot_size >> 20) << " MB" << std::endl;
+		valid = false;
+	}
+	if(!valid)
+	{
+		std::cerr << filename << " is not a valid octree file" << std::endl;
+#ifdef _WIN32
+		fclose(m_file);
+#else
+		munmap(m_mapping, m_mapping_size);
+#endif
+		throw(0);
+	}
+
+	//~ The pool is allocated once, the slots are never resized
+	m_number_of_slots = std::min(gpu_budget / slot_size, m_nodes.size());
+	glGenVertexArrays(1, &m_vao);
+	glGenBuffers(1, &m_vertices_vbo);
+	glGenBuffers(1, &m_indices_ibo);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertices_vbo);
+	glBufferData(GL_ARRAY_BUFFER, (size_t)m_number_of_slots * m_header.max_vertices * sizeof(OctreeVertex), NULL, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(OctreeVertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(OctreeVertex), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(OctreeVertex), (void*)(6 * sizeof(float)));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)m_number_of_slots * m_header.max_indices * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	m_slot_nodes.assign(m_number_of_slots, -1);
+	m_slot_last_use.assign(m_number_of_slots, 0);
+	m_node_slots.assign(m_nodes.size(), -1);
+	m_loading.assign(m_nodes.size(), 0);
+	std::cout << filename << " : " << m_nodes.size() << " nodes, pool of " << m_number_of_slots << " slots of " << (slot_size >> 10) << " KB" << std::endl;
+
+	load_texture(texture_path);
+
+	m_mutex = SDL_CreateMutex();
+	m_condition = SDL_CreateCond();
+	m_thread = SDL_CreateThread(OctreeModel::run_loader, this);
+	if(m_thread == NULL)
+	{
+		std::cerr << "Unable to create the paging thread : " << SDL_GetError() << std::endl;
+	}
+}
+
+OctreeModel::~OctreeModel()
+{
+	//~ Stopping the loader, it ends once its current chunk is read
+	SDL_LockMutex(m_mutex);
+	m_stop = true;
+	SDL_CondSignal(m_condition);
+	SDL_UnlockMutex(m_mutex);
+	if(m_thread != NULL)
+	{
+		SDL_WaitThread(m_thread, NULL);
+	}
+	SDL_DestroyCond(m_condition);
+	SDL_DestroyMutex(m_mutex);
+	for(unsigned int p = 0; p < m_pages.size(); ++p)
+	{
+		delete m_pages[p];
+	}
+	for(unsigned int p = 0; p < m_waiting_pages.size(); ++p)
+	{
+		delete m_waiting_pages[p];
+	}
+
+	if(m_texture_range.texture != 0)
+	{
+		TextureArrayManager::get_shared().release(m_texture_range);
+	}
+	glDeleteBuffers(1, &m_vertices_vbo);
+	glDeleteBuffers(1, &m_indices_ibo);
+	glDeleteVertexArrays(1, &m_vao);
+#ifdef _WIN32
+	fclose(m_file);
+#else
+	munmap(m_mapping, m_mapping_size);
+#endif
+}
+
+int OctreeModel::run_loader(void* data)
+{
+	((OctreeModel*)data)->load();
+	return 0;
+}
+
+void OctreeModel::load()
+{
+	SDL_LockMutex(m_mutex);
+	while(!m_stop)
+	{
+		//~ The most needed request whose chunk is not read yet, the requests being sorted by increasing priority
+		int node = -1;
+		while(node < 0 && !m_requests.empty())
+		{
+			node = m_requests.back();
+			m_requests.pop_back();
+			if(m_loading[node])
+			{
+				node = -1;
+			}
+		}
+		//~ The chunks waiting for their upload stay within the budget, unless there is only one
+		if(node < 0 || (m_staged_size > 0 && m_staged_size + get_chunk_size(node) > m_cpu_budget))
+		{
+			if(node >= 0)
+			{
+				m_requests.push_back(node);
+			}
+			SDL_CondWait(m_condition, m_mutex);
+			continue;
+		}
+		m_loading[node] = 1;
+		m_staged_size += get_chunk_size(node);
+		SDL_UnlockMutex(m_mutex);
+
+		OctreePage* page = new OctreePage;
+		page->node = node;
+		read_chunk(node, page->data);
+
+		SDL_LockMutex(m_mutex);
+		m_pages.push_back(page);
+	}
+	SDL_UnlockMutex(m_mutex);
+}
+
+void OctreeModel::read_chunk(unsigned int node, std::vector<unsigned char>& data)
+{
+	const OctreeFileNode& entry = m_nodes[node];
+	data.resize(get_chunk_size(node));
+	if(data.empty())
+	{
+		return;
+	}
+#ifdef _WIN32
+	_fseeki64(m_file, entry.data_offset, SEEK_SET);
+	if(fread(&data[0], 1, data.size(), m_file) != data.size())
+	{
+		std::cerr << "Unable to read a chunk of " << m_filename << std::endl;
+	}
+#else
+	//~ The pages of the chunk are read from the disk here, on the loader thread, and given back right after the copy
+	memcpy(&data[0], (const char*)m_mapping + entry.data_offset, data.size());
+	const size_t page_size = sysconf(_SC_PAGESIZE);
+	const size_t first_page = (entry.data_offset + page_size - 1) / page_size * page_size;
+	const size_t last_page = (entry.data_offset + data.size()) / page_size * page_size;
+	if(last_page > first_page)
+	{
+		madvise((char*)m_mapping + first_page, last_page - first_page, MADV_DONTNEED);
+	}
+#endif
+}
+
+size_t OctreeModel::get_chunk_size(unsigned int node) const
+{
+	return (size_t)m_nodes[node].number_of_vertices * sizeof(OctreeVertex) + (size_t)m_nodes[node].number_of_indices * sizeof(GLuint);
+}
+
+void OctreeModel::update(const Camera& first, const Camera& second, float projection_scale, float max_error, size_t upload_budget)
+{
+	++m_frame;
+	//~ The octree is walked in model space : the frusta take the model matrix, the error is the same at any uniform scale
+	const glm::mat4 world_to_model = glm::inverse(m_model_matrix);
+	const Frustum eyes(first.get_projection_matrix() * first.get_view_matrix() * m_model_matrix, second.get_projection_matrix() * second.get_view_matrix() * m_model_matrix);
+	const glm::vec3 viewpoints[2] = {	glm::vec3(world_to_model * glm::vec4(first.get_position(), 1.0f)),
+										glm::vec3(world_to_model * glm::vec4(second.get_position(), 1.0f)) };
+	m_draw_counts.clear();
+	m_draw_offsets.clear();
+	m_draw_base_vertices.clear();
+	m_drawn_triangles = 0;
+	std::vector<std::pair<float, unsigned int> > requests;
+	if(m_node_slots[0] >= 0)
+	{
+		select(0, eyes, viewpoints, projection_scale, max_error, requests);
+	}
+	else
+	{
+		requests.push_back(std::make_pair(FLT_MAX, 0u));
+	}
+
+	//~ No more requests than chunks the pool can take this frame, so that the loader does not read chunks to drop them
+	unsigned int available = 0;
+	for(unsigned int s = 0; s < m_number_of_slots; ++s)
+	{
+		available += (m_slot_nodes[s] < 0 || m_slot_last_use[s] != m_frame);
+	}
+	std::sort(requests.begin(), requests.end());
+	const unsigned int nb_requests = std::min(std::min((unsigned int)requests.size(), available), OCTREE_MAX_REQUESTS);
+	m_number_of_requests = requests.size();
+
+	//~ The chunks read since the last frame join the ones waiting for their upload
+	std::vector<unsigned int> consumed;
+	SDL_LockMutex(m_mutex);
+	m_waiting_pages.insert(m_waiting_pages.end(), m_pages.begin(), m_pages.end());
+	m_pages.clear();
+	SDL_UnlockMutex(m_mutex);
+
+	size_t uploaded = 0, released = 0;
+	unsigned int p = 0;
+	for(; p < m_waiting_pages.size() && (p == 0 || uploaded + m_waiting_pages[p]->data.size() <= upload_budget); ++p)
+	{
+		OctreePage* page = m_waiting_pages[p];
+		//~ Without a slot the chunk is dropped, it will be asked again while it is needed
+		const int slot = (m_node_slots[page->node] < 0) ? acquire_slot() : -1;
+		if(slot >= 0)
+		{
+			upload(*page, slot);
+			uploaded += page->data.size();
+		}
+		released += page->data.size();
+		consumed.push_back(page->node);
+		delete page;
+	}
+	m_waiting_pages.erase(m_waiting_pages.begin(), m_waiting_pages.begin() + p);
+
+	//~ The requests replace the previous ones once the chunks are uploaded, so that a chunk just uploaded is not read again
+	SDL_LockMutex(m_mutex);
+	for(unsigned int c = 0; c < consumed.size(); ++c)
+	{
+		m_loading[consumed[c]] = 0;
+	}
+	m_staged_size -= released;
+	m_requests.clear();
+	for(unsigned int r = requests.size() - nb_requests; r < requests.size(); ++r)
+	{
+		if(m_node_slots[requests[r].second] < 0)
+		{
+			m_requests.push_back(requests[r].second);
+		}
+	}
+	SDL_CondSignal(m_condition);
+	SDL_UnlockMutex(m_mutex);
+}
+
+void OctreeModel::select(unsigned int node, const Frustum& eyes, const glm::vec3 viewpoints[2], float projection_scale, float max_error, std::vector<std::pair<float, unsigned int> >& requests)
+{
+	const OctreeFileNode& entry = m_nodes[node];
+	if(!eyes.intersects_box(glm::vec3(entry.min[0], entry.min[1], entry.min[2]), glm::vec3(entry.max[0], entry.max[1], entry.max[2])))
+	{
+		return;
+	}
+	//~ Every walked node is kept in the pool : the walk only goes through resident nodes
+	m_slot_last_use[m_node_slots[node]] = m_frame;
+	bool refine = false;
+	if(entry.number_of_children > 0)
+	{
+		const float error = get_projected_error(node, viewpoints, projection_scale);
+		refine = error > max_error;
+		//~ The node is replaced by its children once all the visible ones are resident, the missing ones are asked for meanwhile
+		for(unsigned int c = entry.first_child; c < entry.first_child + entry.number_of_children && error > max_error; ++c)
+		{
+			const OctreeFileNode& child = m_nodes[c];
+			if(!eyes.intersects_box(glm::vec3(child.min[0], child.min[1], child.min[2]), glm::vec3(child.max[0], child.max[1], child.max[2])))
+			{
+				continue;
+			}
+			if(m_node_slots[c] < 0)
+			{
+				requests.push_back(std::make_pair(error, c));
+				refine = false;
+			}
+			else
+			{
+				m_slot_last_use[m_node_slots[c]] = m_frame;
+			}
+		}
+	}
+	if(refine)
+	{
+		for(unsigned int c = entry.first_child; c < entry.first_child + entry.number_of_children; ++c)
+		{
+			select(c, eyes, viewpoints, projection_scale, max_error, requests);
+		}
+		return;
+	}
+	const unsigned int slot = m_node_slots[node];
+	m_draw_counts.push_back(entry.number_of_indices);
+	m_draw_offsets.push_back((const GLvoid*)((size_t)slot * m_header.max_indices * sizeof(GLuint)));
+	m_draw_base_vertices.push_back(slot * m_header.max_vertices);
+	m_drawn_triangles += entry.number_of_indices / 3;
+}
+
+float OctreeModel::get_projected_error(unsigned int node, const glm::vec3 viewpoints[2], float projection_scale) const
+{
+	//~ Distance from the nearest eye to the bounding box : the error is bounded for every point of the node
+	const OctreeFileNode& entry = m_nodes[node];
+	float distance = FLT_MAX;
+	for(unsigned int v = 0; v < 2; ++v)
+	{
+		glm::vec3 gap(0.0f);
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			gap[c] = std::max(std::max(entry.min[c] - viewpoints[v][c], viewpoints[v][c] - entry.max[c]), 0.0f);
+		}
+		distance = std::min(distance, glm::length(gap));
+	}
+	return (distance > 0.0f) ? entry.error * projection_scale / distance : FLT_MAX;
+}
+
+int OctreeModel::acquire_slot()
+{
+	int slot = -1;
+	for(unsigned int s = 0; s < m_number_of_slots; ++s)
+	{
+		if(m_slot_nodes[s] < 0)
+		{
+			return s;
+		}
+		if(m_slot_last_use[s] != m_frame && (slot < 0 || m_slot_last_use[s] < m_slot_last_use[slot]))
+		{
+			slot = s;
+		}
+	}
+	if(slot >= 0)
+	{
+		m_node_slots[m_slot_nodes[slot]] = -1;
+		m_slot_nodes[slot] = -1;
+	}
+	return slot;
+}
+
+void OctreeModel::upload(const OctreePage& page, unsigned int slot)
+{
+	const OctreeFileNode& entry = m_nodes[page.node];
+	const size_t vertices_size = (size_t)entry.number_of_vertices * sizeof(OctreeVertex);
+	const size_t indices_size = (size_t)entry.number_of_indices * sizeof(GLuint);
+	//~ Both buffers are filled through GL_ARRAY_BUFFER, which leaves the binding of the VAO alone
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertices_vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, (size_t)slot * m_header.max_vertices * sizeof(OctreeVertex), vertices_size, &page.data[0]);
+	glBindBuffer(GL_ARRAY_BUFFER, m_indices_ibo);
+	glBufferSubData(GL_ARRAY_BUFFER, (size_t)slot * m_header.max_indices * sizeof(GLuint), indices_size, &page.data[vertices_size]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_slot_nodes[slot] = page.node;
+	m_slot_last_use[slot] = m_frame;
+	m_node_slots[page.node] = slot;
+}
+
+void OctreeModel::draw() const
+{
+	if(m_draw_counts.empty())
+	{
+		return;
+	}
+	glBindVertexArray(m_vao);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, &m_draw_counts[0], GL_UNSIGNED_INT, (const GLvoid**)&m_draw_offsets[0], m_draw_counts.size(), &m_draw_base_vertices[0]);
+	glBindVertexArray(0);
+}
+
+void OctreeModel::load_texture(const char* texture_path)
+{
+	std::vector<TextureImage> images(1, TextureDecoder::decode(texture_path != NULL ? texture_path : ""));
+	glm::vec3 tint(1.0f);
+	if(images[0].pixels == NULL)
+	{
+		const unsigned char white[4] = { 255, 255, 255, 255 };
+		images[0] = TextureDecoder::create_filled(1, 1, white);
+		tint = glm::vec3(m_header.diffuse_color[0], m_header.diffuse_color[1], m_header.diffuse_color[2]);
+	}
+	TextureDecoder::prepare(images, 0, 0, true);
+	const TextureImage& image = images[0];
+	m_texture_range = TextureArrayManager::get_shared().allocate(GL_RGBA8, image.width, image.height, image.levels, TextureDecoder::get_level_offset(image, image.levels), 1);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture_range.texture);
+	TextureDecoder::upload(GL_TEXTURE_2D_ARRAY, std::vector<const TextureImage*>(1, &image), m_texture_range.first_layer);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	TextureDecoder::release(images[0]);
+	m_material_table.push_back(glm::vec4(tint, (float)m_texture_range.first_layer));
+}
+
+//~ Setters
+void OctreeModel::set_model_matrix(const glm::mat4& model_matrix)
+{
+	m_model_matrix = model_matrix;
+}
+
+//~ Getters
+glm::mat4 OctreeModel::get_model_matrix() const
+{
+	return m_model_matrix;
+}
+
+glm::vec3 OctreeModel::get_barycentre() const
+{
+	return glm::vec3(m_header.barycentre[0], m_header.barycentre[1], m_header.barycentre[2]);
+}
+
+float OctreeModel::get_average_distance() const
+{
+	return m_header.average_distance;
+}
+
+GLuint OctreeModel::get_diffuse_texture() const
+{
+	return m_texture_range.texture;
+}
+
+const std::vector<glm::vec4>& OctreeModel::get_material_table() const
+{
+	return m_material_table;
+}
+
+unsigned int OctreeModel::get_number_of_nodes() const
+{
+	return m_nodes.size();
+}
+
+unsigned int OctreeModel::get_number_of_slots() const
+{
+	return m_number_of_slots;
+}
+
+unsigned int OctreeModel::get_number_of_resident_nodes() const
+{
+	return m_number_of_slots - std::count(m_slot_nodes.begin(), m_slot_nodes.end(), -1);
+}
+
+unsigned int OctreeModel::get_number_of_drawn_nodes() const
+{
+	return m_draw_counts.size();
+}
+
+unsigned int OctreeModel::get_number_of_drawn_triangles() const
+{
+	return m_drawn_triangles;
+}
+
+unsigned int OctreeModel::get_number_of_requests() const
+{
+	return m_number_of_requests;
+}
@@ -0,0 +1,1162 @@
+/***************************************************************************
+									PointCloud.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file PointCloud.cpp
+ * \brief Point cloud drawn as splats, through a nested octree of subsamples
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/PointCloud.hpp"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+//~ Size of the chunks of text parsed in parallel, before they are extended to the end of their last line
+static const size_t POINT_CHUNK_SIZE = 4 << 20;
+//~ Points converted per task from a binary file
+static const unsigned int POINT_RECORDS_PER_TASK = 1 << 16;
+//~ Cells per side of the grid of a node : a node keeps at most one point per cell
+static const unsigned int POINT_NODE_GRID = 128;
+//~ A node with fewer points keeps them all
+static const unsigned int POINT_LEAF_SIZE = 32768;
+//~ Beyond this depth the points are duplicates, a node keeps POINT_LEAF_SIZE of them
+static const unsigned int POINT_MAX_DEPTH = 20;
+//~ The children of a node are drawn while its spacing covers more pixels
+static const float POINT_MIN_SPACING = 1.0f;
+//~ Values read per line of text, the others are skipped
+static const unsigned int POINT_MAX_COLUMNS = 16;
+
+/*!
+ * \brief Columns of the values of a point, in a line of text or in the properties of a PLY vertex
+ */
+struct PointLayout
+{
+	int position;			/*!< Column of x, y and z follow it */
+	int normal;				/*!< Column of nx, followed by ny and nz, -1 if none */
+	int color;				/*!< Column of red, followed by green and blue, -1 if none */
+	float color_scale;		/*!< Factor bringing the colors to [0, 255] */
+	unsigned int columns;	/*!< Number of columns a line needs */
+};
+
+/*!
+ * \brief Part of a text file, parsed by one task
+ */
+struct PointChunk
+{
+	const char* begin;
+	const char* end;
+	std::vector<PointVertex> points;
+	unsigned int first;
+};
+
+/*!
+ * \brief Parsing of a text file
+ */
+struct PointTextJob
+{
+	std::vector<PointChunk> chunks;
+	PointLayout layout;
+	double offset[3];
+	PointVertex* points;
+};
+
+/*!
+ * \brief Conversion of the vertices of a binary PLY file
+ */
+struct PointRecordJob
+{
+	const char* data;
+	size_t stride;
+	unsigned int count;
+	unsigned int offsets[9];
+	char types[9];
+	bool swap;
+	PointLayout layout;
+	double offset[3];
+	PointVertex* points;
+};
+
+/*!
+ * \brief Building of the subtrees of the children of the root
+ */
+struct PointBuildJob
+{
+	PointVertex* points;
+	std::vector<PointNode> roots;
+	std::vector<std::vector<PointNode> > subtrees;
+	std::vector<unsigned int> dropped;
+};
+
+//~ Octahedral encoding of a unit vector in [-1,1]^2, as done by Object
+static glm::vec2 encode_octahedral(const glm::vec3& n)
+{
+	float sum = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if(sum == 0.0f) return glm::vec2(0.0f);
+	glm::vec2 p = glm::vec2(n.x, n.y) / sum;
+	if(n.z < 0.0f)
+	{
+		p = glm::vec2((1.0f - fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+		              (1.0f - fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+static bool is_line_end(char c)
+{
+	return c == '\n' || c == '\r';
+}
+
+//~ Reads a number of a line, the separators being spaces, tabs or commas ; false at the end of the line or on a word
+static bool read_number(const char*& cursor, const char* end, double& value)
+{
+	while(cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == ','))
+	{
+		++cursor;
+	}
+	const char* start = cursor;
+	bool negative = false;
+	if(cursor < end && (*cursor == '-' || *cursor == '+'))
+	{
+		negative = (*cursor == '-');
+		++cursor;
+	}
+	double mantissa = 0.0;
+	int exponent = 0;
+	bool digits = false;
+	for(; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor, digits = true)
+	{
+		mantissa = mantissa * 10.0 + (*cursor - '0');
+	}
+	if(cursor < end && *cursor == '.')
+	{
+		for(++cursor; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor, digits = true)
+		{
+			mantissa = mantissa * 10.0 + (*cursor - '0');
+			--exponent;
+		}
+	}
+	if(!digits)
+	{
+		cursor = start;
+		return false;
+	}
+	if(cursor < end && (*cursor == 'e' || *cursor == 'E'))
+	{
+		++cursor;
+		bool negative_exponent = false;
+		if(cursor < end && (*cursor == '-' || *cursor == '+'))
+		{
+			negative_exponent = (*cursor == '-');
+			++cursor;
+		}
+		int written = 0;
+		for(; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor)
+		{
+			written = std::min(written * 10 + (*cursor - '0'), 1000);
+		}
+		exponent += negative_exponent ? -written : written;
+	}
+	value = (exponent == 0) ? mantissa : mantissa * pow(10.0, exponent);
+	value = negative ? -value : value;
+	return true;
+}
+
+//~ Reads the numbers of a line, up to POINT_MAX_COLUMNS, and moves the cursor to the next line
+static unsigned int read_line(const char*& cursor, const char* end, double values[POINT_MAX_COLUMNS])
+{
+	unsigned int count = 0;
+	while(count < POINT_MAX_COLUMNS && read_number(cursor, end, values[count]))
+	{
+		++count;
+	}
+	while(cursor < end && !is_line_end(*cursor))
+	{
+		++cursor;
+	}
+	while(cursor < end && is_line_end(*cursor))
+	{
+		++cursor;
+	}
+	return count;
+}
+
+static PointVertex make_point(const double* values, const PointLayout& layout, const double offset[3])
+{
+	PointVertex point;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		point.position[c] = (float)(values[layout.position + c] - offset[c]);
+		point.color[c] = 255;
+	}
+	point.normal[0] = point.normal[1] = 0;
+	point.color[3] = 0;
+	if(layout.normal >= 0)
+	{
+		const glm::vec3 normal((float)values[layout.normal], (float)values[layout.normal + 1], (float)values[layout.normal + 2]);
+		if(glm::length(normal) > 0.0f)
+		{
+			const glm::vec2 encoded = encode_octahedral(normal);
+			point.normal[0] = (GLshort)(glm::clamp(encoded.x, -1.0f, 1.0f) * 32767.0f);
+			point.normal[1] = (GLshort)(glm::clamp(encoded.y, -1.0f, 1.0f) * 32767.0f);
+			point.color[3] = 255;
+		}
+	}
+	if(layout.color >= 0)
+	{
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			point.color[c] = (GLubyte)glm::clamp((float)values[layout.color + c] * layout.color_scale + 0.5f, 0.0f, 255.0f);
+		}
+	}
+	return point;
+}
+
+//~ Mapping of a whole file, NULL if it cannot be read
+static const char* map_file(const char* filename, size_t& size)
+{
+#ifdef _WIN32
+	//~ No mmap : the file is read at once
+	FILE* file = fopen(filename, "rb");
+	if(file == NULL)
+	{
+		return NULL;
+	}
+	_fseeki64(file, 0, SEEK_END);
+	size = _ftelli64(file);
+	_fseeki64(file, 0, SEEK_SET);
+	char* mapping = new char[size + 1];
+	const bool read = fread(mapping, 1, size, file) == size;
+	fclose(file);
+	if(!read)
+	{
+		delete[] mapping;
+		return NULL;
+	}
+	return mapping;
+#else
+	int descriptor = open(filename, O_RDONLY);
+	if(descriptor < 0)
+	{
+		return NULL;
+	}
+	struct stat file_stat;
+	if(fstat(descriptor, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close(descriptor);
+		return NULL;
+	}
+	size = file_stat.st_size;
+	void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(mapped == MAP_FAILED)
+	{
+		return NULL;
+	}
+	madvise(mapped, size, MADV_SEQUENTIAL);
+	return (const char*)mapped;
+#endif
+}
+
+static void unmap_file(const char* mapping, size_t size)
+{
+#ifdef _WIN32
+	delete[] mapping;
+#else
+	munmap((void*)mapping, size);
+#endif
+}
+
+//~ Size of a PLY type, 0 if unknown ; its code is c, C, s, S, i, I, f or d
+static unsigned int get_ply_type(const std::string& name, char& code)
+{
+	const char* names[] = { "char", "int8", "uchar", "uint8", "short", "int16", "ushort", "uint16", "int", "int32", "uint", "uint32", "float", "float32", "double", "float64" };
+	const char codes[] = "ccCCssSSiiIIffdd";
+	const unsigned int sizes[] = { 1, 1, 1, 1, 2, 2, 2, 2, 4, 4, 4, 4, 4, 4, 8, 8 };
+	for(unsigned int t = 0; t < 16; ++t)
+	{
+		if(name == names[t])
+		{
+			code = codes[t];
+			return sizes[t];
+		}
+	}
+	return 0;
+}
+
+static double read_ply_value(const char* data, char code, bool swap)
+{
+	unsigned char bytes[8];
+	const unsigned int size = (code == 'c' || code == 'C') ? 1 : (code == 's' || code == 'S') ? 2 : (code == 'd') ? 8 : 4;
+	for(unsigned int b = 0; b < size; ++b)
+	{
+		bytes[b] = data[swap ? size - 1 - b : b];
+	}
+	switch(code)
+	{
+		case 'c' : { int8_t v; memcpy(&v, bytes, 1); return v; }
+		case 'C' : { uint8_t v; memcpy(&v, bytes, 1); return v; }
+		case 's' : { int16_t v; memcpy(&v, bytes, 2); return v; }
+		case 'S' : { uint16_t v; memcpy(&v, bytes, 2); return v; }
+		case 'i' : { int32_t v; memcpy(&v, bytes, 4); return v; }
+		case 'I' : { uint32_t v; memcpy(&v, bytes, 4); return v; }
+		case 'f' : { float v; memcpy(&v, bytes, 4); return v; }
+		default : { double v; memcpy(&v, bytes, 8); return v; }
+	}
+}
+
+void PointCloud::parse_lines(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	PointTextJob& job = *(PointTextJob*)data;
+	double values[POINT_MAX_COLUMNS];
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		PointChunk& chunk = job.chunks[c];
+		const char* cursor = chunk.begin;
+		while(cursor < chunk.end)
+		{
+			//~ The lines with too few numbers are headers or comments
+			if(read_line(cursor, chunk.end, values) >= job.layout.columns)
+			{
+				chunk.points.push_back(make_point(values, job.layout, job.offset));
+			}
+		}
+	}
+}
+
+void PointCloud::gather_lines(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	PointTextJob& job = *(PointTextJob*)data;
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		PointChunk& chunk = job.chunks[c];
+		if(!chunk.points.empty())
+		{
+			memcpy(job.points + chunk.first, &chunk.points[0], chunk.points.size() * sizeof(PointVertex));
+		}
+		std::vector<PointVertex>().swap(chunk.points);
+	}
+}
+
+void PointCloud::parse_text(const char* begin, const char* end, void* data, std::vector<PointVertex>& points)
+{
+	PointTextJob& job = *(PointTextJob*)data;
+	//~ Chunks ending with a line
+	const char* cursor = begin;
+	while(cursor < end)
+	{
+		PointChunk chunk;
+		chunk.begin = cursor;
+		chunk.end = (size_t)(end - cursor) > POINT_CHUNK_SIZE ? cursor + POINT_CHUNK_SIZE : end;
+		const char* line_end = (const char*)memchr(chunk.end - 1, '\n', end - chunk.end + 1);
+		chunk.end = line_end ? line_end + 1 : end;
+		job.chunks.push_back(chunk);
+		cursor = chunk.end;
+	}
+	ThreadPool& pool = ThreadPool::get_shared();
+	pool.parallel_for(job.chunks.size(), 1, parse_lines, &job);
+	unsigned int count = 0;
+	for(unsigned int c = 0; c < job.chunks.size(); ++c)
+	{
+		job.chunks[c].first = count;
+		count += job.chunks[c].points.size();
+	}
+	points.resize(count);
+	job.points = points.empty() ? NULL : &points[0];
+	pool.parallel_for(job.chunks.size(), 1, gather_lines, &job);
+}
+
+void PointCloud::convert_records(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	PointRecordJob& job = *(PointRecordJob*)data;
+	double values[9];
+	const unsigned int last = std::min(end * POINT_RECORDS_PER_TASK, job.count);
+	for(unsigned int r = begin * POINT_RECORDS_PER_TASK; r < last; ++r)
+	{
+		const char* record = job.data + (size_t)r * job.stride;
+		for(unsigned int v = 0; v < 9; ++v)
+		{
+			values[v] = (job.types[v] != 0) ? read_ply_value(record + job.offsets[v], job.types[v], job.swap) : 0.0;
+		}
+		job.points[r] = make_point(values, job.layout, job.offset);
+	}
+}
+
+PointCloud::PointCloud(const char* filename) throw (int):
+	m_max_node_points(0),
+	m_barycentre(0.0f),
+	m_average_distance(1.0f),
+	m_vao(0),
+	m_vbo(0),
+	m_number_of_slots(0),
+	m_frame(0),
+	m_drawn_points(0),
+	m_model_matrix(1.0f)
+{
+	Uint32 start = SDL_GetTicks();
+	std::string name = filename;
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	if(name.size() > 4 && name.compare(name.size() - 4, 4, ".xyz") == 0)
+	{
+		read_xyz(filename);
+	}
+	else
+	{
+		read_ply(filename);
+	}
+	if(m_points.empty())
+	{
+		std::cerr << filename << " holds no point" << std::endl;
+		throw(0);
+	}
+	Uint32 read = SDL_GetTicks();
+
+	//~ Statistics used to place the cloud, like those of the meshes
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for(unsigned int p = 0; p < m_points.size(); ++p)
+	{
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			sum[c] += m_points[p].position[c];
+		}
+	}
+	m_barycentre = glm::vec3(sum[0] / m_points.size(), sum[1] / m_points.size(), sum[2] / m_points.size());
+	double distance = 0.0;
+	for(unsigned int p = 0; p < m_points.size(); ++p)
+	{
+		distance += glm::length(glm::vec3(m_points[p].position[0], m_points[p].position[1], m_points[p].position[2]) - m_barycentre);
+	}
+	m_average_distance = std::max((float)(distance / m_points.size()), FLT_MIN);
+
+	build_octree();
+	std::cout << filename << " : " << m_points.size() << " points read in " << read - start << " ms, octree of " << m_nodes.size() << " nodes built in " << SDL_GetTicks() - read << " ms" << std::endl;
+}
+
+PointCloud::~PointCloud()
+{
+	if(m_vao != 0)
+	{
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteVertexArrays(1, &m_vao);
+	}
+}
+
+bool PointCloud::is_point_cloud_file(const std::string& filename)
+{
+	std::string name = filename;
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	if(name.size() > 4 && name.compare(name.size() - 4, 4, ".xyz") == 0)
+	{
+		return true;
+	}
+	if(name.size() <= 4 || name.compare(name.size() - 4, 4, ".ply") != 0)
+	{
+		return false;
+	}
+	//~ Only the header is read : the PLY files with faces are meshes
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	std::string line;
+	unsigned int vertices = 0, faces = 0;
+	while(std::getline(file, line) && line.compare(0, 10, "end_header") != 0)
+	{
+		std::istringstream words(line);
+		std::string keyword, element;
+		unsigned int count = 0;
+		if(words >> keyword >> element >> count && keyword == "element")
+		{
+			vertices = (element == "vertex") ? count : vertices;
+			faces = (element == "face") ? count : faces;
+		}
+	}
+	return vertices > 0 && faces == 0;
+}
+
+void PointCloud::read_ply(const char* filename) throw (int)
+{
+	size_t size = 0;
+	const char* mapping = map_file(filename, size);
+	if(mapping == NULL)
+	{
+		throw(0);
+	}
+	const char* end = mapping + size;
+
+	//~ Header : the format, then the vertices, which have to come first
+	std::string format;
+	unsigned int count = 0;
+	bool vertex_element = false, valid = size > 3 && memcmp(mapping, "ply", 3) == 0;
+	std::vector<std::string> names;
+	std::vector<char> types;
+	std::vector<unsigned int> offsets;
+	size_t stride = 0;
+	const char* cursor = mapping;
+	const char* data = NULL;
+	while(valid && cursor < end && data == NULL)
+	{
+		const char* line_end = (const char*)memchr(cursor, '\n', end - cursor);
+		line_end = line_end ? line_end : end;
+		std::istringstream words(std::string(cursor, line_end));
+		cursor = (line_end < end) ? line_end + 1 : end;
+		std::string keyword;
+		words >> keyword;
+		if(keyword == "format")
+		{
+			words >> format;
+		}
+		else if(keyword == "element")
+		{
+			std::string element;
+			words >> element;
+			if(element == "vertex")
+			{
+				words >> count;
+				vertex_element = true;
+			}
+			else
+			{
+				valid = vertex_element;
+				vertex_element = false;
+			}
+		}
+		else if(keyword == "property" && vertex_element)
+		{
+			std::string type, name;
+			words >> type >> name;
+			char code = 0;
+			const unsigned int type_size = get_ply_type(type, code);
+			//~ No list in the vertices : the records have a fixed size
+			valid = type_size > 0;
+			names.push_back(name);
+			types.push_back(code);
+			offsets.push_back(stride);
+			stride += type_size;
+		}
+		else if(keyword == "end_header")
+		{
+			data = cursor;
+		}
+	}
+	valid = valid && data != NULL && count > 0;
+
+	//~ Properties of the points among those of the vertices
+	const char* wanted[9][3] = {	{ "x", "", "" }, { "y", "", "" }, { "z", "", "" },
+									{ "nx", "normal_x", "" }, { "ny", "normal_y", "" }, { "nz", "normal_z", "" },
+									{ "red", "r", "diffuse_red" }, { "green", "g", "diffuse_green" }, { "blue", "b", "diffuse_blue" } };
+	int properties[9];
+	for(unsigned int w = 0; w < 9; ++w)
+	{
+		properties[w] = -1;
+		for(unsigned int p = 0; p < names.size(); ++p)
+		{
+			for(unsigned int a = 0; a < 3; ++a)
+			{
+				properties[w] = (names[p] == wanted[w][a]) ? (int)p : properties[w];
+			}
+		}
+	}
+	valid = valid && properties[0] >= 0 && properties[1] >= 0 && properties[2] >= 0;
+	const bool has_normals = properties[3] >= 0 && properties[4] >= 0 && properties[5] >= 0;
+	const bool has_colors = properties[6] >= 0 && properties[7] >= 0 && properties[8] >= 0;
+	if(!valid || (format != "ascii" && format != "binary_little_endian" && format != "binary_big_endian"))
+	{
+		unmap_file(mapping, size);
+		std::cerr << filename << " is not a PLY point cloud" << std::endl;
+		throw(0);
+	}
+	PointLayout layout;
+	layout.position = 0;
+	layout.normal = has_normals ? 3 : -1;
+	layout.color = has_colors ? 6 : -1;
+	//~ The colors stored as floats are in [0, 1]
+	layout.color_scale = (has_colors && (types[properties[6]] == 'f' || types[properties[6]] == 'd')) ? 255.0f : 1.0f;
+
+	if(format == "ascii")
+	{
+		//~ The columns of the lines are the properties
+		PointTextJob job;
+		PointLayout text_layout = layout;
+		text_layout.columns = names.size();
+		//~ The position, the normal and the color take their first column if they are consecutive, as written by every tool
+		text_layout.position = properties[0];
+		text_layout.normal = has_normals ? properties[3] : -1;
+		text_layout.color = has_colors ? properties[6] : -1;
+		valid = properties[1] == properties[0] + 1 && properties[2] == properties[0] + 2
+			&& (!has_normals || (properties[4] == properties[3] + 1 && properties[5] == properties[3] + 2))
+			&& (!has_colors || (properties[7] == properties[6] + 1 && properties[8] == properties[6] + 2));
+		if(valid)
+		{
+			const char* first_line = data;
+			double values[POINT_MAX_COLUMNS];
+			read_line(first_line, end, values);
+			for(unsigned int c = 0; c < 3; ++c)
+			{
+				job.offset[c] = floor(values[text_layout.position + c]);
+			}
+			job.layout = text_layout;
+			parse_text(data, end, &job, m_points);
+			//~ The lines of the next elements are not points
+			m_points.resize(std::min((unsigned int)m_points.size(), count));
+		}
+	}
+	else
+	{
+		valid = (size_t)(end - data) >= stride * count;
+		if(valid)
+		{
+			PointRecordJob job;
+			job.data = data;
+			job.stride = stride;
+			job.count = count;
+			job.swap = (format == "binary_big_endian");
+			job.layout = layout;
+			for(unsigned int w = 0; w < 9; ++w)
+			{
+				const bool used = (w < 3) || (w < 6 && has_normals) || (w >= 6 && has_colors);
+				job.offsets[w] = used ? offsets[properties[w]] : 0;
+				job.types[w] = used ? types[properties[w]] : 0;
+			}
+			for(unsigned int c = 0; c < 3; ++c)
+			{
+				job.offset[c] = floor(read_ply_value(data + job.offsets[c], job.types[c], job.swap));
+			}
+			m_points.resize(count);
+			job.points = &m_points[0];
+			ThreadPool::get_shared().parallel_for((count + POINT_RECORDS_PER_TASK - 1) / POINT_RECORDS_PER_TASK, 1, convert_records, &job);
+		}
+	}
+	unmap_file(mapping, size);
+	if(!valid)
+	{
+		std::cerr << filename << " is truncated or has properties out of order" << std::endl;
+		throw(0);
+	}
+}
+
+void PointCloud::read_xyz(const char* filename) throw (int)
+{
+	size_t size = 0;
+	const char* mapping = map_file(filename, size);
+	if(mapping == NULL)
+	{
+		throw(0);
+	}
+	const char* end = mapping + size;
+
+	//~ The number of columns of the first line of numbers tells the layout
+	double values[POINT_MAX_COLUMNS];
+	const char* cursor = mapping;
+	unsigned int columns = 0;
+	while(cursor < end && columns < 3)
+	{
+		columns = read_line(cursor, end, values);
+	}
+	if(columns < 3)
+	{
+		unmap_file(mapping, size);
+		throw(0);
+	}
+	PointTextJob job;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		job.offset[c] = floor(values[c]);
+	}
+	PointLayout& layout = job.layout;
+	layout.position = 0;
+	layout.normal = -1;
+	layout.color = -1;
+	layout.color_scale = 1.0f;
+	layout.columns = 3;
+	if(columns == 6 || columns >= 9)
+	{
+		//~ Of the triples after the position, the colors are the one of integers in [0, 255] over the first lines
+		bool integers = true;
+		const char* sample = mapping;
+		for(unsigned int line = 0; line < 1000 && sample < end && integers; ++line)
+		{
+			if(read_line(sample, end, values) >= 6)
+			{
+				for(unsigned int c = 3; c < 6; ++c)
+				{
+					integers = integers && values[c] == floor(values[c]) && values[c] >= 0.0 && values[c] <= 255.0;
+				}
+			}
+		}
+		layout.color = (columns == 6) ? (integers ? 3 : -1) : (integers ? 3 : 6);
+		layout.normal = (columns == 6) ? (integers ? -1 : 3) : (integers ? 6 : 3);
+		layout.columns = (columns == 6) ? 6 : 9;
+	}
+	else if(columns >= 7)
+	{
+		//~ x y z intensity r g b, as in the PTS files
+		layout.color = 4;
+		layout.columns = 7;
+	}
+	parse_text(mapping, end, &job, m_points);
+	unmap_file(mapping, size);
+}
+
+//~ Keeps the first point of each cell of the grid of a node, and sorts the others into the octants of its children
+static void sample_node(PointVertex* points, PointNode& node, std::vector<unsigned int>& stamps, unsigned int& stamp, PointNode children[8], unsigned int& nb_children, unsigned int& dropped)
+{
+	nb_children = 0;
+	const unsigned int first = node.first_point;
+	const unsigned int last = first + node.number_of_points;
+	if(node.number_of_points <= POINT_LEAF_SIZE || node.depth == POINT_MAX_DEPTH)
+	{
+		dropped += node.number_of_points - std::min(node.number_of_points, POINT_LEAF_SIZE);
+		node.number_of_points = std::min(node.number_of_points, POINT_LEAF_SIZE);
+		return;
+	}
+	if(++stamp == 0)
+	{
+		std::fill(stamps.begin(), stamps.end(), 0);
+		stamp = 1;
+	}
+	const float scale = POINT_NODE_GRID / node.size;
+	unsigned int kept = first;
+	for(unsigned int p = first; p < last; ++p)
+	{
+		unsigned int cell = 0;
+		for(int c = 2; c >= 0; --c)
+		{
+			const int coordinate = (int)((points[p].position[c] - node.min[c]) * scale);
+			cell = cell * POINT_NODE_GRID + std::min(std::max(coordinate, 0), (int)POINT_NODE_GRID - 1);
+		}
+		if(stamps[cell] != stamp)
+		{
+			stamps[cell] = stamp;
+			std::swap(points[p], points[kept++]);
+		}
+	}
+	node.number_of_points = kept - first;
+
+	//~ The others are sorted in place by octant, one swap per misplaced point
+	const glm::vec3 middle = node.min + glm::vec3(0.5f * node.size);
+	unsigned int counts[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	std::vector<unsigned char> octants(last - kept);
+	for(unsigned int p = kept; p < last; ++p)
+	{
+		octants[p - kept] = (points[p].position[0] >= middle.x) | ((points[p].position[1] >= middle.y) << 1) | ((points[p].position[2] >= middle.z) << 2);
+		++counts[octants[p - kept]];
+	}
+	unsigned int starts[8], next[8];
+	for(unsigned int o = 0, offset = kept; o < 8; offset += counts[o], ++o)
+	{
+		starts[o] = next[o] = offset;
+	}
+	for(unsigned int o = 0; o < 8; ++o)
+	{
+		while(next[o] < starts[o] + counts[o])
+		{
+			const unsigned int p = next[o];
+			const unsigned int target = octants[p - kept];
+			if(target == o)
+			{
+				++next[o];
+			}
+			else
+			{
+				const unsigned int q = next[target]++;
+				std::swap(points[p], points[q]);
+				std::swap(octants[p - kept], octants[q - kept]);
+			}
+		}
+	}
+	for(unsigned int o = 0; o < 8; ++o)
+	{
+		if(counts[o] == 0)
+		{
+			continue;
+		}
+		PointNode& child = children[nb_children++];
+		child.size = 0.5f * node.size;
+		child.min = node.min + glm::vec3((o & 1) ? child.size : 0.0f, (o & 2) ? child.size : 0.0f, (o & 4) ? child.size : 0.0f);
+		child.first_point = starts[o];
+		child.number_of_points = counts[o];
+		child.first_child = 0;
+		child.number_of_children = 0;
+		child.depth = node.depth + 1;
+	}
+}
+
+//~ Builds the subtree of the first node, depth first : the children of a node are appended together
+static void build_subtree(PointVertex* points, std::vector<PointNode>& nodes, std::vector<unsigned int>& stamps, unsigned int& stamp, unsigned int& dropped)
+{
+	std::vector<unsigned int> stack(1, 0);
+	while(!stack.empty())
+	{
+		const unsigned int n = stack.back();
+		stack.pop_back();
+		PointNode node = nodes[n];
+		PointNode children[8];
+		unsigned int nb_children = 0;
+		sample_node(points, node, stamps, stamp, children, nb_children, dropped);
+		node.first_child = nodes.size();
+		node.number_of_children = nb_children;
+		nodes[n] = node;
+		for(unsigned int c = 0; c < nb_children; ++c)
+		{
+			nodes.push_back(children[c]);
+			stack.push_back(node.first_child + c);
+		}
+	}
+}
+
+void PointCloud::build_subtrees(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	PointBuildJob& job = *(PointBuildJob*)data;
+	std::vector<unsigned int> stamps(POINT_NODE_GRID * POINT_NODE_GRID * POINT_NODE_GRID, 0);
+	unsigned int stamp = 0;
+	for(unsigned int c = begin; c < end; ++c)
+	{
+		job.subtrees[c].assign(1, job.roots[c]);
+		build_subtree(job.points, job.subtrees[c], stamps, stamp, job.dropped[c]);
+	}
+}
+
+void PointCloud::build_octree()
+{
+	//~ The root is the cube enclosing the points
+	glm::vec3 min(FLT_MAX), max(-FLT_MAX);
+	for(unsigned int p = 0; p < m_points.size(); ++p)
+	{
+		const glm::vec3 position(m_points[p].position[0], m_points[p].position[1], m_points[p].position[2]);
+		min = glm::min(min, position);
+		max = glm::max(max, position);
+	}
+	PointNode root;
+	root.min = min;
+	root.size = std::max(std::max(max.x - min.x, max.y - min.y), max.z - min.z) * 1.0001f + FLT_MIN;
+	root.first_point = 0;
+	root.number_of_points = m_points.size();
+	root.first_child = 0;
+	root.number_of_children = 0;
+	root.depth = 0;
+
+	//~ The root is sampled alone, then the subtrees of its children in parallel : their points do not overlap
+	PointBuildJob job;
+	job.points = &m_points[0];
+	job.roots.resize(8);
+	std::vector<unsigned int> stamps(POINT_NODE_GRID * POINT_NODE_GRID * POINT_NODE_GRID, 0);
+	unsigned int stamp = 0, nb_children = 0, dropped = 0;
+	sample_node(job.points, root, stamps, stamp, &job.roots[0], nb_children, dropped);
+	std::vector<unsigned int>().swap(stamps);
+	job.roots.resize(nb_children);
+	job.subtrees.resize(nb_children);
+	job.dropped.assign(nb_children, 0);
+	ThreadPool::get_shared().parallel_for(nb_children, 1, build_subtrees, &job);
+
+	//~ The subtrees are put after the children of the root, their indices shifted
+	m_nodes.assign(1, root);
+	m_nodes[0].first_child = 1;
+	m_nodes[0].number_of_children = nb_children;
+	for(unsigned int c = 0; c < nb_children; ++c)
+	{
+		m_nodes.push_back(job.subtrees[c][0]);
+	}
+	for(unsigned int c = 0; c < nb_children; ++c)
+	{
+		std::vector<PointNode>& subtree = job.subtrees[c];
+		const unsigned int shift = m_nodes.size() - 1;
+		for(unsigned int n = 0; n < subtree.size(); ++n)
+		{
+			subtree[n].first_child += shift;
+		}
+		m_nodes[1 + c].first_child = subtree[0].first_child;
+		m_nodes.insert(m_nodes.end(), subtree.begin() + 1, subtree.end());
+		dropped += job.dropped[c];
+		std::vector<PointNode>().swap(subtree);
+	}
+	m_max_node_points = 0;
+	for(unsigned int n = 0; n < m_nodes.size(); ++n)
+	{
+		m_max_node_points = std::max(m_max_node_points, m_nodes[n].number_of_points);
+	}
+	if(dropped > 0)
+	{
+		std::cout << dropped << " duplicate points dropped" << std::endl;
+	}
+}
+
+void PointCloud::create_buffers(size_t gpu_budget)
+{
+	//~ The pool is allocated once, each slot takes the largest node
+	const size_t slot_size = (size_t)m_max_node_points * sizeof(PointVertex);
+	m_number_of_slots = std::max(std::min(gpu_budget / slot_size, m_nodes.size()), (size_t)1);
+	glGenVertexArrays(1, &m_vao);
+	glGenBuffers(1, &m_vbo);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBufferData(GL_ARRAY_BUFFER, m_number_of_slots * slot_size, NULL, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PointVertex), (void*)0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PointVertex), (void*)(3 * sizeof(float)));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PointVertex), (void*)(3 * sizeof(float) + 2 * sizeof(GLshort)));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_slot_nodes.assign(m_number_of_slots, -1);
+	m_slot_last_use.assign(m_number_of_slots, 0);
+	m_node_slots.assign(m_nodes.size(), -1);
+	m_node_drawn_frame.assign(m_nodes.size(), 0);
+	m_node_splat_depths.assign(m_nodes.size(), 0);
+	std::cout << "Point cloud pool of " << m_number_of_slots << " slots of " << (slot_size >> 10) << " KB" << std::endl;
+}
+
+void PointCloud::update(const Camera& first, const Camera& second, float projection_scale, unsigned int point_budget, size_t upload_budget)
+{
+	++m_frame;
+	m_drawn_nodes.clear();
+	m_drawn_points = 0;
+	m_draw_firsts.clear();
+	m_draw_counts.clear();
+	m_draw_groups.clear();
+	if(m_vao == 0)
+	{
+		return;
+	}
+	//~ The octree is walked in model space, like the one of OctreeModel
+	const glm::mat4 world_to_model = glm::inverse(m_model_matrix);
+	const Frustum eyes(first.get_projection_matrix() * first.get_view_matrix() * m_model_matrix, second.get_projection_matrix() * second.get_view_matrix() * m_model_matrix);
+	const glm::vec3 viewpoints[2] = {	glm::vec3(world_to_model * glm::vec4(first.get_position(), 1.0f)),
+										glm::vec3(world_to_model * glm::vec4(second.get_position(), 1.0f)) };
+
+	//~ The nodes are taken the largest on screen first, until the budget is spent ; a missing node stops its branch
+	std::priority_queue<std::pair<float, unsigned int> > queue;
+	std::vector<unsigned int> missing;
+	queue.push(std::make_pair(FLT_MAX, 0u));
+	while(!queue.empty())
+	{
+		const unsigned int n = queue.top().second;
+		queue.pop();
+		const PointNode& node = m_nodes[n];
+		if(!is_visible(n, eyes))
+		{
+			continue;
+		}
+		if(m_drawn_points + node.number_of_points > point_budget)
+		{
+			break;
+		}
+		if(m_node_slots[n] < 0)
+		{
+			missing.push_back(n);
+			continue;
+		}
+		m_slot_last_use[m_node_slots[n]] = m_frame;
+		m_node_drawn_frame[n] = m_frame;
+		m_drawn_nodes.push_back(n);
+		m_drawn_points += node.number_of_points;
+		if(get_projected_size(n, node.size / POINT_NODE_GRID, viewpoints, projection_scale) > POINT_MIN_SPACING)
+		{
+			for(unsigned int c = node.first_child; c < node.first_child + node.number_of_children; ++c)
+			{
+				queue.push(std::make_pair(get_projected_size(c, m_nodes[c].size, viewpoints, projection_scale), c));
+			}
+		}
+	}
+
+	//~ The missing nodes are uploaded in the same order, drawn from the next frame on
+	size_t uploaded = 0;
+	const size_t slot_size = (size_t)m_max_node_points * sizeof(PointVertex);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	for(unsigned int m = 0; m < missing.size() && (m == 0 || uploaded < upload_budget); ++m)
+	{
+		const int slot = acquire_slot();
+		if(slot < 0)
+		{
+			break;
+		}
+		const PointNode& node = m_nodes[missing[m]];
+		glBufferSubData(GL_ARRAY_BUFFER, slot * slot_size, node.number_of_points * sizeof(PointVertex), &m_points[node.first_point]);
+		uploaded += node.number_of_points * sizeof(PointVertex);
+		m_slot_nodes[slot] = missing[m];
+		m_slot_last_use[slot] = m_frame;
+		m_node_slots[missing[m]] = slot;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//~ The splats of a node shrink to the spacing of its children when all its visible children are drawn, and so on :
+	//~ the children come after their parent in the drawn nodes
+	for(unsigned int d = m_drawn_nodes.size(); d-- > 0;)
+	{
+		const unsigned int n = m_drawn_nodes[d];
+		const PointNode& node = m_nodes[n];
+		unsigned int depth = node.depth;
+		bool covered = false;
+		for(unsigned int c = node.first_child; c < node.first_child + node.number_of_children; ++c)
+		{
+			if(!is_visible(c, eyes))
+			{
+				continue;
+			}
+			if(m_node_drawn_frame[c] != m_frame)
+			{
+				covered = false;
+				depth = node.depth;
+				break;
+			}
+			depth = covered ? std::min(depth, m_node_splat_depths[c]) : m_node_splat_depths[c];
+			covered = true;
+		}
+		m_node_splat_depths[n] = covered ? depth : node.depth;
+	}
+	std::vector<std::pair<unsigned int, unsigned int> > order(m_drawn_nodes.size());
+	for(unsigned int d = 0; d < m_drawn_nodes.size(); ++d)
+	{
+		order[d] = std::make_pair(m_node_splat_depths[m_drawn_nodes[d]], m_drawn_nodes[d]);
+	}
+	std::sort(order.begin(), order.end());
+	for(unsigned int o = 0; o < order.size(); ++o)
+	{
+		if(o == 0 || order[o].first != order[o - 1].first)
+		{
+			m_draw_groups.push_back(std::make_pair(order[o].first, o));
+		}
+		m_draw_firsts.push_back(m_node_slots[order[o].second] * m_max_node_points);
+		m_draw_counts.push_back(m_nodes[order[o].second].number_of_points);
+	}
+}
+
+void PointCloud::draw(GLint spacing_location) const
+{
+	if(m_draw_counts.empty())
+	{
+		return;
+	}
+	//~ The spacing of the grid of a node, in world units, sizes its splats
+	const float spacing = m_nodes[0].size / POINT_NODE_GRID * glm::length(glm::vec3(m_model_matrix[0]));
+	glBindVertexArray(m_vao);
+	for(unsigned int g = 0; g < m_draw_groups.size(); ++g)
+	{
+		const unsigned int begin = m_draw_groups[g].second;
+		const unsigned int end = (g + 1 < m_draw_groups.size()) ? m_draw_groups[g + 1].second : m_draw_counts.size();
+		glUniform1f(spacing_location, ldexp(spacing, -(int)m_draw_groups[g].first));
+		glMultiDrawArrays(GL_POINTS, &m_draw_firsts[begin], &m_draw_counts[begin], end - begin);
+	}
+	glBindVertexArray(0);
+}
+
+bool PointCloud::is_visible(unsigned int node, const Frustum& eyes) const
+{
+	return eyes.intersects_box(m_nodes[node].min, m_nodes[node].min + glm::vec3(m_nodes[node].size));
+}
+
+float PointCloud::get_projected_size(unsigned int node, float length, const glm::vec3 viewpoints[2], float projection_scale) const
+{
+	const glm::vec3 min = m_nodes[node].min;
+	const glm::vec3 max = min + glm::vec3(m_nodes[node].size);
+	float distance = FLT_MAX;
+	for(unsigned int v = 0; v < 2; ++v)
+	{
+		distance = std::min(distance, glm::length(glm::max(glm::max(min - viewpoints[v], viewpoints[v] - max), glm::vec3(0.0f))));
+	}
+	return (distance > 0.0f) ? length * projection_scale / distance : FLT_MAX;
+}
+
+int PointCloud::acquire_slot()
+{
+	int slot = -1;
+	for(unsigned int s = 0; s < m_number_of_slots; ++s)
+	{
+		if(m_slot_nodes[s] < 0)
+		{
+			return s;
+		}
+		if(m_slot_last_use[s] != m_frame && (slot < 0 || m_slot_last_use[s] < m_slot_last_use[slot]))
+		{
+			slot = s;
+		}
+	}
+	if(slot >= 0)
+	{
+		m_node_slots[m_slot_nodes[slot]] = -1;
+		m_slot_nodes[slot] = -1;
+	}
+	return slot;
+}
+
+//~ Setters
+void PointCloud::set_model_matrix(const glm::mat4& model_matrix)
+{
+	m_model_matrix = model_matrix;
+}
+
+//~ Getters
+glm::mat4 PointCloud::get_model_matrix() const
+{
+	return m_model_matrix;
+}
+
+glm::vec3 PointCloud::get_barycentre() const
+{
+	return m_barycentre;
+}
+
+float PointCloud::get_average_distance() const
+{
+	return m_average_distance;
+}
+
+unsigned int PointCloud::get_number_of_points() const
+{
+	return m_points.size();
+}
+
+unsigned int PointCloud::get_number_of_nodes() const
+{
+	return m_nodes.size();
+}
+
+unsigned int PointCloud::get_number_of_slots() const
+{
+	return m_number_of_slots;
+}
+
+unsigned int PointCloud::get_number_of_resident_nodes() const
+{
+	return m_number_of_slots - std::count(m_slot_nodes.begin(), m_slot_nodes.end(), -1);
+}
+
+unsigned int PointCloud::get_number_of_drawn_nodes() const
+{
+	return m_drawn_nodes.size();
+}
+
+unsigned int PointCloud::get_number_of_drawn_points() const
+{
+	return m_drawn_points;
+}
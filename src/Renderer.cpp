@@ -33,6 +33,16 @@
 
 #include "../include/Renderer.hpp"
 
+//~ Bytes of a streamed mesh uploaded per frame
+static const size_t UPLOAD_BUDGET_PER_FRAME = 16 << 20;
+//~ Largest error of a level of detail on screen, in pixels
+static const float LOD_MAX_ERROR = 1.0f;
+//~ Points of a point cloud drawn per frame, in millions, until changed in the GUI
+static const float DEFAULT_POINT_BUDGET = 5.0f;
+//~ Spread of the rays of the auto-convergence around the centre, in pixels, and fraction of the distance covered per frame
+static const float CONVERGENCE_SPREAD = 8.0f;
+static const float CONVERGENCE_EASING = 0.1f;
+
 Renderer::Renderer(int width, int height):
 	m_width(width),
 	m_height(height),
@@ -50,7 +60,18 @@ Renderer::Renderer(int width, int height):
 	m_ssao_scale_value(2.0f),
 	m_ssao_nb_samples_value(16),
 	m_blur_coef_value(8),
-	m_is_ssao_enabled(false)
+	m_is_ssao_enabled(false),
+	m_compressed_vertices(false),
+	m_cpu_retention(RETENTION_NONE),
+	m_resident_memory_before_upload(0),
+	m_use_lods(true),
+	m_cull_clusters(true),
+	m_number_of_instances_value(1.0f),
+	m_texture_cache_budget_value((float)(TextureCache::DEFAULT_BUDGET >> 20)),
+	m_point_budget_value(DEFAULT_POINT_BUDGET),
+	m_texture_binds(0),
+	m_texture_binds_per_object(0),
+	m_auto_convergence(false)
 {
 	GLenum error;
 	if((error = glewInit()) != GLEW_OK) {
@@ -58,6 +79,8 @@ Renderer::Renderer(int width, int height):
 	}
 
 	find_available_files((const char*)"models",m_list_of_models);
+	//~ The mesh caches written next to the models are not models
+	m_list_of_models.erase(std::remove_if(m_list_of_models.begin(), m_list_of_models.end(), Mesh::is_cache_file), m_list_of_models.end());
 	find_available_files((const char*)"textures",m_list_of_textures);
 
 	if (!imguiRenderGLInit("fonts/DroidSans.ttf"))
@@ -66,6 +89,14 @@ Renderer::Renderer(int width, int height):
 		exit(EXIT_FAILURE);
 	}
 	
+	//~ No model is loaded until the user picks one
+	m_object = NULL;
+	m_object_node = 0;
+	m_octree = NULL;
+	m_cloud = NULL;
+	m_scene = new Scene();
+	m_model_loader = new ModelLoader();
+	
 	//~ Loading quads
 	try
 	{
@@ -91,6 +122,7 @@ Renderer::Renderer(int width, int height):
 	m_blur_shader_program = loadProgram("shaders/blur.vertex.glsl","shaders/blur.fragment.glsl");
 	m_ssao_blend_shader_program = loadProgram("shaders/ssao_blend.vertex.glsl","shaders/ssao_blend.fragment.glsl");
 	m_shadow_shader_program = loadProgram("shaders/shadow.vertex.glsl","shaders/shadow.fragment.glsl");
+	m_point_splat_shader_program = loadProgram("shaders/point_splat.vertex.glsl","shaders/point_splat.fragment.glsl");
 	
 	//~ Locating uniforms
 	m_basic_shader_model_matrix_position = glGetUniformLocation(m_basic_shader_program,"model_matrix");
@@ -110,9 +142,13 @@ Renderer::Renderer(int width, int height):
 	glBindFragDataLocation(m_quad_shader, 0, "color");
 
 	m_geometry_buffer_shader_model_matrix_location = glGetUniformLocation(m_geometry_buffer_shader_program,"model_matrix");
+	m_geometry_buffer_shader_normal_matrix_location = glGetUniformLocation(m_geometry_buffer_shader_program,"normal_matrix");
+	m_geometry_buffer_shader_octahedral_normals_location = glGetUniformLocation(m_geometry_buffer_shader_program,"octahedral_normals");
+	m_geometry_buffer_shader_instanced_location = glGetUniformLocation(m_geometry_buffer_shader_program,"instanced");
 	m_geometry_buffer_shader_view_matrix_location = glGetUniformLocation(m_geometry_buffer_shader_program,"view_matrix");
 	m_geometry_buffer_shader_projection_matrix_location = glGetUniformLocation(m_geometry_buffer_shader_program,"projection_matrix");
 	m_geometry_buffer_shader_diffuse_location = glGetUniformLocation(m_geometry_buffer_shader_program,"diffuse_texture");
+	m_geometry_buffer_shader_material_table_location = glGetUniformLocation(m_geometry_buffer_shader_program,"material_table");
 	//~ Adding some parameters
 	glBindFragDataLocation(m_geometry_buffer_shader_program, 0, "out_color");
 	glBindFragDataLocation(m_geometry_buffer_shader_program, 1, "out_normal");
@@ -158,6 +194,18 @@ Renderer::Renderer(int width, int height):
 	m_shadow_projection_matrix_location = glGetUniformLocation(m_shadow_shader_program,"projectionMatrix");
 	m_shadow_model_matrix_location = glGetUniformLocation(m_shadow_shader_program,"modelMatrix");
 	m_shadow_view_matrix_location = glGetUniformLocation(m_shadow_shader_program,"viewMatrix");
+	m_shadow_instanced_location = glGetUniformLocation(m_shadow_shader_program,"instanced");
+
+	m_point_splat_model_matrix_location = glGetUniformLocation(m_point_splat_shader_program,"model_matrix");
+	m_point_splat_view_matrix_location = glGetUniformLocation(m_point_splat_shader_program,"view_matrix");
+	m_point_splat_projection_matrix_location = glGetUniformLocation(m_point_splat_shader_program,"projection_matrix");
+	m_point_splat_eye_position_location = glGetUniformLocation(m_point_splat_shader_program,"eye_position");
+	m_point_splat_spacing_location = glGetUniformLocation(m_point_splat_shader_program,"point_spacing");
+	m_point_splat_viewport_height_location = glGetUniformLocation(m_point_splat_shader_program,"viewport_height");
+	//~ Same outputs as the geometry buffer
+	glBindFragDataLocation(m_point_splat_shader_program, 0, "out_color");
+	glBindFragDataLocation(m_point_splat_shader_program, 1, "out_normal");
+	glBindFragDataLocation(m_point_splat_shader_program, 2, "out_position");
 
 	load_normal_map();
 
@@ -196,10 +244,15 @@ Renderer::~Renderer()
 	delete m_left_ssao_blend_framebuffer;
 	delete m_right_ssao_blend_framebuffer;
 	delete m_shadow_framebuffer;
-	//~ Deleting objects
-	delete m_object;
+	//~ Deleting objects, once the loader thread is stopped
+	delete m_model_loader;
+	delete m_scene;
 	delete m_quad_left;
 	delete m_quad_right;
+	delete m_octree;
+	delete m_cloud;
+	TextureCache::get_shared().clear();
+	TextureArrayManager::get_shared().clear();
 	//~ Deleting cameras and rig
 	delete m_rig;
 	imguiRenderGLDestroy();
@@ -207,6 +260,36 @@ Renderer::~Renderer()
 
 void Renderer::render()
 {
+	//~ Creating the GL objects of a model loaded since the last frame
+	finish_loading();
+	//~ The octree chooses its nodes for both eyes and takes the chunks read by its loader ; so does the point cloud, within its budget
+	const float projection_scale = 0.5f * m_height * m_rig->get_camera_one()->get_projection_matrix()[1][1];
+	if(m_octree != NULL)
+	{
+		m_octree->update(*m_rig->get_camera_one(), *m_rig->get_camera_two(), projection_scale, LOD_MAX_ERROR, UPLOAD_BUDGET_PER_FRAME);
+	}
+	if(m_cloud != NULL)
+	{
+		m_cloud->update(*m_rig->get_camera_one(), *m_rig->get_camera_two(), projection_scale, (unsigned int)(m_point_budget_value * 1e6f), UPLOAD_BUDGET_PER_FRAME);
+	}
+	//~ A big mesh is uploaded a few chunks per frame, its resident part is drawn meanwhile ; one mesh at a time keeps the budget
+	for(unsigned int i = 0; i < m_scene->get_number_of_nodes(); ++i)
+	{
+		Object* object = m_scene->get_object(i);
+		if(object != NULL && !object->is_resident())
+		{
+			if(object->stream_buffers(UPLOAD_BUDGET_PER_FRAME) && object == m_object)
+			{
+				print_resident_memory();
+			}
+			break;
+		}
+	}
+	update_convergence();
+	update_instances();
+	TextureCache::get_shared().set_budget((size_t)m_texture_cache_budget_value << 20);
+	m_scene->update();
+	
 	glClearColor(0.0,0.0,0.0,1.0);
 	glEnable(GL_DEPTH_TEST);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -219,27 +302,30 @@ void Renderer::render()
 	}
 	else
 	{
-		if(m_object != NULL)
+		// Compute light positions
+		glm::vec3 light_pos = glm::vec3(0.0,4.0,-7.0);
+		glm::vec3 light_target = glm::vec3(-2.0,0.0,0.0);
+		glm::vec3 light_direction = glm::normalize(light_target - light_pos);
+		glm::vec3 light_up = glm::vec3(0.0,1.0,0.0);
+		glm::vec3 light_col = glm::vec3(1.0,1.0,1.0);
+		float light_int = 1.0f;
+		// Build shadow matrices
+		glm::mat4 world_to_light = glm::lookAt(light_pos,light_target,light_up);
+		glm::mat4 shadow_projection = glm::perspective(60.0f,1.0f,1.0f,1000.0f);
+		glm::mat4 projection_light = world_to_light * shadow_projection;
+		glm::mat4 biasMatrix(
+			0.5, 0.0, 0.0, 0.0,
+			0.0, 0.5, 0.0, 0.0,
+			0.0, 0.0, 0.5, 0.0,
+			0.5, 0.5, 0.5, 1.0
+			);
+		glm::mat4 projection_light_bias = biasMatrix * projection_light;
+		//~ The objects are culled once for both eyes and once for the light
+		cull_objects(Frustum(shadow_projection * world_to_light));
+		//~ Nothing is drawn, nor shaded, when no object is in sight : the cleared screen is the frame
+		if(!m_scene->get_visible().empty() || (m_octree != NULL && m_octree->get_number_of_drawn_nodes() > 0)
+			|| (m_cloud != NULL && m_cloud->get_number_of_drawn_nodes() > 0))
 		{
-			// Compute light positions
-			glm::vec3 light_pos = glm::vec3(0.0,4.0,-7.0);
-			glm::vec3 light_target = glm::vec3(-2.0,0.0,0.0);
-			glm::vec3 light_direction = glm::normalize(light_target - light_pos);
-			glm::vec3 light_up = glm::vec3(0.0,1.0,0.0);
-			glm::vec3 light_col = glm::vec3(1.0,1.0,1.0);
-			float light_int = 1.0f;
-			// Build shadow matrices
-			glm::mat4 world_to_light = glm::lookAt(light_pos,light_target,light_up);
-			glm::mat4 shadow_projection = glm::perspective(60.0f,1.0f,1.0f,1000.0f);
-			glm::mat4 projection_light = world_to_light * shadow_projection;
-			glm::mat4 biasMatrix(
-				0.5, 0.0, 0.0, 0.0,
-				0.0, 0.5, 0.0, 0.0,
-				0.0, 0.0, 0.5, 0.0,
-				0.5, 0.5, 0.5, 1.0
-				);
-			glm::mat4 projection_light_bias = biasMatrix * projection_light;
-			
 			std::vector<glm::vec3> light_position;
 			light_position.push_back(glm::vec3(-m_radiusLight,-m_radiusLight,-m_radiusLight));
 			//~ light_position.push_back(glm::vec3(m_radiusLight,-m_radiusLight,-m_radiusLight));
@@ -258,18 +344,13 @@ void Renderer::render()
 			//~ Choosing the geometry buffer
 			glUseProgram(m_geometry_buffer_shader_program);
 			//~ Sending uniforms
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, m_object->get_diffuse_texture());
 			glUniform1i(m_geometry_buffer_shader_diffuse_location, 0);
-			glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_model_matrix()));
 			glUniformMatrix4fv(m_geometry_buffer_shader_view_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_view_matrix()));
 			glUniformMatrix4fv(m_geometry_buffer_shader_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_projection_matrix()));
-			//~ Binding VAO
-			glBindVertexArray(m_object->get_vao());
-			//~ Drawing
-			glDrawArrays(GL_TRIANGLES, 0, m_object->get_size());
-			//~ Unbind
-			glBindVertexArray(0);
+			//~ Drawing, one texture bind per page of the texture arrays instead of one per object
+			m_texture_binds = draw_visible_objects();
+			m_texture_binds_per_object = m_scene->get_visible().size();
+			draw_point_cloud(m_rig->get_camera_one());
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			//~ ------------------------------------------------------------------------------------------------------------
 			//~ Rendering the shadow framebuffer
@@ -282,13 +363,10 @@ void Renderer::render()
 			glUseProgram(m_shadow_shader_program);
 			glUniformMatrix4fv(m_shadow_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(shadow_projection));
 			glUniformMatrix4fv(m_shadow_view_matrix_location, 1, GL_FALSE, glm::value_ptr(world_to_light));
-			glUniformMatrix4fv(m_shadow_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_model_matrix()));
 
 			glCullFace(GL_FRONT);
-			//~ Binding VAO
-			glBindVertexArray(m_object->get_vao());
-			//~ Drawing
-			glDrawArrays(GL_TRIANGLES, 0, m_object->get_size());
+			//~ Drawing the objects seen by the light with their position-only VAOs
+			draw_shadow_casters();
 			glCullFace(GL_BACK);
 
 			// Unbind framebuffer
@@ -305,7 +383,7 @@ void Renderer::render()
 							m_normal_map_texture,
 							m_rig->get_camera_one()->get_view_matrix(),
 							m_rig->get_camera_one()->get_projection_matrix(),
-							m_object->get_model_matrix(),
+							get_loaded_model_matrix(),
 							m_geometry_buffer_framebuffer->get_depth_texture_id()
 							);
 			//~ ------------------------------------------------------------------------------------------------------------
@@ -357,7 +435,7 @@ void Renderer::render()
 				//~ Binding vao
 				glBindVertexArray(m_quad_left->get_vao());
 				//~ Drawing
-				glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+				glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 			}
 			
 			glDisable(GL_BLEND);
@@ -380,18 +458,13 @@ void Renderer::render()
 			//~ //Choosing the geometry buffer
 			glUseProgram(m_geometry_buffer_shader_program);
 			//~ //Sending uniforms
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, m_object->get_diffuse_texture());
 			glUniform1i(m_geometry_buffer_shader_diffuse_location, 0);
-			glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_model_matrix()));
 			glUniformMatrix4fv(m_geometry_buffer_shader_view_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_two()->get_view_matrix()));
 			glUniformMatrix4fv(m_geometry_buffer_shader_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_two()->get_projection_matrix()));
-			//~ //Binding VAO
-			glBindVertexArray(m_object->get_vao());
 			//~ //Drawing
-			glDrawArrays(GL_TRIANGLES, 0, m_object->get_size());
-			//~ //Unbind
-			glBindVertexArray(0);
+			m_texture_binds += draw_visible_objects();
+			m_texture_binds_per_object += m_scene->get_visible().size();
+			draw_point_cloud(m_rig->get_camera_two());
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 			//~ ------------------------------------------------------------------------------------------------------------
 			//~ Rendering the SSAO for the second camera
@@ -401,7 +474,7 @@ void Renderer::render()
 							m_normal_map_texture,
 							m_rig->get_camera_two()->get_view_matrix(),
 							m_rig->get_camera_two()->get_projection_matrix(),
-							m_object->get_model_matrix(),
+							get_loaded_model_matrix(),
 							m_geometry_buffer_framebuffer->get_depth_texture_id()
 							);
 			//~ ------------------------------------------------------------------------------------------------------------
@@ -447,7 +520,7 @@ void Renderer::render()
 				//~ //Binding vao
 				glBindVertexArray(m_quad_left->get_vao());
 				//~ //Drawing
-				glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+				glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 			}
 			
 			glDisable(GL_BLEND);
@@ -492,7 +565,7 @@ void Renderer::render()
 				//~ //Binding vao
 				glBindVertexArray(m_quad_left->get_vao());
 				//~ //Drawing
-				glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+				glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 				//~ //Unbind
 				glBindVertexArray(0);
 			}
@@ -528,7 +601,7 @@ void Renderer::render()
 				//~ //Binding vao
 				glBindVertexArray(m_quad_left->get_vao());
 				//~ //Drawing
-				glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+				glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 				//~ //Unbind
 				glBindVertexArray(0);
 
@@ -559,7 +632,7 @@ void Renderer::render()
 				//~ //Binding vao
 				glBindVertexArray(m_quad_right->get_vao());
 				//~ //Drawing
-				glDrawArrays(GL_TRIANGLES, 0, m_quad_right->get_size());
+				glDrawElements(GL_TRIANGLES, m_quad_right->get_number_of_indices(), m_quad_right->get_index_type(), (void*)0);
 				//~ //Unbind
 				glBindVertexArray(0);
 			}
@@ -702,30 +775,55 @@ void Renderer::find_available_files(const char* directory,std::vector<std::strin
 
 void Renderer::load_normal_map()
 {
-	//~ Declarating values : width, height, components per pixel
-	int w, h, comp;
-	//~ Calling stbi
-	unsigned char* normal_map = stbi_load((const char*)"textures/normalmap.jpg", &w, &h, &comp, 3);
-	//~ Processing texture
+	//~ The map tiles random vectors for the SSAO : it is sampled at its first level, mipmaps would average the vectors out
+	Uint32 start = SDL_GetTicks();
 	glGenTextures(1, &m_normal_map_texture);
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, m_normal_map_texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, normal_map);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	
+	//~ Only x and y are used : a BC5 file next to the image is uploaded as it is mapped
+	const std::string path = "textures/normalmap.jpg";
+	std::vector<std::string> compressed_path = CompressedTexture::find(std::vector<std::string>(1, path));
+	if(!compressed_path.empty())
+	{
+		try
+		{
+			CompressedTexture compressed(compressed_path[0]);
+			if(CompressedTexture::is_supported(compressed.get_format()))
+			{
+				CompressedTexture::upload(GL_TEXTURE_2D, std::vector<const CompressedTexture*>(1, &compressed));
+				glBindTexture(GL_TEXTURE_2D, 0);
+				std::cout << "Normal map mapped and uploaded in " << SDL_GetTicks() - start << " ms" << std::endl;
+				return;
+			}
+		}
+		catch(int)
+		{
+			//~ The image is decoded instead
+		}
+	}
+	
+	TextureImage normal_map = TextureDecoder::decode(path);
+	if(normal_map.pixels == NULL)
+	{
+		const unsigned char up[4] = { 128, 128, 255, 255 };
+		normal_map = TextureDecoder::create_filled(1, 1, up);
+	}
+	Uint32 decoded = SDL_GetTicks();
+	//~ Processing texture
+	TextureDecoder::upload(GL_TEXTURE_2D, std::vector<const TextureImage*>(1, &normal_map));
 	glBindTexture(GL_TEXTURE_2D, 0);
+	std::cout << "Normal map decoded in " << decoded - start << " ms, uploaded in " << SDL_GetTicks() - decoded << " ms" << std::endl;
 	
-	stbi_image_free(normal_map);
+	TextureDecoder::release(normal_map);
 }
 
 void Renderer::load_object(const std::string model,const std::string texture)
 {
-	if(m_object != NULL) 
-	{
-		delete m_object;
-	}
 	//~ Loading object
 	std::string m = "models/";
 	m += model;
@@ -733,29 +831,378 @@ void Renderer::load_object(const std::string model,const std::string texture)
 	std::string t = "textures/";
 	t += texture;
 	
-	try
+	//~ An octree file is only opened here, its chunks are read by its own thread while it is drawn
+	if(OctreeBuilder::is_octree_file(m))
 	{
-		m_object = new Object(m.c_str(),t.c_str());
+		OctreeModel* octree = NULL;
+		try
+		{
+			octree = new OctreeModel(m.c_str(), t.c_str());
+		}
+		catch(int)
+		{
+			std::cout << "3D Model not found" << std::endl;
+			return;
+		}
+		octree->set_model_matrix(place_model(octree->get_barycentre(), octree->get_average_distance()));
+		m_scene->clear();
+		m_object = NULL;
+		delete m_octree;
+		m_octree = octree;
+		delete m_cloud;
+		m_cloud = NULL;
+		m_scene->update();
+		return;
 	}
-	catch(int e)
+	//~ The import and the decoding run on the loader thread
+	m_model_loader->request(m,t);
+}
+
+void Renderer::finish_loading()
+{
+	LoadedModel* loaded = m_model_loader->poll();
+	if(loaded == NULL)
 	{
-		switch(e)
+		return;
+	}
+	//~ A point cloud only needs its pool of slots, its octree was built on the loader thread
+	if(loaded->cloud != NULL)
+	{
+		PointCloud* cloud = loaded->cloud;
+		loaded->cloud = NULL;
+		ModelLoader::release(loaded);
+		cloud->create_buffers();
+		cloud->set_model_matrix(place_model(cloud->get_barycentre(), cloud->get_average_distance()));
+		m_scene->clear();
+		m_object = NULL;
+		delete m_octree;
+		m_octree = NULL;
+		delete m_cloud;
+		m_cloud = cloud;
+		m_scene->update();
+		return;
+	}
+	if(loaded->mesh == NULL)
+	{
+		std::cout << "3D Model not found" << std::endl;
+		ModelLoader::release(loaded);
+		return;
+	}
+	
+	//~ Only the buffers and the texture are created here, the object owns the mesh afterwards
+	Uint32 start = SDL_GetTicks();
+	m_resident_memory_before_upload = Mesh::get_resident_memory();
+	Object* object = new Object(loaded->mesh,loaded->texture_path.c_str(),loaded->textures,LAYOUT_SPLIT,m_compressed_vertices ? FORMAT_QUANTIZED : FORMAT_FLOAT,m_cpu_retention);
+	std::cout << "Model switch : textures decoded in " << loaded->texture_time << " ms on the loader thread, GL objects created in " << SDL_GetTicks() - start << " ms on the render thread" << std::endl;
+	ModelLoader::release(loaded);
+	
+	//~ Placement of the model in front of the rig, applied by the scene
+	glm::mat4 model_matrix = place_model(object->computeBarycentre(), object->computeAvgDistToBarycentre());
+
+	std::cout << object->get_size() << " unique vertices for " << object->get_number_of_indices() << " indices (ratio " << object->get_unique_vertex_ratio() << ")" << std::endl;
+	
+	//~ The previous object was rendered until now
+	m_scene->clear();
+	delete m_octree;
+	m_octree = NULL;
+	delete m_cloud;
+	m_cloud = NULL;
+	m_object = object;
+	m_object_node = m_scene->add(object, model_matrix);
+	m_scene->update();
+	//~ A streamed object releases its arrays once its last chunk is uploaded
+	if(object->is_resident())
+	{
+		print_resident_memory();
+	}
+}
+
+void Renderer::print_resident_memory() const
+{
+	const size_t after = Mesh::get_resident_memory();
+	if(m_resident_memory_before_upload > 0 && after > 0)
+	{
+		std::cout << "Resident memory : " << m_resident_memory_before_upload / (1024 * 1024) << " MB before the upload of the model, " << after / (1024 * 1024) << " MB once its buffers are resident" << std::endl;
+	}
+}
+
+glm::mat4 Renderer::place_model(const glm::vec3& barycentre, float average_distance) const
+{
+	glm::mat4 model_matrix = glm::translate(glm::mat4(1.0f),glm::vec3(0.00f,0.00f,-m_dc));
+
+	float scale = (m_dc*(2.0f/3.0f))/average_distance;
+	model_matrix = glm::scale(model_matrix,glm::vec3(scale,scale,scale));
+
+	model_matrix = glm::translate(model_matrix,-barycentre*scale);
+
+	return glm::rotate(model_matrix, 90.0f, glm::vec3(0, 1, 0));
+}
+
+glm::mat4 Renderer::get_loaded_model_matrix() const
+{
+	if(m_octree != NULL)
+	{
+		return m_octree->get_model_matrix();
+	}
+	if(m_cloud != NULL)
+	{
+		return m_cloud->get_model_matrix();
+	}
+	return (m_object != NULL) ? m_object->get_model_matrix() : glm::mat4(1.0f);
+}
+
+unsigned int Renderer::select_lod(const Object* object) const
+{
+	if(!m_use_lods)
+	{
+		return 0;
+	}
+	//~ One decision from the middle of the rig, so that both eyes see the same geometry
+	const glm::vec3 viewpoint = 0.5f * (m_rig->get_camera_one()->get_position() + m_rig->get_camera_two()->get_position());
+	const float projection_scale = 0.5f * m_height * m_rig->get_camera_one()->get_projection_matrix()[1][1];
+	return object->select_lod(viewpoint, projection_scale, LOD_MAX_ERROR);
+}
+
+std::vector<glm::mat4> Renderer::make_instance_grid(unsigned int count) const
+{
+	//~ The object is scaled so that its average distance to its barycentre is 2/3 of the convergence distance
+	const float spacing = 2.0f * m_dc;
+	const unsigned int side = (unsigned int)ceil(sqrt((double)count));
+	std::vector<glm::mat4> instances(count);
+	for(unsigned int i = 0; i < count; ++i)
+	{
+		const float x = ((float)(i % side) - 0.5f * (side - 1)) * spacing;
+		const float z = -(float)(i / side) * spacing;
+		instances[i] = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+	}
+	return instances;
+}
+
+void Renderer::update_instances()
+{
+	//~ One copy is the object alone
+	const unsigned int count = (m_number_of_instances_value > 1.5f) ? (unsigned int)(m_number_of_instances_value + 0.5f) : 0;
+	if(m_object == NULL || m_object->get_number_of_instances() == count)
+	{
+		return;
+	}
+	m_object->set_instances(make_instance_grid(count));
+	//~ The bounds of the node now enclose the copies
+	m_scene->invalidate(m_object_node);
+}
+
+void Renderer::cull_objects(const Frustum& light)
+{
+	//~ One test for both eyes, against a frustum enclosing theirs
+	const Camera* first = m_rig->get_camera_one();
+	const Camera* second = m_rig->get_camera_two();
+	const Frustum eyes(first->get_projection_matrix() * first->get_view_matrix(), second->get_projection_matrix() * second->get_view_matrix());
+	m_scene->cull(eyes, light);
+
+	const std::vector<unsigned int>& visible = m_scene->get_visible();
+	m_visible_lods.resize(visible.size());
+	for(unsigned int v = 0; v < visible.size(); ++v)
+	{
+		Object* object = m_scene->get_object(visible[v]);
+		m_visible_lods[v] = select_lod(object);
+		//~ One draw list for both eyes, the clusters are only bounded for an object alone
+		if(m_cull_clusters && object->get_number_of_instances() == 0)
 		{
-			case 0 : 	std::cout << "3D Model not found" << std::endl;
-						break;
+			object->cull(m_visible_lods[v], *first, *second);
+		}
+	}
+	//~ The shadow map is small and filtered, it can take one level more
+	const std::vector<unsigned int>& casters = m_scene->get_shadow_casters();
+	m_caster_lods.resize(casters.size());
+	for(unsigned int c = 0; c < casters.size(); ++c)
+	{
+		const Object* object = m_scene->get_object(casters[c]);
+		m_caster_lods[c] = m_use_lods ? std::min(select_lod(object) + 1, object->get_number_of_lods() - 1) : 0;
+	}
+}
+
+unsigned int Renderer::draw_visible_objects() const
+{
+	//~ The objects sharing a texture array are drawn one after the other, the array is bound once for all of them
+	const std::vector<unsigned int>& visible = m_scene->get_visible();
+	std::vector<std::pair<GLuint, unsigned int> > order(visible.size());
+	for(unsigned int v = 0; v < visible.size(); ++v)
+	{
+		order[v] = std::make_pair(m_scene->get_object(visible[v])->get_diffuse_texture(), v);
+	}
+	std::sort(order.begin(), order.end());
+	unsigned int binds = 0;
+	glActiveTexture(GL_TEXTURE0);
+	for(unsigned int o = 0; o < order.size(); ++o)
+	{
+		const unsigned int v = order[o].second;
+		const Object* object = m_scene->get_object(visible[v]);
+		if(o == 0 || order[o].first != order[o - 1].first)
+		{
+			glBindTexture(GL_TEXTURE_2D_ARRAY, order[o].first);
+			++binds;
+		}
+		glUniform4fv(m_geometry_buffer_shader_material_table_location, object->get_material_table().size(), glm::value_ptr(object->get_material_table()[0]));
+		glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(object->get_position_matrix()));
+		glUniformMatrix4fv(m_geometry_buffer_shader_normal_matrix_location, 1, GL_FALSE, glm::value_ptr(object->get_model_matrix()));
+		glUniform1i(m_geometry_buffer_shader_octahedral_normals_location, object->get_vertex_format() == FORMAT_QUANTIZED);
+		glUniform1i(m_geometry_buffer_shader_instanced_location, object->get_number_of_instances() > 0);
+		glBindVertexArray(object->get_vao());
+		draw_object(object, m_visible_lods[v]);
+	}
+	//~ The octree culls its nodes itself, its draw list holds the resident nodes seen by the eyes
+	if(m_octree != NULL)
+	{
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_octree->get_diffuse_texture());
+		++binds;
+		glUniform4fv(m_geometry_buffer_shader_material_table_location, m_octree->get_material_table().size(), glm::value_ptr(m_octree->get_material_table()[0]));
+		glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_octree->get_model_matrix()));
+		glUniformMatrix4fv(m_geometry_buffer_shader_normal_matrix_location, 1, GL_FALSE, glm::value_ptr(m_octree->get_model_matrix()));
+		glUniform1i(m_geometry_buffer_shader_octahedral_normals_location, 0);
+		glUniform1i(m_geometry_buffer_shader_instanced_location, 0);
+		m_octree->draw();
+	}
+	glBindVertexArray(0);
+	return binds;
+}
+
+void Renderer::draw_shadow_casters() const
+{
+	const std::vector<unsigned int>& casters = m_scene->get_shadow_casters();
+	for(unsigned int c = 0; c < casters.size(); ++c)
+	{
+		const Object* object = m_scene->get_object(casters[c]);
+		glUniformMatrix4fv(m_shadow_model_matrix_location, 1, GL_FALSE, glm::value_ptr(object->get_position_matrix()));
+		glUniform1i(m_shadow_instanced_location, object->get_number_of_instances() > 0);
+		glBindVertexArray(object->get_depth_vao());
+		if(object->get_number_of_instances() > 0)
+		{
+			object->draw_instanced(m_caster_lods[c]);
+		}
+		else
+		{
+			object->draw(m_caster_lods[c]);
 		}
 	}
-	m_object->set_model_matrix(glm::translate(m_object->get_model_matrix(),glm::vec3(0.00f,0.00f,-m_dc)));
+	//~ The nodes chosen for the eyes cast the shadows : the light does not page chunks in
+	if(m_octree != NULL)
+	{
+		glUniformMatrix4fv(m_shadow_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_octree->get_model_matrix()));
+		glUniform1i(m_shadow_instanced_location, 0);
+		m_octree->draw();
+	}
+	glBindVertexArray(0);
+}
 
-	float avgDistToBarycentre = m_object->computeAvgDistToBarycentre();
-	float scale = (m_dc*(2.0f/3.0f))/avgDistToBarycentre;
-	m_object->set_model_matrix(glm::scale(m_object->get_model_matrix(),glm::vec3(scale,scale,scale)));
+void Renderer::draw_point_cloud(const Camera* camera) const
+{
+	if(m_cloud == NULL || m_cloud->get_number_of_drawn_nodes() == 0)
+	{
+		return;
+	}
+	//~ The splats are sized in the vertex shader, from the spacing of their node
+	glUseProgram(m_point_splat_shader_program);
+	glUniformMatrix4fv(m_point_splat_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_cloud->get_model_matrix()));
+	glUniformMatrix4fv(m_point_splat_view_matrix_location, 1, GL_FALSE, glm::value_ptr(camera->get_view_matrix()));
+	glUniformMatrix4fv(m_point_splat_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(camera->get_projection_matrix()));
+	glUniform3fv(m_point_splat_eye_position_location, 1, glm::value_ptr(camera->get_position()));
+	glUniform1f(m_point_splat_viewport_height_location, (float)m_height);
+	glEnable(GL_PROGRAM_POINT_SIZE);
+	m_cloud->draw(m_point_splat_spacing_location);
+	glDisable(GL_PROGRAM_POINT_SIZE);
+}
 
-	glm::vec3 barycentre = m_object->computeBarycentre();
-	barycentre *= scale;
-	m_object->set_model_matrix(glm::translate(m_object->get_model_matrix(),-barycentre));
+Ray Renderer::view_ray(const float x, const float y) const
+{
+	//~ Unprojection of the pixel on the near and the far planes
+	const Camera* camera = m_rig->get_camera_one();
+	const glm::mat4 clip_to_world = glm::inverse(camera->get_projection_matrix() * camera->get_view_matrix());
+	const float ndc_x = 2.0f * x / m_width - 1.0f;
+	const float ndc_y = 1.0f - 2.0f * y / m_height;
+	glm::vec4 near_point = clip_to_world * glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+	glm::vec4 far_point = clip_to_world * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+	Ray ray;
+	ray.origin = glm::vec3(near_point) / near_point.w;
+	ray.direction = glm::normalize(glm::vec3(far_point) / far_point.w - ray.origin);
+	return ray;
+}
+
+bool Renderer::pick(const int x, const int y, glm::vec3& point) const
+{
+	if(m_object == NULL)
+	{
+		return false;
+	}
+	const Ray ray = view_ray(x + 0.5f, y + 0.5f);
+	RayHit hit;
+	m_object->intersect(&ray, &hit, 1);
+	if(hit.triangle == TriangleBVH::NO_HIT)
+	{
+		return false;
+	}
+	point = ray.origin + hit.distance * ray.direction;
+	return true;
+}
 
-	m_object->set_model_matrix(glm::rotate(m_object->get_model_matrix(), 90.0f, glm::vec3(0, 1, 0)));
+void Renderer::converge_at(const glm::vec3& point)
+{
+	//~ Depth of the point along the axis of the rig, kept beyond the near plane
+	const glm::vec3 eyes = 0.5f * (m_rig->get_camera_one()->get_position() + m_rig->get_camera_two()->get_position());
+	const float depth = glm::dot(point - eyes, glm::normalize(m_rig->get_target()));
+	m_dc = std::max(depth, 2.0f * m_rig->get_camera_one()->get_near());
+	m_rig->set_convergence(m_dc, m_l);
+}
+
+void Renderer::update_convergence()
+{
+	if(!m_auto_convergence || m_object == NULL || !m_object->is_resident())
+	{
+		return;
+	}
+	//~ One packet : a small cross around the centre, the nearest hit wins so that a hole in the model does not push the plane away
+	const float offsets[4][2] = { { -CONVERGENCE_SPREAD, 0.0f }, { CONVERGENCE_SPREAD, 0.0f }, { 0.0f, -CONVERGENCE_SPREAD }, { 0.0f, CONVERGENCE_SPREAD } };
+	Ray rays[4];
+	RayHit hits[4];
+	for(unsigned int r = 0; r < 4; ++r)
+	{
+		rays[r] = view_ray(0.5f * m_width + offsets[r][0], 0.5f * m_height + offsets[r][1]);
+	}
+	m_object->intersect(rays, hits, 4);
+	int nearest = -1;
+	for(unsigned int r = 0; r < 4; ++r)
+	{
+		if(hits[r].triangle != TriangleBVH::NO_HIT && (nearest < 0 || hits[r].distance < hits[nearest].distance))
+		{
+			nearest = r;
+		}
+	}
+	if(nearest < 0)
+	{
+		return;
+	}
+	//~ Eased, so that the eyes are not asked to jump from one depth to another
+	const float previous = m_dc;
+	converge_at(rays[nearest].origin + hits[nearest].distance * rays[nearest].direction);
+	m_dc = previous + (m_dc - previous) * CONVERGENCE_EASING;
+	m_rig->set_convergence(m_dc, m_l);
+}
+
+void Renderer::draw_object(const Object* object, unsigned int level) const
+{
+	if(object->get_number_of_instances() > 0)
+	{
+		object->draw_instanced(level);
+		return;
+	}
+	if(!m_cull_clusters)
+	{
+		object->draw(level);
+		return;
+	}
+	//~ The normal cones only hold if the back faces are not drawn
+	glEnable(GL_CULL_FACE);
+	object->draw_visible();
+	glDisable(GL_CULL_FACE);
 }
 
 void Renderer::render_GUI()
@@ -836,6 +1283,104 @@ void Renderer::render_GUI()
 	}
 	if(m_toggle) m_gui_keyboard_layout = !m_gui_keyboard_layout;
 	
+	//~ The settings change only if the model could apply them
+	if(imguiCheck("Compressed vertices", m_compressed_vertices))
+	{
+		if(m_object == NULL || m_object->set_vertex_format(m_compressed_vertices ? FORMAT_FLOAT : FORMAT_QUANTIZED))
+		{
+			m_compressed_vertices = !m_compressed_vertices;
+		}
+	}
+	const char* retention_names[3] = { "CPU copy : none", "CPU copy : positions", "CPU copy : all" };
+	if(imguiButton(retention_names[m_cpu_retention]))
+	{
+		const CpuRetention retention = (CpuRetention)((m_cpu_retention + 1) % 3);
+		if(m_object == NULL || m_object->set_cpu_retention(retention))
+		{
+			m_cpu_retention = retention;
+		}
+	}
+	
+	if(imguiCheck("Levels of detail", m_use_lods))
+	{
+		m_use_lods = !m_use_lods;
+	}
+	imguiSlider("Instances", &m_number_of_instances_value, 1.0, 1000.0, 1.0);
+	imguiSlider("Texture cache (MB)", &m_texture_cache_budget_value, 0.0, 1024.0, 16.0);
+	imguiSlider("Point budget (M)", &m_point_budget_value, 0.5, 50.0, 0.5);
+	std::ostringstream textures;
+	const TextureCache& texture_cache = TextureCache::get_shared();
+	textures << texture_cache.get_number_of_textures() << " textures, " << (texture_cache.get_size() >> 20) << " MB, " << texture_cache.get_hits() << " hits";
+	imguiLabel(textures.str().c_str());
+	std::ostringstream binds;
+	binds << m_texture_binds << " texture binds (" << m_texture_binds_per_object << " per object), " << TextureArrayManager::get_shared().get_number_of_pages() << " arrays";
+	imguiLabel(binds.str().c_str());
+	if(imguiCheck("Auto-convergence", m_auto_convergence))
+	{
+		m_auto_convergence = !m_auto_convergence;
+	}
+	std::ostringstream convergence;
+	convergence << "Convergence " << m_dc;
+	imguiLabel(convergence.str().c_str());
+	if(imguiCheck("Cluster culling", m_cull_clusters))
+	{
+		m_cull_clusters = !m_cull_clusters;
+	}
+	if(m_object != NULL && m_cull_clusters)
+	{
+		std::ostringstream culled;
+		culled << "Clusters culled " << (int)(100.0f * m_object->get_culled_fraction()) << "%";
+		imguiLabel(culled.str().c_str());
+	}
+	if(m_object != NULL && m_object->get_number_of_lods() > 1)
+	{
+		std::ostringstream lods;
+		const unsigned int lod = select_lod(m_object);
+		lods << "LOD " << lod << " / " << m_object->get_number_of_lods() - 1 << ", shadow " << (m_use_lods ? std::min(lod + 1, m_object->get_number_of_lods() - 1) : 0);
+		imguiLabel(lods.str().c_str());
+	}
+	if(m_object != NULL && !m_object->is_resident())
+	{
+		std::ostringstream upload;
+		upload << "Uploading " << (int)(100.0f * m_object->get_upload_progress()) << "%";
+		imguiLabel(upload.str().c_str());
+	}
+	if(m_octree != NULL)
+	{
+		std::ostringstream octree;
+		octree << m_octree->get_number_of_resident_nodes() << " / " << m_octree->get_number_of_nodes() << " nodes in " << m_octree->get_number_of_slots() << " slots";
+		imguiLabel(octree.str().c_str());
+		std::ostringstream drawn;
+		drawn << m_octree->get_number_of_drawn_nodes() << " nodes drawn, " << m_octree->get_number_of_drawn_triangles() << " triangles, " << m_octree->get_number_of_requests() << " missing";
+		imguiLabel(drawn.str().c_str());
+	}
+	if(m_cloud != NULL)
+	{
+		std::ostringstream cloud;
+		cloud << m_cloud->get_number_of_points() << " points, " << m_cloud->get_number_of_resident_nodes() << " / " << m_cloud->get_number_of_nodes() << " nodes in " << m_cloud->get_number_of_slots() << " slots";
+		imguiLabel(cloud.str().c_str());
+		std::ostringstream drawn;
+		drawn << m_cloud->get_number_of_drawn_nodes() << " nodes drawn, " << m_cloud->get_number_of_drawn_points() << " points";
+		imguiLabel(drawn.str().c_str());
+	}
+	if(m_model_loader->is_loading())
+	{
+		//~ The stage drives the bar, the dots show that the loader is alive
+		const char* stages[] = { "", "waiting", "geometry", "texture", "upload" };
+		LoadingStage stage = m_model_loader->get_stage();
+		std::string bar = "[";
+		for(int i = 1; i < 5; ++i)
+		{
+			bar += (i <= stage) ? "#" : "-";
+		}
+		bar += "] ";
+		bar += stages[stage];
+		bar.append((m_model_loader->get_loading_time() / 250) % 4, '.');
+		std::string model = m_model_loader->get_loading_model();
+		imguiLabel(("Loading " + model.substr(model.find_last_of('/') + 1)).c_str());
+		imguiLabel(bar.c_str());
+	}
+	
 	imguiBeginScrollArea("Settings",m_width-200,0, 200, m_height, &logScroll);
 	imguiSlider("Biais", &m_ssao_biais_value, 0.0, 10.0, 0.01);
 	imguiSlider("Sampling radius", &m_ssao_radius_value, 0.0, 1.0, 0.01);
@@ -883,7 +1428,7 @@ void Renderer::render_SSAO(const GLuint positions_map, const GLuint normals_map,
 	//~ //Binding vao
 	glBindVertexArray(m_quad_left->get_vao());
 	//~ //Drawing
-	glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+	glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 	//~ //Unbind
 	glBindVertexArray(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -906,7 +1451,7 @@ void Renderer::blur(const GLuint texture_to_blur)
 	//~ //Binding vao
 	glBindVertexArray(m_quad_left->get_vao());
 	//~ //Drawing
-	glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+	glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 	//~ //Unbind
 	glBindVertexArray(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -933,12 +1478,200 @@ void Renderer::blend_SSAO(const Framebuffer* output_frambuffer, const GLuint col
 	//~ Binding VAO
 	glBindVertexArray(m_quad_left->get_vao());
 	//~ Drawing
-	glDrawArrays(GL_TRIANGLES, 0, m_quad_left->get_size());
+	glDrawElements(GL_TRIANGLES, m_quad_left->get_number_of_indices(), m_quad_left->get_index_type(), (void*)0);
 	//~ Unbind
 	glBindVertexArray(0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
+void Renderer::benchmark_vertex_layouts()
+{
+	if(m_object == NULL)
+	{
+		std::cout << "Load a model before running the vertex fetch benchmark" << std::endl;
+		return;
+	}
+	if(!GLEW_ARB_timer_query)
+	{
+		std::cout << "GL_ARB_timer_query is not supported, cannot run the vertex fetch benchmark" << std::endl;
+		return;
+	}
+	
+	const VertexLayout initial_layout = m_object->get_vertex_layout();
+	const VertexLayout layouts[3] = { LAYOUT_SEPARATE, LAYOUT_INTERLEAVED, LAYOUT_SPLIT };
+	const char* names[3] = { "separate", "interleaved", "split" };
+	const unsigned int nb_draws = 20;
+	GLuint query;
+	glGenQueries(1, &query);
+	
+	std::cout << "Vertex fetch benchmark : " << m_object->get_size() << " vertices, " << m_object->get_number_of_indices() / 3 << " triangles, " << nb_draws << " draws per pass" << std::endl;
+	for(unsigned int l = 0; l < 3; ++l)
+	{
+		if(!m_object->set_vertex_layout(layouts[l]))
+		{
+			std::cout << "\t" << names[l] << " : the arrays of the mesh could not be read again, skipped" << std::endl;
+			continue;
+		}
+		//~ A big mesh is streamed again : it is uploaded completely first, the draws would stop at its resident indices
+		if(!m_object->stream_buffers((size_t)-1))
+		{
+			std::cout << "\t" << names[l] << " : the buffers could not be uploaded, skipped" << std::endl;
+			continue;
+		}
+		GLuint64 elapsed[2] = { 0, 0 };
+		
+		glBindFramebuffer(GL_FRAMEBUFFER, m_geometry_buffer_framebuffer->get_framebuffer_id());
+		glDrawBuffers(m_geometry_buffer_framebuffer->get_number_of_color_textures(), m_geometry_buffer_framebuffer->get_draw_buffers());
+		glViewport(0, 0, m_width, m_height);
+		glEnable(GL_DEPTH_TEST);
+		
+		//~ Shading pass : every attribute is fetched
+		glUseProgram(m_geometry_buffer_shader_program);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_object->get_diffuse_texture());
+		glUniform1i(m_geometry_buffer_shader_diffuse_location, 0);
+		glUniform4fv(m_geometry_buffer_shader_material_table_location, m_object->get_material_table().size(), glm::value_ptr(m_object->get_material_table()[0]));
+		glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_position_matrix()));
+		glUniformMatrix4fv(m_geometry_buffer_shader_normal_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_model_matrix()));
+		glUniform1i(m_geometry_buffer_shader_octahedral_normals_location, m_object->get_vertex_format() == FORMAT_QUANTIZED);
+		glUniform1i(m_geometry_buffer_shader_instanced_location, GL_FALSE);
+		glUniformMatrix4fv(m_geometry_buffer_shader_view_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_view_matrix()));
+		glUniformMatrix4fv(m_geometry_buffer_shader_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_projection_matrix()));
+		glBindVertexArray(m_object->get_vao());
+		//~ Warming up
+		m_object->draw();
+		glFinish();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for(unsigned int i = 0; i < nb_draws; ++i)
+		{
+			glClear(GL_DEPTH_BUFFER_BIT);
+			m_object->draw();
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed[0]);
+		
+		//~ Depth-only pass : only the positions are needed
+		glUseProgram(m_shadow_shader_program);
+		glUniformMatrix4fv(m_shadow_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_projection_matrix()));
+		glUniformMatrix4fv(m_shadow_view_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_view_matrix()));
+		glUniformMatrix4fv(m_shadow_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_position_matrix()));
+		glUniform1i(m_shadow_instanced_location, GL_FALSE);
+		glBindVertexArray(m_object->get_depth_vao());
+		m_object->draw();
+		glFinish();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for(unsigned int i = 0; i < nb_draws; ++i)
+		{
+			glClear(GL_DEPTH_BUFFER_BIT);
+			m_object->draw();
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed[1]);
+		
+		glBindVertexArray(0);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		
+		std::cout << "\t" << names[l] << " : shading pass " << elapsed[0] / (1.0e6 * nb_draws) << " ms, depth pass " << elapsed[1] / (1.0e6 * nb_draws) << " ms" << std::endl;
+	}
+	
+	glDeleteQueries(1, &query);
+	if(m_object->get_vertex_layout() != initial_layout && !m_object->set_vertex_layout(initial_layout))
+	{
+		std::cout << "The arrays of the mesh could not be read again, the model keeps the " << names[m_object->get_vertex_layout()] << " layout" << std::endl;
+	}
+}
+
+void Renderer::benchmark_instancing()
+{
+	if(m_object == NULL)
+	{
+		std::cout << "Load a model before running the instancing benchmark" << std::endl;
+		return;
+	}
+	if(!GLEW_ARB_timer_query)
+	{
+		std::cout << "GL_ARB_timer_query is not supported, cannot run the instancing benchmark" << std::endl;
+		return;
+	}
+	
+	//~ The coarsest level, so that the submission rather than the vertices dominates
+	const unsigned int level = m_object->get_number_of_lods() - 1;
+	const unsigned int nb_ranges = m_object->get_number_of_ranges(level);
+	const unsigned int counts[2] = { 1000, 10000 };
+	const unsigned int nb_frames = 10;
+	const unsigned int initial_count = m_object->get_number_of_instances();
+	GLuint query;
+	glGenQueries(1, &query);
+	
+	glBindFramebuffer(GL_FRAMEBUFFER, m_geometry_buffer_framebuffer->get_framebuffer_id());
+	glDrawBuffers(m_geometry_buffer_framebuffer->get_number_of_color_textures(), m_geometry_buffer_framebuffer->get_draw_buffers());
+	glViewport(0, 0, m_width, m_height);
+	glEnable(GL_DEPTH_TEST);
+	glUseProgram(m_geometry_buffer_shader_program);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_object->get_diffuse_texture());
+	glUniform1i(m_geometry_buffer_shader_diffuse_location, 0);
+	glUniform4fv(m_geometry_buffer_shader_material_table_location, m_object->get_material_table().size(), glm::value_ptr(m_object->get_material_table()[0]));
+	glUniform1i(m_geometry_buffer_shader_octahedral_normals_location, m_object->get_vertex_format() == FORMAT_QUANTIZED);
+	glUniformMatrix4fv(m_geometry_buffer_shader_view_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_view_matrix()));
+	glUniformMatrix4fv(m_geometry_buffer_shader_projection_matrix_location, 1, GL_FALSE, glm::value_ptr(m_rig->get_camera_one()->get_projection_matrix()));
+	
+	std::cout << "Instancing benchmark : level " << level << " of " << m_object->get_number_of_indices() / 3 << " triangles in all, " << nb_ranges << " ranges, " << nb_frames << " frames" << std::endl;
+	for(unsigned int c = 0; c < 2; ++c)
+	{
+		const std::vector<glm::mat4> grid = make_instance_grid(counts[c]);
+		GLuint64 elapsed[2] = { 0, 0 };
+		Uint32 submission[2] = { 0, 0 };
+		
+		//~ One object per copy : its matrices, then its draws
+		m_object->set_instances(std::vector<glm::mat4>());
+		glUniform1i(m_geometry_buffer_shader_instanced_location, GL_FALSE);
+		glBindVertexArray(m_object->get_vao());
+		glFinish();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		Uint32 start = SDL_GetTicks();
+		for(unsigned int f = 0; f < nb_frames; ++f)
+		{
+			glClear(GL_DEPTH_BUFFER_BIT);
+			for(unsigned int i = 0; i < counts[c]; ++i)
+			{
+				glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(grid[i] * m_object->get_position_matrix()));
+				glUniformMatrix4fv(m_geometry_buffer_shader_normal_matrix_location, 1, GL_FALSE, glm::value_ptr(grid[i] * m_object->get_model_matrix()));
+				m_object->draw(level);
+			}
+		}
+		submission[0] = SDL_GetTicks() - start;
+		glEndQuery(GL_TIME_ELAPSED);
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed[0]);
+		
+		//~ One instanced call per range
+		m_object->set_instances(grid);
+		glUniform1i(m_geometry_buffer_shader_instanced_location, GL_TRUE);
+		glUniformMatrix4fv(m_geometry_buffer_shader_model_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_position_matrix()));
+		glUniformMatrix4fv(m_geometry_buffer_shader_normal_matrix_location, 1, GL_FALSE, glm::value_ptr(m_object->get_model_matrix()));
+		glBindVertexArray(m_object->get_vao());
+		glFinish();
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		start = SDL_GetTicks();
+		for(unsigned int f = 0; f < nb_frames; ++f)
+		{
+			glClear(GL_DEPTH_BUFFER_BIT);
+			m_object->draw_instanced(level);
+		}
+		submission[1] = SDL_GetTicks() - start;
+		glEndQuery(GL_TIME_ELAPSED);
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed[1]);
+		
+		std::cout << "\t" << counts[c] << " copies : separate " << counts[c] * nb_ranges << " draws, " << (float)submission[0] / nb_frames << " ms CPU, " << elapsed[0] / (1.0e6 * nb_frames) << " ms GPU"
+			<< " ; instanced " << nb_ranges << " draws, " << (float)submission[1] / nb_frames << " ms CPU, " << elapsed[1] / (1.0e6 * nb_frames) << " ms GPU" << std::endl;
+	}
+	
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteQueries(1, &query);
+	m_object->set_instances(initial_count > 0 ? make_instance_grid(initial_count) : std::vector<glm::mat4>());
+}
+
 void Renderer::toggle_ssao(const int enable_disable)
 {
 	m_is_ssao_enabled = enable_disable;
@@ -191,6 +191,12 @@ void Rig::reset_dioc(const float dc, const float l)
 	update_position(0,0.0f);
 }
 
+void Rig::set_convergence(const float dc, const float l)
+{
+	m_camera_one->compute_projection_matrix(dc, l);
+	m_camera_two->compute_projection_matrix(dc, l);
+}
+
 //~ Getters
 glm::vec3 Rig::get_position() const
 {
@@ -0,0 +1,247 @@
+/***************************************************************************
+									Scene.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+/*!
+ * \file Scene.cpp
+ * \brief Objects of a scene, their transforms, bounds and render flags
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/Scene.hpp"
+
+//~ Nodes per task of the update, enough to cover the scheduling
+static const unsigned int SCENE_UPDATE_GRAIN = 256;
+
+/*!
+ * \brief Dirty nodes of one depth, updated in parallel
+ */
+struct SceneUpdateJob
+{
+	const unsigned int* nodes;
+	const std::vector<Object*>* objects;
+	const std::vector<int>* parents;
+	const std::vector<glm::mat4>* local_matrices;
+	std::vector<glm::mat4>* world_matrices;
+	std::vector<glm::vec3>* world_min;
+	std::vector<glm::vec3>* world_max;
+};
+
+Scene::Scene()
+{
+}
+
+Scene::~Scene()
+{
+	clear();
+}
+
+unsigned int Scene::add(Object* object, const glm::mat4& local_matrix, int parent)
+{
+	const unsigned int node = m_objects.size();
+	m_objects.push_back(object);
+	m_parents.push_back(parent);
+	m_depths.push_back(parent >= 0 ? m_depths[parent] + 1 : 0);
+	m_local_matrices.push_back(local_matrix);
+	m_world_matrices.push_back(local_matrix);
+	m_world_min.push_back(glm::vec3(FLT_MAX));
+	m_world_max.push_back(glm::vec3(-FLT_MAX));
+	m_flags.push_back(0);
+	m_dirty.push_back(1);
+	return node;
+}
+
+void Scene::clear()
+{
+	for(unsigned int i = 0; i < m_objects.size(); ++i)
+	{
+		delete m_objects[i];
+	}
+	m_objects.clear();
+	m_parents.clear();
+	m_depths.clear();
+	m_local_matrices.clear();
+	m_world_matrices.clear();
+	m_world_min.clear();
+	m_world_max.clear();
+	m_flags.clear();
+	m_dirty.clear();
+	m_visible.clear();
+	m_shadow_casters.clear();
+}
+
+void Scene::update_nodes(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	SceneUpdateJob* job = static_cast<SceneUpdateJob*>(data);
+	for(unsigned int i = begin; i < end; ++i)
+	{
+		const unsigned int node = job->nodes[i];
+		const int parent = (*job->parents)[node];
+		//~ The parent has a lower depth, it was updated by a previous batch
+		const glm::mat4 world = (parent >= 0) ? (*job->world_matrices)[parent] * (*job->local_matrices)[node] : (*job->local_matrices)[node];
+		(*job->world_matrices)[node] = world;
+		Object* object = (*job->objects)[node];
+		if(object != NULL)
+		{
+			object->set_model_matrix(world);
+			(*job->world_min)[node] = object->get_world_min();
+			(*job->world_max)[node] = object->get_world_max();
+		}
+	}
+}
+
+void Scene::update()
+{
+	//~ A node is dirty when it moved or when its parent is, the parents coming first one pass is enough
+	const unsigned int nb_nodes = m_objects.size();
+	unsigned int max_depth = 0;
+	unsigned int nb_dirty = 0;
+	for(unsigned int i = 0; i < nb_nodes; ++i)
+	{
+		if(!m_dirty[i] && m_parents[i] >= 0 && m_dirty[m_parents[i]])
+		{
+			m_dirty[i] = 1;
+		}
+		if(m_dirty[i])
+		{
+			max_depth = std::max(max_depth, m_depths[i]);
+			++nb_dirty;
+		}
+	}
+	if(nb_dirty == 0)
+	{
+		return;
+	}
+
+	//~ Counting sort of the dirty nodes by depth
+	m_depth_starts.assign(max_depth + 2, 0);
+	for(unsigned int i = 0; i < nb_nodes; ++i)
+	{
+		if(m_dirty[i])
+		{
+			++m_depth_starts[m_depths[i] + 1];
+		}
+	}
+	for(unsigned int d = 1; d < m_depth_starts.size(); ++d)
+	{
+		m_depth_starts[d] += m_depth_starts[d - 1];
+	}
+	m_update_list.resize(nb_dirty);
+	std::vector<unsigned int> cursors(m_depth_starts.begin(), m_depth_starts.end() - 1);
+	for(unsigned int i = 0; i < nb_nodes; ++i)
+	{
+		if(m_dirty[i])
+		{
+			m_update_list[cursors[m_depths[i]]++] = i;
+			m_dirty[i] = 0;
+		}
+	}
+
+	//~ One parallel batch per depth, each depth only reads the matrices of the previous ones ; the render thread does not
+	//~ wait for a loop of the loader thread, it updates the nodes alone meanwhile
+	ThreadPool& pool = ThreadPool::get_shared();
+	SceneUpdateJob job;
+	job.objects = &m_objects;
+	job.parents = &m_parents;
+	job.local_matrices = &m_local_matrices;
+	job.world_matrices = &m_world_matrices;
+	job.world_min = &m_world_min;
+	job.world_max = &m_world_max;
+	for(unsigned int d = 0; d <= max_depth; ++d)
+	{
+		const unsigned int count = m_depth_starts[d + 1] - m_depth_starts[d];
+		if(count == 0)
+		{
+			continue;
+		}
+		job.nodes = &m_update_list[m_depth_starts[d]];
+		pool.parallel_for(count, SCENE_UPDATE_GRAIN, update_nodes, &job, false);
+	}
+}
+
+void Scene::cull(const Frustum& eyes, const Frustum& light)
+{
+	m_visible.clear();
+	m_shadow_casters.clear();
+	for(unsigned int i = 0; i < m_objects.size(); ++i)
+	{
+		if(m_objects[i] == NULL || (m_flags[i] & SCENE_HIDDEN))
+		{
+			continue;
+		}
+		if(eyes.intersects_box(m_world_min[i], m_world_max[i]))
+		{
+			m_visible.push_back(i);
+		}
+		if(!(m_flags[i] & SCENE_NO_SHADOW) && light.intersects_box(m_world_min[i], m_world_max[i]))
+		{
+			m_shadow_casters.push_back(i);
+		}
+	}
+}
+
+void Scene::set_local_matrix(unsigned int node, const glm::mat4& local_matrix)
+{
+	m_local_matrices[node] = local_matrix;
+	m_dirty[node] = 1;
+}
+
+void Scene::set_flags(unsigned int node, unsigned int flags)
+{
+	m_flags[node] = flags;
+}
+
+void Scene::invalidate(unsigned int node)
+{
+	m_dirty[node] = 1;
+}
+
+unsigned int Scene::get_number_of_nodes() const
+{
+	return m_objects.size();
+}
+
+Object* Scene::get_object(unsigned int node) const
+{
+	return m_objects[node];
+}
+
+const glm::mat4& Scene::get_world_matrix(unsigned int node) const
+{
+	return m_world_matrices[node];
+}
+
+const std::vector<unsigned int>& Scene::get_visible() const
+{
+	return m_visible;
+}
+
+const std::vector<unsigned int>& Scene::get_shadow_casters() const
+{
+	return m_shadow_casters;
+}
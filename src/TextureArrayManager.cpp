@@ -0,0 +1,173 @@
+/***************************************************************************
+									TextureArrayManager.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file TextureArrayManager.cpp
+ * \brief Texture arrays shared by the objects whose textures have the same size
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/TextureArrayManager.hpp"
+
+TextureArrayManager::TextureArrayManager(size_t page_size):
+	m_page_size(page_size)
+{
+}
+
+TextureArrayManager::~TextureArrayManager()
+{
+}
+
+TextureArrayManager& TextureArrayManager::get_shared()
+{
+	static TextureArrayManager manager;
+	return manager;
+}
+
+TextureArrayRange TextureArrayManager::allocate(GLenum internal_format, int width, int height, unsigned int levels, size_t layer_size, unsigned int count)
+{
+	TextureArrayRange range = { 0, 0, count };
+	//~ First fit among the pages of the same format
+	for(unsigned int p = 0; p < m_pages.size(); ++p)
+	{
+		Page& page = m_pages[p];
+		if(page.internal_format != internal_format || page.width != width || page.height != height || page.levels != levels)
+		{
+			continue;
+		}
+		unsigned int free_layers = 0;
+		for(unsigned int l = 0; l < page.used.size(); ++l)
+		{
+			free_layers = page.used[l] ? 0 : free_layers + 1;
+			if(free_layers == count)
+			{
+				range.texture = page.texture;
+				range.first_layer = l + 1 - count;
+				std::fill(page.used.begin() + range.first_layer, page.used.begin() + l + 1, true);
+				return range;
+			}
+		}
+	}
+
+	//~ A new page, as many layers as fit in the page size within the limit of the driver
+	GLint max_layers;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	const unsigned int fitting = (unsigned int)std::min((size_t)max_layers, m_page_size / std::max(layer_size, (size_t)1));
+	Page page;
+	page.internal_format = internal_format;
+	page.width = width;
+	page.height = height;
+	page.levels = levels;
+	page.used.assign(std::max(count, fitting), false);
+	std::fill(page.used.begin(), page.used.begin() + count, true);
+	create_storage(page);
+	m_pages.push_back(page);
+	range.texture = page.texture;
+	return range;
+}
+
+void TextureArrayManager::create_storage(Page& page)
+{
+	glGenTextures(1, &page.texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, page.texture);
+	const GLsizei depth = page.used.size();
+	if(GLEW_ARB_texture_storage)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, page.levels, page.internal_format, page.width, page.height, depth);
+	}
+	else
+	{
+		//~ Blocks of 4x4 texels, 8 bytes for BC1 and 16 for the other compressed formats
+		const bool compressed = page.internal_format != GL_RGBA8;
+		const size_t block_size = (page.internal_format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+		for(unsigned int level = 0; level < page.levels; ++level)
+		{
+			const GLsizei width = std::max(1, page.width >> level), height = std::max(1, page.height >> level);
+			if(compressed)
+			{
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, page.internal_format, width, height, depth, 0, ((width + 3) / 4) * ((height + 3) / 4) * block_size * depth, NULL);
+			}
+			else
+			{
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, page.internal_format, width, height, depth, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			}
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, page.levels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void TextureArrayManager::release(const TextureArrayRange& range)
+{
+	for(unsigned int p = 0; p < m_pages.size(); ++p)
+	{
+		Page& page = m_pages[p];
+		if(page.texture != range.texture)
+		{
+			continue;
+		}
+		std::fill(page.used.begin() + range.first_layer, page.used.begin() + range.first_layer + range.number_of_layers, false);
+		//~ The empty pages are deleted
+		if(std::find(page.used.begin(), page.used.end(), true) == page.used.end())
+		{
+			glDeleteTextures(1, &page.texture);
+			m_pages.erase(m_pages.begin() + p);
+		}
+		return;
+	}
+}
+
+void TextureArrayManager::clear()
+{
+	for(unsigned int p = 0; p < m_pages.size(); ++p)
+	{
+		glDeleteTextures(1, &m_pages[p].texture);
+	}
+	m_pages.clear();
+}
+
+unsigned int TextureArrayManager::get_number_of_pages() const
+{
+	return m_pages.size();
+}
+
+unsigned int TextureArrayManager::get_number_of_layers() const
+{
+	unsigned int layers = 0;
+	for(unsigned int p = 0; p < m_pages.size(); ++p)
+	{
+		layers += std::count(m_pages[p].used.begin(), m_pages[p].used.end(), true);
+	}
+	return layers;
+}
@@ -0,0 +1,229 @@
+/***************************************************************************
+									TextureCache.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file TextureCache.cpp
+ * \brief Texture arrays shared between the objects, kept after their last use
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/TextureCache.hpp"
+
+TextureCache::TextureCache(size_t budget):
+	m_budget(budget),
+	m_size(0),
+	m_hits(0),
+	m_misses(0)
+{
+	m_mutex = SDL_CreateMutex();
+}
+
+TextureCache::~TextureCache()
+{
+	SDL_DestroyMutex(m_mutex);
+}
+
+TextureCache& TextureCache::get_shared()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+//~ FNV-1a hash of the content of a file, 0 if it cannot be read
+static uint64_t hash_file(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(file == NULL)
+	{
+		return 0;
+	}
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned char buffer[65536];
+	size_t read;
+	while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		for(size_t i = 0; i < read; ++i)
+		{
+			hash = (hash ^ buffer[i]) * 1099511628211ULL;
+		}
+	}
+	fclose(file);
+	return hash;
+}
+
+std::string TextureCache::make_key(const std::vector<std::string>& paths)
+{
+	std::ostringstream key;
+	key << std::hex;
+	for(unsigned int i = 0; i < paths.size(); ++i)
+	{
+		//~ The canonical path merges the relative paths and the links to the same file
+#ifdef _WIN32
+		//~ No realpath : the absolute path only merges the relative paths
+		char* canonical = paths[i].empty() ? NULL : _fullpath(NULL, paths[i].c_str(), 0);
+#else
+		char* canonical = paths[i].empty() ? NULL : realpath(paths[i].c_str(), NULL);
+#endif
+		if(canonical != NULL)
+		{
+			key << canonical << '#' << hash_file(canonical);
+			free(canonical);
+		}
+		key << '|';
+	}
+	return key.str();
+}
+
+bool TextureCache::contains(const std::string& key)
+{
+	SDL_LockMutex(m_mutex);
+	bool found = false;
+	for(std::list<TextureCacheEntry>::const_iterator it = m_entries.begin(); it != m_entries.end() && !found; ++it)
+	{
+		found = (it->key == key);
+	}
+	SDL_UnlockMutex(m_mutex);
+	return found;
+}
+
+const TextureCacheEntry* TextureCache::acquire(const std::string& key)
+{
+	SDL_LockMutex(m_mutex);
+	const TextureCacheEntry* entry = NULL;
+	for(std::list<TextureCacheEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		if(it->key == key)
+		{
+			++it->references;
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			entry = &m_entries.front();
+			break;
+		}
+	}
+	if(entry != NULL)
+	{
+		++m_hits;
+	}
+	else
+	{
+		++m_misses;
+	}
+	SDL_UnlockMutex(m_mutex);
+	return entry;
+}
+
+const TextureCacheEntry* TextureCache::insert(const std::string& key, const TextureArrayRange& range, const std::vector<unsigned int>& material_layers, size_t bytes)
+{
+	TextureCacheEntry entry;
+	entry.key = key;
+	entry.range = range;
+	entry.material_layers = material_layers;
+	entry.bytes = bytes;
+	entry.references = 1;
+
+	SDL_LockMutex(m_mutex);
+	m_entries.push_front(entry);
+	m_size += bytes;
+	evict(m_budget);
+	SDL_UnlockMutex(m_mutex);
+	return &m_entries.front();
+}
+
+void TextureCache::release(const std::string& key)
+{
+	SDL_LockMutex(m_mutex);
+	for(std::list<TextureCacheEntry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+	{
+		if(it->key == key && it->references > 0)
+		{
+			//~ The texture becomes the most recently used of the unused ones
+			--it->references;
+			m_entries.splice(m_entries.begin(), m_entries, it);
+			break;
+		}
+	}
+	evict(m_budget);
+	SDL_UnlockMutex(m_mutex);
+}
+
+void TextureCache::clear()
+{
+	SDL_LockMutex(m_mutex);
+	evict(0);
+	SDL_UnlockMutex(m_mutex);
+}
+
+void TextureCache::evict(size_t budget)
+{
+	std::list<TextureCacheEntry>::iterator it = m_entries.end();
+	while(m_size > budget && it != m_entries.begin())
+	{
+		--it;
+		if(it->references == 0)
+		{
+			TextureArrayManager::get_shared().release(it->range);
+			m_size -= it->bytes;
+			it = m_entries.erase(it);
+		}
+	}
+}
+
+void TextureCache::set_budget(size_t budget)
+{
+	SDL_LockMutex(m_mutex);
+	m_budget = budget;
+	evict(m_budget);
+	SDL_UnlockMutex(m_mutex);
+}
+
+size_t TextureCache::get_budget() const
+{
+	return m_budget;
+}
+
+size_t TextureCache::get_size() const
+{
+	return m_size;
+}
+
+unsigned int TextureCache::get_number_of_textures() const
+{
+	return m_entries.size();
+}
+
+unsigned int TextureCache::get_hits() const
+{
+	return m_hits;
+}
+
+unsigned int TextureCache::get_misses() const
+{
+	return m_misses;
+}
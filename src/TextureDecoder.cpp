@@ -0,0 +1,310 @@
+/***************************************************************************
+									TextureDecoder.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+
+
+/*!
+ * \file TextureDecoder.cpp
+ * \brief Decodes textures on the worker threads and uploads them with their mipmaps
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/TextureDecoder.hpp"
+
+//~ Conversions between sRGB and linear intensities, filled before main
+struct SrgbTables
+{
+	float to_linear[256];
+	unsigned char to_srgb[4096];
+
+	SrgbTables()
+	{
+		for(unsigned int i = 0; i < 256; ++i)
+		{
+			const float c = i / 255.0f;
+			to_linear[i] = (c <= 0.04045f) ? c / 12.92f : (float)pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for(unsigned int i = 0; i < 4096; ++i)
+		{
+			const float l = i / 4095.0f;
+			const float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * (float)pow(l, 1.0f / 2.4f) - 0.055f;
+			to_srgb[i] = (unsigned char)std::min(255.0f, c * 255.0f + 0.5f);
+		}
+	}
+};
+static const SrgbTables SRGB_TABLES;
+
+TextureImage TextureDecoder::decode(const std::string& path)
+{
+	TextureImage image = { NULL, 0, 0, 1 };
+	if(path.empty())
+	{
+		return image;
+	}
+	//~ Calling stbi, the images are converted to RGBA
+	int components;
+	unsigned char* decoded = stbi_load(path.c_str(), &image.width, &image.height, &components, 4);
+	if(decoded == NULL)
+	{
+		std::cerr << "Unable to load the texture " << path << std::endl;
+		return image;
+	}
+	const size_t size = (size_t)image.width * image.height * 4;
+	image.pixels = new unsigned char[size];
+	memcpy(image.pixels, decoded, size);
+	stbi_image_free(decoded);
+	return image;
+}
+
+//~ Paths and results of a parallel decoding, one task per image
+struct DecodeJob
+{
+	const std::vector<std::string>* paths;
+	std::vector<TextureImage>* images;
+};
+
+static void decode_images(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	DecodeJob& job = *(DecodeJob*)data;
+	for(unsigned int i = begin; i < end; ++i)
+	{
+		(*job.images)[i] = TextureDecoder::decode((*job.paths)[i]);
+	}
+}
+
+std::vector<TextureImage> TextureDecoder::decode_all(const std::vector<std::string>& paths)
+{
+	std::vector<TextureImage> images(paths.size());
+	DecodeJob job = { &paths, &images };
+	ThreadPool::get_shared().parallel_for(paths.size(), 1, decode_images, &job);
+	return images;
+}
+
+TextureImage TextureDecoder::create_filled(int width, int height, const unsigned char color[4])
+{
+	TextureImage image = { NULL, width, height, 1 };
+	image.pixels = new unsigned char[(size_t)width * height * 4];
+	for(size_t p = 0; p < (size_t)width * height; ++p)
+	{
+		memcpy(image.pixels + p * 4, color, 4);
+	}
+	return image;
+}
+
+//~ Images and target of a parallel preparation, one task per image
+struct PrepareJob
+{
+	std::vector<TextureImage>* images;
+	int width;
+	int height;
+	bool srgb;
+};
+
+void TextureDecoder::prepare_images(unsigned int begin, unsigned int end, unsigned int, void* data)
+{
+	PrepareJob& job = *(PrepareJob*)data;
+	for(unsigned int i = begin; i < end; ++i)
+	{
+		TextureImage& image = (*job.images)[i];
+		if(image.pixels == NULL)
+		{
+			continue;
+		}
+		if(job.width > 0 && (image.width != job.width || image.height != job.height))
+		{
+			resize(image, job.width, job.height);
+		}
+		build_mipmaps(image, job.srgb);
+	}
+}
+
+void TextureDecoder::prepare(std::vector<TextureImage>& images, int width, int height, bool srgb)
+{
+	PrepareJob job = { &images, width, height, srgb };
+	ThreadPool::get_shared().parallel_for(images.size(), 1, prepare_images, &job);
+}
+
+void TextureDecoder::release(TextureImage& image)
+{
+	delete[] image.pixels;
+	image.pixels = NULL;
+}
+
+unsigned int TextureDecoder::count_levels(int width, int height)
+{
+	unsigned int levels = 1;
+	for(int size = std::max(width, height); size > 1; size >>= 1)
+	{
+		++levels;
+	}
+	return levels;
+}
+
+size_t TextureDecoder::get_level_offset(const TextureImage& image, unsigned int level)
+{
+	size_t offset = 0;
+	for(unsigned int l = 0; l < level; ++l)
+	{
+		offset += (size_t)std::max(1, image.width >> l) * std::max(1, image.height >> l) * 4;
+	}
+	return offset;
+}
+
+void TextureDecoder::resize(TextureImage& image, int width, int height)
+{
+	unsigned char* pixels = new unsigned char[(size_t)width * height * 4];
+	for(int y = 0; y < height; ++y)
+	{
+		const float v = std::max(0.0f, (y + 0.5f) * image.height / height - 0.5f);
+		const int y0 = std::min((int)v, image.height - 1), y1 = std::min(y0 + 1, image.height - 1);
+		const float fy = v - y0;
+		for(int x = 0; x < width; ++x)
+		{
+			const float u = std::max(0.0f, (x + 0.5f) * image.width / width - 0.5f);
+			const int x0 = std::min((int)u, image.width - 1), x1 = std::min(x0 + 1, image.width - 1);
+			const float fx = u - x0;
+			for(int c = 0; c < 4; ++c)
+			{
+				const float top = image.pixels[(y0 * image.width + x0) * 4 + c] * (1.0f - fx) + image.pixels[(y0 * image.width + x1) * 4 + c] * fx;
+				const float bottom = image.pixels[(y1 * image.width + x0) * 4 + c] * (1.0f - fx) + image.pixels[(y1 * image.width + x1) * 4 + c] * fx;
+				pixels[((size_t)y * width + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+			}
+		}
+	}
+	delete[] image.pixels;
+	image.pixels = pixels;
+	image.width = width;
+	image.height = height;
+	image.levels = 1;
+}
+
+void TextureDecoder::build_mipmaps(TextureImage& image, bool srgb)
+{
+	image.levels = count_levels(image.width, image.height);
+	unsigned char* pixels = new unsigned char[get_level_offset(image, image.levels)];
+	memcpy(pixels, image.pixels, (size_t)image.width * image.height * 4);
+	delete[] image.pixels;
+	image.pixels = pixels;
+
+	//~ Each texel of a level averages 2x2 texels of the previous one, the last row or column is repeated for odd sizes
+	for(unsigned int level = 1; level < image.levels; ++level)
+	{
+		const unsigned char* source = pixels + get_level_offset(image, level - 1);
+		unsigned char* destination = pixels + get_level_offset(image, level);
+		const int source_width = std::max(1, image.width >> (level - 1)), source_height = std::max(1, image.height >> (level - 1));
+		const int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+		for(int y = 0; y < height; ++y)
+		{
+			const unsigned char* row0 = source + (size_t)std::min(2 * y, source_height - 1) * source_width * 4;
+			const unsigned char* row1 = source + (size_t)std::min(2 * y + 1, source_height - 1) * source_width * 4;
+			for(int x = 0; x < width; ++x)
+			{
+				const int x0 = std::min(2 * x, source_width - 1) * 4, x1 = std::min(2 * x + 1, source_width - 1) * 4;
+				unsigned char* texel = destination + ((size_t)y * width + x) * 4;
+				for(int c = 0; c < 3; ++c)
+				{
+					if(srgb)
+					{
+						const float sum = SRGB_TABLES.to_linear[row0[x0 + c]] + SRGB_TABLES.to_linear[row0[x1 + c]]
+							+ SRGB_TABLES.to_linear[row1[x0 + c]] + SRGB_TABLES.to_linear[row1[x1 + c]];
+						texel[c] = SRGB_TABLES.to_srgb[(int)(sum * 0.25f * 4095.0f + 0.5f)];
+					}
+					else
+					{
+						texel[c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+					}
+				}
+				texel[3] = (unsigned char)((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) >> 2);
+			}
+		}
+	}
+}
+
+void TextureDecoder::upload(GLenum target, const std::vector<const TextureImage*>& layers, unsigned int first_layer)
+{
+	const TextureImage& first = *layers[0];
+	const size_t layer_size = get_level_offset(first, first.levels);
+	const GLsizei depth = layers.size();
+
+	//~ Immutable storage : every level is allocated at once, the driver does not have to check the completeness at each draw
+	if(target == GL_TEXTURE_2D && GLEW_ARB_texture_storage)
+	{
+		glTexStorage2D(target, first.levels, GL_RGBA8, first.width, first.height);
+	}
+	else if(target == GL_TEXTURE_2D)
+	{
+		for(unsigned int level = 0; level < first.levels; ++level)
+		{
+			glTexImage2D(target, level, GL_RGBA8, std::max(1, first.width >> level), std::max(1, first.height >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+		glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, first.levels - 1);
+	}
+
+	//~ The pixels are copied once into a pixel buffer, the transfers to the texture are then made by the driver without stalling
+	GLuint pixel_buffer;
+	glGenBuffers(1, &pixel_buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, layer_size * depth, NULL, GL_STREAM_DRAW);
+	unsigned char* mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, layer_size * depth, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	for(GLsizei layer = 0; layer < depth; ++layer)
+	{
+		if(mapped != NULL)
+		{
+			memcpy(mapped + layer * layer_size, layers[layer]->pixels, layer_size);
+		}
+		else
+		{
+			glBufferSubData(GL_PIXEL_UNPACK_BUFFER, layer * layer_size, layer_size, layers[layer]->pixels);
+		}
+	}
+	if(mapped != NULL)
+	{
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	//~ Rows of 4 bytes pixels are always aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	for(GLsizei layer = 0; layer < depth; ++layer)
+	{
+		for(unsigned int level = 0; level < first.levels; ++level)
+		{
+			const GLsizei width = std::max(1, first.width >> level), height = std::max(1, first.height >> level);
+			const GLvoid* offset = (const GLvoid*)(layer * layer_size + get_level_offset(first, level));
+			if(target == GL_TEXTURE_2D_ARRAY)
+			{
+				glTexSubImage3D(target, level, 0, 0, first_layer + layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+			}
+			else
+			{
+				glTexSubImage2D(target, level, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+			}
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glDeleteBuffers(1, &pixel_buffer);
+}
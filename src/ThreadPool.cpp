@@ -0,0 +1,209 @@
+/***************************************************************************
+									ThreadPool.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file ThreadPool.cpp
+ * \brief Pool of worker threads
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/ThreadPool.hpp"
+
+#ifndef _WIN32
+	#include <unistd.h>
+#endif
+
+ThreadPool::ThreadPool(unsigned int nb_threads):
+	m_stop(false),
+	m_busy(false),
+	m_generation(0),
+	m_function(NULL),
+	m_data(NULL),
+	m_count(0),
+	m_grain(1),
+	m_next(0),
+	m_running(0)
+{
+	if(nb_threads == 0)
+	{
+#ifndef _WIN32
+		long processors = sysconf(_SC_NPROCESSORS_ONLN);
+		nb_threads = (processors > 1) ? (unsigned int)(processors - 1) : 0;
+#else
+		nb_threads = 3;
+#endif
+	}
+	m_mutex = SDL_CreateMutex();
+	m_start = SDL_CreateCond();
+	m_done = SDL_CreateCond();
+	m_free = SDL_CreateCond();
+	for(unsigned int i = 0; i < nb_threads; ++i)
+	{
+		Worker* worker = new Worker();
+		worker->pool = this;
+		//~ Index 0 is the calling thread
+		worker->index = i + 1;
+		worker->thread = SDL_CreateThread(ThreadPool::run_worker, worker);
+		if(worker->thread == NULL)
+		{
+			std::cerr << "Unable to create a worker thread : " << SDL_GetError() << std::endl;
+			delete worker;
+			break;
+		}
+		m_workers.push_back(worker);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	SDL_LockMutex(m_mutex);
+	m_stop = true;
+	SDL_CondBroadcast(m_start);
+	SDL_UnlockMutex(m_mutex);
+	for(unsigned int i = 0; i < m_workers.size(); ++i)
+	{
+		SDL_WaitThread(m_workers[i]->thread, NULL);
+		delete m_workers[i];
+	}
+	SDL_DestroyCond(m_free);
+	SDL_DestroyCond(m_done);
+	SDL_DestroyCond(m_start);
+	SDL_DestroyMutex(m_mutex);
+}
+
+ThreadPool& ThreadPool::get_shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+unsigned int ThreadPool::get_number_of_workers() const
+{
+	return m_workers.size() + 1;
+}
+
+void ThreadPool::parallel_for(unsigned int count, unsigned int grain, RangeFunction function, void* data, bool wait)
+{
+	if(count == 0)
+	{
+		return;
+	}
+	if(grain == 0)
+	{
+		grain = 1;
+	}
+	//~ Small loops do not wake the workers up
+	if(m_workers.empty() || count <= grain)
+	{
+		function(0, count, 0, data);
+		return;
+	}
+
+	//~ One loop at a time, the ones started by other threads wait here unless their caller cannot wait
+	SDL_LockMutex(m_mutex);
+	if(m_busy && !wait)
+	{
+		SDL_UnlockMutex(m_mutex);
+		function(0, count, 0, data);
+		return;
+	}
+	while(m_busy)
+	{
+		SDL_CondWait(m_free, m_mutex);
+	}
+	m_busy = true;
+	m_function = function;
+	m_data = data;
+	m_count = count;
+	m_grain = grain;
+	m_next = 0;
+	m_running = m_workers.size() + 1;
+	++m_generation;
+	SDL_CondBroadcast(m_start);
+	SDL_UnlockMutex(m_mutex);
+
+	run_ranges(0);
+
+	//~ Waiting for the workers to finish their ranges
+	SDL_LockMutex(m_mutex);
+	while(m_running > 0)
+	{
+		SDL_CondWait(m_done, m_mutex);
+	}
+	m_function = NULL;
+	m_data = NULL;
+	m_busy = false;
+	SDL_CondSignal(m_free);
+	SDL_UnlockMutex(m_mutex);
+}
+
+void ThreadPool::run_ranges(unsigned int worker)
+{
+	SDL_LockMutex(m_mutex);
+	RangeFunction function = m_function;
+	void* data = m_data;
+	while(m_next < m_count)
+	{
+		unsigned int begin = m_next;
+		unsigned int end = (m_count - begin > m_grain) ? begin + m_grain : m_count;
+		m_next = end;
+		SDL_UnlockMutex(m_mutex);
+		function(begin, end, worker, data);
+		SDL_LockMutex(m_mutex);
+	}
+	--m_running;
+	if(m_running == 0)
+	{
+		SDL_CondSignal(m_done);
+	}
+	SDL_UnlockMutex(m_mutex);
+}
+
+int ThreadPool::run_worker(void* data)
+{
+	Worker* worker = static_cast<Worker*>(data);
+	ThreadPool* pool = worker->pool;
+	unsigned int generation = 0;
+	while(true)
+	{
+		SDL_LockMutex(pool->m_mutex);
+		while(!pool->m_stop && pool->m_generation == generation)
+		{
+			SDL_CondWait(pool->m_start, pool->m_mutex);
+		}
+		if(pool->m_stop)
+		{
+			SDL_UnlockMutex(pool->m_mutex);
+			break;
+		}
+		generation = pool->m_generation;
+		SDL_UnlockMutex(pool->m_mutex);
+		pool->run_ranges(worker->index);
+	}
+	return 0;
+}
@@ -0,0 +1,569 @@
+/***************************************************************************
+									TriangleBVH.cpp
+                             --------------------
+    begin                : Feb 1 2013
+    copyright            : (C) 2013 by R. Bertozzi & S. Bougeois
+    email                : romain.bertozzi@gmail.com s.bougeois@gmail.com
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ *                                                                         *
+ ***************************************************************************/
+
+
+/*!
+ * \file TriangleBVH.cpp
+ * \brief Bounding volume hierarchy over the triangles of a mesh, for ray queries
+ * \author R. Bertozzi & S. Bougeois
+ */
+
+#include "../include/TriangleBVH.hpp"
+
+//~ Parameters of the surface area heuristic : number of bins, cost of a traversal step relatively to a triangle test
+static const unsigned int BVH_BINS = 16;
+static const float BVH_TRAVERSAL_COST = 1.0f;
+//~ Largest leaf, and depth past which the nodes are split at the median to bound the traversal stack
+static const unsigned int BVH_MAX_LEAF = 8;
+static const unsigned int BVH_MAX_SAH_DEPTH = 64;
+static const unsigned int BVH_STACK_SIZE = 128;
+//~ Smallest node split on the calling thread, the smaller ones are left to the subtree tasks
+static const unsigned int BVH_PARALLEL_MIN = 4096;
+
+/*!
+ * \brief Axis aligned box
+ */
+struct Box
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+static Box empty_box()
+{
+	Box box;
+	box.min = glm::vec3(FLT_MAX);
+	box.max = glm::vec3(-FLT_MAX);
+	return box;
+}
+
+static void grow(Box& box, const Box& other)
+{
+	box.min = glm::min(box.min, other.min);
+	box.max = glm::max(box.max, other.max);
+}
+
+static float half_area(const Box& box)
+{
+	const glm::vec3 extent = glm::max(box.max - box.min, glm::vec3(0.0f));
+	return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+//~ Triangles being sorted into the nodes
+struct BuildData
+{
+	const glm::vec3* vertices;
+	const unsigned int* indices;
+	std::vector<Box> bounds;
+	std::vector<glm::vec3> centroids;
+	std::vector<unsigned int> order;
+};
+
+//~ Node waiting to be split, with its range of the order and its depth
+struct PendingNode
+{
+	unsigned int node;
+	unsigned int first;
+	unsigned int count;
+	unsigned int depth;
+};
+
+//~ Orders triangles by the coordinate of their centroid along an axis
+struct CentroidLess
+{
+	const glm::vec3* centroids;
+	unsigned int axis;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		return centroids[a][axis] < centroids[b][axis];
+	}
+};
+
+//~ Tells if a triangle falls in the bins up to a given one
+struct BinBelow
+{
+	const glm::vec3* centroids;
+	unsigned int axis;
+	float origin;
+	float scale;
+	unsigned int last_bin;
+	bool operator()(unsigned int triangle) const
+	{
+		return std::min(BVH_BINS - 1, (unsigned int)((centroids[triangle][axis] - origin) * scale)) <= last_bin;
+	}
+};
+
+//~ Leaf bounding a range of the triangles
+static BVHNode make_node(const BuildData& data, unsigned int first, unsigned int count)
+{
+	Box box = empty_box();
+	for(unsigned int k = first; k < first + count; ++k)
+	{
+		grow(box, data.bounds[data.order[k]]);
+	}
+	BVHNode node;
+	for(unsigned int c = 0; c < 3; ++c)
+	{
+		node.min[c] = box.min[c];
+		node.max[c] = box.max[c];
+	}
+	node.index = first;
+	node.count = count;
+	node.axis = 0;
+	return node;
+}
+
+//~ Partitions the range of a node in two, or tells that it is better left as a leaf
+static bool split(BuildData& data, const BVHNode& node, unsigned int first, unsigned int count, unsigned int depth, unsigned int& left_count, unsigned short& axis)
+{
+	if(count <= 2)
+	{
+		return false;
+	}
+	Box centroid_box = empty_box();
+	for(unsigned int k = first; k < first + count; ++k)
+	{
+		const glm::vec3& centroid = data.centroids[data.order[k]];
+		centroid_box.min = glm::min(centroid_box.min, centroid);
+		centroid_box.max = glm::max(centroid_box.max, centroid);
+	}
+
+	//~ Cost of each split between two bins, along each axis
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	unsigned int best_bin = 0;
+	for(unsigned int a = 0; a < 3 && depth < BVH_MAX_SAH_DEPTH; ++a)
+	{
+		const float extent = centroid_box.max[a] - centroid_box.min[a];
+		if(extent <= 0.0f)
+		{
+			continue;
+		}
+		const float scale = BVH_BINS / extent;
+		unsigned int counts[BVH_BINS] = { 0 };
+		Box boxes[BVH_BINS];
+		for(unsigned int b = 0; b < BVH_BINS; ++b)
+		{
+			boxes[b] = empty_box();
+		}
+		for(unsigned int k = first; k < first + count; ++k)
+		{
+			const unsigned int triangle = data.order[k];
+			const unsigned int b = std::min(BVH_BINS - 1, (unsigned int)((data.centroids[triangle][a] - centroid_box.min[a]) * scale));
+			++counts[b];
+			grow(boxes[b], data.bounds[triangle]);
+		}
+		float right_costs[BVH_BINS];
+		Box right = empty_box();
+		unsigned int right_count = 0;
+		for(unsigned int b = BVH_BINS - 1; b > 0; --b)
+		{
+			grow(right, boxes[b]);
+			right_count += counts[b];
+			right_costs[b] = half_area(right) * right_count;
+		}
+		Box left = empty_box();
+		unsigned int nb_left = 0;
+		for(unsigned int b = 0; b + 1 < BVH_BINS; ++b)
+		{
+			grow(left, boxes[b]);
+			nb_left += counts[b];
+			const float cost = half_area(left) * nb_left + right_costs[b + 1];
+			if(nb_left > 0 && nb_left < count && cost < best_cost)
+			{
+				best_cost = cost;
+				best_axis = a;
+				best_bin = b;
+			}
+		}
+	}
+
+	Box node_box;
+	node_box.min = glm::vec3(node.min[0], node.min[1], node.min[2]);
+	node_box.max = glm::vec3(node.max[0], node.max[1], node.max[2]);
+	const float area = half_area(node_box);
+	const bool worth_a_split = best_axis >= 0 && (area == 0.0f || BVH_TRAVERSAL_COST + best_cost / area < count);
+	if(worth_a_split)
+	{
+		BinBelow below;
+		below.centroids = &data.centroids[0];
+		below.axis = best_axis;
+		below.origin = centroid_box.min[best_axis];
+		below.scale = BVH_BINS / (centroid_box.max[best_axis] - centroid_box.min[best_axis]);
+		below.last_bin = best_bin;
+		left_count = std::partition(data.order.begin() + first, data.order.begin() + first + count, below) - (data.order.begin() + first);
+		axis = best_axis;
+		return true;
+	}
+	if(count <= BVH_MAX_LEAF)
+	{
+		return false;
+	}
+
+	//~ Too deep, or the centroids cannot be told apart : split at the median of the widest axis
+	const glm::vec3 extent = centroid_box.max - centroid_box.min;
+	axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	CentroidLess less;
+	less.centroids = &data.centroids[0];
+	less.axis = axis;
+	left_count = count / 2;
+	std::nth_element(data.order.begin() + first, data.order.begin() + first + left_count, data.order.begin() + first + count, less);
+	return true;
+}
+
+//~ Splits a pending node, appends its two children to the nodes and returns them
+static bool split_pending(BuildData& data, std::vector<BVHNode>& nodes, const PendingNode& pending, PendingNode children[2])
+{
+	unsigned int left_count = 0;
+	unsigned short axis = 0;
+	if(!split(data, nodes[pending.node], pending.first, pending.count, pending.depth, left_count, axis))
+	{
+		return false;
+	}
+	const unsigned int child = nodes.size();
+	nodes[pending.node].index = child;
+	nodes[pending.node].count = 0;
+	nodes[pending.node].axis = axis;
+	nodes.push_back(make_node(data, pending.first, left_count));
+	nodes.push_back(make_node(data, pending.first + left_count, pending.count - left_count));
+	PendingNode left = { child, pending.first, left_count, pending.depth + 1 };
+	PendingNode right = { child + 1, pending.first + left_count, pending.count - left_count, pending.depth + 1 };
+	children[0] = left;
+	children[1] = right;
+	return true;
+}
+
+//~ Subtrees built in parallel, each one in its own array with its root first
+struct SubtreeJob
+{
+	BuildData* data;
+	const std::vector<PendingNode>* tasks;
+	std::vector< std::vector<BVHNode> > subtrees;
+};
+
+static void build_subtrees(unsigned int begin, unsigned int end, unsigned int, void* job_data)
+{
+	SubtreeJob* job = static_cast<SubtreeJob*>(job_data);
+	for(unsigned int t = begin; t < end; ++t)
+	{
+		const PendingNode& task = (*job->tasks)[t];
+		std::vector<BVHNode>& nodes = job->subtrees[t];
+		nodes.push_back(make_node(*job->data, task.first, task.count));
+		std::vector<PendingNode> stack;
+		PendingNode root = { 0, task.first, task.count, task.depth };
+		stack.push_back(root);
+		while(!stack.empty())
+		{
+			PendingNode pending = stack.back();
+			stack.pop_back();
+			PendingNode children[2];
+			if(split_pending(*job->data, nodes, pending, children))
+			{
+				stack.push_back(children[0]);
+				stack.push_back(children[1]);
+			}
+		}
+	}
+}
+
+//~ Bounds and centroids of the triangles
+static void bound_triangles(unsigned int begin, unsigned int end, unsigned int, void* job_data)
+{
+	BuildData* data = static_cast<BuildData*>(job_data);
+	for(unsigned int t = begin; t < end; ++t)
+	{
+		const glm::vec3& a = data->vertices[data->indices[3 * t]];
+		const glm::vec3& b = data->vertices[data->indices[3 * t + 1]];
+		const glm::vec3& c = data->vertices[data->indices[3 * t + 2]];
+		data->bounds[t].min = glm::min(a, glm::min(b, c));
+		data->bounds[t].max = glm::max(a, glm::max(b, c));
+		data->centroids[t] = (a + b + c) / 3.0f;
+	}
+}
+
+TriangleBVH::TriangleBVH()
+{
+}
+
+void TriangleBVH::build(const glm::vec3* vertices, const unsigned int* indices, unsigned int nb_indices)
+{
+	m_nodes.clear();
+	m_triangle_edges.clear();
+	m_triangle_ids.clear();
+	const unsigned int nb_triangles = nb_indices / 3;
+	if(nb_triangles == 0)
+	{
+		return;
+	}
+
+	ThreadPool& pool = ThreadPool::get_shared();
+	BuildData data;
+	data.vertices = vertices;
+	data.indices = indices;
+	data.bounds.resize(nb_triangles);
+	data.centroids.resize(nb_triangles);
+	data.order.resize(nb_triangles);
+	for(unsigned int t = 0; t < nb_triangles; ++t)
+	{
+		data.order[t] = t;
+	}
+	pool.parallel_for(nb_triangles, 4096, bound_triangles, &data);
+
+	//~ The top of the tree, breadth first, until there are a few subtrees per thread
+	m_nodes.push_back(make_node(data, 0, nb_triangles));
+	std::vector<PendingNode> queue, tasks;
+	PendingNode root = { 0, 0, nb_triangles, 0 };
+	queue.push_back(root);
+	const unsigned int nb_wanted = 4 * pool.get_number_of_workers();
+	for(unsigned int q = 0; q < queue.size(); ++q)
+	{
+		PendingNode children[2];
+		const bool enough = queue.size() - q + tasks.size() >= nb_wanted;
+		if(enough || queue[q].count < BVH_PARALLEL_MIN)
+		{
+			tasks.push_back(queue[q]);
+		}
+		else if(split_pending(data, m_nodes, queue[q], children))
+		{
+			queue.push_back(children[0]);
+			queue.push_back(children[1]);
+		}
+	}
+
+	SubtreeJob job;
+	job.data = &data;
+	job.tasks = &tasks;
+	job.subtrees.resize(tasks.size());
+	pool.parallel_for(tasks.size(), 1, build_subtrees, &job);
+
+	//~ The root of a subtree replaces its pending node, the other nodes are appended
+	for(unsigned int t = 0; t < tasks.size(); ++t)
+	{
+		std::vector<BVHNode>& subtree = job.subtrees[t];
+		const unsigned int base = m_nodes.size() - 1;
+		for(unsigned int n = 0; n < subtree.size(); ++n)
+		{
+			if(subtree[n].count == 0)
+			{
+				subtree[n].index += base;
+			}
+		}
+		m_nodes[tasks[t].node] = subtree[0];
+		m_nodes.insert(m_nodes.end(), subtree.begin() + 1, subtree.end());
+	}
+
+	//~ The triangles are stored in the order of the leaves, ready for the intersection test
+	m_triangle_edges.resize(3 * nb_triangles);
+	m_triangle_ids.resize(nb_triangles);
+	for(unsigned int k = 0; k < nb_triangles; ++k)
+	{
+		const unsigned int t = data.order[k];
+		const glm::vec3& a = vertices[indices[3 * t]];
+		m_triangle_edges[3 * k] = a;
+		m_triangle_edges[3 * k + 1] = vertices[indices[3 * t + 1]] - a;
+		m_triangle_edges[3 * k + 2] = vertices[indices[3 * t + 2]] - a;
+		m_triangle_ids[k] = t;
+	}
+}
+
+void TriangleBVH::intersect(const Ray* rays, RayHit* hits, unsigned int nb_rays) const
+{
+	for(unsigned int r = 0; r < nb_rays; r += 4)
+	{
+		intersect_packet(rays + r, hits + r, std::min(4u, nb_rays - r));
+	}
+}
+
+RayHit TriangleBVH::intersect(const Ray& ray) const
+{
+	RayHit hit;
+	intersect_packet(&ray, &hit, 1);
+	return hit;
+}
+
+//~ Inverse of a direction, kept finite so that the slab test never multiplies 0 by infinity
+static float safe_inverse(float value)
+{
+	const float tiny = 1e-30f;
+	return 1.0f / ((fabs(value) > tiny) ? value : (value < 0.0f ? -tiny : tiny));
+}
+
+void TriangleBVH::intersect_packet(const Ray* rays, RayHit* hits, unsigned int nb_rays) const
+{
+	for(unsigned int r = 0; r < nb_rays; ++r)
+	{
+		hits[r].distance = FLT_MAX;
+		hits[r].triangle = NO_HIT;
+	}
+	if(m_nodes.empty())
+	{
+		return;
+	}
+
+	//~ Structure of arrays of the packet, the missing rays repeat the last one
+	float origin[3][4], inverse[3][4], direction[3][4];
+	for(unsigned int lane = 0; lane < 4; ++lane)
+	{
+		const Ray& ray = rays[std::min(lane, nb_rays - 1)];
+		for(unsigned int c = 0; c < 3; ++c)
+		{
+			origin[c][lane] = ray.origin[c];
+			direction[c][lane] = ray.direction[c];
+			inverse[c][lane] = safe_inverse(ray.direction[c]);
+		}
+	}
+	unsigned int stack[BVH_STACK_SIZE];
+	unsigned int stack_size = 0;
+	stack[stack_size++] = 0;
+
+#ifdef __SSE2__
+	const __m128 ox = _mm_loadu_ps(origin[0]), oy = _mm_loadu_ps(origin[1]), oz = _mm_loadu_ps(origin[2]);
+	const __m128 dx = _mm_loadu_ps(direction[0]), dy = _mm_loadu_ps(direction[1]), dz = _mm_loadu_ps(direction[2]);
+	const __m128 ix = _mm_loadu_ps(inverse[0]), iy = _mm_loadu_ps(inverse[1]), iz = _mm_loadu_ps(inverse[2]);
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	__m128 t_max = _mm_set1_ps(FLT_MAX);
+	__m128i ids = _mm_set1_epi32((int)NO_HIT);
+	while(stack_size > 0)
+	{
+		const BVHNode& node = m_nodes[stack[--stack_size]];
+		//~ Slab test of the four rays against the box
+		const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[0]), ox), ix), x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[0]), ox), ix);
+		const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[1]), oy), iy), y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[1]), oy), iy);
+		const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.min[2]), oz), iz), z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.max[2]), oz), iz);
+		const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), zero));
+		const __m128 t_far = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_min_ps(_mm_max_ps(z0, z1), t_max));
+		if(_mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) == 0)
+		{
+			continue;
+		}
+		if(node.count == 0)
+		{
+			//~ The child on the side the rays come from is visited first
+			const bool forward = direction[node.axis][0] > 0.0f;
+			stack[stack_size++] = node.index + (forward ? 1 : 0);
+			stack[stack_size++] = node.index + (forward ? 0 : 1);
+			continue;
+		}
+		//~ Moller-Trumbore test of the four rays against each triangle of the leaf
+		for(unsigned int k = node.index; k < node.index + node.count; ++k)
+		{
+			const glm::vec3* triangle = &m_triangle_edges[3 * k];
+			const __m128 e1x = _mm_set1_ps(triangle[1].x), e1y = _mm_set1_ps(triangle[1].y), e1z = _mm_set1_ps(triangle[1].z);
+			const __m128 e2x = _mm_set1_ps(triangle[2].x), e2y = _mm_set1_ps(triangle[2].y), e2z = _mm_set1_ps(triangle[2].z);
+			const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			const __m128 inverse_determinant = _mm_div_ps(one, determinant);
+			const __m128 sx = _mm_sub_ps(ox, _mm_set1_ps(triangle[0].x));
+			const __m128 sy = _mm_sub_ps(oy, _mm_set1_ps(triangle[0].y));
+			const __m128 sz = _mm_sub_ps(oz, _mm_set1_ps(triangle[0].z));
+			const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse_determinant);
+			const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse_determinant);
+			const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse_determinant);
+			//~ The comparisons are false for the NaN of a ray parallel to the triangle
+			const __m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)),
+				_mm_and_ps(_mm_cmple_ps(_mm_add_ps(u, v), one), _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, t_max))));
+			if(_mm_movemask_ps(hit) == 0)
+			{
+				continue;
+			}
+			t_max = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, t_max));
+			const __m128i hit_bits = _mm_castps_si128(hit);
+			ids = _mm_or_si128(_mm_and_si128(hit_bits, _mm_set1_epi32((int)m_triangle_ids[k])), _mm_andnot_si128(hit_bits, ids));
+		}
+	}
+	float distances[4];
+	unsigned int triangles[4];
+	_mm_storeu_ps(distances, t_max);
+	_mm_storeu_si128((__m128i*)triangles, ids);
+#else
+	float distances[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+	unsigned int triangles[4] = { NO_HIT, NO_HIT, NO_HIT, NO_HIT };
+	while(stack_size > 0)
+	{
+		const BVHNode& node = m_nodes[stack[--stack_size]];
+		bool any = false;
+		for(unsigned int lane = 0; lane < 4 && !any; ++lane)
+		{
+			float t_near = 0.0f, t_far = distances[lane];
+			for(unsigned int c = 0; c < 3; ++c)
+			{
+				const float t0 = (node.min[c] - origin[c][lane]) * inverse[c][lane];
+				const float t1 = (node.max[c] - origin[c][lane]) * inverse[c][lane];
+				t_near = std::max(t_near, std::min(t0, t1));
+				t_far = std::min(t_far, std::max(t0, t1));
+			}
+			any = t_near <= t_far;
+		}
+		if(!any)
+		{
+			continue;
+		}
+		if(node.count == 0)
+		{
+			const bool forward = direction[node.axis][0] > 0.0f;
+			stack[stack_size++] = node.index + (forward ? 1 : 0);
+			stack[stack_size++] = node.index + (forward ? 0 : 1);
+			continue;
+		}
+		for(unsigned int k = node.index; k < node.index + node.count; ++k)
+		{
+			const glm::vec3* triangle = &m_triangle_edges[3 * k];
+			for(unsigned int lane = 0; lane < 4; ++lane)
+			{
+				const glm::vec3 d(direction[0][lane], direction[1][lane], direction[2][lane]);
+				const glm::vec3 p = glm::cross(d, triangle[2]);
+				const float inverse_determinant = 1.0f / glm::dot(triangle[1], p);
+				const glm::vec3 s = glm::vec3(origin[0][lane], origin[1][lane], origin[2][lane]) - triangle[0];
+				const float u = glm::dot(s, p) * inverse_determinant;
+				const glm::vec3 q = glm::cross(s, triangle[1]);
+				const float v = glm::dot(d, q) * inverse_determinant;
+				const float t = glm::dot(triangle[2], q) * inverse_determinant;
+				if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < distances[lane])
+				{
+					distances[lane] = t;
+					triangles[lane] = m_triangle_ids[k];
+				}
+			}
+		}
+	}
+#endif
+	for(unsigned int r = 0; r < nb_rays; ++r)
+	{
+		hits[r].distance = distances[r];
+		hits[r].triangle = triangles[r];
+	}
+}
+
+unsigned int TriangleBVH::get_number_of_nodes() const
+{
+	return m_nodes.size();
+}
@@ -32,6 +32,9 @@
  */
 
 #include "../include/Application.hpp"
+#include "../include/Benchmarks.hpp"
+#include "../include/CompressedTexture.hpp"
+#include "../include/OctreeBuilder.hpp"
 
 /*!
  * \brief Main 
@@ -41,6 +44,25 @@
  */
 int main(int argc, char** argv)
 {
+	//~ Benchmarks asked on the command line run without a window
+	int benchmark = Benchmarks::run(argc, argv);
+	if(benchmark >= 0)
+	{
+		return benchmark;
+	}
+	//~ So do the texture compressions
+	int compression = CompressedTexture::run(argc, argv);
+	if(compression >= 0)
+	{
+		return compression;
+	}
+	//~ So do the octree builds
+	int octree = OctreeBuilder::run(argc, argv);
+	if(octree >= 0)
+	{
+		return octree;
+	}
+	
 	Application app;
 	return app.on_execute();
 	